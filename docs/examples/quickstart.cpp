@@ -18,9 +18,10 @@
 
 // To add libobdref to your project, include parser.h
 #include "obdref/parser.h"
+#include "obdref/elm327codec.h"
 
-void elm327_write(QByteArray reqHeader,QByteArray reqData) {}
-QByteArray elm327_read() { QByteArray ba("486B10410C2ABC"); return ba; }
+void elm327_write(QByteArray command) {}
+QByteArray elm327_read() { QByteArray ba("486B10410C2ABC3F\r\r>"); return ba; }
 void print_parsed_data(QList<obdref::Data> const &listData);
 
 int main(int argc, char * argv[])
@@ -67,32 +68,27 @@ int main(int argc, char * argv[])
     // only has a single request.
     obdref::MessageData &msg = pf.listMessageData[0];
 
-    // ELM327 Adapters expect data in ASCII characters,
-    // so we have to convert the request header and data
-    // before sending a message out
-    QByteArray elmRequestHeader,elmRequestData;
-
-    // Convert the header for the ELM
-    for(int i=0; i < msg.reqHeaderBytes.size(); i++)   {
-        elmRequestHeader.append(parser.ConvUByteToHexStr(msg.reqHeaderBytes[i]));
-    }
-
-    // Convert the data for the ELM
-    // The request data is provided in a list because
-    // it may have been split into frames for certain
-    // protocols. In this case, we know there is only
-    // one frame in the request.
-    for(int i=0; i < msg.listReqDataBytes[0].size(); i++)   {
-        elmRequestData.append(parser.ConvUByteToHexStr(msg.listReqDataBytes[0][i]));
-    }
+    // ELM327 Adapters expect data in ASCII characters;
+    // Elm327Codec converts the request header and data
+    // into the commands the adapter needs. The adapter
+    // should first be set up with the commands from
+    // Elm327Codec::GetInitCommands
+    obdref::Elm327Codec codec;
+    QList<QByteArray> listCommands;
+    ok = codec.EncodeRequest(pf,0,listCommands);
+    if(!ok) { qDebug() << "error encoding request"; return -1; }
 
     // Now we have something that looks like:
-    // elmRequestHeader: "686AF1"
-    // elmRequestData: "010C"
+    // listCommands[0]: "ATSH686AF1\r"
+    // listCommands[1]: "010C\r"
 
-    // Use the ELM adapter to send this request
-    // to the vehicle
-    elm327_write(elmRequestHeader,elmRequestData);
+    // (the header is only sent again if it changes)
+
+    // Use the ELM adapter to send each command to the
+    // vehicle, waiting for the prompt ('>') in between
+    for(int i=0; i < listCommands.size(); i++)   {
+        elm327_write(listCommands[i]);
+    }
 
     // Get the response
 
@@ -104,18 +100,17 @@ int main(int argc, char * argv[])
     // Additional fields (like the check sum, or the
     // DLC for ISO 15765) should be discarded
 
-    QByteArray resp = elm327_read();
-
-    // We need to convert the response from the ELM
-    // adapter and pass it back to libobdref
-    QList<obdref::ubyte> listBytes;
-    for(int i=0; i < resp.size(); i+=2)   {
-        listBytes << parser.ConvHexStrToUByte(resp.mid(i,2));
+    // The codec converts the adapter output back into
+    // frames (and drops the checksum) and saves them in
+    // the message. Output can be passed in as it arrives;
+    // DecodeResponse returns true once the prompt is seen
+    bool done = false;
+    while(!done)   {
+        QByteArray resp = elm327_read();
+        done = codec.DecodeResponse(pf,resp.constData(),resp.size(),
+                                    msg.listRawFrames);
     }
 
-    // Save the frame in its corresponding message
-    msg.listRawFrames << listBytes;
-
     // Create a data list to store the results and
     // parse the vehicle response
     QList<obdref::Data> listData;
@@ -0,0 +1,387 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include <QFile>
+#include <QTextStream>
+#include <QMutex>
+#include <QThread>
+
+#include "batchdecoder.h"
+
+namespace obdref
+{
+    // BatchShard
+    // * frames in [startUs,endUs] of a capture; -1
+    //   for the start/end of the capture
+    struct BatchShard
+    {
+        int captureIdx;
+        qint64 startUs;
+        qint64 endUs;
+    };
+
+    // BatchQueue
+    // * shards waiting to be run by a worker; the owner
+    //   takes from the front and thieves from the back
+    struct BatchQueue
+    {
+        QMutex mutex;
+        QList<int> listShardIdx;
+    };
+
+    struct BatchShardResults
+    {
+        int shardIdx;
+        QList<BatchResult> listResults;
+    };
+
+    // BatchJob
+    // * everything workers share for a call to
+    //   Decode; only the queues are modified
+    struct BatchJob
+    {
+        QString filePath;
+        QString fileContents;
+        QList<QStringList> listParamGroups;
+        QStringList listCapturePaths;
+        QList<BatchShard> listShards;
+        BatchOptions options;
+        QList<BatchQueue*> listQueues;
+    };
+
+    static bool compareResultTime(BatchResult const &a,
+                                  BatchResult const &b)
+    {
+        return (a.timestampUs < b.timestampUs);
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    class BatchWorker : public QThread
+    {
+    public:
+        BatchWorker(BatchJob const * job,
+                    int const workerIdx,
+                    Parser * parser) :
+            m_job(job),
+            m_workerIdx(workerIdx),
+            m_parser(parser),
+            m_ok(true),
+            m_numStolen(0),
+            m_numFrames(0)
+        {}
+
+        void run()
+        {
+            if(m_parser == NULL)   {
+                bool parserOk=false;
+                m_parser = new Parser(m_job->filePath,
+                                      m_job->fileContents,
+                                      parserOk);
+                if(!parserOk)   {
+                    delete m_parser;
+                    m_parser = NULL;
+                    m_ok = false;
+                    return;
+                }
+            }
+
+            FrameDispatcher dispatcher(m_parser);
+            QList<QStringList> const &listGroups = m_job->listParamGroups;
+            for(int i=0; i < listGroups.size(); i++)   {
+                if(!dispatcher.AddParameters(listGroups[i][0],
+                                             listGroups[i][1],
+                                             listGroups[i][2]))   {
+                    m_ok = false;
+                    return;
+                }
+            }
+
+            CaptureReader reader;
+            int readerCaptureIdx=-1;
+            int shardIdx=0;
+
+            while(takeShard(shardIdx))   {
+                BatchShard const &shard = m_job->listShards[shardIdx];
+                if(shard.captureIdx != readerCaptureIdx)   {
+                    readerCaptureIdx = shard.captureIdx;
+                    if(!reader.Open(m_job->listCapturePaths[readerCaptureIdx]))   {
+                        m_ok = false;
+                        continue;
+                    }
+                }
+                if(!reader.IsOpen())   {
+                    continue;
+                }
+
+                ReplayOptions replay = m_job->options.replay;
+                replay.speed = 0;
+                replay.startUs = shard.startUs;
+                replay.endUs = shard.endUs;
+
+                QList<Data> listData;
+                QList<qint64> listTimestampUs;
+                dispatcher.ClearDispatchedFrames();
+                reader.Rewind();
+
+                qint64 const numFrames =
+                    reader.Replay(dispatcher,replay,listData,&listTimestampUs);
+                if(numFrames < 0)   {
+                    m_ok = false;
+                    continue;
+                }
+                m_numFrames += numFrames;
+
+                BatchShardResults shardResults;
+                shardResults.shardIdx = shardIdx;
+                for(int i=0; i < listData.size(); i++)   {
+                    BatchResult result;
+                    result.timestampUs = listTimestampUs[i];
+                    result.captureIdx = shard.captureIdx;
+                    result.data = listData[i];
+                    shardResults.listResults.append(result);
+                }
+                m_listShardResults.append(shardResults);
+            }
+        }
+
+        Parser * GetParser() const
+        {   return m_parser;   }
+
+        bool IsOk() const
+        {   return m_ok;   }
+
+        int GetNumStolen() const
+        {   return m_numStolen;   }
+
+        qint64 GetNumFrames() const
+        {   return m_numFrames;   }
+
+        QList<BatchShardResults> const & GetShardResults() const
+        {   return m_listShardResults;   }
+
+    private:
+        // takeShard
+        // * takes the next shard from this worker's queue,
+        //   or steals the last shard from another worker's;
+        //   shards are never added once workers start, so if
+        //   every queue is empty there's nothing left to do
+        bool takeShard(int &shardIdx)
+        {
+            QList<BatchQueue*> const &listQueues = m_job->listQueues;
+            {
+                BatchQueue * queue = listQueues[m_workerIdx];
+                QMutexLocker locker(&(queue->mutex));
+                if(!queue->listShardIdx.isEmpty())   {
+                    shardIdx = queue->listShardIdx.takeFirst();
+                    return true;
+                }
+            }
+
+            for(int i=1; i < listQueues.size(); i++)   {
+                BatchQueue * queue =
+                    listQueues[(m_workerIdx+i) % listQueues.size()];
+                QMutexLocker locker(&(queue->mutex));
+                if(!queue->listShardIdx.isEmpty())   {
+                    shardIdx = queue->listShardIdx.takeLast();
+                    m_numStolen++;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        BatchJob const * m_job;
+        int m_workerIdx;
+        Parser * m_parser;
+        bool m_ok;
+        int m_numStolen;
+        qint64 m_numFrames;
+        QList<BatchShardResults> m_listShardResults;
+    };
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    BatchDecoder::BatchDecoder(QString const &filePath, bool &initOk) :
+        m_filePath(filePath)
+    {
+        // the definitions are read once and shared
+        // by every worker's Parser
+        QFile file(filePath);
+        if(!file.open(QIODevice::ReadOnly))   {
+            OBDREFERROR << "Error: BatchDecoder: could not open" << filePath;
+            initOk = false;
+            return;
+        }
+        QTextStream textStream(&file);
+        m_fileContents = textStream.readAll();
+        initOk = true;
+    }
+
+    BatchDecoder::~BatchDecoder()
+    {
+        for(int i=0; i < m_listParsers.size(); i++)   {
+            delete m_listParsers[i];
+        }
+    }
+
+    void BatchDecoder::AddParameters(QString const &spec,
+                                     QString const &protocol,
+                                     QString const &address)
+    {
+        QStringList group;
+        group << spec << protocol << address;
+        m_listParamGroups.append(group);
+    }
+
+    bool BatchDecoder::Decode(QStringList const &listCapturePaths,
+                              BatchOptions const &options,
+                              QList<BatchResult> &listResults)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        m_stats = BatchStats();
+
+        BatchJob job;
+        job.filePath = m_filePath;
+        job.fileContents = m_fileContents;
+        job.listCapturePaths = listCapturePaths;
+        job.options = options;
+        job.listParamGroups = m_listParamGroups;
+
+        // shards are aligned to parse intervals so splitting
+        // a capture doesn't move where parses happen
+        ReplayOptions const &replay = options.replay;
+        qint64 const parseIntervalUs = qMax(replay.parseIntervalUs,qint64(1));
+        qint64 const shardUs = (options.shardUs > 0) ?
+            ((options.shardUs+parseIntervalUs-1)/parseIntervalUs)*parseIntervalUs : 0;
+
+        for(int c=0; c < listCapturePaths.size(); c++)   {
+            CaptureReader reader;
+            if(!reader.Open(listCapturePaths[c]))   {
+                return false;
+            }
+            qint64 firstUs = reader.GetFirstTimestampUs();
+            qint64 lastUs = reader.GetLastTimestampUs();
+            if(firstUs < 0)   {
+                continue;
+            }
+
+            BatchShard shard;
+            shard.captureIdx = c;
+            shard.startUs = replay.startUs;
+            shard.endUs = replay.endUs;
+
+            // captures without an index can't be
+            // seeked quickly, so they aren't split
+            if(shardUs == 0 || lastUs < 0)   {
+                job.listShards.append(shard);
+                continue;
+            }
+
+            if(replay.startUs >= 0)   {
+                firstUs = qMax(firstUs,replay.startUs);
+            }
+            if(replay.endUs >= 0)   {
+                lastUs = qMin(lastUs,replay.endUs);
+            }
+            for(qint64 s=(firstUs/shardUs)*shardUs; s <= lastUs; s += shardUs)   {
+                shard.startUs = qMax(s,firstUs);
+                shard.endUs = s+shardUs-1;
+                if(replay.endUs >= 0)   {
+                    shard.endUs = qMin(shard.endUs,replay.endUs);
+                }
+                job.listShards.append(shard);
+            }
+        }
+
+        int const numShards = job.listShards.size();
+        int numThreads = (options.numThreads > 0) ?
+            options.numThreads : QThread::idealThreadCount();
+        numThreads = qMax(1,qMin(numThreads,numShards));
+
+        // each worker starts with a contiguous run of shards
+        for(int i=0; i < numThreads; i++)   {
+            job.listQueues.append(new BatchQueue);
+        }
+        for(int i=0; i < numShards; i++)   {
+            int const workerIdx = int((qint64(i)*numThreads)/qMax(numShards,1));
+            job.listQueues[workerIdx]->listShardIdx.append(i);
+        }
+
+        while(m_listParsers.size() < numThreads)   {
+            m_listParsers.append(NULL);
+        }
+
+        QList<BatchWorker*> listWorkers;
+        for(int i=0; i < numThreads; i++)   {
+            listWorkers.append(new BatchWorker(&job,i,m_listParsers[i]));
+            listWorkers.last()->start();
+        }
+
+        // merge results in shard order (by capture, then
+        // time) so a stable sort keeps ties in capture order
+        bool decodeOk=true;
+        QList<QList<BatchResult> > listShardResults;
+        for(int i=0; i < numShards; i++)   {
+            listShardResults.append(QList<BatchResult>());
+        }
+
+        for(int i=0; i < numThreads; i++)   {
+            BatchWorker * worker = listWorkers[i];
+            worker->wait();
+            m_listParsers[i] = worker->GetParser();
+
+            if(!worker->IsOk())   {
+                OBDREFERROR << "Error: BatchDecoder: worker" << i << "failed";
+                decodeOk = false;
+            }
+            m_stats.numStolen += worker->GetNumStolen();
+            m_stats.numFrames += worker->GetNumFrames();
+
+            QList<BatchShardResults> const &listResultsForWorker =
+                worker->GetShardResults();
+            for(int j=0; j < listResultsForWorker.size(); j++)   {
+                listShardResults[listResultsForWorker[j].shardIdx] =
+                    listResultsForWorker[j].listResults;
+            }
+            delete worker;
+        }
+
+        // other workers may look in a queue until
+        // they've all stopped
+        for(int i=0; i < numThreads; i++)   {
+            delete job.listQueues[i];
+        }
+
+        int const firstResult = listResults.size();
+        for(int i=0; i < numShards; i++)   {
+            listResults.append(listShardResults[i]);
+        }
+        qStableSort(listResults.begin()+firstResult,
+                    listResults.end(),compareResultTime);
+
+        m_stats.numThreads = numThreads;
+        m_stats.numShards = numShards;
+        m_stats.elapsedNs = timer.nsecsElapsed();
+        return decodeOk;
+    }
+}
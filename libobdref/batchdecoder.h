@@ -0,0 +1,142 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef BATCHDECODER_H
+#define BATCHDECODER_H
+
+#include "datatypes.h"
+#include "obdrefdebug.h"
+#include "framecapture.h"
+
+namespace obdref
+{
+
+// BatchOptions
+// * numThreads: worker threads (and Parsers); 0 uses
+//   one per core
+// * shardUs: captures are split into shards this long
+//   (rounded up to a multiple of replay.parseIntervalUs);
+//   0 decodes each capture as a single shard
+// * replay: options used to replay every shard (speed
+//   is ignored, shards are always decoded at full speed)
+struct BatchOptions
+{
+    BatchOptions() :
+        numThreads(0),
+        shardUs(60000000)
+    {}
+
+    int numThreads;
+    qint64 shardUs;
+    ReplayOptions replay;
+};
+
+// BatchResult
+// * a parsed result, the capture it was decoded
+//   from and the timestamp of the last frame
+//   dispatched before it was parsed
+struct BatchResult
+{
+    BatchResult() :
+        timestampUs(0),
+        captureIdx(0)
+    {}
+
+    qint64 timestampUs;
+    int captureIdx;
+    Data data;
+};
+
+// BatchStats
+// * stats for the last call to Decode
+struct BatchStats
+{
+    BatchStats() :
+        numThreads(0),
+        numShards(0),
+        numStolen(0),
+        numFrames(0),
+        elapsedNs(0)
+    {}
+
+    int numThreads;
+    int numShards;
+    int numStolen;          // shards run by a worker that
+                            // didn't start with them
+    qint64 numFrames;       // frames dispatched
+    qint64 elapsedNs;
+};
+
+// BatchDecoder
+// * decodes recorded captures (see CaptureWriter) on
+//   every core; a Parser only has one javascript context
+//   so each worker thread gets its own Parser, created
+//   from the same definitions that are read once
+// * each capture is a shard, or with shardUs is split
+//   into shards by time; shards are queued with the
+//   worker threads in contiguous runs, and a worker that
+//   runs out steals from the back of another's queue
+// * each shard is replayed from a clean FrameDispatcher
+//   and the results are merged in timestamp order (ties
+//   keep capture order); since parses happen at multiples
+//   of parseIntervalUs, the results match a single replay
+//   of each capture unless a message (or parameter with
+//   several requests) spans a shard boundary
+// * timestamps are compared across captures as is, so
+//   captures should share a time base for the merged
+//   order to mean anything
+class BatchDecoder
+{
+public:
+    BatchDecoder(QString const &filePath, bool &initOk);
+    ~BatchDecoder();
+
+    // AddParameters
+    // * every parameter in the definitions file for
+    //   spec/protocol/address is decoded (see
+    //   FrameDispatcher::AddParameters)
+    void AddParameters(QString const &spec,
+                       QString const &protocol,
+                       QString const &address);
+
+    // Decode
+    // * decodes every capture in listCapturePaths and
+    //   saves the merged results to listResults
+    // * returns false if a capture couldn't be read or
+    //   a worker couldn't set up its parameters
+    bool Decode(QStringList const &listCapturePaths,
+                BatchOptions const &options,
+                QList<BatchResult> &listResults);
+
+    BatchStats const & GetStats() const
+    {   return m_stats;   }
+
+private:
+    QString m_filePath;
+    QString m_fileContents;
+    QList<QStringList> m_listParamGroups;   // [spec,protocol,address]
+
+    // worker parsers are kept between calls to Decode
+    QList<Parser*> m_listParsers;
+    BatchStats m_stats;
+};
+
+}
+
+#endif // BATCHDECODER_H
@@ -0,0 +1,258 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "bustimingmodel.h"
+
+namespace obdref
+{
+    // baud rates used when the definitions
+    // file doesn't list one for a protocol
+    static quint32 const DEFAULT_BAUD_J1850_PWM = 41600;
+    static quint32 const DEFAULT_BAUD_J1850_VPW = 10400;
+    static quint32 const DEFAULT_BAUD_K_LINE    = 10400;
+    static quint32 const DEFAULT_BAUD_CAN       = 500000;
+
+    // SAE J1850 PWM: sof (2), eod (2), in-frame
+    // response byte (8) and eof (3) in bit times
+    static double const J1850_PWM_OVERHEAD_BITS = 15.0;
+
+    // SAE J1850 VPW: sof (200us) and ifs (300us)
+    static double const J1850_VPW_OVERHEAD_US = 500.0;
+
+    // largest response a single legacy frame can carry
+    static int const LEGACY_MAX_DATA_BYTES = 7;
+
+    // ISO 9141-2 / ISO 14230-4 minimum timings
+    static double const K_LINE_P2_MIN_US = 25000.0;  // request to response
+    static double const K_LINE_P3_MIN_US = 55000.0;  // response to next request
+    static double const K_LINE_P4_MIN_US = 5000.0;   // between request bytes
+
+    // CAN: bits subject to stuffing for a frame with
+    // eight data bytes (sof, id, control, data, crc) and
+    // bits that aren't (crc delim, ack, eof, ifs)
+    static int const CAN_STD_STUFFED_BITS = 34+64;
+    static int const CAN_EXT_STUFFED_BITS = 54+64;
+    static int const CAN_FIXED_BITS = 13;
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    BusTimingModel::BusTimingModel() :
+        m_baudRate(0),
+        m_responderCount(1)
+    {}
+
+    void BusTimingModel::SetBaudRate(quint32 const baudRate)
+    {
+        m_baudRate = baudRate;
+    }
+
+    void BusTimingModel::SetResponderCount(int const responderCount)
+    {
+        if(responderCount < 1)   {
+            OBDREFWARN << "Warn: BusTimingModel: responder "
+                          "count must be at least 1";
+            m_responderCount = 1;
+            return;
+        }
+        m_responderCount = responderCount;
+    }
+
+    double BusTimingModel::GetMessageTimeUs(ParameterFrame const &paramFrame,
+                                            int const msgIdx) const
+    {
+        if(msgIdx < 0 || msgIdx >= paramFrame.listMessageData.size())   {
+            OBDREFERROR << "Error: BusTimingModel: invalid message index";
+            return 0;
+        }
+
+        MessageData const &msg = paramFrame.listMessageData[msgIdx];
+        if(paramFrame.parseProtocol == PROTOCOL_ISO_15765)   {
+            return getMessageTimeUs_ISO_15765(paramFrame,msg);
+        }
+        return getMessageTimeUs_Legacy(paramFrame,msg);
+    }
+
+    double BusTimingModel::GetParameterTimeUs(ParameterFrame const &paramFrame) const
+    {
+        double timeUs=0;
+        for(int i=0; i < paramFrame.listMessageData.size(); i++)   {
+            timeUs += GetMessageTimeUs(paramFrame,i);
+        }
+        return timeUs;
+    }
+
+    double BusTimingModel::GetUtilization(QList<ParameterFrame> const &listParams) const
+    {
+        double utilization=0;
+        for(int i=0; i < listParams.size(); i++)   {
+            if(listParams[i].pollRate > 0)   {
+                utilization += listParams[i].pollRate*
+                        GetParameterTimeUs(listParams[i])/1000000.0;
+            }
+        }
+        return utilization;
+    }
+
+    double BusTimingModel::GetMaxSampleRate(QList<ParameterFrame> const &listParams) const
+    {
+        double timeUs=0;
+        for(int i=0; i < listParams.size(); i++)   {
+            timeUs += GetParameterTimeUs(listParams[i]);
+        }
+        return (timeUs > 0) ? 1000000.0/timeUs : 0;
+    }
+
+    double BusTimingModel::GetRequestBudget(QList<ParameterFrame> const &listParams) const
+    {
+        double timeUs=0;
+        int numRequests=0;
+        for(int i=0; i < listParams.size(); i++)   {
+            ParameterFrame const &paramFrame = listParams[i];
+            for(int j=0; j < paramFrame.listMessageData.size(); j++)   {
+                if(paramFrame.listMessageData[j].listReqDataBytes.isEmpty())   {
+                    continue;
+                }
+                timeUs += GetMessageTimeUs(paramFrame,j);
+                numRequests++;
+            }
+        }
+        return (timeUs > 0) ? numRequests*1000000.0/timeUs : 0;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    double BusTimingModel::getBitTimeUs(ParameterFrame const &paramFrame) const
+    {
+        quint32 baudRate = m_baudRate;
+        if(baudRate == 0)   {
+            baudRate = paramFrame.baudRate;
+        }
+        if(baudRate == 0)   {
+            if(paramFrame.parseProtocol == PROTOCOL_ISO_15765)   {
+                baudRate = DEFAULT_BAUD_CAN;
+            }
+            else if(paramFrame.parseProtocol == PROTOCOL_SAE_J1850)   {
+                baudRate = (paramFrame.protocol.contains("PWM")) ?
+                    DEFAULT_BAUD_J1850_PWM : DEFAULT_BAUD_J1850_VPW;
+            }
+            else   {
+                baudRate = DEFAULT_BAUD_K_LINE;
+            }
+        }
+        return 1000000.0/baudRate;
+    }
+
+    double BusTimingModel::getFrameTimeUs_J1850(ParameterFrame const &paramFrame,
+                                                int const numBytes) const
+    {
+        // [header] [data] [crc]
+        double const bitTimeUs = getBitTimeUs(paramFrame);
+        double const dataBits = (numBytes+1)*8;
+
+        if(paramFrame.protocol.contains("PWM"))   {
+            return (dataBits+J1850_PWM_OVERHEAD_BITS)*bitTimeUs;
+        }
+        return dataBits*bitTimeUs + J1850_VPW_OVERHEAD_US;
+    }
+
+    double BusTimingModel::getFrameTimeUs_ISO_15765(ParameterFrame const &paramFrame) const
+    {
+        int const stuffedBits = (paramFrame.iso15765_extendedId) ?
+                    CAN_EXT_STUFFED_BITS : CAN_STD_STUFFED_BITS;
+
+        // worst case is one stuff bit for every four bits
+        // after the first five bits with the same value
+        int const numBits = stuffedBits + (stuffedBits-1)/4 + CAN_FIXED_BITS;
+        return numBits*getBitTimeUs(paramFrame);
+    }
+
+    double BusTimingModel::getMessageTimeUs_Legacy(ParameterFrame const &paramFrame,
+                                                   MessageData const &msg) const
+    {
+        int respBytes = getResponseByteCount(msg);
+        if(respBytes < 0 || respBytes > LEGACY_MAX_DATA_BYTES)   {
+            respBytes = LEGACY_MAX_DATA_BYTES;
+        }
+        int const respFrameBytes = msg.expHeaderBytes.size() + respBytes;
+
+        if(paramFrame.parseProtocol == PROTOCOL_SAE_J1850)
+        {
+            double timeUs=0;
+            for(int i=0; i < msg.listReqDataBytes.size(); i++)   {
+                timeUs += getFrameTimeUs_J1850(paramFrame,msg.reqHeaderBytes.size()+
+                                               msg.listReqDataBytes[i].size());
+            }
+            timeUs += m_responderCount*getFrameTimeUs_J1850(paramFrame,respFrameBytes);
+            return timeUs;
+        }
+
+        // ISO 9141-2, ISO 14230: [header] [data] [checksum]
+        double const byteTimeUs = 10*getBitTimeUs(paramFrame);
+        double timeUs=0;
+        for(int i=0; i < msg.listReqDataBytes.size(); i++)   {
+            int const numBytes = msg.reqHeaderBytes.size()+
+                    msg.listReqDataBytes[i].size()+1;
+            timeUs += numBytes*byteTimeUs + (numBytes-1)*K_LINE_P4_MIN_US;
+        }
+        timeUs += m_responderCount*(K_LINE_P2_MIN_US + (respFrameBytes+1)*byteTimeUs);
+        timeUs += K_LINE_P3_MIN_US;
+        return timeUs;
+    }
+
+    double BusTimingModel::getMessageTimeUs_ISO_15765(ParameterFrame const &paramFrame,
+                                                      MessageData const &msg) const
+    {
+        // request data may or may not already be split
+        // into frames; a multi-frame request gets a flow
+        // control frame back from the ecu
+        int numReqFrames=0;
+        for(int i=0; i < msg.listReqDataBytes.size(); i++)   {
+            numReqFrames += qMax(1,(msg.listReqDataBytes[i].size()+7)/8);
+        }
+        if(numReqFrames > 1)   {
+            numReqFrames++;     // flow control from the ecu
+        }
+
+        // [single frame] pci byte and up to 7 data bytes
+        // [first frame] two pci bytes and 6 data bytes
+        // [consecutive frame] pci byte and 7 data bytes
+        // (one less data byte with extended addressing)
+        int const addrBytes = (paramFrame.iso15765_extendedAddr) ? 1 : 0;
+        int const respBytes = getResponseByteCount(msg);
+        int numRespFrames=1;
+        if(respBytes > 7-addrBytes)   {
+            int const cfBytes = 7-addrBytes;
+            int const ffBytes = 6-addrBytes;
+            numRespFrames = 1 + (respBytes-ffBytes+cfBytes-1)/cfBytes;
+            numRespFrames++;    // flow control from tester
+        }
+
+        double const frameTimeUs = getFrameTimeUs_ISO_15765(paramFrame);
+        return (numReqFrames + m_responderCount*numRespFrames)*frameTimeUs;
+    }
+
+    int BusTimingModel::getResponseByteCount(MessageData const &msg) const
+    {
+        if(msg.expDataByteCount < 0)   {
+            return -1;
+        }
+        return msg.expDataPrefix.size() + msg.expDataByteCount;
+    }
+}
@@ -0,0 +1,122 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef BUSTIMINGMODEL_H
+#define BUSTIMINGMODEL_H
+
+#include "datatypes.h"
+#include "obdrefdebug.h"
+
+namespace obdref
+{
+
+// BusTimingModel
+// * estimates how long the requests and responses
+//   of parameters built with Parser::BuildParameterFrame
+//   take on the bus, so polling plans can be sized
+//   before connecting to a vehicle
+// * uses the baud rate from the definitions file
+//   (ParameterFrame.baudRate) unless one is set
+// * SAE J1850: header, data and crc bytes plus the
+//   start/end of frame symbols (and the in-frame
+//   response byte for PWM)
+// * ISO 9141-2 and ISO 14230: ten bits per byte plus
+//   the minimum inter-byte (P4), response (P2) and
+//   inter-message (P3) times, since the K-Line can't
+//   be used for anything else while waiting
+// * ISO 15765: every frame is padded to eight bytes
+//   and has worst case bit stuffing; multi-frame
+//   messages are split up as per ISO-TP and a single
+//   flow control frame is assumed
+// * responses with an unknown byte count are assumed
+//   to fit in a single frame
+class BusTimingModel
+{
+public:
+    BusTimingModel();
+
+    // SetBaudRate
+    // * overrides the baud rate in ParameterFrame
+    //   (a value of 0 uses ParameterFrame.baudRate)
+    void SetBaudRate(quint32 const baudRate);
+
+    // SetResponderCount
+    // * number of ECUs expected to respond to each
+    //   request (ie. for functional requests); 1 by default
+    void SetResponderCount(int const responderCount);
+
+    // GetMessageTimeUs
+    // * returns the time in microseconds taken by the
+    //   request and the expected responses of a single
+    //   MessageData in paramFrame
+    double GetMessageTimeUs(ParameterFrame const &paramFrame,
+                            int const msgIdx) const;
+
+    // GetParameterTimeUs
+    // * returns the time in microseconds taken to get
+    //   one sample of paramFrame (all of its MessageData)
+    double GetParameterTimeUs(ParameterFrame const &paramFrame) const;
+
+    // GetUtilization
+    // * returns the fraction of bus time used if every
+    //   parameter in listParams is polled at its pollRate
+    //   (values over 1 mean the rates can't be reached)
+    // * parameters with a pollRate of 0 are ignored
+    double GetUtilization(QList<ParameterFrame> const &listParams) const;
+
+    // GetMaxSampleRate
+    // * returns the highest rate (in Hz) that every
+    //   parameter in listParams can be sampled at when
+    //   they're all polled at the same rate
+    double GetMaxSampleRate(QList<ParameterFrame> const &listParams) const;
+
+    // GetRequestBudget
+    // * returns the average number of requests per
+    //   second the bus can carry for listParams, which
+    //   can be passed to PollScheduler::SetBusBudget
+    double GetRequestBudget(QList<ParameterFrame> const &listParams) const;
+
+private:
+    double getBitTimeUs(ParameterFrame const &paramFrame) const;
+
+    // getFrameTimeUs_[...]
+    // * time taken by a single frame with
+    //   numBytes bytes (header and data)
+    double getFrameTimeUs_J1850(ParameterFrame const &paramFrame,
+                                int const numBytes) const;
+
+    double getFrameTimeUs_ISO_15765(ParameterFrame const &paramFrame) const;
+
+    double getMessageTimeUs_Legacy(ParameterFrame const &paramFrame,
+                                   MessageData const &msg) const;
+
+    double getMessageTimeUs_ISO_15765(ParameterFrame const &paramFrame,
+                                      MessageData const &msg) const;
+
+    // getResponseByteCount
+    // * expected response data bytes (prefix and data)
+    //   or -1 if the count isn't known
+    int getResponseByteCount(MessageData const &msg) const;
+
+    quint32 m_baudRate;
+    int m_responderCount;
+};
+
+}
+
+#endif // BUSTIMINGMODEL_H
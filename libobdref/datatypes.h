@@ -56,6 +56,76 @@ struct Data
     QList<NumericalData> listNumericalData;
 };
 
+// MultiFrameMessage
+// * an ISO 15765 multi-frame message that is
+//   still waiting on consecutive frames
+struct MultiFrameMessage
+{
+    ByteList        header;             // header of the first frame
+    ByteList        data;               // data bytes merged so far (no pci bytes)
+    int             dataLength;         // total number of data bytes expected
+    ubyte           nextPciByte;        // pci byte of the next consecutive frame
+
+    MultiFrameMessage() :
+        dataLength(0),
+        nextPciByte(0x21)
+    {}
+};
+
+// RejectStats
+// * the number of raw frames a cleaner rejected
+//   (or couldn't complete) for each reason
+struct RejectStats
+{
+    quint32         headerMismatch;     // header didn't match expHeaderBytes/Mask
+    quint32         prefixMismatch;     // data didn't start with expDataPrefix
+    quint32         badLength;          // too short for its header and prefix, or
+                                        // shorter than its length byte says
+    quint32         sequenceGap;        // ISO 15765 consecutive frame out of sequence
+                                        // or without a first frame
+    quint32         truncated;          // ISO 15765 multi-frame message that didn't
+                                        // receive all of its consecutive frames
+
+    RejectStats() :
+        headerMismatch(0),
+        prefixMismatch(0),
+        badLength(0),
+        sequenceGap(0),
+        truncated(0)
+    {}
+
+    void Add(RejectStats const &other)
+    {
+        headerMismatch += other.headerMismatch;
+        prefixMismatch += other.prefixMismatch;
+        badLength += other.badLength;
+        sequenceGap += other.sequenceGap;
+        truncated += other.truncated;
+    }
+
+    quint32 Total() const
+    {
+        return headerMismatch + prefixMismatch +
+               badLength + sequenceGap + truncated;
+    }
+};
+
+// JsHeapStats
+// * allocations made by a Parser's javascript heap
+//   (reallocs that grow a block count as allocs)
+struct JsHeapStats
+{
+    quint64         numAllocs;
+    quint64         numBytes;           // bytes requested by allocs
+    quint64         numFrees;
+
+    JsHeapStats() :
+        numAllocs(0),
+        numBytes(0),
+        numFrees(0)
+    {}
+};
+
 // MessageData
 // * generic container for vehicle message data
 // * the message data may represent data tied to
@@ -79,6 +149,11 @@ struct MessageData
     ByteList        expDataPrefix;      // expected data prefix
     int             expDataByteCount;   // expected data byte count (after prefix); a value
                                         // less than 0 means the expected length is unknown
+    int             expResponseCount;   // expected number of responses (ie. one per ecu); a
+                                        // value less than 0 means the count is unknown
+    int             expFramesPerResponse;   // SAE J1850, ISO 9141-2, ISO 14230: expected number
+                                            // of frames each ecu sends in its response; a value
+                                            // less than 0 means the count is unknown
     // Raw Data
     // * each entry in the list contains bytes received for
     //   a single data frame in the format [header] [data]
@@ -96,10 +171,29 @@ struct MessageData
     QList<ByteList> listHeaders;
     QList<ByteList> listData;
 
+    // Incremental Parse State
+    // * used by Parser::ParseParameterFrameIncremental to
+    //   track which raw frames have been cleaned and which
+    //   entries in listData have been parsed so far
+    int             idxNextRawFrame;    // first raw frame that hasn't been cleaned
+    int             idxNextData;        // first entry in listData that hasn't been parsed
+    ByteList        lastRawFrame;       // raw frame at idxNextRawFrame-1 when it was cleaned
+    QList<MultiFrameMessage> listPartialMessages;   // ISO 15765 messages waiting on CFs
+
+    // Reject Stats
+    // * added to every time raw frames are cleaned (so
+    //   parsing the same frames twice counts them twice);
+    //   never reset by the Parser
+    RejectStats     rejectStats;
+
 
     MessageData() :
         reqDataDelayMs(0),
-        expDataByteCount(-1)
+        expDataByteCount(-1),
+        expResponseCount(-1),
+        expFramesPerResponse(-1),
+        idxNextRawFrame(0),
+        idxNextData(0)
     {}
 };
 
@@ -163,6 +257,16 @@ public:
     bool                iso14230_addLengthByte;
     bool                iso15765_extendedId;
     bool                iso15765_extendedAddr;
+    quint32             baudRate;       // lowest <baudrate> listed for the
+                                        // protocol or 0 if none are listed
+
+    // Polling
+    // * the rate (in Hz) this parameter should be
+    //   requested at and its relative priority (higher
+    //   values are more important), used by PollScheduler
+    // * a rate of 0 means 'as often as possible'
+    double              pollRate;
+    int                 pollPriority;
 
     // Message Data
     // * list of message data for this parameter
@@ -185,10 +289,69 @@ public:
         iso14230_addLengthByte(false),
         iso15765_extendedId(false),
         iso15765_extendedAddr(false),
+        baudRate(0),
+        pollRate(0),
+        pollPriority(0),
         functionKeyIdx(-1)
     {}
 };
 
+// CoalescedFrame
+// * a single SAE J1979 mode 01 request that carries
+//   the PIDs of up to six parameters (ISO 15765 only)
+// * built with Parser::BuildCoalescedFrames; the
+//   response should be saved to msg.listRawFrames
+//   and parsed with Parser::ParseCoalescedFrame
+struct CoalescedFrame
+{
+    QList<int>      listParamIdx;       // indices into the list of parameters
+    ByteList        listPids;           // pid of each parameter
+    MessageData     msg;                // combined request and response data
+};
+
+enum PeriodicLayout
+{
+    // layout of the periodic data frames
+    // sent for a PeriodicFrame
+    PERIODIC_LAYOUT_UUDT,           // [periodicId] [d0 ... d6] (ISO 14229-2 type 1)
+    PERIODIC_LAYOUT_SINGLE_FRAME    // [pci] [periodicId] [d0 ... d5]
+};
+
+// PeriodicFrame
+// * a UDS dynamically defined data identifier (0xF2XX)
+//   that bundles the data of several parameters read
+//   with ReadDataByIdentifier (0x22), and is sent by
+//   the ECU periodically (ISO 15765 only)
+// * built with Parser::BuildPeriodicFrames; the periodic
+//   data frames should be saved to msgData.listRawFrames
+//   and parsed with Parser::ParsePeriodicFrame
+struct PeriodicFrame
+{
+    QList<int>      listParamIdx;       // indices into the list of parameters
+    QList<int>      listDataOffset;     // offset of each parameter's data
+    ubyte           periodicId;         // low byte of the periodic identifier
+    PeriodicLayout  layout;             // layout of the periodic data frames
+
+    MessageData     msgDefine;          // DynamicallyDefineDataIdentifier (0x2C)
+    MessageData     msgStart;           // ReadDataByPeriodicIdentifier (0x2A)
+    MessageData     msgStop;            // ReadDataByPeriodicIdentifier, stop (0x2A 0x04)
+    MessageData     msgData;            // periodic data: [periodicId] [data]
+
+    PeriodicFrame() :
+        periodicId(0),
+        layout(PERIODIC_LAYOUT_UUDT)
+    {}
+};
+
+enum PeriodicRate
+{
+    // transmission modes for
+    // ReadDataByPeriodicIdentifier
+    PERIODIC_RATE_SLOW      = 0x01,
+    PERIODIC_RATE_MEDIUM    = 0x02,
+    PERIODIC_RATE_FAST      = 0x03
+};
+
 
 }
 #endif // DATATYPES_H
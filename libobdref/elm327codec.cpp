@@ -0,0 +1,363 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "elm327codec.h"
+
+namespace obdref
+{
+    static char const HEX_CHARS[] = "0123456789ABCDEF";
+
+    // the response count hint is a single hex digit
+    static int const MAX_RESPONSE_COUNT_HINT = 15;
+
+    // data bytes (including the prefix) that fit in a single
+    // frame: an ISO 15765 single frame or an OBD frame on
+    // SAE J1850, ISO 9141-2 and ISO 14230-4
+    static int const MAX_SINGLE_FRAME_DATA = 7;
+
+    // HexTable
+    // * maps an ascii character to its hex value,
+    //   -1 for anything that isn't a hex character
+    struct HexTable
+    {
+        signed char value[256];
+
+        HexTable()
+        {
+            for(int i=0; i < 256; i++)   {
+                value[i] = -1;
+            }
+            for(int i=0; i < 10; i++)   {
+                value['0'+i] = i;
+            }
+            for(int i=0; i < 6; i++)   {
+                value['A'+i] = 10+i;
+                value['a'+i] = 10+i;
+            }
+        }
+    };
+
+    static HexTable const & getHexTable()
+    {
+        static HexTable const hexTable;
+        return hexTable;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    Elm327Codec::Elm327Codec() :
+        m_useHints(true),
+        m_headerValid(false)
+    {}
+
+    void Elm327Codec::EncodeHex(ByteList const &bytes,
+                                QByteArray &hexStr,
+                                bool const addSpaces)
+    {
+        int const idxStart = hexStr.size();
+        int const charsPerByte = (addSpaces) ? 3 : 2;
+        hexStr.resize(idxStart + bytes.size()*charsPerByte);
+
+        char * out = hexStr.data()+idxStart;
+        for(int i=0; i < bytes.size(); i++)   {
+            *out++ = HEX_CHARS[bytes[i] >> 4];
+            *out++ = HEX_CHARS[bytes[i] & 0x0F];
+            if(addSpaces)   {
+                *out++ = ' ';
+            }
+        }
+        if(addSpaces && !bytes.isEmpty())   {
+            hexStr.chop(1);
+        }
+    }
+
+    bool Elm327Codec::DecodeHex(char const * hexStr,
+                                int const length,
+                                ByteList &bytes)
+    {
+        HexTable const &hexTable = getHexTable();
+
+        int upperNibble=-1;
+        for(int i=0; i < length; i++)   {
+            char const c = hexStr[i];
+            if(c == ' ')   {
+                continue;
+            }
+            int const nibble = hexTable.value[ubyte(c)];
+            if(nibble < 0)   {
+                return false;
+            }
+            if(upperNibble < 0)   {
+                upperNibble = nibble;
+            }
+            else   {
+                bytes << ubyte((upperNibble << 4) | nibble);
+                upperNibble = -1;
+            }
+        }
+        return (upperNibble < 0);
+    }
+
+    void Elm327Codec::GetInitCommands(QList<QByteArray> &listCommands)
+    {
+        listCommands.clear();
+        listCommands << "ATZ\r";        // reset
+        listCommands << "ATE0\r";       // echo off
+        listCommands << "ATL0\r";       // linefeeds off
+        listCommands << "ATS0\r";       // spaces off
+        listCommands << "ATH1\r";       // headers on
+        listCommands << "ATCAF1\r";     // CAN auto formatting on
+        ResetState();
+    }
+
+    void Elm327Codec::SetResponseCountHints(bool const useHints)
+    {
+        m_useHints = useHints;
+    }
+
+    void Elm327Codec::ResetState()
+    {
+        m_headerValid = false;
+        m_lastHeader.clear();
+        m_line.clear();
+        m_lastStatus.clear();
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    bool Elm327Codec::EncodeRequest(ParameterFrame const &paramFrame,
+                                    int const msgIdx,
+                                    QList<QByteArray> &listCommands)
+    {
+        listCommands.clear();
+        if(msgIdx < 0 || msgIdx >= paramFrame.listMessageData.size())   {
+            OBDREFERROR << "Error: Elm327Codec: invalid message index";
+            return false;
+        }
+        MessageData const &msg = paramFrame.listMessageData[msgIdx];
+        if(msg.listReqDataBytes.isEmpty())   {
+            OBDREFERROR << "Error: Elm327Codec: no request data";
+            return false;
+        }
+
+        bool const isCan = (paramFrame.parseProtocol == PROTOCOL_ISO_15765);
+        ByteList header = msg.reqHeaderBytes;
+        ByteList data = msg.listReqDataBytes[0];
+
+        if(isCan)   {
+            if(msg.listReqDataBytes.size() > 1)   {
+                OBDREFERROR << "Error: Elm327Codec: multi-frame "
+                               "requests aren't supported";
+                return false;
+            }
+            // the adapter adds the pci byte
+            if(paramFrame.iso15765_addPciByte && !data.isEmpty())   {
+                data.removeFirst();
+            }
+            if(data.size() > 7)   {
+                OBDREFERROR << "Error: Elm327Codec: request "
+                               "data too long for a single frame";
+                return false;
+            }
+            int const headerLength = (paramFrame.iso15765_extendedId) ? 4 : 2;
+            if(header.size() != headerLength)   {
+                OBDREFERROR << "Error: Elm327Codec: invalid request header";
+                return false;
+            }
+        }
+        else if(paramFrame.parseProtocol == PROTOCOL_ISO_14230)   {
+            // [format] [target] [source] ([length]); the adapter
+            // sets the length itself so it's left out
+            if(header.size() < 3)   {
+                OBDREFERROR << "Error: Elm327Codec: the adapter "
+                               "needs target and source addresses";
+                return false;
+            }
+            header = header.mid(0,3);
+            header[0] = header[0] & 0xC0;
+        }
+        else if(header.size() != 3)   {
+            OBDREFERROR << "Error: Elm327Codec: invalid request header";
+            return false;
+        }
+
+        // [header]
+        if(!m_headerValid || header != m_lastHeader)
+        {
+            if(isCan && paramFrame.iso15765_extendedId)   {
+                // ATCP sets the priority byte and ATSH the rest
+                if(!m_headerValid || m_lastHeader.size() != 4 ||
+                   header[0] != m_lastHeader[0])   {
+                    QByteArray cmdPriority("ATCP");
+                    EncodeHex(header.mid(0,1),cmdPriority);
+                    cmdPriority.append('\r');
+                    listCommands << cmdPriority;
+                }
+                QByteArray cmdHeader("ATSH");
+                EncodeHex(header.mid(1),cmdHeader);
+                cmdHeader.append('\r');
+                listCommands << cmdHeader;
+            }
+            else if(isCan)   {
+                // 11-bit ids are three hex digits
+                QByteArray hexHeader;
+                EncodeHex(header,hexHeader);
+                listCommands << "ATSH" + hexHeader.mid(1) + "\r";
+            }
+            else   {
+                QByteArray cmdHeader("ATSH");
+                EncodeHex(header,cmdHeader);
+                cmdHeader.append('\r');
+                listCommands << cmdHeader;
+            }
+            m_lastHeader = header;
+            m_headerValid = true;
+        }
+
+        // [data] [response count]
+        QByteArray cmdData;
+        EncodeHex(data,cmdData);
+
+        if(m_useHints && msg.expResponseCount > 0 &&
+           msg.expResponseCount <= MAX_RESPONSE_COUNT_HINT &&
+           msg.expDataByteCount >= 0)   {
+            // the adapter counts frames, so responses
+            // must each fit in a single frame
+            bool const singleFrame =
+                (msg.expDataPrefix.size()+msg.expDataByteCount <= MAX_SINGLE_FRAME_DATA) &&
+                (msg.expFramesPerResponse <= 1);
+
+            if(singleFrame)   {
+                cmdData.append(HEX_CHARS[msg.expResponseCount]);
+            }
+        }
+        cmdData.append('\r');
+        listCommands << cmdData;
+
+        m_line.clear();
+        m_lastStatus.clear();
+        return true;
+    }
+
+    bool Elm327Codec::GetFlowControlCommands(ParameterFrame const &paramFrame,
+                                             ByteList const &fcFrame,
+                                             QList<QByteArray> &listCommands) const
+    {
+        listCommands.clear();
+        if(paramFrame.parseProtocol != PROTOCOL_ISO_15765)   {
+            return false;
+        }
+
+        int const headerLength = (paramFrame.iso15765_extendedId) ? 4 : 2;
+        if(fcFrame.size() < headerLength+3 ||
+           (fcFrame[headerLength] & 0xF0) != 0x30)   {
+            OBDREFERROR << "Error: Elm327Codec: invalid flow control frame";
+            return false;
+        }
+
+        // the adapter only accepts three hex digits for 11-bit ids
+        QByteArray hexHeader;
+        EncodeHex(fcFrame.mid(0,headerLength),hexHeader);
+        if(!paramFrame.iso15765_extendedId)   {
+            hexHeader.remove(0,1);
+        }
+        listCommands << "ATFCSH" + hexHeader + "\r";
+
+        // [pci] [BS] [STmin], padded by the adapter
+        QByteArray cmdData("ATFCSD");
+        EncodeHex(fcFrame.mid(headerLength,3),cmdData);
+        cmdData.append('\r');
+        listCommands << cmdData;
+
+        // mode 1: user defined header and data
+        listCommands << "ATFCSM1\r";
+        return true;
+    }
+
+    bool Elm327Codec::DecodeResponse(ParameterFrame const &paramFrame,
+                                     char const * data,
+                                     int const length,
+                                     QList<ByteList> &listRawFrames)
+    {
+        for(int i=0; i < length; i++)   {
+            char const c = data[i];
+            if(c == '\r' || c == '\n')   {
+                decodeLine(paramFrame,listRawFrames);
+            }
+            else if(c == '>')   {
+                decodeLine(paramFrame,listRawFrames);
+                return true;
+            }
+            else if(c != '\0')   {
+                m_line.append(c);
+            }
+        }
+        return false;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void Elm327Codec::decodeLine(ParameterFrame const &paramFrame,
+                                 QList<ByteList> &listRawFrames)
+    {
+        if(m_line.isEmpty())   {
+            return;
+        }
+
+        QByteArray line;
+        line.reserve(m_line.size()+1);
+        for(int i=0; i < m_line.size(); i++)   {
+            if(m_line[i] != ' ')   {
+                line.append(m_line[i]);
+            }
+        }
+
+        bool const isCan = (paramFrame.parseProtocol == PROTOCOL_ISO_15765);
+        if(isCan && !paramFrame.iso15765_extendedId && (line.size() % 2) != 0)   {
+            // 11-bit ids are three hex digits
+            line.prepend('0');
+        }
+
+        ByteList rawFrame;
+        if(line.isEmpty() || !DecodeHex(line.constData(),line.size(),rawFrame))   {
+            // status or error message
+            m_lastStatus = m_line.trimmed();
+            m_line.clear();
+            return;
+        }
+        m_line.clear();
+
+        int headerLength = 3;
+        if(isCan)   {
+            headerLength = (paramFrame.iso15765_extendedId) ? 4 : 2;
+        }
+        else   {
+            // [checksum]
+            rawFrame.removeLast();
+        }
+
+        if(rawFrame.size() <= headerLength)   {
+            OBDREFWARN << "Warn: Elm327Codec: frame too short";
+            return;
+        }
+        listRawFrames << rawFrame;
+    }
+}
@@ -0,0 +1,140 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef ELM327CODEC_H
+#define ELM327CODEC_H
+
+#include "datatypes.h"
+#include "obdrefdebug.h"
+
+namespace obdref
+{
+
+// Elm327Codec
+// * converts requests in a ParameterFrame to ELM327/STN
+//   ascii commands and converts adapter output back into
+//   raw frames for MessageData.listRawFrames
+// * the adapter is expected to be set up with the
+//   commands from GetInitCommands (headers on, echo
+//   and linefeeds off, CAN auto formatting on)
+// * request headers are only sent (with ATSH, and ATCP
+//   for the priority byte of 29-bit CAN ids) when they
+//   differ from the last header that was sent
+class Elm327Codec
+{
+public:
+    Elm327Codec();
+
+    // EncodeHex
+    // * appends bytes to hexStr as uppercase hex
+    //   characters, optionally separated by spaces
+    static void EncodeHex(ByteList const &bytes,
+                          QByteArray &hexStr,
+                          bool const addSpaces=false);
+
+    // DecodeHex
+    // * appends the bytes in a string of hex characters
+    //   to bytes; spaces are ignored
+    // * returns false if there is an odd number of hex
+    //   characters or any other character is found
+    static bool DecodeHex(char const * hexStr,
+                          int const length,
+                          ByteList &bytes);
+
+    // GetInitCommands
+    // * saves the commands that set the adapter up for
+    //   this codec to listCommands (including a reset)
+    void GetInitCommands(QList<QByteArray> &listCommands);
+
+    // SetResponseCountHints
+    // * if true (the default), requests expecting a known
+    //   number of single frame responses (expResponseCount,
+    //   see ResponderMap) have the count appended so the
+    //   adapter returns as soon as they've all arrived
+    // * responses with more than seven data bytes (including
+    //   the prefix) or that are known to span several frames
+    //   (expFramesPerResponse) don't get a hint, since the
+    //   adapter would stop after the first frame
+    void SetResponseCountHints(bool const useHints);
+
+    // ResetState
+    // * forgets the last header sent and any partially
+    //   received output; should be called whenever the
+    //   adapter is reset or changes protocol
+    void ResetState();
+
+    // EncodeRequest
+    // * saves the commands needed to send the request of
+    //   a MessageData in paramFrame to listCommands; each
+    //   command ends with a carriage return and should be
+    //   sent after the prompt for the previous one
+    // * ISO 15765 requests must fit in a single frame; the
+    //   adapter adds the pci byte itself
+    // * returns false if the request can't be sent
+    bool EncodeRequest(ParameterFrame const &paramFrame,
+                       int const msgIdx,
+                       QList<QByteArray> &listCommands);
+
+    // GetFlowControlCommands
+    // * saves the commands that make the adapter reply to
+    //   ISO 15765 first frames with fcFrame's header, BS
+    //   and STmin (see IsoTpFlowControl) to listCommands,
+    //   instead of its own conservative defaults
+    // * returns false if fcFrame isn't a flow control frame
+    bool GetFlowControlCommands(ParameterFrame const &paramFrame,
+                                ByteList const &fcFrame,
+                                QList<QByteArray> &listCommands) const;
+
+    // DecodeResponse
+    // * converts adapter output (which may be split up
+    //   arbitrarily) into raw frames ([header] [data]) and
+    //   appends them to listRawFrames as lines complete
+    // * checksums of legacy frames are removed and 11-bit
+    //   CAN ids are saved as two bytes
+    // * lines that aren't frames (ie. "NO DATA") are saved
+    //   as the last status
+    // * returns true once the prompt has been received,
+    //   ie. the adapter has finished with the request
+    bool DecodeResponse(ParameterFrame const &paramFrame,
+                        char const * data,
+                        int const length,
+                        QList<ByteList> &listRawFrames);
+
+    // GetLastStatus
+    // * returns the last line received that wasn't a frame
+    //   or an empty string if there wasn't one since the
+    //   last request
+    QByteArray const & GetLastStatus() const
+    {   return m_lastStatus;   }
+
+private:
+    void decodeLine(ParameterFrame const &paramFrame,
+                    QList<ByteList> &listRawFrames);
+
+    bool m_useHints;
+
+    bool m_headerValid;
+    ByteList m_lastHeader;
+
+    QByteArray m_line;
+    QByteArray m_lastStatus;
+};
+
+}
+
+#endif // ELM327CODEC_H
@@ -0,0 +1,569 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include <cstring>
+
+#include <QDateTime>
+#include <QThread>
+
+#include "framecapture.h"
+#include "timeseriesstore.h"
+
+namespace obdref
+{
+    // first and last eight bytes of a capture file
+    static char const CAPTURE_MAGIC[] = "OBDCAP01";
+    static char const CAPTURE_INDEX_MAGIC[] = "OBDCAPIX";
+
+    // [magic] [start time]
+    static qint64 const CAPTURE_HEADER_SIZE = 16;
+
+    // [index offset] [frames] [last timestamp] [magic]
+    static qint64 const CAPTURE_TRAILER_SIZE = 32;
+
+    // [base timestamp] [offset]
+    static qint64 const CAPTURE_INDEX_ENTRY_SIZE = 16;
+
+    // records per index entry; a seek scans at
+    // most this many records past the entry
+    static quint64 const CAPTURE_BLOCK_FRAMES = 4096;
+
+    // CaptureWriter buffers this many bytes
+    // before writing them to the file
+    static int const CAPTURE_WRITE_BUFFER_SIZE = 1 << 20;
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    static void appendU64(QByteArray &buffer,quint64 value)
+    {
+        for(int i=0; i < 8; i++)   {
+            buffer.append(char(value & 0xFF));
+            value >>= 8;
+        }
+    }
+
+    static void appendVarint(QByteArray &buffer,quint64 value)
+    {
+        while(value >= 0x80)   {
+            buffer.append(char((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        buffer.append(char(value));
+    }
+
+    static quint64 readU64(uchar const * data)
+    {
+        quint64 value=0;
+        for(int i=7; i >= 0; i--)   {
+            value = (value << 8) | data[i];
+        }
+        return value;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    qint64 FrameSource::Replay(FrameDispatcher &dispatcher,
+                               ReplayOptions const &options,
+                               QList<Data> &listData,
+                               QList<qint64> * listTimestampUs)
+    {
+        return replay(dispatcher,options,listData,listTimestampUs,NULL);
+    }
+
+    qint64 FrameSource::Replay(FrameDispatcher &dispatcher,
+                               ReplayOptions const &options,
+                               TimeSeriesStore &store)
+    {
+        QList<Data> listData;
+        return replay(dispatcher,options,listData,NULL,&store);
+    }
+
+    qint64 FrameSource::replay(FrameDispatcher &dispatcher,
+                               ReplayOptions const &options,
+                               QList<Data> &listData,
+                               QList<qint64> * listTimestampUs,
+                               TimeSeriesStore * store)
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        CapturedFrame frame;
+        qint64 const parseIntervalUs = qMax(options.parseIntervalUs,qint64(1));
+        qint64 numFrames=0;
+        qint64 firstTimestampUs=-1;
+        qint64 lastTimestampUs=-1;
+        qint64 nextParseUs=0;
+
+        while(ReadNext(frame))   {
+            if(options.endUs >= 0 && frame.timestampUs > options.endUs)   {
+                break;
+            }
+            if((options.startUs >= 0 && frame.timestampUs < options.startUs) ||
+               (options.channel >= 0 && frame.channel != options.channel))   {
+                continue;
+            }
+
+            // parses happen at fixed points in capture time so
+            // replaying part of a capture (see BatchDecoder)
+            // gives the same results as replaying all of it
+            if(firstTimestampUs < 0)   {
+                firstTimestampUs = frame.timestampUs;
+            }
+            else if(frame.timestampUs >= nextParseUs)   {
+                parseDispatched(dispatcher,lastTimestampUs,
+                                listData,listTimestampUs,store);
+            }
+            nextParseUs = (frame.timestampUs/parseIntervalUs+1)*parseIntervalUs;
+
+            if(options.speed > 0)   {
+                qint64 const dueUs = qint64(
+                    (frame.timestampUs-firstTimestampUs)/options.speed);
+                qint64 const waitUs = dueUs-(timer.nsecsElapsed()/1000);
+                if(waitUs > 0)   {
+                    QThread::usleep((unsigned long)waitUs);
+                }
+            }
+
+            dispatcher.DispatchFrame(frame.rawFrame);
+            lastTimestampUs = frame.timestampUs;
+            numFrames++;
+        }
+        parseDispatched(dispatcher,lastTimestampUs,
+                        listData,listTimestampUs,store);
+
+        return numFrames;
+    }
+
+    void FrameSource::parseDispatched(FrameDispatcher &dispatcher,
+                                      qint64 const timestampUs,
+                                      QList<Data> &listData,
+                                      QList<qint64> * listTimestampUs,
+                                      TimeSeriesStore * store)
+    {
+        // parse failures are logged by the
+        // dispatcher and don't stop the replay
+        int const numData = listData.size();
+        dispatcher.ParseDispatchedFrames(listData);
+
+        if(store)   {
+            for(int i=numData; i < listData.size(); i++)   {
+                store->Add(timestampUs,listData[i]);
+            }
+            listData.clear();
+            return;
+        }
+
+        if(listTimestampUs)   {
+            for(int i=numData; i < listData.size(); i++)   {
+                listTimestampUs->append(timestampUs);
+            }
+        }
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    CaptureWriter::CaptureWriter() :
+        m_bufferOffset(0),
+        m_lastTimestampUs(0),
+        m_numFrames(0)
+    {}
+
+    CaptureWriter::~CaptureWriter()
+    {
+        if(IsOpen())   {
+            Close();
+        }
+    }
+
+    bool CaptureWriter::Open(QString const &filePath,
+                             qint64 const startTimeMs)
+    {
+        if(IsOpen())   {
+            Close();
+        }
+
+        m_file.setFileName(filePath);
+        if(!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate))   {
+            OBDREFERROR << "Error: CaptureWriter: could not open" << filePath;
+            return false;
+        }
+
+        m_buffer.resize(0);
+        m_buffer.reserve(CAPTURE_WRITE_BUFFER_SIZE+1024);
+        m_buffer.append(CAPTURE_MAGIC,8);
+        appendU64(m_buffer,quint64((startTimeMs < 0) ?
+            QDateTime::currentMSecsSinceEpoch() : startTimeMs));
+
+        m_index.resize(0);
+        m_bufferOffset = 0;
+        m_lastTimestampUs = 0;
+        m_numFrames = 0;
+        m_timer.start();
+        return true;
+    }
+
+    bool CaptureWriter::Close()
+    {
+        if(!IsOpen())   {
+            return false;
+        }
+
+        bool writeOk = flushBuffer();
+
+        // [index] [trailer]
+        quint64 const indexOffset = quint64(m_bufferOffset);
+        m_buffer.append(m_index);
+        appendU64(m_buffer,indexOffset);
+        appendU64(m_buffer,m_numFrames);
+        appendU64(m_buffer,(m_numFrames > 0) ?
+                      quint64(m_lastTimestampUs) : quint64(-1));
+        m_buffer.append(CAPTURE_INDEX_MAGIC,8);
+
+        writeOk = flushBuffer() && writeOk;
+        m_file.close();
+        m_index.resize(0);
+
+        if(!writeOk)   {
+            OBDREFERROR << "Error: CaptureWriter: could not write"
+                        << m_file.fileName();
+        }
+        return writeOk;
+    }
+
+    bool CaptureWriter::WriteFrame(qint64 const timestampUs,
+                                   ubyte const channel,
+                                   ubyte const headerLength,
+                                   ByteList const &rawFrame)
+    {
+        if(!IsOpen())   {
+            return false;
+        }
+
+        // every block starts with an index entry
+        if(m_numFrames % CAPTURE_BLOCK_FRAMES == 0)   {
+            appendU64(m_index,quint64(m_lastTimestampUs));
+            appendU64(m_index,quint64(m_bufferOffset+m_buffer.size()));
+        }
+
+        qint64 const ts = qMax(timestampUs,m_lastTimestampUs);
+        appendVarint(m_buffer,quint64(ts-m_lastTimestampUs));
+        m_buffer.append(char(channel));
+        m_buffer.append(char(headerLength));
+        appendVarint(m_buffer,quint64(rawFrame.size()));
+        for(int i=0; i < rawFrame.size(); i++)   {
+            m_buffer.append(char(rawFrame[i]));
+        }
+
+        m_lastTimestampUs = ts;
+        m_numFrames++;
+
+        if(m_buffer.size() >= CAPTURE_WRITE_BUFFER_SIZE)   {
+            return flushBuffer();
+        }
+        return true;
+    }
+
+    bool CaptureWriter::WriteFrame(ubyte const channel,
+                                   ubyte const headerLength,
+                                   ByteList const &rawFrame)
+    {
+        return WriteFrame(GetElapsedUs(),channel,headerLength,rawFrame);
+    }
+
+    bool CaptureWriter::flushBuffer()
+    {
+        if(m_buffer.isEmpty())   {
+            return true;
+        }
+        qint64 const numWritten = m_file.write(m_buffer);
+        if(numWritten != m_buffer.size())   {
+            OBDREFERROR << "Error: CaptureWriter: write failed";
+            return false;
+        }
+        m_bufferOffset += numWritten;
+        m_buffer.resize(0);
+        return true;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    CaptureReader::CaptureReader() :
+        m_data(NULL),
+        m_size(0),
+        m_endRecords(0),
+        m_startTimeMs(0),
+        m_firstTimestampUs(-1),
+        m_lastTimestampUs(-1),
+        m_numFrames(0),
+        m_hasIndex(false),
+        m_index(NULL),
+        m_numIndexEntries(0),
+        m_pos(0),
+        m_corrupt(false),
+        m_prevTimestampUs(0),
+        m_frameIdx(0)
+    {}
+
+    CaptureReader::~CaptureReader()
+    {
+        Close();
+    }
+
+    bool CaptureReader::Open(QString const &filePath)
+    {
+        Close();
+
+        m_file.setFileName(filePath);
+        if(!m_file.open(QIODevice::ReadOnly))   {
+            OBDREFERROR << "Error: CaptureReader: could not open" << filePath;
+            return false;
+        }
+
+        m_size = m_file.size();
+        if(m_size >= CAPTURE_HEADER_SIZE)   {
+            m_data = m_file.map(0,m_size);
+        }
+        if(m_data == NULL || memcmp(m_data,CAPTURE_MAGIC,8) != 0)   {
+            OBDREFERROR << "Error: CaptureReader:" << filePath
+                        << "is not a capture file";
+            Close();
+            return false;
+        }
+        m_startTimeMs = qint64(readU64(m_data+8));
+
+        if(!readTrailer())   {
+            OBDREFWARN << "Warn: CaptureReader:" << filePath
+                       << "has no index (it wasn't closed)";
+        }
+
+        // the first record's delta is its timestamp
+        quint64 delta=0;
+        m_pos = CAPTURE_HEADER_SIZE;
+        if(m_endRecords > CAPTURE_HEADER_SIZE && readVarint(delta))   {
+            m_firstTimestampUs = qint64(delta);
+        }
+
+        Rewind();
+        return true;
+    }
+
+    void CaptureReader::Close()
+    {
+        if(m_data != NULL)   {
+            m_file.unmap(const_cast<uchar*>(m_data));
+            m_data = NULL;
+        }
+        if(m_file.isOpen())   {
+            m_file.close();
+        }
+        m_size = 0;
+        m_endRecords = 0;
+        m_startTimeMs = 0;
+        m_firstTimestampUs = -1;
+        m_lastTimestampUs = -1;
+        m_numFrames = 0;
+        m_hasIndex = false;
+        m_index = NULL;
+        m_numIndexEntries = 0;
+        m_pos = 0;
+        m_corrupt = false;
+        m_prevTimestampUs = 0;
+        m_frameIdx = 0;
+    }
+
+    void CaptureReader::Rewind()
+    {
+        m_pos = CAPTURE_HEADER_SIZE;
+        m_prevTimestampUs = 0;
+        m_frameIdx = 0;
+    }
+
+    bool CaptureReader::SeekToTime(qint64 const timestampUs)
+    {
+        if(!IsOpen())   {
+            return false;
+        }
+        Rewind();
+
+        // find the last block whose base timestamp is
+        // earlier than timestampUs; every record in the
+        // blocks before it is earlier than timestampUs
+        if(m_hasIndex && m_numIndexEntries > 0)   {
+            quint64 lo=0;
+            quint64 hi=m_numIndexEntries;
+            while(hi-lo > 1)   {
+                quint64 const mid = lo+(hi-lo)/2;
+                qint64 const base = qint64(readU64(
+                    m_index+mid*CAPTURE_INDEX_ENTRY_SIZE));
+                if(base < timestampUs)   {
+                    lo = mid;
+                }
+                else   {
+                    hi = mid;
+                }
+            }
+            uchar const * entry = m_index+lo*CAPTURE_INDEX_ENTRY_SIZE;
+            m_prevTimestampUs = qint64(readU64(entry));
+            m_pos = qint64(readU64(entry+8));
+            m_frameIdx = lo*CAPTURE_BLOCK_FRAMES;
+        }
+
+        // scan forward to the first frame at or after
+        // timestampUs without copying frame data
+        while(m_pos < m_endRecords)   {
+            qint64 const pos = m_pos;
+            qint64 const prevTimestampUs = m_prevTimestampUs;
+
+            quint64 delta=0;
+            quint64 frameLength=0;
+            if(!readVarint(delta) || m_endRecords-m_pos < 2)   {
+                break;
+            }
+            m_pos += 2;
+            if(!readVarint(frameLength) ||
+               quint64(m_endRecords-m_pos) < frameLength)   {
+                break;
+            }
+            m_pos += qint64(frameLength);
+            m_prevTimestampUs += qint64(delta);
+
+            if(m_prevTimestampUs >= timestampUs)   {
+                m_pos = pos;
+                m_prevTimestampUs = prevTimestampUs;
+                return true;
+            }
+            m_frameIdx++;
+        }
+        return false;
+    }
+
+    bool CaptureReader::ReadNext(CapturedFrame &frame)
+    {
+        // a record that can't be read (or a frame count that
+        // doesn't match the trailer's) is only expected at
+        // the end of a capture that wasn't closed
+        if(m_pos >= m_endRecords)   {
+            m_corrupt = (m_hasIndex && m_frameIdx != m_numFrames);
+            return false;
+        }
+        m_corrupt = m_hasIndex;
+
+        quint64 delta=0;
+        quint64 frameLength=0;
+        if(!readVarint(delta) || m_endRecords-m_pos < 2)   {
+            return false;
+        }
+        frame.channel = m_data[m_pos];
+        frame.headerLength = m_data[m_pos+1];
+        m_pos += 2;
+
+        if(!readVarint(frameLength) ||
+           quint64(m_endRecords-m_pos) < frameLength)   {
+            return false;
+        }
+        m_corrupt = false;
+
+        frame.rawFrame.clear();
+        uchar const * bytes = m_data+m_pos;
+        for(quint64 i=0; i < frameLength; i++)   {
+            frame.rawFrame.append(bytes[i]);
+        }
+        m_pos += qint64(frameLength);
+
+        m_prevTimestampUs += qint64(delta);
+        frame.timestampUs = m_prevTimestampUs;
+        m_frameIdx++;
+        return true;
+    }
+
+    qint64 CaptureReader::replay(FrameDispatcher &dispatcher,
+                                 ReplayOptions const &options,
+                                 QList<Data> &listData,
+                                 QList<qint64> * listTimestampUs,
+                                 TimeSeriesStore * store)
+    {
+        if(!IsOpen())   {
+            return -1;
+        }
+        if(options.startUs >= 0 && !SeekToTime(options.startUs))   {
+            return 0;
+        }
+
+        m_corrupt = false;
+        qint64 const numFrames = FrameSource::replay(dispatcher,options,listData,
+                                                     listTimestampUs,store);
+        if(m_corrupt)   {
+            OBDREFERROR << "Error: CaptureReader: corrupt record"
+                        << "after frame" << m_frameIdx;
+            return -1;
+        }
+        return numFrames;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    bool CaptureReader::readVarint(quint64 &value)
+    {
+        value=0;
+        for(int shift=0; shift < 64; shift += 7)   {
+            if(m_pos >= m_endRecords)   {
+                return false;
+            }
+            uchar const byte = m_data[m_pos++];
+            value |= quint64(byte & 0x7F) << shift;
+            if((byte & 0x80) == 0)   {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool CaptureReader::readTrailer()
+    {
+        m_endRecords = m_size;
+        if(m_size < CAPTURE_HEADER_SIZE+CAPTURE_TRAILER_SIZE)   {
+            return false;
+        }
+
+        uchar const * trailer = m_data+(m_size-CAPTURE_TRAILER_SIZE);
+        if(memcmp(trailer+24,CAPTURE_INDEX_MAGIC,8) != 0)   {
+            return false;
+        }
+
+        qint64 const indexOffset = qint64(readU64(trailer));
+        qint64 const indexSize = m_size-CAPTURE_TRAILER_SIZE-indexOffset;
+        if(indexOffset < CAPTURE_HEADER_SIZE || indexSize < 0 ||
+           indexSize % CAPTURE_INDEX_ENTRY_SIZE != 0)   {
+            return false;
+        }
+
+        m_endRecords = indexOffset;
+        m_numFrames = readU64(trailer+8);
+        m_lastTimestampUs = qint64(readU64(trailer+16));
+        m_index = m_data+indexOffset;
+        m_numIndexEntries = quint64(indexSize/CAPTURE_INDEX_ENTRY_SIZE);
+        m_hasIndex = true;
+        return true;
+    }
+}
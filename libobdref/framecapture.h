@@ -0,0 +1,323 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef FRAMECAPTURE_H
+#define FRAMECAPTURE_H
+
+#include <QFile>
+#include <QElapsedTimer>
+
+#include "datatypes.h"
+#include "obdrefdebug.h"
+#include "framedispatcher.h"
+
+namespace obdref
+{
+
+class TimeSeriesStore;
+
+// CapturedFrame
+// * a single raw frame ([header] [data]) read
+//   from or written to a capture file
+struct CapturedFrame
+{
+    CapturedFrame() :
+        timestampUs(0),
+        channel(0),
+        headerLength(0)
+    {}
+
+    qint64      timestampUs;
+    ubyte       channel;        // bus the frame was seen on
+    ubyte       headerLength;   // number of header bytes in rawFrame
+    ByteList    rawFrame;
+};
+
+// Capture file format
+// * all values are little endian; varints are unsigned
+//   LEB128 (7 bits per byte, low bits first)
+// * [file header]
+//   8 bytes   magic "OBDCAP01"
+//   8 bytes   wall clock time the capture was started
+//             (ms since epoch)
+// * [records] one per frame
+//   varint    timestamp delta (us) from the previous record
+//             (from 0 for the first record)
+//   1 byte    channel
+//   1 byte    header length
+//   varint    frame length (header and data)
+//   n bytes   frame
+// * [index] one entry per block of CAPTURE_BLOCK_FRAMES records
+//   8 bytes   timestamp of the record before the block (0
+//             for the first block), which is what the first
+//             record's delta is from
+//   8 bytes   file offset of the block's first record
+// * [trailer]
+//   8 bytes   file offset of the index
+//   8 bytes   number of frames
+//   8 bytes   timestamp of the last frame
+//   8 bytes   magic "OBDCAPIX"
+// * a capture that wasn't closed (ie. the recording process
+//   died) has no index or trailer; it can still be read,
+//   but seeking scans from the start
+
+// CaptureWriter
+// * writes frames to a capture file; records are buffered
+//   and written in chunks so writing a frame is a few
+//   byte appends
+// * timestamps are expected to be in order and >= 0; a frame
+//   that's older than the last one written is saved with the
+//   last frame's timestamp so the file stays sorted by time
+class CaptureWriter
+{
+public:
+    CaptureWriter();
+    ~CaptureWriter();
+
+    // Open
+    // * creates (or truncates) filePath and writes the file
+    //   header; the capture clock starts at 0
+    // * startTimeMs is saved as the wall clock time the
+    //   capture was started (when it's less than 0, the
+    //   current time is used)
+    bool Open(QString const &filePath,
+              qint64 const startTimeMs=-1);
+
+    // Close
+    // * writes buffered frames, the index and the trailer
+    bool Close();
+
+    bool IsOpen() const
+    {   return m_file.isOpen();   }
+
+    // WriteFrame
+    // * saves rawFrame with timestampUs
+    bool WriteFrame(qint64 const timestampUs,
+                    ubyte const channel,
+                    ubyte const headerLength,
+                    ByteList const &rawFrame);
+
+    // WriteFrame
+    // * as above, but the frame is stamped with the
+    //   time since the capture was opened
+    bool WriteFrame(ubyte const channel,
+                    ubyte const headerLength,
+                    ByteList const &rawFrame);
+
+    // GetElapsedUs
+    // * time since the capture was opened
+    qint64 GetElapsedUs() const
+    {   return m_timer.nsecsElapsed()/1000;   }
+
+    quint64 GetFrameCount() const
+    {   return m_numFrames;   }
+
+private:
+    bool flushBuffer();
+
+    QFile m_file;
+    QElapsedTimer m_timer;
+    QByteArray m_buffer;
+    QByteArray m_index;
+    qint64 m_bufferOffset;      // file offset of m_buffer[0]
+    qint64 m_lastTimestampUs;
+    quint64 m_numFrames;
+};
+
+// ReplayOptions
+// * speed: 0 replays as fast as frames can be dispatched,
+//   1 replays in real time (2 at twice real time, ...)
+// * frames are dispatched in order and the dispatcher's
+//   parameters are parsed each time the capture time passes
+//   a multiple of parseIntervalUs (and once at the end);
+//   this should be longer than a request/response so
+//   multi-frame messages aren't split between parses
+// * startUs/endUs limit the replay to a time range
+//   (-1 for the start/end of the capture)
+// * channel: only frames on this channel are replayed
+//   (-1 for every channel)
+struct ReplayOptions
+{
+    ReplayOptions() :
+        speed(0),
+        parseIntervalUs(100000),
+        startUs(-1),
+        endUs(-1),
+        channel(-1)
+    {}
+
+    double speed;
+    qint64 parseIntervalUs;
+    qint64 startUs;
+    qint64 endUs;
+    int channel;
+};
+
+// FrameSource
+// * frames that are read in time order and can be
+//   replayed with a FrameDispatcher (see CaptureReader
+//   and LogImporter)
+class FrameSource
+{
+public:
+    virtual ~FrameSource() {}
+
+    // ReadNext
+    // * reads the next frame into frame (reusing its
+    //   rawFrame); returns false once there are none left
+    virtual bool ReadNext(CapturedFrame &frame) = 0;
+
+    // Replay
+    // * dispatches frames from the current position with
+    //   dispatcher and saves parsed data to listData
+    // * if listTimestampUs isn't NULL, the timestamp of the
+    //   last frame dispatched before each entry in listData
+    //   was parsed is appended to it
+    // * returns the number of frames dispatched or -1
+    //   if there was an error
+    qint64 Replay(FrameDispatcher &dispatcher,
+                  ReplayOptions const &options,
+                  QList<Data> &listData,
+                  QList<qint64> * listTimestampUs=NULL);
+
+    // Replay
+    // * as above, but parsed data is added to store
+    //   (with the same timestamps) as it's parsed
+    //   instead of being kept in a list
+    qint64 Replay(FrameDispatcher &dispatcher,
+                  ReplayOptions const &options,
+                  TimeSeriesStore &store);
+
+protected:
+    // replay
+    // * saves data to listData or store (if it
+    //   isn't NULL); overridden by sources that
+    //   can seek or check for errors
+    virtual qint64 replay(FrameDispatcher &dispatcher,
+                          ReplayOptions const &options,
+                          QList<Data> &listData,
+                          QList<qint64> * listTimestampUs,
+                          TimeSeriesStore * store);
+
+private:
+    void parseDispatched(FrameDispatcher &dispatcher,
+                         qint64 const timestampUs,
+                         QList<Data> &listData,
+                         QList<qint64> * listTimestampUs,
+                         TimeSeriesStore * store);
+};
+
+// CaptureReader
+// * reads a capture file through a memory map, so captures
+//   larger than memory can be read (the OS pages the file
+//   in and out as it's read) and nothing is copied until
+//   a frame is read
+// * SeekToTime uses the index to find the block a time
+//   falls in and scans forward from there
+class CaptureReader : public FrameSource
+{
+public:
+    CaptureReader();
+    ~CaptureReader();
+
+    // Open
+    // * maps filePath and reads its trailer (if it has
+    //   one); the reader is positioned at the first frame
+    bool Open(QString const &filePath);
+
+    void Close();
+
+    bool IsOpen() const
+    {   return (m_data != NULL);   }
+
+    // HasIndex
+    // * false if the capture wasn't closed properly
+    bool HasIndex() const
+    {   return m_hasIndex;   }
+
+    // GetFrameCount
+    // * 0 if the capture has no index
+    quint64 GetFrameCount() const
+    {   return m_numFrames;   }
+
+    qint64 GetStartTimeMs() const
+    {   return m_startTimeMs;   }
+
+    // GetFirstTimestampUs / GetLastTimestampUs
+    // * -1 if the capture has no frames (the last
+    //   timestamp is also -1 if it has no index)
+    qint64 GetFirstTimestampUs() const
+    {   return m_firstTimestampUs;   }
+
+    qint64 GetLastTimestampUs() const
+    {   return m_lastTimestampUs;   }
+
+    // Rewind
+    // * positions the reader at the first frame
+    void Rewind();
+
+    // SeekToTime
+    // * positions the reader at the first frame with a
+    //   timestamp >= timestampUs; returns false if there
+    //   are no frames at or after timestampUs
+    bool SeekToTime(qint64 const timestampUs);
+
+    // ReadNext
+    // * reads the next frame into frame (reusing its
+    //   rawFrame); returns false at the end of the capture
+    //   or if the record is corrupt
+    bool ReadNext(CapturedFrame &frame);
+
+protected:
+    // replay
+    // * seeks to options.startUs with the index first
+    //   and fails (-1) if a corrupt record was found
+    qint64 replay(FrameDispatcher &dispatcher,
+                  ReplayOptions const &options,
+                  QList<Data> &listData,
+                  QList<qint64> * listTimestampUs,
+                  TimeSeriesStore * store);
+
+private:
+    bool readVarint(quint64 &value);
+    bool readTrailer();
+
+    QFile m_file;
+    uchar const * m_data;
+    qint64 m_size;
+    qint64 m_endRecords;        // offset just past the last record
+
+    qint64 m_startTimeMs;
+    qint64 m_firstTimestampUs;
+    qint64 m_lastTimestampUs;
+    quint64 m_numFrames;
+    bool m_hasIndex;
+    uchar const * m_index;
+    quint64 m_numIndexEntries;
+
+    // read position
+    qint64 m_pos;
+    bool m_corrupt;             // a record in the index's range couldn't be read
+    qint64 m_prevTimestampUs;
+    quint64 m_frameIdx;         // index of the next frame
+};
+
+}
+
+#endif // FRAMECAPTURE_H
@@ -0,0 +1,485 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "framedispatcher.h"
+#include "framecapture.h"
+
+namespace obdref
+{
+    // ========================================================================== //
+    // ========================================================================== //
+
+    FrameDispatcher::FrameDispatcher(Parser * parser) :
+        m_parser(parser),
+        m_protocol(PROTOCOL_SAE_J1850),
+        m_headerLength(0),
+        m_captureWriter(NULL),
+        m_captureChannel(0)
+    {}
+
+    bool FrameDispatcher::AddParameters(QString const &spec,
+                                        QString const &protocol,
+                                        QString const &address)
+    {
+        QStringList listParams =
+            m_parser->GetParameterNames(spec,protocol,address);
+
+        bool addedParam=false;
+        for(int i=0; i < listParams.size(); i++)   {
+            ParameterFrame param;
+            param.spec = spec;
+            param.protocol = protocol;
+            param.address = address;
+            param.name = listParams[i];
+
+            if(!m_parser->BuildParameterFrame(param))   {
+                OBDREFWARN << "Warn: FrameDispatcher: could not "
+                              "build parameter" << listParams[i];
+                continue;
+            }
+            if(AddParameterFrame(param))   {
+                addedParam = true;
+            }
+        }
+
+        if(!addedParam)   {
+            OBDREFERROR << "Error: FrameDispatcher: no parameters "
+                           "added for" << spec << protocol << address;
+        }
+        return addedParam;
+    }
+
+    bool FrameDispatcher::AddParameterFrame(ParameterFrame const &paramFrame)
+    {
+        if(paramFrame.functionKeyIdx == -1)   {
+            OBDREFERROR << "Error: FrameDispatcher: parameter"
+                        << paramFrame.name << "has not been built";
+            return false;
+        }
+
+        // all parameters are expected to be on the same bus
+        int headerLength = 3;
+        if(paramFrame.parseProtocol == PROTOCOL_ISO_15765)   {
+            headerLength = (paramFrame.iso15765_extendedId) ? 4 : 2;
+        }
+
+        if(m_listParams.isEmpty())   {
+            m_protocol = paramFrame.parseProtocol;
+            m_headerLength = headerLength;
+        }
+        else if((paramFrame.parseProtocol != m_protocol) ||
+                (headerLength != m_headerLength))   {
+            OBDREFERROR << "Error: FrameDispatcher: parameter"
+                        << paramFrame.name << "uses a different "
+                           "protocol than other parameters";
+            return false;
+        }
+
+        int const paramIdx = m_listParams.size();
+        m_listParams.push_back(paramFrame);
+        m_listParamHasFrames.push_back(false);
+
+        // clear any frames the parameter may
+        // have been added with
+        ParameterFrame &param = m_listParams.last();
+        for(int i=0; i < param.listMessageData.size(); i++)   {
+            param.listMessageData[i].listRawFrames.clear();
+            addRoute(paramIdx,i);
+        }
+
+        return true;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void FrameDispatcher::DispatchFrame(ByteList const &rawFrame)
+    {
+        if(m_captureWriter)   {
+            int headerLength = m_headerLength;
+            if(m_protocol == PROTOCOL_ISO_14230 && !rawFrame.isEmpty())   {
+                // see lookupRoutes_ISO_14230
+                headerLength = 4;
+                if((rawFrame[0] >> 6) == 0)     { headerLength -= 2; }
+                if((rawFrame[0] & 0x3F) != 0)   { headerLength -= 1; }
+            }
+            m_captureWriter->WriteFrame(m_captureChannel,
+                                        ubyte(headerLength),
+                                        rawFrame);
+        }
+
+        m_listRouteIdx.clear();
+
+        if(m_protocol < 0xA00)   {
+            lookupRoutes_Legacy(rawFrame,m_listRouteIdx);
+        }
+        else if(m_protocol == PROTOCOL_ISO_14230)   {
+            lookupRoutes_ISO_14230(rawFrame,m_listRouteIdx);
+        }
+        else if(m_protocol == PROTOCOL_ISO_15765)   {
+            if(rawFrame.size() < m_headerLength+1)   {
+                return;
+            }
+
+            QByteArray header;
+            header.resize(m_headerLength);
+            for(int k=0; k < m_headerLength; k++)   {
+                header[k] = char(rawFrame[k]);
+            }
+
+            ubyte const pciType = (rawFrame[m_headerLength] >> 4);
+            if(pciType == 0)   {
+                // [single frame]
+                m_tablePendingFF.remove(header);
+                lookupRoutes_ISO_15765(rawFrame,m_headerLength+1,
+                                       m_listRouteIdx);
+            }
+            else if(pciType == 1)   {
+                // [first frame] consecutive frames with the
+                // same header are sent to the same routes
+                lookupRoutes_ISO_15765(rawFrame,m_headerLength+2,
+                                       m_listRouteIdx);
+
+                int numBytesLeft=0;
+                if(rawFrame.size() >= m_headerLength+2)   {
+                    numBytesLeft = ((rawFrame[m_headerLength] & 0x0F) << 8) +
+                        rawFrame[m_headerLength+1] -
+                        (rawFrame.size()-m_headerLength-2);
+                }
+                if(m_listRouteIdx.isEmpty() || numBytesLeft <= 0)   {
+                    m_tablePendingFF.remove(header);
+                }
+                else   {
+                    PendingMessage pending;
+                    pending.listRouteIdx = m_listRouteIdx;
+                    pending.numBytesLeft = numBytesLeft;
+                    pending.nextPciByte = 0x21;
+                    m_tablePendingFF.insert(header,pending);
+                }
+            }
+            else if(pciType == 2)   {
+                // [consecutive frame] the message is complete
+                // (or broken) once it's no longer pending
+                QHash<QByteArray,PendingMessage>::iterator it =
+                    m_tablePendingFF.find(header);
+
+                if(it != m_tablePendingFF.end())   {
+                    PendingMessage &pending = it.value();
+                    m_listRouteIdx = pending.listRouteIdx;
+                    pending.numBytesLeft -= (rawFrame.size()-m_headerLength-1);
+
+                    if(rawFrame[m_headerLength] != pending.nextPciByte ||
+                       pending.numBytesLeft <= 0)   {
+                        m_tablePendingFF.erase(it);
+                    }
+                    else   {
+                        pending.nextPciByte+=0x01;
+                        if(pending.nextPciByte == 0x30)   {
+                            pending.nextPciByte = 0x20;
+                        }
+                    }
+                }
+            }
+            // [flow control] ignore
+        }
+
+        for(int i=0; i < m_listRouteIdx.size(); i++)   {
+            routeFrame(m_listRouteIdx[i],rawFrame);
+        }
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void FrameDispatcher::SetCaptureWriter(CaptureWriter * writer,
+                                           ubyte const channel)
+    {
+        m_captureWriter = writer;
+        m_captureChannel = channel;
+    }
+
+    bool FrameDispatcher::ParseDispatchedFrames(QList<Data> &listData)
+    {
+        bool parsedOk=true;
+        QList<int> listParamsWaiting;
+
+        // parameters with a multi-frame message that's still
+        // waiting on consecutive frames aren't parsed yet, so
+        // the message isn't split between two parses
+        QList<int> listParamsPending;
+        QHash<QByteArray,PendingMessage>::const_iterator it;
+        for(it = m_tablePendingFF.constBegin(); it != m_tablePendingFF.constEnd(); ++it)   {
+            QList<int> const &listRouteIdx = it.value().listRouteIdx;
+            for(int i=0; i < listRouteIdx.size(); i++)   {
+                listParamsPending << m_listRoutes[listRouteIdx[i]].paramIdx;
+            }
+        }
+
+        for(int i=0; i < m_listParamsWithFrames.size(); i++)   {
+            int const paramIdx = m_listParamsWithFrames[i];
+            ParameterFrame &param = m_listParams[paramIdx];
+
+            if(listParamsPending.contains(paramIdx))   {
+                listParamsWaiting.push_back(paramIdx);
+                continue;
+            }
+
+            // wait until every MessageData has frames
+            bool hasAllFrames=true;
+            for(int j=0; j < param.listMessageData.size(); j++)   {
+                if(param.listMessageData[j].listRawFrames.isEmpty())   {
+                    hasAllFrames=false;
+                    break;
+                }
+            }
+            if(!hasAllFrames)   {
+                listParamsWaiting.push_back(paramIdx);
+                continue;
+            }
+
+            if(!m_parser->ParseParameterFrame(param,listData))   {
+                OBDREFWARN << "Warn: FrameDispatcher: could not "
+                              "parse parameter" << param.name;
+                parsedOk=false;
+            }
+
+            for(int j=0; j < param.listMessageData.size(); j++)   {
+                param.listMessageData[j].listRawFrames.clear();
+            }
+            m_listParamHasFrames[paramIdx] = false;
+        }
+
+        m_listParamsWithFrames = listParamsWaiting;
+        return parsedOk;
+    }
+
+    void FrameDispatcher::ClearDispatchedFrames()
+    {
+        for(int i=0; i < m_listParamsWithFrames.size(); i++)   {
+            int const paramIdx = m_listParamsWithFrames[i];
+            ParameterFrame &param = m_listParams[paramIdx];
+            for(int j=0; j < param.listMessageData.size(); j++)   {
+                param.listMessageData[j].listRawFrames.clear();
+            }
+            m_listParamHasFrames[paramIdx] = false;
+        }
+        m_listParamsWithFrames.clear();
+        m_tablePendingFF.clear();
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void FrameDispatcher::addRoute(int const paramIdx,
+                                   int const msgIdx)
+    {
+        MessageData const &msg =
+            m_listParams[paramIdx].listMessageData[msgIdx];
+
+        // ISO 14230 headers are normalized
+        // to [format] [target] [source]
+        int const headerLength = m_headerLength;
+        int const prefixLength = msg.expDataPrefix.size();
+
+        ByteList headerMask;
+        for(int k=0; k < headerLength; k++)   {
+            bool const hasByte = (k < msg.expHeaderBytes.size()) &&
+                                 (k < msg.expHeaderMask.size());
+
+            headerMask << ((hasByte) ? msg.expHeaderMask[k] : 0x00);
+        }
+
+        // find or create the shape for this message
+        QByteArray shapeKey;
+        shapeKey.append(char(prefixLength));
+        for(int k=0; k < headerLength; k++)   {
+            shapeKey.append(char(headerMask[k]));
+        }
+
+        int shapeIdx = m_tableShapeIdx.value(shapeKey,-1);
+        if(shapeIdx == -1)   {
+            Shape shape;
+            shape.headerLength = headerLength;
+            shape.prefixLength = prefixLength;
+            shape.headerMask = headerMask;
+            shapeIdx = m_listShapes.size();
+            m_listShapes.push_back(shape);
+            m_tableShapeIdx.insert(shapeKey,shapeIdx);
+        }
+        Shape &shape = m_listShapes[shapeIdx];
+
+        // add the route
+        Route route;
+        route.paramIdx = paramIdx;
+        route.msgIdx = msgIdx;
+        int const routeIdx = m_listRoutes.size();
+        m_listRoutes.push_back(route);
+
+        QByteArray key;
+        key.resize(headerLength+prefixLength);
+        for(int k=0; k < headerLength; k++)   {
+            ubyte const expByte = (headerMask[k] == 0x00) ?
+                0x00 : msg.expHeaderBytes[k];
+
+            key[k] = char(expByte & headerMask[k]);
+        }
+        for(int k=0; k < prefixLength; k++)   {
+            key[headerLength+k] = char(msg.expDataPrefix[k]);
+        }
+        shape.tableRoutes[key].push_back(routeIdx);
+
+        if(m_protocol == PROTOCOL_ISO_14230)   {
+            key[1] = 0x00;
+            key[2] = 0x00;
+            shape.tableRoutesNoAddr[key].push_back(routeIdx);
+        }
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void FrameDispatcher::lookupRoutes_Legacy(ByteList const &rawFrame,
+                                              QList<int> &listRouteIdx)
+    {
+        // [h0 h1 h2] [prefix] [d0 d1 ...]
+        for(int i=0; i < m_listShapes.size(); i++)   {
+            Shape const &shape = m_listShapes[i];
+            int const keyLength = shape.headerLength+shape.prefixLength;
+            if(rawFrame.size() < keyLength)   {
+                continue;
+            }
+
+            m_key.resize(keyLength);
+            for(int k=0; k < shape.headerLength; k++)   {
+                m_key[k] = char(rawFrame[k] & shape.headerMask[k]);
+            }
+            for(int k=shape.headerLength; k < keyLength; k++)   {
+                m_key[k] = char(rawFrame[k]);
+            }
+
+            QHash<QByteArray,QList<int> >::const_iterator it =
+                shape.tableRoutes.find(m_key);
+
+            if(it != shape.tableRoutes.end())   {
+                listRouteIdx << it.value();
+            }
+        }
+    }
+
+    void FrameDispatcher::lookupRoutes_ISO_14230(ByteList const &rawFrame,
+                                                 QList<int> &listRouteIdx)
+    {
+        if(rawFrame.isEmpty())   {
+            return;
+        }
+
+        // see Parser::cleanFrames_ISO_14230
+        // for a description of the header types
+        ubyte const formatByte = rawFrame[0];
+        bool const noAddressing = ((formatByte >> 6) == 0);
+        bool const hasLengthByte = ((formatByte & 0x3F) == 0);
+
+        int headerLength=4;
+        if(noAddressing)   { headerLength -= 2; }
+        if(!hasLengthByte) { headerLength -= 1; }
+
+        if(rawFrame.size() < headerLength)   {
+            return;
+        }
+
+        int const dataLength = (hasLengthByte) ?
+            rawFrame[headerLength-1] : (formatByte & 0x3F);
+
+        for(int i=0; i < m_listShapes.size(); i++)   {
+            Shape const &shape = m_listShapes[i];
+            if((dataLength < shape.prefixLength) ||
+               (rawFrame.size() < headerLength+shape.prefixLength))   {
+                continue;
+            }
+
+            // [format] [target] [source] [prefix]
+            m_key.resize(3+shape.prefixLength);
+            m_key[0] = char(formatByte & shape.headerMask[0]);
+            if(noAddressing)   {
+                m_key[1] = 0x00;
+                m_key[2] = 0x00;
+            }
+            else   {
+                m_key[1] = char(rawFrame[1] & shape.headerMask[1]);
+                m_key[2] = char(rawFrame[2] & shape.headerMask[2]);
+            }
+            for(int k=0; k < shape.prefixLength; k++)   {
+                m_key[3+k] = char(rawFrame[headerLength+k]);
+            }
+
+            QHash<QByteArray,QList<int> > const &tableRoutes =
+                (noAddressing) ? shape.tableRoutesNoAddr : shape.tableRoutes;
+
+            QHash<QByteArray,QList<int> >::const_iterator it =
+                tableRoutes.find(m_key);
+
+            if(it != tableRoutes.end())   {
+                listRouteIdx << it.value();
+            }
+        }
+    }
+
+    void FrameDispatcher::lookupRoutes_ISO_15765(ByteList const &rawFrame,
+                                                 int const idxPrefix,
+                                                 QList<int> &listRouteIdx)
+    {
+        // [header] [pci] [prefix] [d0 d1 ...]
+        for(int i=0; i < m_listShapes.size(); i++)   {
+            Shape const &shape = m_listShapes[i];
+            if(rawFrame.size() < idxPrefix+shape.prefixLength)   {
+                continue;
+            }
+
+            m_key.resize(shape.headerLength+shape.prefixLength);
+            for(int k=0; k < shape.headerLength; k++)   {
+                m_key[k] = char(rawFrame[k] & shape.headerMask[k]);
+            }
+            for(int k=0; k < shape.prefixLength; k++)   {
+                m_key[shape.headerLength+k] = char(rawFrame[idxPrefix+k]);
+            }
+
+            QHash<QByteArray,QList<int> >::const_iterator it =
+                shape.tableRoutes.find(m_key);
+
+            if(it != shape.tableRoutes.end())   {
+                listRouteIdx << it.value();
+            }
+        }
+    }
+
+    void FrameDispatcher::routeFrame(int const routeIdx,
+                                     ByteList const &rawFrame)
+    {
+        Route const &route = m_listRoutes[routeIdx];
+        m_listParams[route.paramIdx].
+            listMessageData[route.msgIdx].listRawFrames << rawFrame;
+
+        if(!m_listParamHasFrames[route.paramIdx])   {
+            m_listParamHasFrames[route.paramIdx] = true;
+            m_listParamsWithFrames.push_back(route.paramIdx);
+        }
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+}
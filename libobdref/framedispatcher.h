@@ -0,0 +1,182 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef FRAMEDISPATCHER_H
+#define FRAMEDISPATCHER_H
+
+#include <QHash>
+#include <QVector>
+
+#include "parser.h"
+
+namespace obdref
+{
+
+class CaptureWriter;
+
+// FrameDispatcher
+// * routes frames seen on the bus (ie. when passively
+//   monitoring another tool's requests or broadcast
+//   messages) to every parameter they belong to
+// * each MessageData added to the dispatcher is keyed
+//   by its masked expHeaderBytes and expDataPrefix in
+//   a hash table; MessageData with the same header mask
+//   and prefix length share a table, so the cost of
+//   dispatching a frame depends on the number of
+//   distinct (mask, prefix length) pairs and not on
+//   the number of parameters
+// * all parameters added to a dispatcher should use
+//   the same protocol (they're on the same bus)
+class FrameDispatcher
+{
+public:
+    FrameDispatcher(Parser * parser);
+
+    // AddParameters
+    // * builds every parameter in the definitions file
+    //   for spec/protocol/address and adds it
+    // * returns false if no parameters could be added
+    bool AddParameters(QString const &spec,
+                       QString const &protocol,
+                       QString const &address);
+
+    // AddParameterFrame
+    // * adds a parameter that has already been built
+    //   with Parser::BuildParameterFrame
+    bool AddParameterFrame(ParameterFrame const &paramFrame);
+
+    // DispatchFrame
+    // * saves rawFrame ([header] [data]) to listRawFrames
+    //   of every MessageData it matches
+    // * ISO 15765 consecutive frames are routed to the
+    //   same MessageData as the last first frame that
+    //   was seen with the same header; flow control
+    //   frames are ignored
+    void DispatchFrame(ByteList const &rawFrame);
+
+    // SetCaptureWriter
+    // * every frame passed to DispatchFrame is also saved
+    //   with writer (stamped with the writer's clock) as
+    //   being seen on channel; NULL stops capturing
+    // * the writer isn't owned by the dispatcher
+    void SetCaptureWriter(CaptureWriter * writer,
+                          ubyte const channel=0);
+
+    // ParseDispatchedFrames
+    // * parses every parameter that has had frames
+    //   dispatched to all of its MessageData, and
+    //   saves the results to listData
+    // * the raw frames of parsed parameters are cleared;
+    //   parameters still waiting on frames for some of
+    //   their MessageData (or on the consecutive frames
+    //   of an ISO 15765 multi-frame message) keep them
+    // * returns false if any parameter failed to parse
+    bool ParseDispatchedFrames(QList<Data> &listData);
+
+    // ClearDispatchedFrames
+    // * clears raw frames from every parameter
+    void ClearDispatchedFrames();
+
+    // GetParameterFrames
+    QList<ParameterFrame> const & GetParameterFrames() const
+    {   return m_listParams;   }
+
+private:
+    // Route
+    // * a single MessageData in a parameter
+    struct Route
+    {
+        int paramIdx;
+        int msgIdx;
+    };
+
+    // Shape
+    // * MessageData that share a header mask and
+    //   prefix length are keyed in the same table
+    struct Shape
+    {
+        int headerLength;
+        int prefixLength;
+        ByteList headerMask;
+
+        // [masked header] [prefix] -> list of route idx
+        QHash<QByteArray,QList<int> > tableRoutes;
+
+        // ISO 14230 only: frames without target and source
+        // bytes are looked up with a key that ignores them
+        QHash<QByteArray,QList<int> > tableRoutesNoAddr;
+    };
+
+    void addRoute(int const paramIdx,
+                  int const msgIdx);
+
+    // lookupRoutes_[...]
+    // * appends the routes that rawFrame matches in
+    //   each shape to listRouteIdx
+    void lookupRoutes_Legacy(ByteList const &rawFrame,
+                             QList<int> &listRouteIdx);
+
+    void lookupRoutes_ISO_14230(ByteList const &rawFrame,
+                                QList<int> &listRouteIdx);
+
+    void lookupRoutes_ISO_15765(ByteList const &rawFrame,
+                                int const idxPrefix,
+                                QList<int> &listRouteIdx);
+
+    void routeFrame(int const routeIdx,
+                    ByteList const &rawFrame);
+
+    Parser * m_parser;
+    Protocol m_protocol;
+    int m_headerLength;
+
+    CaptureWriter * m_captureWriter;
+    ubyte m_captureChannel;
+
+    QList<ParameterFrame> m_listParams;
+    QList<Route> m_listRoutes;
+    QList<Shape> m_listShapes;
+    QHash<QByteArray,int> m_tableShapeIdx;
+
+    // PendingMessage
+    // * an ISO 15765 multi-frame message that's
+    //   still waiting on consecutive frames
+    struct PendingMessage
+    {
+        QList<int> listRouteIdx;
+        int numBytesLeft;       // data bytes still expected
+        ubyte nextPciByte;
+    };
+
+    // ISO 15765: [header] -> the message for the last
+    // first frame seen with [header]
+    QHash<QByteArray,PendingMessage> m_tablePendingFF;
+
+    // parameters that have been sent frames
+    // since they were last parsed
+    QList<int> m_listParamsWithFrames;
+    QVector<bool> m_listParamHasFrames;
+
+    // scratch
+    QByteArray m_key;
+    QList<int> m_listRouteIdx;
+};
+
+}
+
+#endif // FRAMEDISPATCHER_H
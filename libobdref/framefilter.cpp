@@ -0,0 +1,452 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "framefilter.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define OBDREF_FRAMEFILTER_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define OBDREF_FRAMEFILTER_SSE2
+#endif
+
+namespace obdref
+{
+    // ========================================================================== //
+    // ========================================================================== //
+
+    FrameFilter::FrameFilter() :
+        m_numFrames(0),
+        m_numColumns(0),
+        m_numHeaderColumns(0),
+        m_stride(0)
+    {
+#if defined(OBDREF_FRAMEFILTER_AVX2) || defined(OBDREF_FRAMEFILTER_SSE2)
+        m_useSimd = true;
+#else
+        m_useSimd = false;
+#endif
+    }
+
+    void FrameFilter::SetUseSimd(bool useSimd)
+    {
+#if defined(OBDREF_FRAMEFILTER_AVX2) || defined(OBDREF_FRAMEFILTER_SSE2)
+        m_useSimd = useSimd;
+#else
+        m_useSimd = false;
+#endif
+    }
+
+    char const * FrameFilter::SimdInstructionSet()
+    {
+#if defined(OBDREF_FRAMEFILTER_AVX2)
+        return "AVX2";
+#elif defined(OBDREF_FRAMEFILTER_SSE2)
+        return "SSE2";
+#else
+        return "None";
+#endif
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void FrameFilter::FilterFrames_Legacy(MessageData const &msg,
+                                          int const idxStart,
+                                          QList<int> &listIdxAccepted)
+    {
+        int const headerLength = 3;
+        int const prefixLength = msg.expDataPrefix.size();
+        int const numFrames = msg.listRawFrames.size()-idxStart;
+        if(numFrames < 1)   {
+            m_numFrames = 0;
+            return;
+        }
+
+        resetColumns(numFrames,1+headerLength+prefixLength);
+        m_numHeaderColumns = headerLength;
+
+        // [flag] [h0 h1 h2] [prefix]
+        for(int k=0; k < headerLength; k++)   {
+            if(k < msg.expHeaderBytes.size() && k < msg.expHeaderMask.size())   {
+                setExpected(1+k,msg.expHeaderBytes[k],msg.expHeaderMask[k]);
+            }
+            else   {
+                setExpected(1+k,0x00,0x00);
+            }
+        }
+        for(int k=0; k < prefixLength; k++)   {
+            setExpected(1+headerLength+k,msg.expDataPrefix[k],0xFF);
+        }
+
+        // pack
+        int const numBytes = headerLength+prefixLength;
+        ubyte * colFlag = column(0);
+        for(int i=0; i < numFrames; i++)   {
+            ByteList const &rawFrame = msg.listRawFrames[idxStart+i];
+            if(rawFrame.size() < numBytes)   {
+                colFlag[i] = 0x00;
+                continue;
+            }
+            colFlag[i] = 0xFF;
+            for(int k=0; k < numBytes; k++)   {
+                column(1+k)[i] = rawFrame[k];
+            }
+        }
+
+        compareColumns(idxStart,listIdxAccepted);
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void FrameFilter::FilterFrames_ISO_14230(MessageData const &msg,
+                                             int const idxStart,
+                                             QList<int> &listIdxAccepted)
+    {
+        int const prefixLength = msg.expDataPrefix.size();
+        int const numFrames = msg.listRawFrames.size()-idxStart;
+        if(numFrames < 1)   {
+            m_numFrames = 0;
+            return;
+        }
+
+        // the header is packed as [format] [target] [source]
+        // regardless of the actual header type; frames that
+        // don't have target and source bytes get the expected
+        // bytes packed in their place so they always match
+        resetColumns(numFrames,4+prefixLength);
+        m_numHeaderColumns = 3;
+
+        for(int k=0; k < 3; k++)   {
+            setExpected(1+k,msg.expHeaderBytes[k],msg.expHeaderMask[k]);
+        }
+        for(int k=0; k < prefixLength; k++)   {
+            setExpected(4+k,msg.expDataPrefix[k],0xFF);
+        }
+
+        // pack
+        ubyte * colFlag = column(0);
+        ubyte * colFormat = column(1);
+        ubyte * colTarget = column(2);
+        ubyte * colSource = column(3);
+        for(int i=0; i < numFrames; i++)   {
+            ByteList const &rawFrame = msg.listRawFrames[idxStart+i];
+            colFlag[i] = 0x00;
+            if(rawFrame.isEmpty())   {
+                continue;
+            }
+
+            // see Parser::cleanFrames_ISO_14230
+            // for a description of the header types
+            ubyte const formatByte = rawFrame[0];
+            bool const noAddressing = ((formatByte >> 6) == 0);
+            bool const hasLengthByte = ((formatByte & 0x3F) == 0);
+
+            int headerLength=4;
+            if(noAddressing)   { headerLength -= 2; }
+            if(!hasLengthByte) { headerLength -= 1; }
+
+            if(rawFrame.size() < headerLength)   {
+                continue;
+            }
+
+            int const dataLength = (hasLengthByte) ?
+                rawFrame[headerLength-1] : (formatByte & 0x3F);
+
+            if((dataLength < prefixLength) ||
+               (rawFrame.size() < headerLength+dataLength))   {
+                continue;
+            }
+
+            colFlag[i] = 0xFF;
+            colFormat[i] = formatByte;
+            if(noAddressing)   {
+                colTarget[i] = msg.expHeaderBytes[1];
+                colSource[i] = msg.expHeaderBytes[2];
+            }
+            else   {
+                colTarget[i] = rawFrame[1];
+                colSource[i] = rawFrame[2];
+            }
+            for(int k=0; k < prefixLength; k++)   {
+                column(4+k)[i] = rawFrame[headerLength+k];
+            }
+        }
+
+        compareColumns(idxStart,listIdxAccepted);
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void FrameFilter::FilterFrames_ISO_15765(MessageData const &msg,
+                                             int const headerLength,
+                                             int const idxStart,
+                                             QList<int> &listIdxAccepted)
+    {
+        int const prefixLength = msg.expDataPrefix.size();
+        int const numFrames = msg.listRawFrames.size()-idxStart;
+        if(numFrames < 1)   {
+            m_numFrames = 0;
+            return;
+        }
+
+        // [flag] [header] [prefix]
+        resetColumns(numFrames,1+headerLength+prefixLength);
+        m_numHeaderColumns = headerLength;
+
+        for(int k=0; k < headerLength; k++)   {
+            if(k < msg.expHeaderBytes.size() && k < msg.expHeaderMask.size())   {
+                setExpected(1+k,msg.expHeaderBytes[k],msg.expHeaderMask[k]);
+            }
+            else   {
+                setExpected(1+k,0x00,0x00);
+            }
+        }
+        for(int k=0; k < prefixLength; k++)   {
+            setExpected(1+headerLength+k,msg.expDataPrefix[k],0xFF);
+        }
+
+        // pack
+        ubyte * colFlag = column(0);
+        for(int i=0; i < numFrames; i++)   {
+            ByteList const &rawFrame = msg.listRawFrames[idxStart+i];
+
+            // every frame needs at least a pci byte
+            if(rawFrame.size() < headerLength+1)   {
+                colFlag[i] = 0x00;
+                continue;
+            }
+
+            for(int k=0; k < headerLength; k++)   {
+                column(1+k)[i] = rawFrame[k];
+            }
+
+            int const pciType = (rawFrame[headerLength] >> 4);
+            if(pciType == 0)   {
+                // [single frame] the prefix must be present
+                int const idxPrefix = headerLength+1;
+                if(rawFrame.size() < idxPrefix+prefixLength)   {
+                    colFlag[i] = 0x00;
+                    continue;
+                }
+                for(int k=0; k < prefixLength; k++)   {
+                    column(1+headerLength+k)[i] = rawFrame[idxPrefix+k];
+                }
+            }
+            else if(pciType == 1)   {
+                // [first frame] the prefix may continue
+                // into consecutive frames, so only test
+                // the bytes present in this frame
+                int const idxPrefix = headerLength+2;
+                if(rawFrame.size() < idxPrefix)   {
+                    colFlag[i] = 0x00;
+                    continue;
+                }
+                for(int k=0; k < prefixLength; k++)   {
+                    column(1+headerLength+k)[i] = (idxPrefix+k < rawFrame.size()) ?
+                        rawFrame[idxPrefix+k] : msg.expDataPrefix[k];
+                }
+            }
+            else   {
+                // [consecutive frame] no prefix
+                for(int k=0; k < prefixLength; k++)   {
+                    column(1+headerLength+k)[i] = msg.expDataPrefix[k];
+                }
+            }
+            colFlag[i] = 0xFF;
+        }
+
+        compareColumns(idxStart,listIdxAccepted);
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void FrameFilter::CountRejected(QList<int> const &listIdxAccepted,
+                                    int const idxStart,
+                                    RejectStats &stats) const
+    {
+        ubyte const * columns = m_columns.constData();
+        ubyte const * listExpBytes = m_listExpBytes.constData();
+        ubyte const * listMask = m_listMask.constData();
+
+        // accepted indices are in order, so walk
+        // them alongside the rows
+        int idxAccepted=0;
+        for(int i=0; i < m_numFrames; i++)   {
+            if(idxAccepted < listIdxAccepted.size() &&
+               listIdxAccepted[idxAccepted] == idxStart+i)   {
+                idxAccepted++;
+                continue;
+            }
+
+            // the flag column is only set for
+            // frames that were long enough
+            if(columns[i] != 0xFF)   {
+                stats.badLength++;
+                continue;
+            }
+
+            bool headerOk = true;
+            for(int k=1; k <= m_numHeaderColumns; k++)   {
+                ubyte const colByte = columns[(k*m_stride)+i];
+                if((colByte & listMask[k]) != listExpBytes[k])   {
+                    headerOk = false;
+                    break;
+                }
+            }
+            if(headerOk)   {
+                stats.prefixMismatch++;
+            }
+            else   {
+                stats.headerMismatch++;
+            }
+        }
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void FrameFilter::resetColumns(int const numFrames,
+                                   int const numColumns)
+    {
+        m_numFrames = numFrames;
+        m_numColumns = numColumns;
+        m_stride = (numFrames+31) & ~31;
+
+        // reuse previously allocated memory where possible
+        m_columns.resize(m_numColumns*m_stride);
+        m_listExpBytes.resize(m_numColumns);
+        m_listMask.resize(m_numColumns);
+
+        // the flag column must be 0xFF for every row
+        // that was long enough to be tested
+        setExpected(0,0xFF,0xFF);
+
+        // rows past numFrames are padding and are
+        // never returned, but clear their flags anyway
+        ubyte * colFlag = column(0);
+        for(int i=m_numFrames; i < m_stride; i++)   {
+            colFlag[i] = 0x00;
+        }
+    }
+
+    void FrameFilter::setExpected(int const k,
+                                  ubyte const expByte,
+                                  ubyte const maskByte)
+    {
+        m_listExpBytes[k] = (expByte & maskByte);
+        m_listMask[k] = maskByte;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void FrameFilter::compareColumns(int const idxStart,
+                                     QList<int> &listIdxAccepted)
+    {
+        if(m_useSimd)   {
+            compareColumns_Simd(idxStart,listIdxAccepted);
+        }
+        else   {
+            compareColumns_Scalar(idxStart,listIdxAccepted);
+        }
+    }
+
+    void FrameFilter::compareColumns_Scalar(int const idxStart,
+                                            QList<int> &listIdxAccepted)
+    {
+        ubyte const * listExpBytes = m_listExpBytes.constData();
+        ubyte const * listMask = m_listMask.constData();
+
+        for(int i=0; i < m_numFrames; i++)   {
+            bool rowOk = true;
+            for(int k=0; k < m_numColumns; k++)   {
+                ubyte const colByte = m_columns.constData()[(k*m_stride)+i];
+                if((colByte & listMask[k]) != listExpBytes[k])   {
+                    rowOk = false;
+                    break;
+                }
+            }
+            if(rowOk)   {
+                listIdxAccepted.push_back(idxStart+i);
+            }
+        }
+    }
+
+    void FrameFilter::compareColumns_Simd(int const idxStart,
+                                          QList<int> &listIdxAccepted)
+    {
+#if defined(OBDREF_FRAMEFILTER_AVX2)
+        int const width = 32;
+#elif defined(OBDREF_FRAMEFILTER_SSE2)
+        int const width = 16;
+#endif
+
+#if defined(OBDREF_FRAMEFILTER_AVX2) || defined(OBDREF_FRAMEFILTER_SSE2)
+        ubyte const * columns = m_columns.constData();
+        ubyte const * listExpBytes = m_listExpBytes.constData();
+        ubyte const * listMask = m_listMask.constData();
+
+        for(int i=0; i < m_stride; i+=width)   {
+            // and the result of comparing each column
+            // for 'width' rows at a time
+#if defined(OBDREF_FRAMEFILTER_AVX2)
+            __m256i rowsOk = _mm256_set1_epi8(char(0xFF));
+            for(int k=0; k < m_numColumns; k++)   {
+                __m256i colBytes = _mm256_loadu_si256(
+                    reinterpret_cast<__m256i const*>(columns+(k*m_stride)+i));
+
+                __m256i mask = _mm256_set1_epi8(char(listMask[k]));
+                __m256i expBytes = _mm256_set1_epi8(char(listExpBytes[k]));
+                colBytes = _mm256_and_si256(colBytes,mask);
+                rowsOk = _mm256_and_si256(rowsOk,_mm256_cmpeq_epi8(colBytes,expBytes));
+            }
+            quint32 rowBits = quint32(_mm256_movemask_epi8(rowsOk));
+#else
+            __m128i rowsOk = _mm_set1_epi8(char(0xFF));
+            for(int k=0; k < m_numColumns; k++)   {
+                __m128i colBytes = _mm_loadu_si128(
+                    reinterpret_cast<__m128i const*>(columns+(k*m_stride)+i));
+
+                __m128i mask = _mm_set1_epi8(char(listMask[k]));
+                __m128i expBytes = _mm_set1_epi8(char(listExpBytes[k]));
+                colBytes = _mm_and_si128(colBytes,mask);
+                rowsOk = _mm_and_si128(rowsOk,_mm_cmpeq_epi8(colBytes,expBytes));
+            }
+            quint32 rowBits = quint32(_mm_movemask_epi8(rowsOk));
+#endif
+            // most frames are expected to be rejected,
+            // so skip the whole block if nothing matched
+            for(int j=i; rowBits != 0; j++, rowBits >>= 1)   {
+                if((rowBits & 1) && (j < m_numFrames))   {
+                    listIdxAccepted.push_back(idxStart+j);
+                }
+            }
+        }
+#else
+        compareColumns_Scalar(idxStart,listIdxAccepted);
+#endif
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+}
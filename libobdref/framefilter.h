@@ -0,0 +1,136 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef FRAMEFILTER_H
+#define FRAMEFILTER_H
+
+#include <QVector>
+
+#include "datatypes.h"
+
+namespace obdref
+{
+
+// FrameFilter
+// * batch filter that tests raw frames against the
+//   expHeaderBytes, expHeaderMask and expDataPrefix
+//   of a MessageData before any frames are copied
+// * the bytes that need to be tested are packed into
+//   a columnar buffer (byte k of every frame is stored
+//   contiguously) so each column can be compared for
+//   16 (SSE2) or 32 (AVX2) frames at once
+// * a scalar fallback is used on other platforms
+class FrameFilter
+{
+public:
+    FrameFilter();
+
+    // FilterFrames_[...]
+    // * saves the indices of frames in msg.listRawFrames
+    //   that have a matching header and data prefix to
+    //   listIdxAccepted (in order), starting at idxStart
+    // * frames that are too short to contain the header
+    //   and prefix are rejected
+
+    // FilterFrames_Legacy
+    // * [h0 h1 h2] [prefix] [d0 d1 ...]
+    void FilterFrames_Legacy(MessageData const &msg,
+                             int const idxStart,
+                             QList<int> &listIdxAccepted);
+
+    // FilterFrames_ISO_14230
+    // * [format] [target] [source] [length] [prefix] [d0 d1 ...]
+    //   where target/source and length may not be present
+    void FilterFrames_ISO_14230(MessageData const &msg,
+                                int const idxStart,
+                                QList<int> &listIdxAccepted);
+
+    // FilterFrames_ISO_15765
+    // * [header] [pci] [prefix] [d0 d1 ...]
+    // * the prefix is only tested for single frames and
+    //   first frames; consecutive frames only have their
+    //   header tested since they don't contain the prefix
+    void FilterFrames_ISO_15765(MessageData const &msg,
+                                int const headerLength,
+                                int const idxStart,
+                                QList<int> &listIdxAccepted);
+
+    // CountRejected
+    // * adds the frames the last FilterFrames_[...] call
+    //   didn't accept to stats as either too short, header
+    //   mismatch or prefix mismatch; only rejected frames
+    //   are looked at again
+    void CountRejected(QList<int> const &listIdxAccepted,
+                       int const idxStart,
+                       RejectStats &stats) const;
+
+    // SetUseSimd
+    // * use the SSE2/AVX2 compare (true by default when
+    //   available); only useful for testing/benchmarks
+    void SetUseSimd(bool useSimd);
+
+    // SimdInstructionSet
+    // * returns "AVX2", "SSE2" or "None"
+    static char const * SimdInstructionSet();
+
+private:
+    // resetColumns
+    // * sizes the columnar buffer for numFrames frames
+    //   and numColumns tested bytes per frame
+    void resetColumns(int const numFrames,
+                      int const numColumns);
+
+    // setExpected
+    // * sets the (masked) value expected in column k
+    void setExpected(int const k,
+                     ubyte const expByte,
+                     ubyte const maskByte);
+
+    // column
+    // * returns a pointer to the first row of column k
+    inline ubyte * column(int const k)
+    {   return m_columns.data() + (k*m_stride);   }
+
+    // compareColumns
+    // * compares every column against the expected
+    //   bytes and saves accepted rows to listIdxAccepted
+    // * column 0 is used to flag whether or not a frame
+    //   was long enough to be packed (0xFF if it was)
+    void compareColumns(int const idxStart,
+                        QList<int> &listIdxAccepted);
+
+    void compareColumns_Scalar(int const idxStart,
+                               QList<int> &listIdxAccepted);
+
+    void compareColumns_Simd(int const idxStart,
+                             QList<int> &listIdxAccepted);
+
+    bool m_useSimd;
+    int m_numFrames;
+    int m_numColumns;
+    int m_numHeaderColumns;     // columns after the flag that hold the header
+    int m_stride;       // numFrames rounded up to 32
+
+    QVector<ubyte> m_columns;
+    QVector<ubyte> m_listExpBytes;  // (masked) expected byte per column
+    QVector<ubyte> m_listMask;      // mask per column
+};
+
+}
+
+#endif // FRAMEFILTER_H
@@ -0,0 +1,326 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "isotpflowcontrol.h"
+
+namespace obdref
+{
+    // max time between consecutive frames before
+    // the receiver gives up (N_Cr, ISO 15765-2)
+    static qint64 const N_CR_TIMEOUT_MS = 1000;
+
+    // adaptive STmin: the first backoff from 0 and
+    // the largest STmin that can be sent
+    static quint32 const ADAPT_FIRST_STMIN_US = 1000;
+    static quint32 const MAX_STMIN_US = 127000;
+
+    // adaptive STmin: error free transfers before
+    // trying a shorter STmin again
+    static int const ADAPT_OK_TRANSFERS = 4;
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    IsoTpFlowControl::IsoTpFlowControl() :
+        m_defBlockSize(0),
+        m_defStMinUs(0),
+        m_adaptive(false)
+    {}
+
+    void IsoTpFlowControl::SetDefaults(ubyte const blockSize,
+                                       quint32 const stMinUs)
+    {
+        m_defBlockSize = blockSize;
+        m_defStMinUs = qMin(stMinUs,MAX_STMIN_US);
+    }
+
+    void IsoTpFlowControl::SetParameters(ByteList const &respHeader,
+                                         ubyte const blockSize,
+                                         quint32 const stMinUs)
+    {
+        EcuState &state = getState(respHeader);
+        state.cfgBlockSize = blockSize;
+        state.cfgStMinUs = qMin(stMinUs,MAX_STMIN_US);
+        state.blockSize = state.cfgBlockSize;
+        state.stMinUs = state.cfgStMinUs;
+        state.okTransfers = 0;
+    }
+
+    void IsoTpFlowControl::SetAdaptive(bool const adaptive)
+    {
+        m_adaptive = adaptive;
+    }
+
+    bool IsoTpFlowControl::ProcessFrame(ParameterFrame const &paramFrame,
+                                        ByteList const &rawFrame,
+                                        qint64 const timeMs,
+                                        ByteList &fcFrame)
+    {
+        if(paramFrame.parseProtocol != PROTOCOL_ISO_15765)   {
+            return false;
+        }
+
+        int const headerLength = (paramFrame.iso15765_extendedId) ? 4 : 2;
+        if(rawFrame.size() <= headerLength)   {
+            return false;
+        }
+
+        ByteList const respHeader = rawFrame.mid(0,headerLength);
+        ubyte const pciByte = rawFrame[headerLength];
+        ubyte const pciType = (pciByte >> 4);
+
+        EcuState &state = getState(respHeader);
+
+        if(pciType == 0x00)   {
+            // [single frame]: an unfinished transfer
+            // won't be continued
+            if(state.active)   {
+                endTransfer(state,false);
+            }
+            return false;
+        }
+        else if(pciType == 0x01)   {
+            // [first frame]
+            if(rawFrame.size() < headerLength+2)   {
+                return false;
+            }
+            if(state.active)   {
+                endTransfer(state,false);
+            }
+            int const dataLength = (int(pciByte & 0x0F) << 8) | rawFrame[headerLength+1];
+
+            state.active = true;
+            state.bytesLeft = dataLength-6;
+            state.nextSeqNum = 1;
+            state.framesLeftInBlock = state.blockSize;
+            state.lastFrameMs = timeMs;
+            return buildFlowControlFrame(paramFrame,respHeader,state,fcFrame);
+        }
+        else if(pciType == 0x02)   {
+            // [consecutive frame]
+            if(!state.active)   {
+                return false;
+            }
+            if((pciByte & 0x0F) != state.nextSeqNum)   {
+                // lost a frame
+                endTransfer(state,false);
+                return false;
+            }
+            state.nextSeqNum = (state.nextSeqNum+1) & 0x0F;
+            state.bytesLeft -= 7;
+            state.lastFrameMs = timeMs;
+
+            if(state.bytesLeft <= 0)   {
+                endTransfer(state,true);
+                return false;
+            }
+            if(state.blockSize > 0)   {
+                state.framesLeftInBlock--;
+                if(state.framesLeftInBlock == 0)   {
+                    state.framesLeftInBlock = state.blockSize;
+                    return buildFlowControlFrame(paramFrame,respHeader,state,fcFrame);
+                }
+            }
+        }
+        return false;
+    }
+
+    int IsoTpFlowControl::CheckTimeouts(qint64 const timeMs)
+    {
+        int numTimedOut=0;
+        QHash<QByteArray,EcuState>::iterator it;
+        for(it = m_tableEcus.begin(); it != m_tableEcus.end(); ++it)   {
+            EcuState &state = it.value();
+            if(state.active && timeMs-state.lastFrameMs > N_CR_TIMEOUT_MS)   {
+                endTransfer(state,false);
+                numTimedOut++;
+            }
+        }
+        return numTimedOut;
+    }
+
+    int IsoTpFlowControl::GetFramesUntilFlowControl(ByteList const &respHeader) const
+    {
+        QHash<QByteArray,EcuState>::const_iterator it =
+            m_tableEcus.find(getKey(respHeader));
+
+        if(it == m_tableEcus.end() || !it.value().active ||
+           it.value().blockSize == 0)   {
+            return -1;
+        }
+        return it.value().framesLeftInBlock;
+    }
+
+    ubyte IsoTpFlowControl::GetBlockSize(ByteList const &respHeader) const
+    {
+        QHash<QByteArray,EcuState>::const_iterator it =
+            m_tableEcus.find(getKey(respHeader));
+
+        return (it == m_tableEcus.end()) ? m_defBlockSize : it.value().blockSize;
+    }
+
+    quint32 IsoTpFlowControl::GetStMinUs(ByteList const &respHeader) const
+    {
+        QHash<QByteArray,EcuState>::const_iterator it =
+            m_tableEcus.find(getKey(respHeader));
+
+        return (it == m_tableEcus.end()) ? m_defStMinUs : it.value().stMinUs;
+    }
+
+    bool IsoTpFlowControl::BuildFlowControlFrame(ParameterFrame const &paramFrame,
+                                                 ByteList const &respHeader,
+                                                 ByteList &fcFrame)
+    {
+        return buildFlowControlFrame(paramFrame,respHeader,
+                                     getState(respHeader),fcFrame);
+    }
+
+    void IsoTpFlowControl::Clear()
+    {
+        m_tableEcus.clear();
+    }
+
+    ubyte IsoTpFlowControl::EncodeStMin(quint32 const stMinUs)
+    {
+        if(stMinUs >= 1000)   {
+            return ubyte(qMin(stMinUs/1000,quint32(0x7F)));
+        }
+        if(stMinUs >= 100)   {
+            return ubyte(0xF0 + stMinUs/100);
+        }
+        return 0x00;
+    }
+
+    quint32 IsoTpFlowControl::DecodeStMin(ubyte const stMin)
+    {
+        if(stMin <= 0x7F)   {
+            return quint32(stMin)*1000;
+        }
+        if(stMin >= 0xF1 && stMin <= 0xF9)   {
+            return quint32(stMin-0xF0)*100;
+        }
+        // reserved values are treated as the max
+        return MAX_STMIN_US;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    IsoTpFlowControl::EcuState & IsoTpFlowControl::getState(ByteList const &respHeader)
+    {
+        QByteArray const key = getKey(respHeader);
+        QHash<QByteArray,EcuState>::iterator it = m_tableEcus.find(key);
+        if(it != m_tableEcus.end())   {
+            return it.value();
+        }
+
+        EcuState state;
+        state.cfgBlockSize = m_defBlockSize;
+        state.cfgStMinUs = m_defStMinUs;
+        state.blockSize = m_defBlockSize;
+        state.stMinUs = m_defStMinUs;
+        state.okTransfers = 0;
+        state.active = false;
+        state.bytesLeft = 0;
+        state.nextSeqNum = 0;
+        state.framesLeftInBlock = 0;
+        state.lastFrameMs = 0;
+        return m_tableEcus.insert(key,state).value();
+    }
+
+    void IsoTpFlowControl::endTransfer(EcuState &state,
+                                       bool const transferOk)
+    {
+        state.active = false;
+        if(!m_adaptive)   {
+            return;
+        }
+
+        if(transferOk)   {
+            state.okTransfers++;
+            if(state.okTransfers >= ADAPT_OK_TRANSFERS &&
+               state.stMinUs > state.cfgStMinUs)   {
+                quint32 stMinUs = state.stMinUs/2;
+                if(stMinUs < 100)   {
+                    stMinUs = 0;
+                }
+                state.stMinUs = qMax(stMinUs,state.cfgStMinUs);
+                state.okTransfers = 0;
+            }
+        }
+        else   {
+            quint32 const stMinUs = (state.stMinUs < ADAPT_FIRST_STMIN_US) ?
+                ADAPT_FIRST_STMIN_US : state.stMinUs*2;
+            state.stMinUs = qMin(stMinUs,MAX_STMIN_US);
+            state.okTransfers = 0;
+        }
+    }
+
+    bool IsoTpFlowControl::buildFlowControlFrame(ParameterFrame const &paramFrame,
+                                                 ByteList const &respHeader,
+                                                 EcuState const &state,
+                                                 ByteList &fcFrame) const
+    {
+        fcFrame.clear();
+        if(paramFrame.iso15765_extendedId)   {
+            // [prio] [format] [target] [source]
+            if(respHeader.size() != 4)   {
+                return false;
+            }
+            fcFrame << respHeader[0] << respHeader[1]
+                    << respHeader[3] << respHeader[2];
+        }
+        else   {
+            // [11-bit identifier]: the physical request id
+            // for OBD responses 0x7E8-0x7EF is 8 less
+            if(respHeader.size() != 2)   {
+                return false;
+            }
+            quint32 const respId = (quint32(respHeader[0]) << 8) | respHeader[1];
+            if(respId >= 0x7E8 && respId <= 0x7EF)   {
+                quint32 const reqId = respId-8;
+                fcFrame << ubyte(reqId >> 8) << ubyte(reqId & 0xFF);
+            }
+            else if(!paramFrame.listMessageData.isEmpty() &&
+                    paramFrame.listMessageData[0].reqHeaderBytes.size() == 2)   {
+                fcFrame << paramFrame.listMessageData[0].reqHeaderBytes;
+            }
+            else   {
+                OBDREFERROR << "Error: IsoTpFlowControl: no flow "
+                               "control id for" << respId;
+                return false;
+            }
+        }
+
+        // [0x30: continue to send] [BS] [STmin] [padding]
+        fcFrame << 0x30 << state.blockSize << EncodeStMin(state.stMinUs);
+        for(int i=0; i < 5; i++)   {
+            fcFrame << 0x00;
+        }
+        return true;
+    }
+
+    QByteArray IsoTpFlowControl::getKey(ByteList const &respHeader) const
+    {
+        QByteArray key;
+        for(int i=0; i < respHeader.size(); i++)   {
+            key.append(char(respHeader[i]));
+        }
+        return key;
+    }
+}
@@ -0,0 +1,155 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef ISOTPFLOWCONTROL_H
+#define ISOTPFLOWCONTROL_H
+
+#include <QHash>
+
+#include "datatypes.h"
+#include "obdrefdebug.h"
+
+namespace obdref
+{
+
+// IsoTpFlowControl
+// * generates the flow control frames (pci 0x3N) a
+//   receiver has to send for ISO 15765 multi-frame
+//   responses, when frames are sent and received
+//   directly (ie. with SocketCanReader) instead of
+//   through an adapter that does it itself
+// * the block size (BS, consecutive frames between
+//   flow control frames, 0 for no limit) and minimum
+//   separation time (STmin) are kept per ecu (response
+//   header); by default BS is 0 and STmin is 0 so ecus
+//   send as fast as they can
+// * when adaptive, STmin is doubled whenever a transfer
+//   from an ecu loses frames or times out, and halved
+//   again (down to the configured value) after a number
+//   of transfers complete without errors
+class IsoTpFlowControl
+{
+public:
+    IsoTpFlowControl();
+
+    // SetDefaults
+    // * BS and STmin (in microseconds) used for ecus
+    //   that haven't been set with SetParameters
+    void SetDefaults(ubyte const blockSize,
+                     quint32 const stMinUs);
+
+    // SetParameters
+    // * BS and STmin for a single ecu
+    void SetParameters(ByteList const &respHeader,
+                       ubyte const blockSize,
+                       quint32 const stMinUs);
+
+    // SetAdaptive
+    void SetAdaptive(bool const adaptive);
+
+    // ProcessFrame
+    // * tracks a received frame ([header] [data]) of
+    //   paramFrame's ISO 15765 responses
+    // * returns true if a flow control frame should be
+    //   sent now (after a first frame, or when the last
+    //   consecutive frame of a block is received) and
+    //   saves it to fcFrame ([header] [data], with the
+    //   data padded to 8 bytes)
+    bool ProcessFrame(ParameterFrame const &paramFrame,
+                      ByteList const &rawFrame,
+                      qint64 const timeMs,
+                      ByteList &fcFrame);
+
+    // CheckTimeouts
+    // * ends transfers that haven't received a consecutive
+    //   frame within N_Cr (1000ms) of timeMs and returns
+    //   how many were ended
+    int CheckTimeouts(qint64 const timeMs);
+
+    // GetFramesUntilFlowControl
+    // * returns the number of consecutive frames an
+    //   ecu still has to send before the next flow
+    //   control frame is due, or -1 if there's no
+    //   transfer in progress or no block size
+    int GetFramesUntilFlowControl(ByteList const &respHeader) const;
+
+    // GetBlockSize / GetStMinUs
+    // * current values for an ecu
+    ubyte GetBlockSize(ByteList const &respHeader) const;
+    quint32 GetStMinUs(ByteList const &respHeader) const;
+
+    // BuildFlowControlFrame
+    // * saves the flow control frame an ecu would currently
+    //   be sent to fcFrame without tracking a transfer (ie.
+    //   to set up an adapter with Elm327Codec)
+    bool BuildFlowControlFrame(ParameterFrame const &paramFrame,
+                               ByteList const &respHeader,
+                               ByteList &fcFrame);
+
+    // Clear
+    // * forgets every ecu's parameters and transfers
+    void Clear();
+
+    // EncodeStMin / DecodeStMin
+    // * convert STmin between microseconds and its byte
+    //   value (0x00-0x7F: ms, 0xF1-0xF9: 100-900us);
+    //   times are rounded down to what can be sent
+    static ubyte EncodeStMin(quint32 const stMinUs);
+    static quint32 DecodeStMin(ubyte const stMin);
+
+private:
+    struct EcuState
+    {
+        // parameters
+        ubyte       cfgBlockSize;
+        quint32     cfgStMinUs;
+        ubyte       blockSize;
+        quint32     stMinUs;
+        int         okTransfers;    // since STmin was last changed
+
+        // current transfer
+        bool        active;
+        int         bytesLeft;
+        ubyte       nextSeqNum;
+        int         framesLeftInBlock;
+        qint64      lastFrameMs;
+    };
+
+    EcuState & getState(ByteList const &respHeader);
+
+    void endTransfer(EcuState &state,
+                     bool const transferOk);
+
+    bool buildFlowControlFrame(ParameterFrame const &paramFrame,
+                               ByteList const &respHeader,
+                               EcuState const &state,
+                               ByteList &fcFrame) const;
+
+    QByteArray getKey(ByteList const &respHeader) const;
+
+    ubyte m_defBlockSize;
+    quint32 m_defStMinUs;
+    bool m_adaptive;
+
+    // [response header] -> state
+    QHash<QByteArray,EcuState> m_tableEcus;
+};
+
+}
+
+#endif // ISOTPFLOWCONTROL_H
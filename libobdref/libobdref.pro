@@ -8,12 +8,52 @@ HEADERS += \
     pugixml/pugixml.hpp \
     obdrefdebug.h \
     datatypes.h \
-    parser.h
+    framefilter.h \
+    parser.h \
+    framedispatcher.h \
+    pollscheduler.h \
+    bustimingmodel.h \
+    supportedpids.h \
+    respondermap.h \
+    elm327codec.h \
+    isotpflowcontrol.h \
+    parseprofiler.h \
+    framecapture.h \
+    batchdecoder.h \
+    logimporter.h \
+    timeseriesstore.h
 
 SOURCES += \
     pugixml/pugixml.cpp \
     duktape/duktape.c \
     obdrefdebug.cpp \
-    parser.cpp
+    framefilter.cpp \
+    parser.cpp \
+    framedispatcher.cpp \
+    pollscheduler.cpp \
+    bustimingmodel.cpp \
+    supportedpids.cpp \
+    respondermap.cpp \
+    elm327codec.cpp \
+    isotpflowcontrol.cpp \
+    parseprofiler.cpp \
+    framecapture.cpp \
+    batchdecoder.cpp \
+    logimporter.cpp \
+    timeseriesstore.cpp
+
+# SocketCAN is only available on Linux
+linux {
+    HEADERS += socketcanreader.h
+    SOURCES += socketcanreader.cpp
+}
 
 DEFINES += OBDREF_DEBUG_QDEBUG
+
+# uncomment to record stage latencies to each
+# Parser's ParseProfiler (see Parser::GetProfiler)
+# DEFINES += OBDREF_PROFILE
+
+# FrameFilter uses SSE2 when available (always on
+# x86_64); uncomment to use AVX2 instead
+# QMAKE_CXXFLAGS += -mavx2
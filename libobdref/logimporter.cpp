@@ -0,0 +1,534 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include <cstring>
+
+#include "logimporter.h"
+
+namespace obdref
+{
+    // lines checked to detect the format of a log
+    static int const LOG_DETECT_LINES = 32;
+
+    // largest valid 29-bit CAN id; candump sets the bits
+    // above it for error (and remote) frames
+    static quint32 const CAN_EXT_ID_MAX = 0x1FFFFFFF;
+    static quint32 const CAN_STD_ID_MAX = 0x7FF;
+
+    // data bytes in a classic CAN frame
+    static int const CAN_MAX_DLEN = 8;
+
+    // channels are saved in a byte
+    static int const LOG_MAX_CHANNELS = 256;
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    static inline int hexValue(char const c)
+    {
+        if(c >= '0' && c <= '9')   { return c-'0'; }
+        if(c >= 'A' && c <= 'F')   { return c-'A'+10; }
+        if(c >= 'a' && c <= 'f')   { return c-'a'+10; }
+        return -1;
+    }
+
+    static inline bool isSpace(char const c)
+    {
+        return (c == ' ' || c == '\t');
+    }
+
+    static inline char const * skipSpaces(char const * p,
+                                          char const * end)
+    {
+        while(p < end && isSpace(*p))   {
+            p++;
+        }
+        return p;
+    }
+
+    static inline char const * tokenEnd(char const * p,
+                                        char const * end)
+    {
+        while(p < end && !isSpace(*p))   {
+            p++;
+        }
+        return p;
+    }
+
+    static inline bool startsWith(char const * p,
+                                  char const * end,
+                                  char const * str)
+    {
+        int const length = int(strlen(str));
+        return (end-p >= length && memcmp(p,str,length) == 0);
+    }
+
+    // parseUnsigned
+    // * reads all of [p,end) as a number in base 16
+    //   or 10; returns false if it's empty, too long
+    //   or has any other character
+    static bool parseUnsigned(char const * p,
+                              char const * end,
+                              bool const hex,
+                              quint32 &value)
+    {
+        if(p == end || end-p > ((hex) ? 8 : 10))   {
+            return false;
+        }
+        quint64 result=0;
+        for(; p < end; p++)   {
+            int digit = (hex) ? hexValue(*p) : int(*p-'0');
+            if(digit < 0 || (!hex && digit > 9))   {
+                return false;
+            }
+            result = result*((hex) ? 16 : 10) + quint64(digit);
+        }
+        if(result > 0xFFFFFFFF)   {
+            return false;
+        }
+        value = quint32(result);
+        return true;
+    }
+
+    // parseSeconds
+    // * reads a timestamp in seconds with up to nine
+    //   decimal places (ie. 1436509052.249713) from p
+    //   and saves it in us; returns the position after
+    //   it or NULL if there's no timestamp
+    static char const * parseSeconds(char const * p,
+                                     char const * end,
+                                     qint64 &timestampUs)
+    {
+        qint64 sec=0;
+        char const * start = p;
+        while(p < end && *p >= '0' && *p <= '9' && p-start < 12)   {
+            sec = sec*10 + (*p-'0');
+            p++;
+        }
+        if(p == start)   {
+            return NULL;
+        }
+
+        qint64 usec=0;
+        int numDigits=0;
+        if(p < end && *p == '.')   {
+            p++;
+            while(p < end && *p >= '0' && *p <= '9')   {
+                if(numDigits < 6)   {
+                    usec = usec*10 + (*p-'0');
+                    numDigits++;
+                }
+                p++;
+            }
+        }
+        for(; numDigits < 6; numDigits++)   {
+            usec *= 10;
+        }
+        timestampUs = sec*1000000 + usec;
+        return p;
+    }
+
+    // appendId
+    // * saves a CAN id as the header of rawFrame
+    static void appendId(quint32 const id,
+                         bool const extended,
+                         CapturedFrame &frame)
+    {
+        frame.rawFrame.clear();
+        if(extended)   {
+            frame.rawFrame.append(ubyte(id >> 24));
+            frame.rawFrame.append(ubyte(id >> 16));
+        }
+        frame.rawFrame.append(ubyte(id >> 8));
+        frame.rawFrame.append(ubyte(id));
+        frame.headerLength = (extended) ? 4 : 2;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    LogImporter::LogImporter() :
+        m_data(NULL),
+        m_size(0),
+        m_pos(0),
+        m_format(LOG_FORMAT_AUTO),
+        m_startTimeMs(0),
+        m_firstTimestampUs(-1),
+        m_prevTimestampUs(0),
+        m_numLines(0),
+        m_numSkippedLines(0),
+        m_ascHex(true),
+        m_ascRelative(false)
+    {}
+
+    LogImporter::~LogImporter()
+    {
+        Close();
+    }
+
+    bool LogImporter::Open(QString const &filePath,
+                           LogFormat const format)
+    {
+        Close();
+
+        m_file.setFileName(filePath);
+        if(!m_file.open(QIODevice::ReadOnly))   {
+            OBDREFERROR << "Error: LogImporter: could not open" << filePath;
+            return false;
+        }
+
+        m_size = m_file.size();
+        if(m_size > 0)   {
+            m_data = m_file.map(0,m_size);
+        }
+        if(m_data == NULL)   {
+            OBDREFERROR << "Error: LogImporter: could not map" << filePath;
+            Close();
+            return false;
+        }
+
+        m_format = (format == LOG_FORMAT_AUTO) ? detectFormat() : format;
+        if(m_format == LOG_FORMAT_AUTO)   {
+            OBDREFERROR << "Error: LogImporter:" << filePath
+                        << "is not a candump or ASC log";
+            Close();
+            return false;
+        }
+
+        // timestamps are from the first frame, so
+        // find it before anything else is read
+        CapturedFrame frame;
+        Rewind();
+        if(ReadNext(frame) && m_format == LOG_FORMAT_CANDUMP)   {
+            m_startTimeMs = m_firstTimestampUs/1000;
+        }
+        Rewind();
+        return true;
+    }
+
+    void LogImporter::Close()
+    {
+        if(m_data != NULL)   {
+            m_file.unmap(const_cast<uchar*>(m_data));
+            m_data = NULL;
+        }
+        if(m_file.isOpen())   {
+            m_file.close();
+        }
+        m_size = 0;
+        m_format = LOG_FORMAT_AUTO;
+        m_startTimeMs = 0;
+        m_firstTimestampUs = -1;
+        Rewind();
+    }
+
+    void LogImporter::Rewind()
+    {
+        m_pos = 0;
+        m_prevTimestampUs = 0;
+        m_numLines = 0;
+        m_numSkippedLines = 0;
+        m_listChannelNames.clear();
+        m_ascHex = true;
+        m_ascRelative = false;
+    }
+
+    bool LogImporter::ReadNext(CapturedFrame &frame)
+    {
+        char const * data = reinterpret_cast<char const*>(m_data);
+        while(m_pos < m_size)   {
+            char const * line = data+m_pos;
+            char const * end = static_cast<char const*>(
+                memchr(line,'\n',size_t(m_size-m_pos)));
+
+            if(end == NULL)   {
+                end = data+m_size;
+                m_pos = m_size;
+            }
+            else   {
+                m_pos = (end-data)+1;
+            }
+            if(end > line && end[-1] == '\r')   {
+                end--;
+            }
+            m_numLines++;
+
+            bool const frameOk = (m_format == LOG_FORMAT_CANDUMP) ?
+                readLine_Candump(line,end,frame) :
+                readLine_Asc(line,end,frame);
+
+            if(frameOk)   {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    qint64 LogImporter::ConvertToCapture(QString const &filePath)
+    {
+        if(!IsOpen())   {
+            return -1;
+        }
+
+        CaptureWriter writer;
+        if(!writer.Open(filePath,m_startTimeMs))   {
+            return -1;
+        }
+
+        Rewind();
+        CapturedFrame frame;
+        while(ReadNext(frame))   {
+            if(!writer.WriteFrame(frame.timestampUs,frame.channel,
+                                  frame.headerLength,frame.rawFrame))   {
+                return -1;
+            }
+        }
+        if(!writer.Close())   {
+            return -1;
+        }
+        return qint64(writer.GetFrameCount());
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    LogFormat LogImporter::detectFormat() const
+    {
+        char const * data = reinterpret_cast<char const*>(m_data);
+        char const * end = data+m_size;
+        char const * line = data;
+
+        for(int i=0; i < LOG_DETECT_LINES && line < end; i++)   {
+            char const * lineEnd = static_cast<char const*>(
+                memchr(line,'\n',size_t(end-line)));
+            if(lineEnd == NULL)   {
+                lineEnd = end;
+            }
+
+            char const * p = skipSpaces(line,lineEnd);
+            if(p < lineEnd && *p == '(')   {
+                return LOG_FORMAT_CANDUMP;
+            }
+            if(startsWith(p,lineEnd,"date ") ||
+               startsWith(p,lineEnd,"base ") ||
+               startsWith(p,lineEnd,"Begin Triggerblock"))   {
+                return LOG_FORMAT_ASC;
+            }
+            line = lineEnd+1;
+        }
+        return LOG_FORMAT_AUTO;
+    }
+
+    bool LogImporter::readLine_Candump(char const * line,
+                                       char const * end,
+                                       CapturedFrame &frame)
+    {
+        // (1436509052.249713) can0 18DAF110#0762F41001020304
+        char const * p = skipSpaces(line,end);
+        if(p == end || *p != '(')   {
+            return false;
+        }
+
+        qint64 timestampUs=0;
+        p = parseSeconds(p+1,end,timestampUs);
+        if(p == NULL || p == end || *p != ')')   {
+            m_numSkippedLines++;
+            return false;
+        }
+
+        // interface
+        char const * iface = skipSpaces(p+1,end);
+        char const * ifaceEnd = tokenEnd(iface,end);
+
+        // id#data
+        char const * id = skipSpaces(ifaceEnd,end);
+        char const * idEnd = id;
+        while(idEnd < end && *idEnd != '#' && !isSpace(*idEnd))   {
+            idEnd++;
+        }
+
+        quint32 canId=0;
+        bool const extended = (idEnd-id == 8);
+        if(iface == ifaceEnd || idEnd == end || *idEnd != '#' ||
+           (idEnd-id != 3 && !extended) ||
+           !parseUnsigned(id,idEnd,true,canId) ||
+           canId > CAN_EXT_ID_MAX)   {
+            m_numSkippedLines++;
+            return false;
+        }
+
+        // remote (#R) and CAN FD (##) frames
+        p = idEnd+1;
+        if(p < end && (*p == 'R' || *p == '#'))   {
+            m_numSkippedLines++;
+            return false;
+        }
+
+        appendId(canId,extended,frame);
+        int numBytes=0;
+        while(p < end && !isSpace(*p))   {
+            if(*p == '.')   {
+                p++;
+                continue;
+            }
+            int const hi = hexValue(*p);
+            int const lo = (p+1 < end) ? hexValue(p[1]) : -1;
+            if(hi < 0 || lo < 0 || numBytes == CAN_MAX_DLEN)   {
+                m_numSkippedLines++;
+                return false;
+            }
+            frame.rawFrame.append(ubyte((hi << 4) | lo));
+            numBytes++;
+            p += 2;
+        }
+
+        // channels are numbered by interface in the order
+        // they're first seen; names are only copied once
+        int const ifaceLength = int(ifaceEnd-iface);
+        int channel=0;
+        for(; channel < m_listChannelNames.size(); channel++)   {
+            QByteArray const &name = m_listChannelNames[channel];
+            if(name.size() == ifaceLength &&
+               memcmp(name.constData(),iface,ifaceLength) == 0)   {
+                break;
+            }
+        }
+        if(channel == m_listChannelNames.size())   {
+            if(channel == LOG_MAX_CHANNELS)   {
+                m_numSkippedLines++;
+                return false;
+            }
+            m_listChannelNames.append(QByteArray(iface,ifaceLength));
+        }
+
+        frame.channel = ubyte(channel);
+        setTimestamp(timestampUs,frame);
+        return true;
+    }
+
+    bool LogImporter::readLine_Asc(char const * line,
+                                   char const * end,
+                                   CapturedFrame &frame)
+    {
+        //    0.008000 1  18DAF110x       Rx   d 8 07 62 F4 10 01 02 03 04
+        char const * p = skipSpaces(line,end);
+        if(p == end)   {
+            return false;
+        }
+
+        if(*p < '0' || *p > '9')   {
+            // header lines; only the number base and
+            // timestamp type change how lines are read
+            if(startsWith(p,end,"base "))   {
+                p = skipSpaces(p+5,end);
+                m_ascHex = !startsWith(p,end,"dec");
+                p = skipSpaces(tokenEnd(p,end),end);
+                if(startsWith(p,end,"timestamps "))   {
+                    p = skipSpaces(p+11,end);
+                    m_ascRelative = startsWith(p,end,"relative");
+                }
+            }
+            return false;
+        }
+
+        qint64 timestampUs=0;
+        p = parseSeconds(p,end,timestampUs);
+        if(p == NULL)   {
+            m_numSkippedLines++;
+            return false;
+        }
+        if(m_ascRelative)   {
+            timestampUs += m_prevTimestampUs;
+        }
+        m_prevTimestampUs = timestampUs;
+
+        // channel (CAN FD and other events have a
+        // name here instead of a channel number)
+        quint32 channel=0;
+        p = skipSpaces(p,end);
+        char const * tokEnd = tokenEnd(p,end);
+        if(!parseUnsigned(p,tokEnd,false,channel) ||
+           channel >= quint32(LOG_MAX_CHANNELS))   {
+            m_numSkippedLines++;
+            return false;
+        }
+
+        // id, with an 'x' suffix for 29-bit ids
+        // (ErrorFrame and other events here too)
+        p = skipSpaces(tokEnd,end);
+        tokEnd = tokenEnd(p,end);
+        bool extended = (tokEnd > p && (tokEnd[-1] == 'x' || tokEnd[-1] == 'X'));
+        quint32 canId=0;
+        if(!parseUnsigned(p,(extended) ? tokEnd-1 : tokEnd,m_ascHex,canId) ||
+           canId > CAN_EXT_ID_MAX)   {
+            m_numSkippedLines++;
+            return false;
+        }
+        extended = (extended || canId > CAN_STD_ID_MAX);
+
+        // direction
+        p = skipSpaces(tokEnd,end);
+        tokEnd = tokenEnd(p,end);
+        if(tokEnd-p != 2 || (memcmp(p,"Rx",2) != 0 && memcmp(p,"Tx",2) != 0))   {
+            m_numSkippedLines++;
+            return false;
+        }
+
+        // 'd' for data frames, 'r' for remote frames
+        p = skipSpaces(tokEnd,end);
+        tokEnd = tokenEnd(p,end);
+        if(tokEnd-p != 1 || *p != 'd')   {
+            m_numSkippedLines++;
+            return false;
+        }
+
+        quint32 dlc=0;
+        p = skipSpaces(tokEnd,end);
+        tokEnd = tokenEnd(p,end);
+        if(!parseUnsigned(p,tokEnd,true,dlc) || dlc > quint32(CAN_MAX_DLEN))   {
+            m_numSkippedLines++;
+            return false;
+        }
+
+        appendId(canId,extended,frame);
+        for(quint32 i=0; i < dlc; i++)   {
+            quint32 value=0;
+            p = skipSpaces(tokEnd,end);
+            tokEnd = tokenEnd(p,end);
+            if(!parseUnsigned(p,tokEnd,m_ascHex,value) || value > 0xFF)   {
+                m_numSkippedLines++;
+                return false;
+            }
+            frame.rawFrame.append(ubyte(value));
+        }
+
+        frame.channel = ubyte(channel);
+        setTimestamp(timestampUs,frame);
+        return true;
+    }
+
+    void LogImporter::setTimestamp(qint64 const logTimestampUs,
+                                   CapturedFrame &frame)
+    {
+        if(m_firstTimestampUs < 0)   {
+            m_firstTimestampUs = logTimestampUs;
+        }
+        frame.timestampUs = qMax(logTimestampUs-m_firstTimestampUs,qint64(0));
+    }
+}
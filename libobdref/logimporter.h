@@ -0,0 +1,146 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef LOGIMPORTER_H
+#define LOGIMPORTER_H
+
+#include "datatypes.h"
+#include "obdrefdebug.h"
+#include "framecapture.h"
+
+namespace obdref
+{
+
+enum LogFormat
+{
+    LOG_FORMAT_AUTO,        // detected from the first lines of the file
+    LOG_FORMAT_CANDUMP,     // SocketCAN candump -l
+    LOG_FORMAT_ASC          // Vector ASCII (ASC)
+};
+
+// LogImporter
+// * reads CAN frames from SocketCAN candump (-l) and Vector
+//   ASC text logs so they can be replayed and decoded like
+//   a capture (see FrameSource::Replay and BatchDecoder)
+// * the file is mapped and lines are tokenized in place;
+//   each frame is read as [header] [data] with the CAN id
+//   as the header: 2 bytes for 11-bit ids and 4 bytes for
+//   29-bit ids, which is what the ISO 15765 cleaners expect
+// * timestamps are in us from the first frame in the log
+// * channels: candump interfaces are numbered in the order
+//   they're first seen (see GetChannelNames); ASC channels
+//   keep their number
+// * remote, error and CAN FD frames (and any line that
+//   can't be read) are skipped
+class LogImporter : public FrameSource
+{
+public:
+    LogImporter();
+    ~LogImporter();
+
+    // Open
+    // * maps filePath; with LOG_FORMAT_AUTO the format is
+    //   detected from the first lines of the file
+    bool Open(QString const &filePath,
+              LogFormat const format=LOG_FORMAT_AUTO);
+
+    void Close();
+
+    bool IsOpen() const
+    {   return (m_data != NULL);   }
+
+    LogFormat GetFormat() const
+    {   return m_format;   }
+
+    // GetStartTimeMs
+    // * wall clock time of the first frame (ms since
+    //   epoch) for candump logs, 0 for ASC logs
+    qint64 GetStartTimeMs() const
+    {   return m_startTimeMs;   }
+
+    // Rewind
+    // * moves back to the first line (and resets
+    //   the line counts and channel names)
+    void Rewind();
+
+    // ReadNext
+    // * reads the next CAN frame into frame; returns
+    //   false once there are none left
+    bool ReadNext(CapturedFrame &frame);
+
+    // ConvertToCapture
+    // * rewinds and writes every frame to a capture file
+    //   at filePath so the log can be replayed and seeked
+    //   with a CaptureReader
+    // * returns the number of frames written or -1
+    //   if there was an error
+    qint64 ConvertToCapture(QString const &filePath);
+
+    // GetChannelNames
+    // * candump interface names (ie. can0) by channel,
+    //   for the lines read so far
+    QList<QByteArray> const & GetChannelNames() const
+    {   return m_listChannelNames;   }
+
+    // GetLineCount
+    // * lines read so far (since the last Rewind)
+    qint64 GetLineCount() const
+    {   return m_numLines;   }
+
+    // GetSkippedLineCount
+    // * lines read so far that had a timestamp but no
+    //   CAN data frame that could be imported
+    qint64 GetSkippedLineCount() const
+    {   return m_numSkippedLines;   }
+
+private:
+    LogFormat detectFormat() const;
+
+    bool readLine_Candump(char const * line,
+                          char const * end,
+                          CapturedFrame &frame);
+
+    bool readLine_Asc(char const * line,
+                      char const * end,
+                      CapturedFrame &frame);
+
+    void setTimestamp(qint64 const logTimestampUs,
+                      CapturedFrame &frame);
+
+    QFile m_file;
+    uchar const * m_data;
+    qint64 m_size;
+    qint64 m_pos;
+    LogFormat m_format;
+
+    qint64 m_startTimeMs;
+    qint64 m_firstTimestampUs;      // log time of the first frame
+    qint64 m_prevTimestampUs;       // log time of the previous timestamped line
+    qint64 m_numLines;
+    qint64 m_numSkippedLines;
+    QList<QByteArray> m_listChannelNames;
+
+    // ASC settings (from the file header)
+    bool m_ascHex;                  // 'base hex' (otherwise dec)
+    bool m_ascRelative;             // 'timestamps relative'
+};
+
+}
+
+#endif // LOGIMPORTER_H
@@ -16,17 +16,248 @@
    limitations under the License.
 */
 
+#include <cstdio>
+#include <cstring>
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QThreadStorage>
+
 #include "obdrefdebug.h"
-#include <QDebug>
 
 namespace obdref
 {
 
+// number of messages each thread can queue before
+// the drain thread empties it (must be a power of 2)
+static int const RING_SIZE = 256;
+
+// time between the drain thread emptying the queues
+static unsigned long const DRAIN_INTERVAL_MS = 20;
+
+// "00" to "99" for converting numbers two
+// digits at a time
+static char const DIGIT_PAIRS[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// DebugRing
+// * a single producer (the thread that owns it), single
+//   consumer (whoever holds g_debug_drain_mutex) queue;
+//   head and tail only ever increase and are masked
+//   to get entry indices
+struct DebugRing
+{
+    struct Entry
+    {
+        qint64 ms;
+        int length;
+        char text[Debug::MAX_MSG_LENGTH];
+    };
+
+    DebugRing() :
+        head(0),
+        tail(0),
+        dropped(0),
+        orphaned(0)
+    {}
+
+    Entry entries[RING_SIZE];
+    QAtomicInt head;
+    QAtomicInt tail;
+    QAtomicInt dropped;
+    QAtomicInt orphaned;    // owning thread has exited
+};
+
+// DebugThreadHandle
+// * deleted by QThreadStorage when its thread exits;
+//   the ring itself is deleted by the drain once
+//   it's been emptied
+struct DebugThreadHandle
+{
+    DebugThreadHandle() :
+        ring(new DebugRing)
+    {}
+
+    ~DebugThreadHandle()
+    {   ring->orphaned.storeRelease(1);   }
+
+    DebugRing * ring;
+};
+
+class DebugDrain : public QThread
+{
+public:
+    DebugDrain() :
+        m_stop(0)
+    {}
+
+    void Stop()
+    {   m_stop.storeRelease(1);   }
+
+protected:
+    void run();
+
+private:
+    QAtomicInt m_stop;
+};
+
 // ================================================================ //
 // ================================================================ //
 
 DebugBroadcast * g_debug_broadcast = new DebugBroadcast;
+
+// guards g_debug_rings and g_debug_drain
 static QMutex * g_debug_mutex = new QMutex;
+static QList<DebugRing*> * g_debug_rings = new QList<DebugRing*>;
+static DebugDrain * g_debug_drain = NULL;
+
+// only one thread empties the rings at a time
+static QMutex * g_debug_drain_mutex = new QMutex;
+
+// messages are emitted after g_debug_drain_mutex is
+// released; this keeps messages from drains in different
+// threads in order, and g_debug_emit_thread lets a
+// receiver call FlushDebug without waiting on itself
+static QMutex * g_debug_emit_mutex = new QMutex;
+static QAtomicPointer<void> g_debug_emit_thread;
+
+// DebugMessage
+// * a message copied out of a ring to be emitted
+struct DebugMessage
+{
+    QString timestamp;
+    QString msg;
+};
+
+static QThreadStorage<DebugThreadHandle*> g_debug_thread_handle;
+
+static DebugRing * getThreadRing()
+{
+    if(!g_debug_thread_handle.hasLocalData())   {
+        DebugThreadHandle * handle = new DebugThreadHandle;
+        g_debug_thread_handle.setLocalData(handle);
+
+        QMutexLocker locker(g_debug_mutex);
+        g_debug_rings->push_back(handle->ring);
+        if(g_debug_drain == NULL)   {
+            g_debug_drain = new DebugDrain;
+            g_debug_drain->start();
+        }
+    }
+    return g_debug_thread_handle.localData()->ring;
+}
+
+static void drainRing(DebugRing * ring,
+                      QList<DebugMessage> &listMessages)
+{
+    int tail = ring->tail.load();
+    int const head = ring->head.loadAcquire();
+    while(tail != head)   {
+        DebugRing::Entry const &entry = ring->entries[tail & (RING_SIZE-1)];
+
+        // timestamp as sss.mmm:
+        qint64 const numSec = entry.ms/1000;
+        qint64 const numMs = entry.ms%1000;
+        char timestamp[32];
+        snprintf(timestamp,sizeof(timestamp),"%03lld.%03lld:",
+                 (long long)numSec,(long long)numMs);
+
+        DebugMessage message;
+        message.timestamp = QString::fromLatin1(timestamp);
+        message.msg = QString::fromLatin1(entry.text,entry.length);
+        listMessages.push_back(message);
+
+        // release the entry once it's been copied
+        tail++;
+        ring->tail.storeRelease(tail);
+    }
+
+    int const numDropped = ring->dropped.load();
+    if(numDropped > 0)   {
+        ring->dropped.fetchAndAddRelaxed(-numDropped);
+        char msg[64];
+        snprintf(msg,sizeof(msg),"Warn: Debug: dropped %d message(s)",numDropped);
+
+        DebugMessage message;
+        message.msg = QString::fromLatin1(msg);
+        listMessages.push_back(message);
+    }
+}
+
+static void drainRings()
+{
+    // called by a receiver of the message being emitted;
+    // the rest is emitted by the next drain
+    if(g_debug_emit_thread.loadAcquire() == QThread::currentThreadId())   {
+        return;
+    }
+    QMutexLocker emitLocker(g_debug_emit_mutex);
+
+    QList<DebugMessage> listMessages;
+    {
+        QMutexLocker drainLocker(g_debug_drain_mutex);
+
+        QList<DebugRing*> listRings;
+        {
+            QMutexLocker locker(g_debug_mutex);
+            listRings = *g_debug_rings;
+        }
+
+        for(int i=0; i < listRings.size(); i++)   {
+            // an orphaned ring won't receive any more
+            // messages once it's been emptied
+            bool const orphaned = (listRings[i]->orphaned.loadAcquire() != 0);
+            drainRing(listRings[i],listMessages);
+            if(orphaned)   {
+                QMutexLocker locker(g_debug_mutex);
+                g_debug_rings->removeAll(listRings[i]);
+                delete listRings[i];
+            }
+        }
+    }
+
+    g_debug_emit_thread.storeRelease(QThread::currentThreadId());
+    for(int i=0; i < listMessages.size(); i++)   {
+        g_debug_broadcast->debug(listMessages[i].timestamp,
+                                 listMessages[i].msg);
+    }
+    g_debug_emit_thread.storeRelease(NULL);
+}
+
+// DebugShutdown
+// * stops the drain thread and broadcasts anything
+//   left over when the library is unloaded
+struct DebugShutdown
+{
+    ~DebugShutdown()
+    {
+        DebugDrain * drain = NULL;
+        {
+            QMutexLocker locker(g_debug_mutex);
+            drain = g_debug_drain;
+        }
+        if(drain)   {
+            drain->Stop();
+            drain->wait();
+            drainRings();
+        }
+    }
+};
+
+static DebugShutdown g_debug_shutdown;
 
 // ================================================================ //
 // ================================================================ //
@@ -47,57 +278,161 @@ qint64 DebugBroadcast::msElapsed()
 // ================================================================ //
 // ================================================================ //
 
-Debug::Debug()
+void DebugDrain::run()
 {
-    m_stream = new QTextStream(&m_byteArray,QIODevice::ReadWrite);
-
-    // for replacing 'bad' ASCII chars
-    for(int i=0; i < 256; i++)   {
-        // ie 0x
-        QByteArray hexcode = QByteArray::number(i,16);
-        if(hexcode.length() < 2)   {
-            hexcode.prepend("0");
-        }
-        hexcode = hexcode.toUpper();
-        hexcode.prepend("<0x");
-        hexcode.append(">");
-        m_listHexCodes.push_back(hexcode);
+    while(m_stop.loadAcquire() == 0)   {
+        drainRings();
+        QThread::msleep(DRAIN_INTERVAL_MS);
     }
 }
 
+// ================================================================ //
+// ================================================================ //
+
 Debug::~Debug()
 {
-    // broadcast
-    g_debug_mutex->lock();
+    DebugRing * ring = getThreadRing();
+
+    // only this thread writes head
+    int const head = ring->head.load();
+    int const tail = ring->tail.loadAcquire();
+    if(uint(head-tail) >= uint(RING_SIZE))   {
+        ring->dropped.fetchAndAddRelaxed(1);
+        return;
+    }
+
+    DebugRing::Entry &entry = ring->entries[head & (RING_SIZE-1)];
+    entry.ms = g_debug_broadcast->msElapsed();
+    entry.length = m_length;
+    memcpy(entry.text,m_buffer,m_length);
+    ring->head.storeRelease(head+1);
+}
+
+Debug & Debug::operator << (char const * str)
+{
+    if(str)   {
+        append(str,int(strlen(str)));
+    }
+    return *this;
+}
+
+Debug & Debug::operator << (QString const &str)
+{
+    int const length = qMin(str.size(),int(MAX_MSG_LENGTH)-m_length);
+    for(int i=0; i < length; i++)   {
+        m_buffer[m_length++] = str.at(i).toLatin1();
+    }
+    return *this;
+}
+
+Debug & Debug::operator << (QByteArray const &str)
+{
+    append(str.constData(),str.size());
+    return *this;
+}
+
+Debug & Debug::operator << (char c)
+{
+    append(&c,1);
+    return *this;
+}
+
+Debug & Debug::operator << (bool b)
+{
+    if(b)   {
+        append("true",4);
+    }
+    else   {
+        append("false",5);
+    }
+    return *this;
+}
+
+Debug & Debug::operator << (unsigned char n)
+{   appendUnsigned(n); return *this;   }
 
-    qint64 ms = g_debug_broadcast->msElapsed();
-    qint64 numsec = ms/1000;
-    qint64 numms = ms%1000;
+Debug & Debug::operator << (short n)
+{   appendSigned(n); return *this;   }
 
-    QString s_numsec = QString::number(numsec,10);
-    while(s_numsec.size() < 3) { s_numsec.prepend("0"); }
+Debug & Debug::operator << (unsigned short n)
+{   appendUnsigned(n); return *this;   }
 
-    QString s_numms = QString::number(numms,10);
-    while(s_numms.size() < 3) { s_numms.prepend("0"); }
+Debug & Debug::operator << (int n)
+{   appendSigned(n); return *this;   }
 
-    QString timestamp = s_numsec+"."+s_numms+":";
+Debug & Debug::operator << (unsigned int n)
+{   appendUnsigned(n); return *this;   }
+
+Debug & Debug::operator << (long n)
+{   appendSigned(n); return *this;   }
+
+Debug & Debug::operator << (unsigned long n)
+{   appendUnsigned(n); return *this;   }
+
+Debug & Debug::operator << (long long n)
+{   appendSigned(n); return *this;   }
+
+Debug & Debug::operator << (unsigned long long n)
+{   appendUnsigned(n); return *this;   }
+
+Debug & Debug::operator << (double n)
+{
+    char str[32];
+    int const length = snprintf(str,sizeof(str),"%g",n);
+    if(length > 0)   {
+        append(str,qMin(length,int(sizeof(str))-1));
+    }
+    return *this;
+}
 
-    m_stream->flush();
-    g_debug_broadcast->debug(timestamp,m_byteArray);
+void Debug::append(char const * str,int const length)
+{
+    int const numChars = qMin(length,int(MAX_MSG_LENGTH)-m_length);
+    if(numChars > 0)   {
+        memcpy(m_buffer+m_length,str,numChars);
+        m_length += numChars;
+    }
+}
 
-    g_debug_mutex->unlock();
+void Debug::appendUnsigned(quint64 n)
+{
+    // write digits backwards from the end
+    char str[20];
+    int idx = sizeof(str);
+    while(n >= 100)   {
+        int const pairIdx = int(n%100)*2;
+        n /= 100;
+        str[--idx] = DIGIT_PAIRS[pairIdx+1];
+        str[--idx] = DIGIT_PAIRS[pairIdx];
+    }
+    if(n >= 10)   {
+        int const pairIdx = int(n)*2;
+        str[--idx] = DIGIT_PAIRS[pairIdx+1];
+        str[--idx] = DIGIT_PAIRS[pairIdx];
+    }
+    else   {
+        str[--idx] = char('0'+n);
+    }
+    append(str+idx,int(sizeof(str))-idx);
+}
 
-    // clean up
-    delete m_stream;
+void Debug::appendSigned(qint64 n)
+{
+    if(n < 0)   {
+        append("-",1);
+        appendUnsigned(quint64(0)-quint64(n));
+    }
+    else   {
+        appendUnsigned(quint64(n));
+    }
 }
 
 // ================================================================ //
 // ================================================================ //
 
-template<typename T>
-DebugBlackHole & DebugBlackHole::operator << (T const &spaceShip)
+void FlushDebug()
 {
-    return *this;
+    drainRings();
 }
 
 // ================================================================ //
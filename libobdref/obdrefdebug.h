@@ -20,15 +20,19 @@
 #define OBDREF_DEBUG_H
 
 #include <QObject>
-#include <QMutex>
-#include <QIODevice>
-#include <QTextStream>
 #include <QElapsedTimer>
-#include <QList>
+#include <QString>
+#include <QByteArray>
 
 namespace obdref
 {
 
+// DebugBroadcast
+// * emits debug messages when OBDREF_DEBUG_BROADCAST is
+//   defined; messages are emitted from a background
+//   thread that drains the per-thread queues Debug
+//   writes to, so receivers in other threads should
+//   use queued connections
 class DebugBroadcast : public QObject
 {
     Q_OBJECT
@@ -46,24 +50,64 @@ private:
     QElapsedTimer m_timer;
 };
 
+// Debug
+// * builds a single message in a fixed size buffer and
+//   queues it (without locking or allocating) to a ring
+//   buffer owned by the calling thread when it goes out
+//   of scope; messages longer than the buffer are cut
+//   and messages that don't fit in a full ring are
+//   dropped (and counted)
 class Debug
 {
 public:
-    Debug();
+    Debug() :
+        m_length(0)
+    {}
+
     ~Debug();
 
-    QTextStream * m_stream;
+    Debug & operator << (char const * str);
+    Debug & operator << (QString const &str);
+    Debug & operator << (QByteArray const &str);
+    Debug & operator << (char c);
+    Debug & operator << (bool b);
+    Debug & operator << (unsigned char n);
+    Debug & operator << (short n);
+    Debug & operator << (unsigned short n);
+    Debug & operator << (int n);
+    Debug & operator << (unsigned int n);
+    Debug & operator << (long n);
+    Debug & operator << (unsigned long n);
+    Debug & operator << (long long n);
+    Debug & operator << (unsigned long long n);
+    Debug & operator << (double n);
+
+    // max length of a single message
+    enum { MAX_MSG_LENGTH = 240 };
 
 private:
-    QByteArray m_byteArray;
-    QList<QByteArray> m_listHexCodes;
+    void append(char const * str,int const length);
+    void appendUnsigned(quint64 n);
+    void appendSigned(qint64 n);
+
+    char m_buffer[MAX_MSG_LENGTH];
+    int m_length;
 };
 
+// FlushDebug
+// * broadcasts every queued message right away (from
+//   the calling thread), ie. before exiting
+// * does nothing when called from a receiver connected
+//   directly to DebugBroadcast::debug; its messages are
+//   broadcast by the next drain instead
+void FlushDebug();
+
 class DebugBlackHole
 {
 public:
     template<typename T>
-    DebugBlackHole& operator << (T const & spaceShip);
+    DebugBlackHole& operator << (T const &)
+    {   return *this;   }
 };
 
 extern DebugBroadcast * g_debug_broadcast;
@@ -71,10 +115,11 @@ extern DebugBroadcast * g_debug_broadcast;
 }
 
 #ifdef OBDREF_DEBUG_BROADCAST
-#define OBDREFDEBUG    (*(obdref::Debug().m_stream))
+#define OBDREFDEBUG    obdref::Debug()
 #endif
 
 #ifdef OBDREF_DEBUG_QDEBUG
+#include <QDebug>
 #define OBDREFDEBUG    qDebug() << "OBDREF:"
 #endif
 
@@ -82,4 +127,22 @@ extern DebugBroadcast * g_debug_broadcast;
 #define OBDREFDEBUG    obdref::DebugBlackHole()
 #endif
 
+// OBDREF_DEBUG_LEVEL
+// * messages logged with OBDREFERROR, OBDREFWARN and
+//   OBDREFINFO are compiled out entirely (including
+//   their arguments) when their level is above
+//   OBDREF_DEBUG_LEVEL; 0 removes all of them,
+//   1 keeps errors, 2 (default) keeps warnings
+//   and 3 keeps info messages
+#ifndef OBDREF_DEBUG_LEVEL
+#define OBDREF_DEBUG_LEVEL 2
+#endif
+
+#define OBDREF_DEBUG_AT(level) \
+    if((level) > OBDREF_DEBUG_LEVEL) {} else OBDREFDEBUG
+
+#define OBDREFERROR    OBDREF_DEBUG_AT(1)
+#define OBDREFWARN     OBDREF_DEBUG_AT(2)
+#define OBDREFINFO     OBDREF_DEBUG_AT(3)
+
 #endif // OBDREF_DEBUG_H
@@ -0,0 +1,338 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cstring>
+
+#include <QPair>
+#include <QtAlgorithms>
+
+#include "parseprofiler.h"
+
+namespace obdref
+{
+    // values below this have a bucket each
+    static quint64 const NUM_EXACT_VALUES = 32;
+
+    // highest bit that gets its own set of sub-buckets
+    static int const MAX_VALUE_BIT = 39;
+
+    static char const * const STAGE_NAMES[PROFILE_NUM_STAGES] = {
+        "build",
+        "clean",
+        "js_marshal",
+        "js_call",
+        "save_results"
+    };
+
+    static int getHighestBit(quint64 value)
+    {
+#if defined(__GNUC__)
+        return 63-__builtin_clzll(value);
+#else
+        int bit=0;
+        while(value >>= 1)   {
+            bit++;
+        }
+        return bit;
+#endif
+    }
+
+    static void appendUInt(QByteArray &json,quint64 const value)
+    {
+        json.append(QByteArray::number(value));
+    }
+
+    static void appendString(QByteArray &json,QString const &str)
+    {
+        QByteArray const utf8 = str.toUtf8();
+        json.append('"');
+        for(int i=0; i < utf8.size(); i++)   {
+            char const c = utf8[i];
+            if(c == '"' || c == '\\')   {
+                json.append('\\');
+                json.append(c);
+            }
+            else if(c >= 0 && c < 0x20)   {
+                static char const hexChars[] = "0123456789ABCDEF";
+                json.append("\\u00");
+                json.append(hexChars[(c >> 4) & 0x0F]);
+                json.append(hexChars[c & 0x0F]);
+            }
+            else   {
+                json.append(c);
+            }
+        }
+        json.append('"');
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    LatencyHistogram::LatencyHistogram()
+    {
+        Reset();
+    }
+
+    void LatencyHistogram::Record(quint64 const valueNs)
+    {
+        m_buckets[getBucketIdx(valueNs)]++;
+        m_count++;
+        m_sum += valueNs;
+        if(valueNs < m_min)   {
+            m_min = valueNs;
+        }
+        if(valueNs > m_max)   {
+            m_max = valueNs;
+        }
+    }
+
+    void LatencyHistogram::Add(LatencyHistogram const &other)
+    {
+        for(int i=0; i < NUM_BUCKETS; i++)   {
+            m_buckets[i] += other.m_buckets[i];
+        }
+        m_count += other.m_count;
+        m_sum += other.m_sum;
+        m_min = qMin(m_min,other.m_min);
+        m_max = qMax(m_max,other.m_max);
+    }
+
+    void LatencyHistogram::Reset()
+    {
+        memset(m_buckets,0,sizeof(m_buckets));
+        m_count = 0;
+        m_sum = 0;
+        m_min = Q_UINT64_C(0xFFFFFFFFFFFFFFFF);
+        m_max = 0;
+    }
+
+    quint64 LatencyHistogram::GetMin() const
+    {
+        return (m_count == 0) ? 0 : m_min;
+    }
+
+    double LatencyHistogram::GetMean() const
+    {
+        return (m_count == 0) ? 0.0 : double(m_sum)/m_count;
+    }
+
+    quint64 LatencyHistogram::GetPercentile(double const percentile) const
+    {
+        if(m_count == 0)   {
+            return 0;
+        }
+
+        // the rank of the value we want (1 based)
+        quint64 rank = quint64((percentile/100.0)*m_count + 0.5);
+        rank = qMax(rank,quint64(1));
+        rank = qMin(rank,m_count);
+        if(rank == m_count)   {
+            return m_max;
+        }
+
+        quint64 numSeen=0;
+        for(int i=0; i < NUM_BUCKETS; i++)   {
+            numSeen += m_buckets[i];
+            if(numSeen >= rank)   {
+                quint64 const value = getBucketValue(i);
+                return qMax(m_min,qMin(value,m_max));
+            }
+        }
+        return m_max;
+    }
+
+    void LatencyHistogram::ToJson(QByteArray &json) const
+    {
+        json.append("{\"count\":");
+        appendUInt(json,m_count);
+        json.append(",\"min\":");
+        appendUInt(json,GetMin());
+        json.append(",\"mean\":");
+        appendUInt(json,quint64(GetMean()+0.5));
+        json.append(",\"p50\":");
+        appendUInt(json,GetPercentile(50.0));
+        json.append(",\"p90\":");
+        appendUInt(json,GetPercentile(90.0));
+        json.append(",\"p99\":");
+        appendUInt(json,GetPercentile(99.0));
+        json.append(",\"p999\":");
+        appendUInt(json,GetPercentile(99.9));
+        json.append(",\"max\":");
+        appendUInt(json,m_max);
+        json.append('}');
+    }
+
+    int LatencyHistogram::getBucketIdx(quint64 const valueNs)
+    {
+        if(valueNs < NUM_EXACT_VALUES)   {
+            return int(valueNs);
+        }
+
+        // [highest bit] [4 bits for the sub-bucket]
+        int const highestBit = getHighestBit(valueNs);
+        if(highestBit > MAX_VALUE_BIT)   {
+            return NUM_BUCKETS-1;
+        }
+        int const shift = highestBit-4;
+        return (16*shift) + int(valueNs >> shift);
+    }
+
+    quint64 LatencyHistogram::getBucketValue(int const bucketIdx)
+    {
+        if(quint64(bucketIdx) < NUM_EXACT_VALUES)   {
+            return quint64(bucketIdx);
+        }
+
+        // middle of the bucket's range
+        int const shift = (bucketIdx/16)-1;
+        quint64 const subBucket = quint64(bucketIdx%16)+16;
+        return (subBucket << shift) + ((quint64(1) << shift) >> 1);
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    ParseProfiler::ParseProfiler() :
+        m_lastParam(NULL)
+    {}
+
+    ParseProfiler::~ParseProfiler()
+    {
+        Reset();
+    }
+
+    void ParseProfiler::Record(QString const &paramName,
+                               ProfileStage const stage,
+                               quint64 const valueNs)
+    {
+        if(m_lastParam == NULL || paramName != m_lastParamName)   {
+            QHash<QString,ParamHistograms*>::iterator it =
+                m_tableParams.find(paramName);
+
+            if(it == m_tableParams.end())   {
+                it = m_tableParams.insert(paramName,new ParamHistograms);
+            }
+            m_lastParamName = paramName;
+            m_lastParam = it.value();
+        }
+        m_lastParam->stages[stage].Record(valueNs);
+    }
+
+    LatencyHistogram const * ParseProfiler::GetHistogram(QString const &paramName,
+                                                         ProfileStage const stage) const
+    {
+        ParamHistograms * param = m_tableParams.value(paramName,NULL);
+        return (param) ? &(param->stages[stage]) : NULL;
+    }
+
+    LatencyHistogram ParseProfiler::GetStageHistogram(ProfileStage const stage) const
+    {
+        LatencyHistogram histogram;
+        QHash<QString,ParamHistograms*>::const_iterator it;
+        for(it = m_tableParams.begin(); it != m_tableParams.end(); ++it)   {
+            histogram.Add(it.value()->stages[stage]);
+        }
+        return histogram;
+    }
+
+    QStringList ParseProfiler::GetParameterNames() const
+    {
+        return m_tableParams.keys();
+    }
+
+    void ParseProfiler::Reset()
+    {
+        QHash<QString,ParamHistograms*>::iterator it;
+        for(it = m_tableParams.begin(); it != m_tableParams.end(); ++it)   {
+            delete it.value();
+        }
+        m_tableParams.clear();
+        m_lastParamName.clear();
+        m_lastParam = NULL;
+    }
+
+    QByteArray ParseProfiler::ToJson() const
+    {
+        QByteArray json;
+        json.append("{\"stages\":");
+
+        LatencyHistogram listTotals[PROFILE_NUM_STAGES];
+        for(int i=0; i < PROFILE_NUM_STAGES; i++)   {
+            listTotals[i] = GetStageHistogram(ProfileStage(i));
+        }
+        stagesToJson(listTotals,json);
+
+        // sort by the total of the stage means
+        QList<QPair<double,QString> > listParams;
+        QHash<QString,ParamHistograms*>::const_iterator it;
+        for(it = m_tableParams.begin(); it != m_tableParams.end(); ++it)   {
+            double totalMean=0;
+            for(int i=0; i < PROFILE_NUM_STAGES; i++)   {
+                totalMean += it.value()->stages[i].GetMean();
+            }
+            listParams.push_back(qMakePair(-totalMean,it.key()));
+        }
+        qSort(listParams);
+
+        json.append(",\"parameters\":[");
+        for(int i=0; i < listParams.size(); i++)   {
+            if(i > 0)   {
+                json.append(',');
+            }
+            json.append("{\"name\":");
+            appendString(json,listParams[i].second);
+            json.append(",\"stages\":");
+            stagesToJson(m_tableParams.value(listParams[i].second)->stages,json);
+            json.append('}');
+        }
+        json.append("]}");
+        return json;
+    }
+
+    char const * ParseProfiler::StageName(ProfileStage const stage)
+    {
+        if(stage < 0 || stage >= PROFILE_NUM_STAGES)   {
+            return "";
+        }
+        return STAGE_NAMES[stage];
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void ParseProfiler::stagesToJson(LatencyHistogram const * stages,
+                                     QByteArray &json) const
+    {
+        json.append('{');
+        bool first=true;
+        for(int i=0; i < PROFILE_NUM_STAGES; i++)   {
+            if(stages[i].GetCount() == 0)   {
+                continue;
+            }
+            if(!first)   {
+                json.append(',');
+            }
+            first = false;
+            json.append('"');
+            json.append(STAGE_NAMES[i]);
+            json.append("\":");
+            stages[i].ToJson(json);
+        }
+        json.append('}');
+    }
+}
@@ -0,0 +1,179 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef PARSEPROFILER_H
+#define PARSEPROFILER_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+namespace obdref
+{
+
+// LatencyHistogram
+// * HDR-style histogram of latencies in nanoseconds;
+//   values are bucketed by their highest set bit and
+//   then linearly into 16 sub-buckets, so any value is
+//   kept to within ~6% with a fixed amount of memory
+//   and recording is a few shifts and an increment
+// * values of 2^40 ns (~18 min) and up are saved
+//   to the last bucket
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void Record(quint64 const valueNs);
+    void Add(LatencyHistogram const &other);
+    void Reset();
+
+    quint64 GetCount() const
+    {   return m_count;   }
+
+    quint64 GetMin() const;
+
+    quint64 GetMax() const
+    {   return m_max;   }
+
+    double GetMean() const;
+
+    // GetPercentile
+    // * returns the value (0 < percentile <= 100)
+    //   that percentile percent of recorded values
+    //   are less than or equal to
+    quint64 GetPercentile(double const percentile) const;
+
+    // ToJson
+    // * appends {"count":N,"min":N,"mean":N,"p50":N,
+    //   "p90":N,"p99":N,"p999":N,"max":N} (in ns)
+    void ToJson(QByteArray &json) const;
+
+    // 32 exact buckets (0-31ns) and then 16 per power of 2
+    enum { NUM_BUCKETS = 16*37 };
+
+private:
+    static int getBucketIdx(quint64 const valueNs);
+    static quint64 getBucketValue(int const bucketIdx);
+
+    quint64 m_count;
+    quint64 m_sum;
+    quint64 m_min;
+    quint64 m_max;
+    quint32 m_buckets[NUM_BUCKETS];
+};
+
+enum ProfileStage
+{
+    PROFILE_BUILD,          // BuildParameterFrame
+    PROFILE_CLEAN,          // cleaning raw frames for a parameter
+    PROFILE_JS_MARSHAL,     // copying cleaned data to the js context
+    PROFILE_JS_CALL,        // running the parse script
+    PROFILE_SAVE_RESULTS,   // copying results out of the js context
+    PROFILE_NUM_STAGES
+};
+
+// ParseProfiler
+// * a LatencyHistogram for each stage of building and
+//   parsing, for each parameter
+// * the Parser only records to its profiler when it's
+//   built with OBDREF_PROFILE defined; otherwise the
+//   timing code is compiled out
+class ParseProfiler
+{
+public:
+    ParseProfiler();
+    ~ParseProfiler();
+
+    void Record(QString const &paramName,
+                ProfileStage const stage,
+                quint64 const valueNs);
+
+    // GetHistogram
+    // * returns NULL if nothing has been
+    //   recorded for paramName
+    LatencyHistogram const * GetHistogram(QString const &paramName,
+                                          ProfileStage const stage) const;
+
+    // GetStageHistogram
+    // * returns a stage's histogram over every parameter
+    LatencyHistogram GetStageHistogram(ProfileStage const stage) const;
+
+    QStringList GetParameterNames() const;
+
+    void Reset();
+
+    // ToJson
+    // * returns {"stages":{"<stage>":{...}},
+    //   "parameters":[{"name":"<name>","stages":{...}}]}
+    //   with parameters sorted by their total mean time
+    //   (slowest first); stages with no values are skipped
+    QByteArray ToJson() const;
+
+    static char const * StageName(ProfileStage const stage);
+
+private:
+    ParseProfiler(ParseProfiler const &other);
+    ParseProfiler & operator = (ParseProfiler const &other);
+
+    struct ParamHistograms
+    {
+        LatencyHistogram stages[PROFILE_NUM_STAGES];
+    };
+
+    void stagesToJson(LatencyHistogram const * stages,
+                      QByteArray &json) const;
+
+    QHash<QString,ParamHistograms*> m_tableParams;
+
+    // the last parameter recorded, since stages for
+    // the same parameter are recorded back to back
+    QString m_lastParamName;
+    ParamHistograms * m_lastParam;
+};
+
+// ProfileTimer
+// * Lap returns the nanoseconds since the last
+//   call to Start or Lap
+class ProfileTimer
+{
+public:
+    void Start()
+    {
+        m_timer.start();
+        m_lastNs = 0;
+    }
+
+    quint64 Lap()
+    {
+        qint64 const ns = m_timer.nsecsElapsed();
+        qint64 const lapNs = ns-m_lastNs;
+        m_lastNs = ns;
+        return quint64(lapNs);
+    }
+
+private:
+    QElapsedTimer m_timer;
+    qint64 m_lastNs;
+};
+
+}
+
+#endif // PARSEPROFILER_H
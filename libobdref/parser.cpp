@@ -16,15 +16,96 @@
    limitations under the License.
 */
 
+#include <cstdlib>
+
 #include "parser.h"
+#include "supportedpids.h"
 #include "globals_js.h"
 
+// stage timing recorded to m_profiler; compiled
+// out unless OBDREF_PROFILE is defined
+#ifdef OBDREF_PROFILE
+#define OBDREF_PROFILE_START(timer) \
+    ProfileTimer timer; timer.Start()
+#define OBDREF_PROFILE_LAP(timer,paramName,stage) \
+    m_profiler.Record(paramName,stage,timer.Lap())
+#else
+#define OBDREF_PROFILE_START(timer)
+#define OBDREF_PROFILE_LAP(timer,paramName,stage)
+#endif
+
 namespace obdref
 {
+    // marks parse functions in m_js_listFunctionIdx that
+    // haven't been compiled yet (stack index 0 is always
+    // the global object)
+    static quint32 const JS_FUNCTION_NOT_COMPILED = 0;
+
+    // duktape heap allocators; udata is the
+    // JsHeapStats of the Parser that owns the heap
+
+    static void * jsAlloc(void * udata,size_t size)
+    {
+        JsHeapStats * stats = static_cast<JsHeapStats*>(udata);
+        stats->numAllocs++;
+        stats->numBytes += size;
+        return malloc(size);
+    }
+
+    static void * jsRealloc(void * udata,void * ptr,size_t size)
+    {
+        if(size > 0)   {
+            JsHeapStats * stats = static_cast<JsHeapStats*>(udata);
+            stats->numAllocs++;
+            stats->numBytes += size;
+        }
+        return realloc(ptr,size);
+    }
+
+    static void jsFree(void * udata,void * ptr)
+    {
+        if(ptr)   {
+            static_cast<JsHeapStats*>(udata)->numFrees++;
+        }
+        free(ptr);
+    }
+
+    // evaluates the string on top of the stack; used with
+    // duk_safe_call so a script error is returned instead
+    // of aborting (this duktape has no duk_peval_string)
+    static int jsSafeEval(duk_context * ctx)
+    {
+        duk_eval(ctx);
+        return 1;
+    }
+
     // ========================================================================== //
     // ========================================================================== //
 
-    Parser::Parser(QString const &filePath, bool &initOk)
+    Parser::Parser(QString const &filePath, bool &initOk) :
+        m_rejectLogInterval(0),
+        m_rejectsSinceLog(0)
+    {
+        m_xmlFilePath = filePath;
+        QString xmlFileContents;
+        if(!convTextFileToQStr(m_xmlFilePath,xmlFileContents))   {
+            initOk = false;
+            return;
+        }
+        init(xmlFileContents,initOk);
+    }
+
+    Parser::Parser(QString const &filePath,
+                   QString const &fileContents,
+                   bool &initOk) :
+        m_rejectLogInterval(0),
+        m_rejectsSinceLog(0)
+    {
+        m_xmlFilePath = filePath;
+        init(fileContents,initOk);
+    }
+
+    void Parser::init(QString const &xmlFileContents, bool &initOk)
     {
         // error logging
         m_lkErrors.setString(&m_lkErrorString, QIODevice::ReadWrite);
@@ -44,13 +125,6 @@ namespace obdref
         }
 
         // setup pugixml with xml source file
-        m_xmlFilePath = filePath;
-        QString xmlFileContents;
-        if(!convTextFileToQStr(m_xmlFilePath,xmlFileContents))   {
-            initOk = false;
-            return;
-        }
-
         pugi::xml_parse_result xmlParseResult;
         xmlParseResult = m_xmlDoc.load(xmlFileContents.toLocal8Bit().data());
 
@@ -58,12 +132,12 @@ namespace obdref
         {   initOk = true;   }
         else
         {
-            OBDREFDEBUG << "Error: XML [" << filePath << "] errors!\n";
+            OBDREFERROR << "Error: XML [" << m_xmlFilePath << "] errors!\n";
 
-            OBDREFDEBUG << "Error: "
+            OBDREFERROR << "Error: "
                         << QString::fromStdString(xmlParseResult.description()) << "\n";
 
-            OBDREFDEBUG << "Error: Offset Char: "
+            OBDREFERROR << "Error: Offset Char: "
                         << qint64(xmlParseResult.offset) << "\n";
 
             initOk = false;
@@ -72,7 +146,7 @@ namespace obdref
 
         // setup js context
         if(!jsInit())   {
-            OBDREFDEBUG << "Error: failed to setup JS engine";
+            OBDREFERROR << "Error: failed to setup JS engine";
             initOk = false;
             return;
         }
@@ -90,6 +164,8 @@ namespace obdref
 
     bool Parser::BuildParameterFrame(ParameterFrame &paramFrame)
     {
+        OBDREF_PROFILE_START(profileTimer);
+
         bool xnSpecFound       = false;
         bool xnProtocolFound   = false;
         bool xnAddressFound    = false;
@@ -126,6 +202,18 @@ namespace obdref
                             }
                         }
 
+                        // save the lowest baud rate listed for the protocol
+                        paramFrame.baudRate = 0;
+                        pugi::xml_node xnBaudRate = xnProtocol.child("baudrate");
+                        for(; xnBaudRate!=NULL; xnBaudRate=xnBaudRate.next_sibling("baudrate"))
+                        {
+                            quint32 const baudRate = xnBaudRate.attribute("value").as_uint();
+                            if(baudRate > 0 && (paramFrame.baudRate == 0 ||
+                                                baudRate < paramFrame.baudRate))   {
+                                paramFrame.baudRate = baudRate;
+                            }
+                        }
+
                         // set actual protocol used to clean up raw message data
                         int optIdx;
                         if(protocol.contains("SAE J1850"))   {
@@ -157,7 +245,7 @@ namespace obdref
                             }
                         }
                         else   {
-                            OBDREFDEBUG << "ERROR: unsupported protocol: "
+                            OBDREFERROR << "ERROR: unsupported protocol: "
                                         << protocol;
                             return false;
                         }
@@ -194,91 +282,117 @@ namespace obdref
                     break;
                 }
 
-                pugi::xml_node xnParams = xnSpec.child("parameters");
-                for(; xnParams!=NULL; xnParams=xnParams.next_sibling("parameters"))
-                {
-                    QString const paramsAddr(xnParams.attribute("address").value());
-                    if(paramsAddr == paramFrame.address)
-                    {   // found parameters group
-                        xnParamsFound = true;
-
-                        // use parameter information to build request data
-                        pugi::xml_node xnParameter = xnParams.child("parameter");
-                        for(; xnParameter!=NULL; xnParameter=xnParameter.next_sibling("parameter"))
-                        {
-                            QString const name(xnParameter.attribute("name").value());
-                            if(name == paramFrame.name)
-                            {   // found parameter
-                                xnParameterFound = true;
-
-                                // [build request data]
-                                if(!buildData(paramFrame,xnParameter))   {
-                                    OBDREFDEBUG << "Error: failed to build request data";
-                                    return false;
-                                }
-
-                                // [save parse script]
-                                // set parse mode
-                                QString parseMode(xnParameter.attribute("parse").value());
-                                if(parseMode == "combined")   {
-                                    paramFrame.parseMode = PARSE_COMBINED;
-                                }
-                                else   {
-                                    paramFrame.parseMode = PARSE_SEPARATELY;
-                                }
+                pugi::xml_node xnParameter =
+                    m_tableParamNodes.value(paramFrame.spec+":"+
+                                            paramFrame.address+":"+
+                                            paramFrame.name);
+                if(xnParameter)
+                {   // found parameter
+                    xnParamsFound = true;
+                    xnParameterFound = true;
+
+                    // [build request data]
+                    if(!buildData(paramFrame,xnParameter))   {
+                        OBDREFERROR << "Error: failed to build request data";
+                        return false;
+                    }
 
-                                // save reference to parse function
-                                pugi::xml_node xnScript = xnParameter.child("script");
-                                QString protocols(xnScript.attribute("protocols").value());
-                                if(!protocols.isEmpty())   {
-                                    bool foundProtocol=false;
-                                    for(; xnScript!=NULL; xnScript = xnScript.next_sibling("script"))   {
-                                        // get the script for the specified protocol
-                                        protocols = QString(xnScript.attribute("protocols").value());
-                                        if(protocols.contains(paramFrame.protocol))   {
-                                            foundProtocol = true;
-                                            break;
-                                        }
-                                    }
-                                    if(!foundProtocol)   {
-                                        OBDREFDEBUG << "Error: protocol specified not "
-                                                       "found in parse script";
-                                        return false;
-                                    }
-                                }
+                    // [save parse script]
+                    // set parse mode
+                    QString parseMode(xnParameter.attribute("parse").value());
+                    if(parseMode == "combined")   {
+                        paramFrame.parseMode = PARSE_COMBINED;
+                    }
+                    else   {
+                        paramFrame.parseMode = PARSE_SEPARATELY;
+                    }
 
-                                QString jsFunctionKey = paramFrame.spec+":"+paramFrame.address+":"+
-                                                        paramFrame.name+":"+protocols;
+                    // [save polling options]
+                    pugi::xml_attribute xaRate = xnParameter.attribute("rate");
+                    if(xaRate)   {
+                        bool convOk = false;
+                        paramFrame.pollRate = QString(xaRate.value()).toDouble(&convOk);
+                        if(!convOk || paramFrame.pollRate < 0)   {
+                            OBDREFWARN << "Warn: invalid rate for parameter "
+                                       << paramFrame.name;
+                            paramFrame.pollRate = 0;
+                        }
+                    }
+                    pugi::xml_attribute xaPriority = xnParameter.attribute("priority");
+                    if(xaPriority)   {
+                        bool convOk = false;
+                        paramFrame.pollPriority = QString(xaPriority.value()).toInt(&convOk);
+                        if(!convOk)   {
+                            OBDREFWARN << "Warn: invalid priority for parameter "
+                                       << paramFrame.name;
+                            paramFrame.pollPriority = 0;
+                        }
+                    }
 
-                                paramFrame.functionKeyIdx = m_js_listFunctionKey.indexOf(jsFunctionKey);
-                                if(paramFrame.functionKeyIdx == -1)   {
-                                    OBDREFDEBUG << "No parse function found for "
-                                                << "message: " << paramFrame.name << "\n";
-                                    return false;
-                                }
-                                // done
-                                return true;
+                    // save reference to parse function
+                    pugi::xml_node xnScript = xnParameter.child("script");
+                    QString protocols(xnScript.attribute("protocols").value());
+                    if(!protocols.isEmpty())   {
+                        bool foundProtocol=false;
+                        for(; xnScript!=NULL; xnScript = xnScript.next_sibling("script"))   {
+                            // get the script for the specified protocol
+                            protocols = QString(xnScript.attribute("protocols").value());
+                            if(protocols.contains(paramFrame.protocol))   {
+                                foundProtocol = true;
+                                break;
                             }
                         }
+                        if(!foundProtocol)   {
+                            OBDREFERROR << "Error: protocol specified not "
+                                           "found in parse script";
+                            return false;
+                        }
+                    }
+
+                    QString jsFunctionKey = paramFrame.spec+":"+paramFrame.address+":"+
+                                            paramFrame.name+":"+protocols;
+
+                    paramFrame.functionKeyIdx = m_js_tableFunctionKeyIdx.value(jsFunctionKey,-1);
+                    if(paramFrame.functionKeyIdx == -1)   {
+                        OBDREFERROR << "No parse function found for "
+                                    << "message: " << paramFrame.name << "\n";
+                        return false;
+                    }
+                    if(!jsCompileFunction(paramFrame.functionKeyIdx))   {
+                        return false;
+                    }
+                    // done
+                    OBDREF_PROFILE_LAP(profileTimer,paramFrame.name,
+                                       PROFILE_BUILD);
+                    return true;
+                }
+
+                // only used to report what's missing
+                pugi::xml_node xnParams = xnSpec.child("parameters");
+                for(; xnParams!=NULL; xnParams=xnParams.next_sibling("parameters"))
+                {
+                    QString const paramsAddr(xnParams.attribute("address").value());
+                    if(paramsAddr == paramFrame.address)   {
+                        xnParamsFound = true;
                     }
                 }
             }
         }
 
         if(!xnSpecFound)   {
-            OBDREFDEBUG << "Error: could not find spec " << paramFrame.spec;
+            OBDREFERROR << "Error: could not find spec " << paramFrame.spec;
         }
         else if(!xnProtocolFound)   {
-            OBDREFDEBUG << "Error: could not find protocol " << paramFrame.protocol;
+            OBDREFERROR << "Error: could not find protocol " << paramFrame.protocol;
         }
         else if(!xnAddressFound)    {
-            OBDREFDEBUG << "Error: could not find address " << paramFrame.address;
+            OBDREFERROR << "Error: could not find address " << paramFrame.address;
         }
         else if(!xnParamsFound)   {
-            OBDREFDEBUG << "Error: could not find param group";
+            OBDREFERROR << "Error: could not find param group";
         }
         else if(!xnParameterFound)   {
-            OBDREFDEBUG << "Error: could not find parameter " << paramFrame.name;
+            OBDREFERROR << "Error: could not find parameter " << paramFrame.name;
         }
 
         return false;
@@ -291,11 +405,37 @@ namespace obdref
                                    QList<obdref::Data> &listData)
     {
         if(msgFrame.functionKeyIdx == -1)   {
-            OBDREFDEBUG << "OBDREF: Error: Invalid parse"
+            OBDREFERROR << "Error: Invalid parse"
                         << "function index in message frame\n";
             return false;
         }
 
+        OBDREF_PROFILE_START(profileTimer);
+
+        if(!CleanParameterFrame(msgFrame))   {
+            OBDREFERROR << "Error: Could not clean"
+                        << "raw data using spec'd format\n";
+            return false;
+        }
+        OBDREF_PROFILE_LAP(profileTimer,msgFrame.name,PROFILE_CLEAN);
+
+        // parse
+        bool parseOk = false;
+        parseOk = parseResponse(msgFrame,listData);
+
+        if(!parseOk)   {
+            OBDREFERROR << "Error: Could not parse message";
+            return false;
+        }
+
+        return true;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    bool Parser::CleanParameterFrame(ParameterFrame &msgFrame)
+    {
         bool formatOk=true;
 
         // clean message data based on protocol type
@@ -303,14 +443,16 @@ namespace obdref
 
         // clear any data left over from prior use
         for(int i=0; i < msgFrame.listMessageData.size(); i++)   {
-            msgFrame.listMessageData[i].listHeaders.clear();
-            msgFrame.listMessageData[i].listData.clear();
+            resetIncrementalState(msgFrame.listMessageData[i]);
         }
 
         if(parseProtocol < 0xA00)
         {   // SAE_J1850, ISO_9141-2, ISO_14230-4
             for(int i=0; i < msgFrame.listMessageData.size(); i++)   {
-                if(!cleanFrames_Legacy(msgFrame.listMessageData[i]))   {
+                cleanFrames_Legacy(msgFrame.listMessageData[i],0);
+                if(msgFrame.listMessageData[i].listHeaders.empty())   {
+                    OBDREFERROR << "Error: SAE J1850/ISO 9141-2/ISO 14230-4, "
+                                   "empty message data";
                     formatOk=false;
                     break;
                 }
@@ -319,8 +461,10 @@ namespace obdref
         else if(parseProtocol == PROTOCOL_ISO_15765)   {
             int headerLength = (msgFrame.iso15765_extendedId) ? 4 : 2;
             for(int i=0; i < msgFrame.listMessageData.size(); i++)   {
-                if(!cleanFrames_ISO_15765(msgFrame.listMessageData[i],
-                                          headerLength))   {
+                cleanFrames_ISO_15765(msgFrame.listMessageData[i],
+                                      headerLength,0);
+                if(msgFrame.listMessageData[i].listHeaders.empty())   {
+                    OBDREFERROR << "Error: ISO 15765-4, empty message data";
                     formatOk=false;
                     break;
                 }
@@ -328,33 +472,778 @@ namespace obdref
         }
         else if(parseProtocol == PROTOCOL_ISO_14230)   {
             for(int i=0; i < msgFrame.listMessageData.size(); i++)   {
-                if(!cleanFrames_ISO_14230(msgFrame.listMessageData[i]))   {
+                cleanFrames_ISO_14230(msgFrame.listMessageData[i],0);
+                if(msgFrame.listMessageData[i].listHeaders.empty())   {
+                    OBDREFERROR << "Error: ISO 14230, empty message data";
                     formatOk=false;
                     break;
                 }
             }
         }
         else   {
-            OBDREFDEBUG << "ERROR: protocol not yet supported";
+            OBDREFERROR << "ERROR: protocol not yet supported";
             return false;
         }
 
+        return formatOk;
+    }
 
-        if(!formatOk)   {
-            OBDREFDEBUG << "OBDREF: Error: Could not clean"
-                        << "raw data using spec'd format\n";
+    // ========================================================================== //
+    // ========================================================================== //
+
+    bool Parser::ParseParameterFrameIncremental(ParameterFrame &msgFrame,
+                                                QList<Data> &listData)
+    {
+        if(msgFrame.functionKeyIdx == -1)   {
+            OBDREFERROR << "Error: Invalid parse"
+                        << "function index in message frame\n";
             return false;
         }
 
-        // parse
-        bool parseOk = false;
-        parseOk = parseResponse(msgFrame,listData);
+        Protocol parseProtocol = msgFrame.parseProtocol;
+        if((parseProtocol >= 0xA00) &&
+           (parseProtocol != PROTOCOL_ISO_15765) &&
+           (parseProtocol != PROTOCOL_ISO_14230))   {
+            OBDREFERROR << "ERROR: protocol not yet supported";
+            return false;
+        }
+
+        OBDREF_PROFILE_START(profileTimer);
+
+        bool hasNewData=false;
+        bool hasAllData=true;
+
+        // clean any frames that were added since the last call
+        for(int i=0; i < msgFrame.listMessageData.size(); i++)   {
+            MessageData &msg = msgFrame.listMessageData[i];
+
+            // start over if this is the first call (or the first
+            // call after ParseParameterFrame), or if raw frames
+            // were removed or replaced since the last call
+            if((msg.idxNextRawFrame == 0) ||
+               (msg.idxNextRawFrame > msg.listRawFrames.size()) ||
+               (msg.listRawFrames[msg.idxNextRawFrame-1] != msg.lastRawFrame))   {
+                resetIncrementalState(msg);
+            }
+
+            int const idxStart = msg.idxNextRawFrame;
+            if(idxStart < msg.listRawFrames.size())   {
+                if(parseProtocol < 0xA00)   {
+                    cleanFrames_Legacy(msg,idxStart);
+                }
+                else if(parseProtocol == PROTOCOL_ISO_15765)   {
+                    int headerLength = (msgFrame.iso15765_extendedId) ? 4 : 2;
+                    cleanFramesInOrder_ISO_15765(msg,headerLength,idxStart);
+                }
+                else   {
+                    cleanFrames_ISO_14230(msg,idxStart);
+                }
+                msg.idxNextRawFrame = msg.listRawFrames.size();
+                msg.lastRawFrame = msg.listRawFrames.last();
+            }
+
+            if(msg.listData.size() > msg.idxNextData)   {
+                hasNewData = true;
+            }
+            if(msg.listData.isEmpty())   {
+                hasAllData = false;
+            }
+        }
+
+        OBDREF_PROFILE_LAP(profileTimer,msgFrame.name,PROFILE_CLEAN);
+
+        if(!hasNewData)   {
+            return true;
+        }
+
+        if((msgFrame.parseMode == PARSE_COMBINED) && !hasAllData)   {
+            // wait until there's data for every request
+            return true;
+        }
+
+        // parse (only listData entries after
+        // msg.idxNextData are parsed separately)
+        bool parseOk = parseResponse(msgFrame,listData);
+
+        for(int i=0; i < msgFrame.listMessageData.size(); i++)   {
+            MessageData &msg = msgFrame.listMessageData[i];
+            msg.idxNextData = msg.listData.size();
+        }
 
         if(!parseOk)   {
-            OBDREFDEBUG << "OBDREF: Error: Could not parse message";
+            OBDREFERROR << "Error: Could not parse message";
+            return false;
+        }
+
+        return true;
+    }
+
+    void Parser::ResetIncremental(ParameterFrame &msgFrame)
+    {
+        for(int i=0; i < msgFrame.listMessageData.size(); i++)   {
+            resetIncrementalState(msgFrame.listMessageData[i]);
+        }
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void Parser::GroupSharedRequests(QList<ParameterFrame> const &listParams,
+                                     QList<QList<int> > &listGroups)
+    {
+        // parameters are keyed by everything that
+        // goes into their requests and everything that
+        // is used to identify their responses; the
+        // expected data byte count is left out since
+        // different parameters may read different
+        // amounts of the same response
+        QHash<QByteArray,int> tableGroupIdx;
+        listGroups.clear();
+
+        for(int i=0; i < listParams.size(); i++)   {
+            ParameterFrame const &param = listParams[i];
+
+            QByteArray key;
+            key.append(QByteArray::number(int(param.parseProtocol)));
+            key.append(param.iso15765_extendedId ? 'x' : 's');
+            for(int j=0; j < param.listMessageData.size(); j++)   {
+                MessageData const &msg = param.listMessageData[j];
+                key.append('|');
+                key.append(QByteArray::number(msg.reqDataDelayMs));
+                appendBytesToKey(key,msg.reqHeaderBytes);
+                for(int k=0; k < msg.listReqDataBytes.size(); k++)   {
+                    appendBytesToKey(key,msg.listReqDataBytes[k]);
+                }
+                appendBytesToKey(key,msg.expHeaderBytes);
+                appendBytesToKey(key,msg.expHeaderMask);
+                appendBytesToKey(key,msg.expDataPrefix);
+            }
+
+            int groupIdx = tableGroupIdx.value(key,-1);
+            if(groupIdx == -1)   {
+                groupIdx = listGroups.size();
+                tableGroupIdx.insert(key,groupIdx);
+                listGroups.push_back(QList<int>());
+            }
+            listGroups[groupIdx].push_back(i);
+        }
+    }
+
+    bool Parser::ParseSharedResponse(QList<ParameterFrame> &listParams,
+                                     QList<int> const &listGroup,
+                                     QList<Data> &listData)
+    {
+        if(listGroup.isEmpty())   {
+            return true;
+        }
+
+        ParameterFrame const &srcParam = listParams[listGroup[0]];
+        for(int i=1; i < listGroup.size(); i++)   {
+            ParameterFrame &param = listParams[listGroup[i]];
+            if(param.listMessageData.size() != srcParam.listMessageData.size())   {
+                OBDREFERROR << "Error: ParseSharedResponse:"
+                            << param.name << "does not share "
+                               "requests with" << srcParam.name;
+                return false;
+            }
+            for(int j=0; j < param.listMessageData.size(); j++)   {
+                param.listMessageData[j].listRawFrames =
+                    srcParam.listMessageData[j].listRawFrames;
+            }
+        }
+
+        bool parsedOk=true;
+        for(int i=0; i < listGroup.size(); i++)   {
+            if(!ParseParameterFrame(listParams[listGroup[i]],listData))   {
+                parsedOk=false;
+            }
+        }
+        return parsedOk;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void Parser::BuildCoalescedFrames(QList<ParameterFrame> const &listParams,
+                                      QList<CoalescedFrame> &listFrames,
+                                      QList<int> &listParamIdxOther)
+    {
+        listFrames.clear();
+        listParamIdxOther.clear();
+
+        // requests can only be coalesced if they're sent
+        // to and received from the same addresses with
+        // the same formatting; 'PIDs Supported' requests
+        // can't be mixed with other PIDs
+        QHash<QByteArray,int> tableOpenFrameIdx;
+        QHash<int,int> tableNumPids;
+
+        for(int i=0; i < listParams.size(); i++)   {
+            ParameterFrame const &param = listParams[i];
+
+            int const pid = getMode01Pid(param);
+            if(pid == -1)   {
+                listParamIdxOther.push_back(i);
+                continue;
+            }
+            MessageData const &paramMsg = param.listMessageData[0];
+
+            QByteArray key;
+            key.append(param.iso15765_extendedId ? 'x' : 's');
+            key.append(param.iso15765_addPciByte ? 'p' : '-');
+            key.append(((pid % 0x20) == 0) ? 'b' : 'd');
+            appendBytesToKey(key,paramMsg.reqHeaderBytes);
+            appendBytesToKey(key,paramMsg.expHeaderBytes);
+            appendBytesToKey(key,paramMsg.expHeaderMask);
+
+            int frameIdx = tableOpenFrameIdx.value(key,-1);
+            if(frameIdx == -1)   {
+                CoalescedFrame frame;
+                frame.msg.reqHeaderBytes = paramMsg.reqHeaderBytes;
+                frame.msg.expHeaderBytes = paramMsg.expHeaderBytes;
+                frame.msg.expHeaderMask = paramMsg.expHeaderMask;
+                frame.msg.expDataPrefix << 0x41;
+
+                frameIdx = listFrames.size();
+                listFrames.push_back(frame);
+                tableOpenFrameIdx.insert(key,frameIdx);
+            }
+
+            // parameters that share a pid share its
+            // data in the response
+            CoalescedFrame &frame = listFrames[frameIdx];
+            bool const isNewPid = !frame.listPids.contains(ubyte(pid));
+            frame.listParamIdx.push_back(i);
+            frame.listPids.push_back(ubyte(pid));
+
+            if(isNewPid)   {
+                // a single request can have at most six pids
+                tableNumPids[frameIdx]++;
+                if(tableNumPids[frameIdx] == 6)   {
+                    tableOpenFrameIdx.remove(key);
+                }
+            }
+        }
+
+        // build the requests: [0x01] [pid0] [pid1] ... [pidN]
+        for(int i=0; i < listFrames.size(); i++)   {
+            CoalescedFrame &frame = listFrames[i];
+            ParameterFrame const &firstParam = listParams[frame.listParamIdx[0]];
+
+            ByteList reqDataBytes;
+            reqDataBytes << 0x01;
+            for(int j=0; j < frame.listPids.size(); j++)   {
+                if(!reqDataBytes.mid(1).contains(frame.listPids[j]))   {
+                    reqDataBytes << frame.listPids[j];
+                }
+            }
+            frame.msg.listReqDataBytes << reqDataBytes;
+            formatReqData_ISO_15765(firstParam,frame.msg.listReqDataBytes);
+        }
+    }
+
+    bool Parser::ParseCoalescedFrame(QList<ParameterFrame> &listParams,
+                                     CoalescedFrame &coalescedFrame,
+                                     QList<Data> &listData)
+    {
+        if(coalescedFrame.listParamIdx.isEmpty())   {
+            return true;
+        }
+
+        ParameterFrame const &firstParam =
+            listParams[coalescedFrame.listParamIdx[0]];
+
+        // clean the combined responses: [0x41] is
+        // removed as the prefix, which leaves
+        // [pid0] [data0] [pid1] [data1] ...
+        MessageData &msg = coalescedFrame.msg;
+        int headerLength = (firstParam.iso15765_extendedId) ? 4 : 2;
+        resetIncrementalState(msg);
+        cleanFrames_ISO_15765(msg,headerLength,0);
+        if(msg.listHeaders.empty())   {
+            OBDREFERROR << "Error: ISO 15765-4, empty message data";
+            return false;
+        }
+
+        for(int i=0; i < coalescedFrame.listParamIdx.size(); i++)   {
+            ParameterFrame &param = listParams[coalescedFrame.listParamIdx[i]];
+            resetIncrementalState(param.listMessageData[0]);
+        }
+
+        // split each response up by pid
+        for(int i=0; i < msg.listHeaders.size(); i++)   {
+            ByteList const &dataBytes = msg.listData[i];
+            ByteList listPidsSeen;
+
+            int idx=0;
+            while(idx < dataBytes.size())   {
+                ubyte const pid = dataBytes[idx];
+                int pidIdx = coalescedFrame.listPids.indexOf(pid);
+
+                // stop once we run into padding bytes, which
+                // shouldn't match a requested pid that
+                // hasn't been seen yet
+                if(pidIdx == -1 || listPidsSeen.contains(pid))   {
+                    break;
+                }
+                listPidsSeen.push_back(pid);
+
+                // the first parameter with this pid
+                // determines the data length
+                int const byteCount = listParams[coalescedFrame.
+                    listParamIdx[pidIdx]].listMessageData[0].expDataByteCount;
+
+                if(idx+1+byteCount > dataBytes.size())   {
+                    OBDREFWARN << "Warn: ISO 15765-4, truncated data "
+                                  "for pid" << pid << "in coalesced response";
+                    break;
+                }
+
+                for(; pidIdx < coalescedFrame.listPids.size(); pidIdx++)   {
+                    if(coalescedFrame.listPids[pidIdx] != pid)   {
+                        continue;
+                    }
+                    ParameterFrame &param =
+                        listParams[coalescedFrame.listParamIdx[pidIdx]];
+
+                    MessageData &paramMsg = param.listMessageData[0];
+                    int const pidByteCount =
+                        qMin(paramMsg.expDataByteCount,byteCount);
+
+                    ByteList pidDataBytes;
+                    for(int k=idx+1; k < idx+1+pidByteCount; k++)   {
+                        pidDataBytes << dataBytes[k];
+                    }
+                    paramMsg.listHeaders << msg.listHeaders[i];
+                    paramMsg.listData << pidDataBytes;
+                }
+
+                idx += 1+byteCount;
+            }
+        }
+
+        // parse
+        bool parsedOk=true;
+        for(int i=0; i < coalescedFrame.listParamIdx.size(); i++)   {
+            ParameterFrame &param = listParams[coalescedFrame.listParamIdx[i]];
+            if(param.listMessageData[0].listData.isEmpty())   {
+                continue;
+            }
+            if(!parseResponse(param,listData))   {
+                OBDREFERROR << "Error: Could not parse message";
+                parsedOk=false;
+            }
+        }
+        return parsedOk;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void Parser::BuildPeriodicFrames(QList<ParameterFrame> const &listParams,
+                                     PeriodicRate const rate,
+                                     ubyte const firstPeriodicId,
+                                     QList<PeriodicFrame> &listFrames,
+                                     QList<int> &listParamIdxOther,
+                                     PeriodicLayout const layout)
+    {
+        listFrames.clear();
+        listParamIdxOther.clear();
+
+        // a periodic message is a single frame:
+        // uudt: [periodicId] [d0 ... d6]
+        // single frame: [pci] [periodicId] [d0 ... d5]
+        int const maxDataBytes =
+            (layout == PERIODIC_LAYOUT_UUDT) ? 7 : 6;
+
+        // parameters can only be bundled if they're
+        // requested from and received by the same addresses
+        QHash<QByteArray,int> tableOpenFrameIdx;
+        QHash<int,int> tableNumDataBytes;
+        int periodicId = firstPeriodicId;
+
+        for(int i=0; i < listParams.size(); i++)   {
+            ParameterFrame const &param = listParams[i];
+
+            int const did = getReadDataId(param);
+            if(did == -1)   {
+                listParamIdxOther.push_back(i);
+                continue;
+            }
+            MessageData const &paramMsg = param.listMessageData[0];
+            int const numDataBytes = paramMsg.expDataByteCount;
+
+            QByteArray key;
+            key.append(param.iso15765_extendedId ? 'x' : 's');
+            key.append(param.iso15765_addPciByte ? 'p' : '-');
+            appendBytesToKey(key,paramMsg.reqHeaderBytes);
+            appendBytesToKey(key,paramMsg.expHeaderBytes);
+            appendBytesToKey(key,paramMsg.expHeaderMask);
+
+            int frameIdx = tableOpenFrameIdx.value(key,-1);
+            if((frameIdx != -1) &&
+               (tableNumDataBytes[frameIdx]+numDataBytes > maxDataBytes))   {
+                frameIdx = -1;
+            }
+
+            if(frameIdx == -1)   {
+                if(periodicId > 0xFF)   {
+                    OBDREFWARN << "Warn: BuildPeriodicFrames, "
+                                  "out of periodic identifiers";
+                    listParamIdxOther.push_back(i);
+                    continue;
+                }
+
+                PeriodicFrame frame;
+                frame.periodicId = ubyte(periodicId);
+                frame.layout = layout;
+                periodicId++;
+
+                // define: [0x2C] [0x01] [0xF2] [periodicId] ...
+                frame.msgDefine.reqHeaderBytes = paramMsg.reqHeaderBytes;
+                frame.msgDefine.expHeaderBytes = paramMsg.expHeaderBytes;
+                frame.msgDefine.expHeaderMask = paramMsg.expHeaderMask;
+                frame.msgDefine.expDataPrefix << 0x6C << 0x01
+                                              << 0xF2 << frame.periodicId;
+                frame.msgDefine.expDataByteCount = 0;
+
+                ByteList reqDataBytes;
+                reqDataBytes << 0x2C << 0x01 << 0xF2 << frame.periodicId;
+                frame.msgDefine.listReqDataBytes << reqDataBytes;
+
+                // start: [0x2A] [rate] [periodicId]
+                frame.msgStart.reqHeaderBytes = paramMsg.reqHeaderBytes;
+                frame.msgStart.expHeaderBytes = paramMsg.expHeaderBytes;
+                frame.msgStart.expHeaderMask = paramMsg.expHeaderMask;
+                frame.msgStart.expDataPrefix << 0x6A;
+                frame.msgStart.expDataByteCount = 0;
+
+                reqDataBytes.clear();
+                reqDataBytes << 0x2A << ubyte(rate) << frame.periodicId;
+                frame.msgStart.listReqDataBytes << reqDataBytes;
+                formatReqData_ISO_15765(param,frame.msgStart.listReqDataBytes);
+
+                // stop: [0x2A] [0x04] [periodicId]
+                frame.msgStop = frame.msgStart;
+                frame.msgStop.listReqDataBytes.clear();
+
+                reqDataBytes.clear();
+                reqDataBytes << 0x2A << 0x04 << frame.periodicId;
+                frame.msgStop.listReqDataBytes << reqDataBytes;
+                formatReqData_ISO_15765(param,frame.msgStop.listReqDataBytes);
+
+                // data: [periodicId] [d0 ...]
+                frame.msgData.expHeaderBytes = paramMsg.expHeaderBytes;
+                frame.msgData.expHeaderMask = paramMsg.expHeaderMask;
+                frame.msgData.expDataPrefix << frame.periodicId;
+                frame.msgData.expDataByteCount = 0;
+
+                frameIdx = listFrames.size();
+                listFrames.push_back(frame);
+                tableOpenFrameIdx.insert(key,frameIdx);
+                tableNumDataBytes.insert(frameIdx,0);
+            }
+
+            // add the source: [DID hi] [DID lo] [position] [size]
+            // where position is the (1-based) index of the first
+            // data byte in the source record
+            PeriodicFrame &frame = listFrames[frameIdx];
+            frame.listParamIdx.push_back(i);
+            frame.listDataOffset.push_back(tableNumDataBytes[frameIdx]);
+            frame.msgDefine.listReqDataBytes[0] << ubyte(did >> 8)
+                                                << ubyte(did & 0xFF)
+                                                << 0x01
+                                                << ubyte(numDataBytes);
+
+            tableNumDataBytes[frameIdx] += numDataBytes;
+            frame.msgData.expDataByteCount = tableNumDataBytes[frameIdx];
+        }
+
+        // format the define requests now that all
+        // of the sources have been added
+        for(int i=0; i < listFrames.size(); i++)   {
+            PeriodicFrame &frame = listFrames[i];
+            formatReqData_ISO_15765(listParams[frame.listParamIdx[0]],
+                                    frame.msgDefine.listReqDataBytes);
+        }
+    }
+
+    bool Parser::ParsePeriodicFrame(QList<ParameterFrame> &listParams,
+                                    PeriodicFrame &periodicFrame,
+                                    QList<Data> &listData)
+    {
+        if(periodicFrame.listParamIdx.isEmpty())   {
+            return true;
+        }
+
+        ParameterFrame const &firstParam =
+            listParams[periodicFrame.listParamIdx[0]];
+
+        // clean the periodic messages: [periodicId] is
+        // removed as the prefix, which leaves the data
+        // for each parameter at its offset
+        MessageData &msg = periodicFrame.msgData;
+        int headerLength = (firstParam.iso15765_extendedId) ? 4 : 2;
+        resetIncrementalState(msg);
+        if(periodicFrame.layout == PERIODIC_LAYOUT_UUDT)   {
+            cleanFrames_UUDT(msg,headerLength,0);
+        }
+        else   {
+            cleanFrames_ISO_15765(msg,headerLength,0);
+        }
+        if(msg.listHeaders.empty())   {
+            OBDREFERROR << "Error: ISO 15765-4, empty message data";
+            return false;
+        }
+
+        for(int i=0; i < periodicFrame.listParamIdx.size(); i++)   {
+            ParameterFrame &param = listParams[periodicFrame.listParamIdx[i]];
+            MessageData &paramMsg = param.listMessageData[0];
+            resetIncrementalState(paramMsg);
+
+            int const offset = periodicFrame.listDataOffset[i];
+            int const numDataBytes = paramMsg.expDataByteCount;
+
+            for(int j=0; j < msg.listHeaders.size(); j++)   {
+                ByteList const &dataBytes = msg.listData[j];
+                if(dataBytes.size() < offset+numDataBytes)   {
+                    OBDREFWARN << "Warn: ISO 15765-4, truncated "
+                                  "periodic message";
+                    continue;
+                }
+                paramMsg.listHeaders << msg.listHeaders[j];
+                paramMsg.listData << dataBytes.mid(offset,numDataBytes);
+            }
+        }
+
+        // parse
+        bool parsedOk=true;
+        for(int i=0; i < periodicFrame.listParamIdx.size(); i++)   {
+            ParameterFrame &param = listParams[periodicFrame.listParamIdx[i]];
+            if(param.listMessageData[0].listData.isEmpty())   {
+                continue;
+            }
+            if(!parseResponse(param,listData))   {
+                OBDREFERROR << "Error: Could not parse message";
+                parsedOk=false;
+            }
+        }
+        return parsedOk;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    int Parser::CountCompleteResponses(ParameterFrame const &paramFrame,
+                                       int const msgIdx)
+    {
+        if(msgIdx < 0 || msgIdx >= paramFrame.listMessageData.size())   {
+            OBDREFERROR << "Error: invalid message index";
+            return 0;
+        }
+        MessageData const &msg = paramFrame.listMessageData[msgIdx];
+
+        m_listIdxAccepted.clear();
+        if(paramFrame.parseProtocol < 0xA00 ||
+           paramFrame.parseProtocol == PROTOCOL_ISO_14230)
+        {
+            bool const isLegacy = (paramFrame.parseProtocol < 0xA00);
+            if(isLegacy)   {
+                m_frameFilter.FilterFrames_Legacy(msg,0,m_listIdxAccepted);
+            }
+            else   {
+                m_frameFilter.FilterFrames_ISO_14230(msg,0,m_listIdxAccepted);
+            }
+
+            // [h0 h1 h2] [prefix] [data]
+            int const minFrameSize = 3 + msg.expDataPrefix.size() +
+                    qMax(msg.expDataByteCount,0);
+
+            // each responder has to send expFramesPerResponse
+            // distinct frames; repeated frames only count once
+            int const expFrameCount = qMax(msg.expFramesPerResponse,1);
+            QList<ByteList> listResponders;
+            QList<QList<int> > listResponderFrames;
+
+            for(int i=0; i < m_listIdxAccepted.size(); i++)
+            {
+                ByteList const &rawFrame = msg.listRawFrames[m_listIdxAccepted[i]];
+
+                ByteList responderId;
+                if(isLegacy)   {
+                    if(rawFrame.size() < minFrameSize)   {
+                        continue;
+                    }
+                    // [prio] [target] [source]
+                    responderId << rawFrame[0] << rawFrame[1] << rawFrame[2];
+                }
+                else   {
+                    // the data length is in the format byte
+                    // or in a separate length byte (see
+                    // FrameFilter::FilterFrames_ISO_14230)
+                    ubyte const formatByte = rawFrame[0];
+                    bool const noAddressing = ((formatByte >> 6) == 0);
+                    bool const hasLengthByte = ((formatByte & 0x3F) == 0);
+
+                    int headerLength=4;
+                    if(noAddressing)   { headerLength -= 2; }
+                    if(!hasLengthByte) { headerLength -= 1; }
+
+                    int const dataLength = (hasLengthByte) ?
+                        rawFrame[headerLength-1] : (formatByte & 0x3F);
+
+                    if(dataLength-msg.expDataPrefix.size() <
+                       qMax(msg.expDataByteCount,0))   {
+                        continue;
+                    }
+
+                    // [format] [target] [source]; the format
+                    // byte also holds the data length
+                    if(!noAddressing)   {
+                        responderId << (formatByte & 0xC0)
+                                    << rawFrame[1] << rawFrame[2];
+                    }
+                }
+
+                int idxResponder = listResponders.indexOf(responderId);
+                if(idxResponder == -1)   {
+                    idxResponder = listResponders.size();
+                    listResponders << responderId;
+                    listResponderFrames << QList<int>();
+                }
+
+                QList<int> &listFrames = listResponderFrames[idxResponder];
+                bool repeated=false;
+                for(int k=0; k < listFrames.size(); k++)   {
+                    if(msg.listRawFrames[listFrames[k]] == rawFrame)   {
+                        repeated=true;
+                        break;
+                    }
+                }
+                if(!repeated)   {
+                    listFrames << m_listIdxAccepted[i];
+                }
+            }
+
+            int numResponses=0;
+            for(int i=0; i < listResponderFrames.size(); i++)   {
+                if(listResponderFrames[i].size() >= expFrameCount)   {
+                    numResponses++;
+                }
+            }
+            return numResponses;
+        }
+        else if(paramFrame.parseProtocol != PROTOCOL_ISO_15765)   {
+            OBDREFERROR << "ERROR: protocol not yet supported";
+            return 0;
+        }
+
+        int const headerLength = (paramFrame.iso15765_extendedId) ? 4 : 2;
+        m_frameFilter.FilterFrames_ISO_15765(msg,headerLength,0,m_listIdxAccepted);
+
+        // messages waiting on consecutive frames
+        QList<MultiFrameMessage> listPartialMessages;
+        int numResponses=0;
+
+        for(int i=0; i < m_listIdxAccepted.size(); i++)
+        {
+            ByteList const &rawFrame = msg.listRawFrames[m_listIdxAccepted[i]];
+
+            ByteList headerBytes;
+            for(int k=0; k < headerLength; k++)   {
+                headerBytes << rawFrame[k];
+            }
+
+            int idxPartial=-1;
+            for(int k=0; k < listPartialMessages.size(); k++)   {
+                if(listPartialMessages[k].header == headerBytes)   {
+                    idxPartial = k;
+                    break;
+                }
+            }
+
+            ubyte const pciByte = rawFrame[headerLength];
+            if((pciByte >> 4) == 0)   {
+                // [single frame]
+                if(idxPartial != -1)   {
+                    listPartialMessages.removeAt(idxPartial);
+                }
+                int const dataLength = pciByte & 0x0F;
+                if(dataLength >= msg.expDataPrefix.size() +
+                   qMax(msg.expDataByteCount,0))   {
+                    numResponses++;
+                }
+            }
+            else if((pciByte >> 4) == 1)   {
+                // [first frame]
+                if(idxPartial != -1)   {
+                    listPartialMessages.removeAt(idxPartial);
+                }
+                if(rawFrame.size() < headerLength+2)   {
+                    continue;
+                }
+                MultiFrameMessage partial;
+                partial.header = headerBytes;
+                partial.dataLength = ((pciByte & 0x0F) << 8) +
+                                     rawFrame[headerLength+1];
+                int const numBytes = rawFrame.size()-headerLength-2;
+                if(numBytes >= partial.dataLength)   {
+                    numResponses++;
+                    continue;
+                }
+                // data isn't saved; dataLength is used as
+                // the number of bytes still expected
+                partial.dataLength -= numBytes;
+                listPartialMessages << partial;
+            }
+            else if((pciByte >> 4) == 2)   {
+                // [consecutive frame]
+                if(idxPartial == -1)   {
+                    continue;
+                }
+                MultiFrameMessage &partial = listPartialMessages[idxPartial];
+                if(pciByte != partial.nextPciByte)   {
+                    listPartialMessages.removeAt(idxPartial);
+                    continue;
+                }
+                partial.dataLength -= (rawFrame.size()-headerLength-1);
+                if(partial.dataLength <= 0)   {
+                    numResponses++;
+                    listPartialMessages.removeAt(idxPartial);
+                    continue;
+                }
+                partial.nextPciByte+=0x01;
+                if(partial.nextPciByte == 0x30)   {
+                    partial.nextPciByte = 0x20;
+                }
+            }
+        }
+        return numResponses;
+    }
+
+    bool Parser::IsMessageComplete(ParameterFrame const &paramFrame,
+                                   int const msgIdx)
+    {
+        if(msgIdx < 0 || msgIdx >= paramFrame.listMessageData.size())   {
+            OBDREFERROR << "Error: invalid message index";
             return false;
         }
+        int const expResponseCount =
+            paramFrame.listMessageData[msgIdx].expResponseCount;
 
+        if(expResponseCount < 0)   {
+            return false;
+        }
+        return (CountCompleteResponses(paramFrame,msgIdx) >= expResponseCount);
+    }
+
+    bool Parser::IsParameterFrameComplete(ParameterFrame const &paramFrame)
+    {
+        for(int i=0; i < paramFrame.listMessageData.size(); i++)   {
+            if(!IsMessageComplete(paramFrame,i))   {
+                return false;
+            }
+        }
         return true;
     }
 
@@ -396,7 +1285,7 @@ namespace obdref
                 {   break;   }
 
                 pugi::xml_node nodeParams = nodeSpec.child("parameters");
-                for(; nodeParams!=NULL; nodeParams = nodeProtocol.next_sibling("parameters"))
+                for(; nodeParams!=NULL; nodeParams = nodeParams.next_sibling("parameters"))
                 {
                     QString fileParamsName(nodeParams.attribute("address").value());
                     if(fileParamsName == addressName)
@@ -415,6 +1304,36 @@ namespace obdref
         return myParamList;
     }
 
+    QStringList Parser::GetParameterNames(QString const &specName,
+                                          QString const &protocolName,
+                                          QString const &addressName,
+                                          SupportedPids const &supportedPids)
+    {
+        QStringList listNames =
+            GetParameterNames(specName,protocolName,addressName);
+
+        if(!supportedPids.HasData())   {
+            return listNames;
+        }
+
+        QStringList listSupportedNames;
+        for(int i=0; i < listNames.size(); i++)   {
+            ParameterFrame paramFrame;
+            paramFrame.spec = specName;
+            paramFrame.protocol = protocolName;
+            paramFrame.address = addressName;
+            paramFrame.name = listNames[i];
+
+            // parameters that can't be built are left in
+            // so errors are reported where they're used
+            if(!BuildParameterFrame(paramFrame) ||
+               supportedPids.IsParameterSupported(paramFrame))   {
+                listSupportedNames << listNames[i];
+            }
+        }
+        return listSupportedNames;
+    }
+
     // ========================================================================== //
     // ========================================================================== //
 
@@ -437,12 +1356,33 @@ namespace obdref
     // ========================================================================== //
     // ========================================================================== //
 
+    void Parser::ResetRejectStats()
+    {
+        m_rejectStats = RejectStats();
+        m_rejectsSinceLog = 0;
+    }
+
+    void Parser::ResetProfiler()
+    {
+        m_profiler.Reset();
+    }
+
+    void Parser::SetRejectLogInterval(quint32 const logInterval)
+    {
+        m_rejectLogInterval = logInterval;
+        m_rejectsSinceLog = 0;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
     bool Parser::jsInit()
     {
         // create js heap and default context
-        m_js_ctx = duk_create_heap_default();
+        m_js_ctx = duk_create_heap(jsAlloc,jsRealloc,jsFree,
+                                   &m_jsHeapStats,NULL);
         if(!m_js_ctx)   {
-            OBDREFDEBUG << "ERROR: Could not create JS context";
+            OBDREFERROR << "ERROR: Could not create JS context";
             return false;
         }
 
@@ -477,7 +1417,7 @@ namespace obdref
         m_js_idx_f_get_num_data     = duk_normalize_index(m_js_ctx,-4);
         m_js_idx_f_get_lit_data     = duk_normalize_index(m_js_ctx,-5);
 
-        // evaluate and save all parse functions
+        // save all parse functions
         pugi::xml_node xnSpec = m_xmlDoc.child("spec");
         for(; xnSpec!=NULL; xnSpec=xnSpec.next_sibling("spec"))
         {   // for each spec
@@ -492,28 +1432,27 @@ namespace obdref
                     QString param(xnParam.attribute("name").value());
                     pugi::xml_node xnScript = xnParam.child("script");
                     for(; xnScript!=NULL; xnScript=xnScript.next_sibling("script"))
-                    {   // for each script
-                        QString protocols(xnScript.attribute("protocols").value());
-                        QString script(xnScript.child_value());
-
-                        // add parse function name and scope
-                        QString idx=QString::number(m_js_listFunctionKey.size(),10);
-                        QString fname = "f"+idx;
-                        script.prepend("function "+fname+"() {");
-                        script.append("}");
-
-                        // register parse function to global js object
-                        duk_eval_string(m_js_ctx,script.toLocal8Bit().data());
-                        duk_pop(m_js_ctx);
-
-                        // add parse function to top of stack
-                        duk_get_prop_string(m_js_ctx,m_js_idx_global_object,
-                                            fname.toLocal8Bit().data());
+                    {   // for each script
+                        QString protocols(xnScript.attribute("protocols").value());
 
-                        // save unique key string and stack index for function
+                        // save unique key string for the function; it's
+                        // compiled when it's first needed (jsCompileFunction)
                         QString jsFunctionKey = spec+":"+address+":"+param+":"+protocols;
+                        if(!m_js_tableFunctionKeyIdx.contains(jsFunctionKey))   {
+                            m_js_tableFunctionKeyIdx.insert(jsFunctionKey,
+                                                            m_js_listFunctionKey.size());
+                        }
                         m_js_listFunctionKey.push_back(jsFunctionKey);
-                        m_js_listFunctionIdx.push_back(duk_normalize_index(m_js_ctx,-1));
+                        m_js_listFunctionIdx.push_back(JS_FUNCTION_NOT_COMPILED);
+                        m_js_listFunctionScript.push_back(xnScript);
+                    }
+
+                    // index the parameter node (the first one
+                    // wins if a name is repeated, like a search
+                    // through the file would)
+                    QString const paramKey = spec+":"+address+":"+param;
+                    if(!m_tableParamNodes.contains(paramKey))   {
+                        m_tableParamNodes.insert(paramKey,xnParam);
                     }
                 }
             }
@@ -524,6 +1463,38 @@ namespace obdref
     // ========================================================================== //
     // ========================================================================== //
 
+    bool Parser::jsCompileFunction(int const functionKeyIdx)
+    {
+        if(m_js_listFunctionIdx[functionKeyIdx] != JS_FUNCTION_NOT_COMPILED)   {
+            return true;
+        }
+
+        // add parse function name and scope
+        QString script(m_js_listFunctionScript[functionKeyIdx].child_value());
+        QString fname = "f"+QString::number(functionKeyIdx,10);
+        script.prepend("function "+fname+"() {");
+        script.append("}");
+
+        // register parse function to global js object
+        duk_push_string(m_js_ctx,script.toLocal8Bit().data());
+        if(duk_safe_call(m_js_ctx,jsSafeEval,1,1,DUK_INVALID_INDEX) != DUK_EXEC_SUCCESS)   {
+            OBDREFERROR << "Error: could not compile parse function "
+                        << fname << ":" << duk_to_string(m_js_ctx,-1);
+            duk_pop(m_js_ctx);
+            return false;
+        }
+        duk_pop(m_js_ctx);
+
+        // add parse function to top of stack and save its index
+        duk_get_prop_string(m_js_ctx,m_js_idx_global_object,
+                            fname.toLocal8Bit().data());
+        m_js_listFunctionIdx[functionKeyIdx] = duk_normalize_index(m_js_ctx,-1);
+        return true;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
     bool Parser::buildHeader_Legacy(ParameterFrame &paramFrame,
                                     pugi::xml_node xnAddress)
     {
@@ -540,7 +1511,7 @@ namespace obdref
 
             // all three bytes must be defined
             if(prio.isEmpty() || target.isEmpty() || source.isEmpty())   {
-                OBDREFDEBUG << "Error: ISO 9141-2/SAE J1850,"
+                OBDREFERROR << "Error: ISO 9141-2/SAE J1850,"
                             << "Incomplete Request Header";
                 return false;
             }
@@ -551,7 +1522,7 @@ namespace obdref
             msg.reqHeaderBytes << stringToUInt(okSource,source);
 
             if(!(okPrio&&okTarget&&okSource))   {
-                OBDREFDEBUG << "Error: ISO 9141-2/SAE J1850,"
+                OBDREFERROR << "Error: ISO 9141-2/SAE J1850,"
                                "bad request header";
                 return false;
             }
@@ -559,8 +1530,8 @@ namespace obdref
         else   {
             // for messages without requests,
             // we use an empty header
-            OBDREFDEBUG << "Warn: ISO 9141-2/SAE J1850,"
-                        << "No Request Header";
+            OBDREFWARN << "Warn: ISO 9141-2/SAE J1850,"
+                       << "No Request Header";
         }
 
         // preemptively fill out response header
@@ -594,7 +1565,7 @@ namespace obdref
             }
 
             if(!(okPrio&&okTarget&&okSource))   {
-                OBDREFDEBUG << "Error: ISO 9141-2/SAE J1850,"
+                OBDREFERROR << "Error: ISO 9141-2/SAE J1850,"
                                "bad response header";
                 return false;
             }
@@ -644,7 +1615,7 @@ namespace obdref
         if(xnReq)   {
             QString format(xnReq.attribute("format").value());
             if(format.isEmpty())   {
-                OBDREFDEBUG << "Error: ISO 14230, request "
+                OBDREFERROR << "Error: ISO 14230, request "
                             << "header is missing format byte";
                 return false;
             }
@@ -654,7 +1625,7 @@ namespace obdref
             msg.reqHeaderBytes << formatByte;
 
             if(!convOk)   {
-                OBDREFDEBUG << "Error: ISO 14230, invalid "
+                OBDREFERROR << "Error: ISO 14230, invalid "
                                "request header format byte";
                 return false;
             }
@@ -670,15 +1641,15 @@ namespace obdref
                 msg.reqHeaderBytes << stringToUInt(okSource,source);
 
                 if(!(okTarget&&okSource))   {
-                    OBDREFDEBUG << "Error: ISO 14230, invalid "
+                    OBDREFERROR << "Error: ISO 14230, invalid "
                                    "request source/target bytes";
                     return false;
                 }
             }
         }
         else   {
-            OBDREFDEBUG << "Warn: ISO 14230,"
-                        << "no request header";
+            OBDREFWARN << "Warn: ISO 14230,"
+                       << "no request header";
         }
 
         // preemptively fill out response header
@@ -714,7 +1685,7 @@ namespace obdref
             }
 
             if(!(okFormat&&okTarget&&okSource))   {
-                OBDREFDEBUG << "Error: ISO 14230,"
+                OBDREFERROR << "Error: ISO 14230,"
                                "invalid response header";
                 return false;
             }
@@ -739,28 +1710,30 @@ namespace obdref
         // store 11-bit header in two bytes
         if(!paramFrame.iso15765_extendedId)   {
             // request header bytes
+            quint32 reqId = 0;
             pugi::xml_node xnReq = xnAddress.child("request");
             if(xnReq)   {
                 QString identifier(xnReq.attribute("identifier").value());
                 if(identifier.isEmpty())   {
-                    OBDREFDEBUG << "Error: ISO 15765-4 std,"
+                    OBDREFERROR << "Error: ISO 15765-4 std,"
                                 << "Incomplete Request Header";
                     return false;
                 }
                 bool convOk = false;
                 quint32 headerVal = stringToUInt(convOk,identifier);
                 if(!convOk)   {
-                    OBDREFDEBUG << "Error: ISO 15765 std, "
+                    OBDREFERROR << "Error: ISO 15765 std, "
                                    "bad response header";
                     return false;
                 }
                 ubyte upperByte = ((headerVal & 0xF00) >> 8);
                 ubyte lowerByte = (headerVal & 0xFF);
                 msg.reqHeaderBytes << upperByte << lowerByte;
+                reqId = headerVal & 0x7FF;
             }
             else   {
-                OBDREFDEBUG << "Warn: ISO 15765 std, "
-                               "no request header";
+                OBDREFWARN << "Warn: ISO 15765 std, "
+                              "no request header";
             }
 
             // preemptively fill out response header
@@ -774,14 +1747,14 @@ namespace obdref
             if(xnResp)   {
                 QString identifier(xnResp.attribute("identifier").value());
                 if(identifier.isEmpty())   {
-                    OBDREFDEBUG << "Error: ISO 15765-4 std,"
+                    OBDREFERROR << "Error: ISO 15765-4 std,"
                                 << "incomplete response header";
                     return false;
                 }
                 bool convOk = false;
                 quint32 headerVal = stringToUInt(convOk,identifier);
                 if(!convOk)   {
-                    OBDREFDEBUG << "Error: ISO 15765 std, "
+                    OBDREFERROR << "Error: ISO 15765 std, "
                                    "bad request header";
                     return false;
                 }
@@ -789,6 +1762,28 @@ namespace obdref
                 ubyte lowerByte = (headerVal & 0xFF);
                 msg.expHeaderBytes[0] = upperByte;
                 msg.expHeaderBytes[1] = lowerByte;
+
+                // every ecu answers a functional request
+                // with its own id (0x7E8-0x7EF)
+                quint32 const respMask = (reqId == 0x7DF) ? 0x7F8 : 0x7FF;
+                msg.expHeaderMask[0] = ubyte(respMask >> 8);
+                msg.expHeaderMask[1] = ubyte(respMask & 0xFF);
+            }
+            else if(reqId == 0x7DF)   {
+                // functional request: 0x7E8-0x7EF
+                msg.expHeaderBytes[0] = 0x07;
+                msg.expHeaderBytes[1] = 0xE8;
+                msg.expHeaderMask[0] = 0x07;
+                msg.expHeaderMask[1] = 0xF8;
+            }
+            else if(reqId >= 0x7E0 && reqId <= 0x7E7)   {
+                // physical request: the ecu answers
+                // with its request id + 8
+                quint32 const respId = reqId+8;
+                msg.expHeaderBytes[0] = ubyte(respId >> 8);
+                msg.expHeaderBytes[1] = ubyte(respId & 0xFF);
+                msg.expHeaderMask[0] = 0x07;
+                msg.expHeaderMask[1] = 0xFF;
             }
         }
         // ISO 15765-4 (29-bit extended id)
@@ -805,7 +1800,7 @@ namespace obdref
                 // all four bytes must be defined
                 if(prio.isEmpty() || format.isEmpty() ||
                    target.isEmpty() || source.isEmpty())   {
-                    OBDREFDEBUG << "Error: ISO 15765-4 Ext,"
+                    OBDREFERROR << "Error: ISO 15765-4 Ext,"
                                 << "incomplete request header";
                     return false;
                 }
@@ -817,15 +1812,15 @@ namespace obdref
                 msg.reqHeaderBytes << stringToUInt(okSource,source);
 
                 if(!(okPrio&&okFormat&&okTarget&&okSource))   {
-                    OBDREFDEBUG << "Error: ISO 15765-4 Ext,"
+                    OBDREFERROR << "Error: ISO 15765-4 Ext,"
                                 << "invalid request header";
                     return false;
                 }
 
             }
             else   {
-                OBDREFDEBUG << "Warn: ISO 15765 ext, "
-                               "no request header";
+                OBDREFWARN << "Warn: ISO 15765 ext, "
+                              "no request header";
             }
 
             // preemptively fill out response header
@@ -837,10 +1832,10 @@ namespace obdref
             // response header bytes
             pugi::xml_node xnResp = xnAddress.child("response");
             if(xnResp)   {
-                QString prio(xnReq.attribute("prio").value());
-                QString format(xnReq.attribute("format").value());
-                QString target(xnReq.attribute("target").value());
-                QString source(xnReq.attribute("source").value());
+                QString prio(xnResp.attribute("prio").value());
+                QString format(xnResp.attribute("format").value());
+                QString target(xnResp.attribute("target").value());
+                QString source(xnResp.attribute("source").value());
 
                 bool okPrio   = true;
                 bool okFormat = true;
@@ -859,13 +1854,13 @@ namespace obdref
                     msg.expHeaderBytes[2] = stringToUInt(okTarget,target);
                     msg.expHeaderMask[2] = 0xFF;
                 }
-                if(!target.isEmpty())   {
+                if(!source.isEmpty())   {
                     msg.expHeaderBytes[3] = stringToUInt(okSource,source);
                     msg.expHeaderMask[3] = 0xFF;
                 }
 
                 if(!(okPrio&&okFormat&&okTarget&&okSource))   {
-                    OBDREFDEBUG << "Error: ISO 15765-4 ext, "
+                    OBDREFERROR << "Error: ISO 15765-4 ext, "
                                    "invalid response header";
                     return false;
                 }
@@ -897,7 +1892,7 @@ namespace obdref
                 return true;
             }
             else if((!request.isEmpty()) && (!request0.isEmpty()))   {
-                OBDREFDEBUG << "Error: mixed single and multiple requests";
+                OBDREFERROR << "Error: mixed single and multiple requests";
                 return false;
             }
             else if(request.isEmpty())   {
@@ -976,7 +1971,7 @@ namespace obdref
                 msg.listReqDataBytes[0] << stringToUInt(convOk,sl_request[i]);
             }
             if(msg.listReqDataBytes[0].isEmpty())   {
-                OBDREFDEBUG << "Error: invalid request data bytes";
+                OBDREFERROR << "Error: invalid request data bytes";
                 return false;
             }
 
@@ -1017,65 +2012,8 @@ namespace obdref
         if(paramFrame.parseProtocol == PROTOCOL_ISO_15765)
         {
             for(int i=0; i < paramFrame.listMessageData.size(); i++)   {
-                MessageData &msg = paramFrame.listMessageData[i];
-                QList<ByteList> &listReqDataBytes = msg.listReqDataBytes;
-                int dataLength = listReqDataBytes[0].size();
-
-                if(paramFrame.iso15765_splitReqIntoFrames && dataLength > 7)   {
-                    // split the request data into frames
-                    ubyte idxFrame = 0;
-                    ByteList emptyByteList;
-
-                    // (first frame)
-                    // truncate the current frame after six
-                    // bytes and copy to the next frame
-                    listReqDataBytes << emptyByteList;
-                    while(listReqDataBytes[idxFrame].size() > 6)   {
-                        ubyte dataByte = listReqDataBytes[idxFrame].takeAt(6);
-                        listReqDataBytes[idxFrame+1] << dataByte;
-                    }
-                    idxFrame++;
-
-                    // (consecutive frames)
-                    // truncate the current frame after seven
-                    // bytes and copy to the next frame
-                    while(listReqDataBytes[idxFrame].size() > 7)   {
-                        listReqDataBytes << emptyByteList;
-                        while(listReqDataBytes[idxFrame].size() > 7)   {
-                            ubyte dataByte = listReqDataBytes[idxFrame].takeAt(7);
-                            listReqDataBytes[idxFrame+1] << dataByte;
-                        }
-                        idxFrame++;
-                    }
-                }
-                if(paramFrame.iso15765_addPciByte)   {
-                    // (single frame)
-                    // * higher 4 bits set to 0 for a single frame
-                    // * lower 4 bits gives the number of data bytes
-                    if(listReqDataBytes.size() == 1)   {
-                        ubyte pciByte = listReqDataBytes[0].size();
-                        listReqDataBytes[0].prepend(pciByte);
-                    }
-                    // (multi frame)
-                    else   {
-                        // (first frame)
-                        // higher 4 bits set to 0001
-                        // lower 12 bits give number of data bytes
-                        ubyte lowerByte = (dataLength & 0x0FF);
-                        ubyte upperByte = (dataLength & 0xF00) >> 8;
-                        upperByte += 16;    // += 0b1000
-
-                        listReqDataBytes[0].prepend(lowerByte);
-                        listReqDataBytes[0].prepend(upperByte);
-
-                        // (consecutive frames)
-                        // * cycle 0x20-0x2F for each CF starting with 0x21
-                        for(int j=1; j < listReqDataBytes.size(); j++)   {
-                            ubyte pciByte = 0x20 + (j % 0x10);
-                            listReqDataBytes[j].prepend(pciByte);
-                        }
-                    }
-                }
+                formatReqData_ISO_15765(paramFrame,
+                    paramFrame.listMessageData[i].listReqDataBytes);
             }
         }
 
@@ -1089,7 +2027,7 @@ namespace obdref
                 int dataLength = listReqDataBytes[0].size();
 
                 if(dataLength > 255)   {
-                    OBDREFDEBUG << "Error: ISO 14230, invalid"
+                    OBDREFERROR << "Error: ISO 14230, invalid"
                                    "data length ( > 255)";
                     return false;
                 }
@@ -1101,7 +2039,7 @@ namespace obdref
                 else   {
                     // encode length in format byte
                     if(dataLength > 63)   {
-                        OBDREFDEBUG << "Error: ISO 14230, invalid"
+                        OBDREFERROR << "Error: ISO 14230, invalid"
                                        "data length ( > 63)";
                         return false;
                     }
@@ -1115,15 +2053,157 @@ namespace obdref
     // ========================================================================== //
     // ========================================================================== //
 
+    int Parser::getReadDataId(ParameterFrame const &paramFrame)
+    {
+        if((paramFrame.parseProtocol != PROTOCOL_ISO_15765) ||
+           (paramFrame.functionKeyIdx == -1) ||
+           (paramFrame.listMessageData.size() != 1))   {
+            return -1;
+        }
+
+        // a periodic message has room for six data bytes
+        MessageData const &msg = paramFrame.listMessageData[0];
+        if((msg.listReqDataBytes.size() != 1) ||
+           (msg.expDataByteCount < 1) ||
+           (msg.expDataByteCount > 6) ||
+           (msg.expDataPrefix.size() != 3))   {
+            return -1;
+        }
+
+        // [pci] [0x22] [DID hi] [DID lo]
+        ByteList const &reqDataBytes = msg.listReqDataBytes[0];
+        int const idxService = (paramFrame.iso15765_addPciByte) ? 1 : 0;
+        if((reqDataBytes.size() != idxService+3) ||
+           (reqDataBytes[idxService] != 0x22))   {
+            return -1;
+        }
+
+        // [0x62] [DID hi] [DID lo]
+        if((msg.expDataPrefix[0] != 0x62) ||
+           (msg.expDataPrefix[1] != reqDataBytes[idxService+1]) ||
+           (msg.expDataPrefix[2] != reqDataBytes[idxService+2]))   {
+            return -1;
+        }
+
+        return (reqDataBytes[idxService+1] << 8) |
+                reqDataBytes[idxService+2];
+    }
+
+    int Parser::getMode01Pid(ParameterFrame const &paramFrame)
+    {
+        if((paramFrame.parseProtocol != PROTOCOL_ISO_15765) ||
+           (paramFrame.functionKeyIdx == -1) ||
+           (paramFrame.listMessageData.size() != 1))   {
+            return -1;
+        }
+
+        MessageData const &msg = paramFrame.listMessageData[0];
+        if((msg.listReqDataBytes.size() != 1) ||
+           (msg.expDataByteCount < 1) ||
+           (msg.expDataPrefix.size() != 2))   {
+            return -1;
+        }
+
+        // [pci] [0x01] [pid]
+        ByteList const &reqDataBytes = msg.listReqDataBytes[0];
+        int const idxMode = (paramFrame.iso15765_addPciByte) ? 1 : 0;
+        if((reqDataBytes.size() != idxMode+2) ||
+           (reqDataBytes[idxMode] != 0x01))   {
+            return -1;
+        }
+
+        // [0x41] [pid]
+        ubyte const pid = reqDataBytes[idxMode+1];
+        if((msg.expDataPrefix[0] != 0x41) ||
+           (msg.expDataPrefix[1] != pid))   {
+            return -1;
+        }
+
+        return pid;
+    }
+
+    void Parser::formatReqData_ISO_15765(ParameterFrame const &paramFrame,
+                                         QList<ByteList> &listReqDataBytes)
+    {
+        int dataLength = listReqDataBytes[0].size();
+
+        if(paramFrame.iso15765_splitReqIntoFrames && dataLength > 7)   {
+            // split the request data into frames
+            ubyte idxFrame = 0;
+            ByteList emptyByteList;
+
+            // (first frame)
+            // truncate the current frame after six
+            // bytes and copy to the next frame
+            listReqDataBytes << emptyByteList;
+            while(listReqDataBytes[idxFrame].size() > 6)   {
+                ubyte dataByte = listReqDataBytes[idxFrame].takeAt(6);
+                listReqDataBytes[idxFrame+1] << dataByte;
+            }
+            idxFrame++;
+
+            // (consecutive frames)
+            // truncate the current frame after seven
+            // bytes and copy to the next frame
+            while(listReqDataBytes[idxFrame].size() > 7)   {
+                listReqDataBytes << emptyByteList;
+                while(listReqDataBytes[idxFrame].size() > 7)   {
+                    ubyte dataByte = listReqDataBytes[idxFrame].takeAt(7);
+                    listReqDataBytes[idxFrame+1] << dataByte;
+                }
+                idxFrame++;
+            }
+        }
+        if(paramFrame.iso15765_addPciByte)   {
+            // (single frame)
+            // * higher 4 bits set to 0 for a single frame
+            // * lower 4 bits gives the number of data bytes
+            if(listReqDataBytes.size() == 1)   {
+                ubyte pciByte = listReqDataBytes[0].size();
+                listReqDataBytes[0].prepend(pciByte);
+            }
+            // (multi frame)
+            else   {
+                // (first frame)
+                // higher 4 bits set to 0001
+                // lower 12 bits give number of data bytes
+                ubyte lowerByte = (dataLength & 0x0FF);
+                ubyte upperByte = (dataLength & 0xF00) >> 8;
+                upperByte += 16;    // += 0b1000
+
+                listReqDataBytes[0].prepend(lowerByte);
+                listReqDataBytes[0].prepend(upperByte);
+
+                // (consecutive frames)
+                // * cycle 0x20-0x2F for each CF starting with 0x21
+                for(int j=1; j < listReqDataBytes.size(); j++)   {
+                    ubyte pciByte = 0x20 + (j % 0x10);
+                    listReqDataBytes[j].prepend(pciByte);
+                }
+            }
+        }
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
     bool Parser::parseResponse(ParameterFrame const &msgFrame,
                                QList<Data> &listData)
     {
         if(msgFrame.functionKeyIdx < 0)   {
-            OBDREFDEBUG << "Error: parseResponse: invalid function idx";
+            OBDREFERROR << "Error: parseResponse: invalid function idx";
             return false;
         }
         int js_f_idx = msgFrame.functionKeyIdx;
 
+        // BuildParameterFrame compiles the function, but the
+        // frame may have been built by another Parser
+        if(js_f_idx >= m_js_listFunctionIdx.size() ||
+           !jsCompileFunction(js_f_idx))   {
+            OBDREFERROR << "Error: parseResponse: could not compile function";
+            return false;
+        }
+
         if(msgFrame.parseMode == PARSE_SEPARATELY)
         {
             // * default parse mode -- the parse script is run
@@ -1134,12 +2214,16 @@ namespace obdref
 
             for(int i=0; i < msgFrame.listMessageData.size(); i++)
             {
+                // entries before idxNextData were already
+                // parsed (see ParseParameterFrameIncremental)
                 MessageData const &msg = msgFrame.listMessageData[i];
-                for(int j=0; j < msg.listHeaders.size(); j++)
+                for(int j=msg.idxNextData; j < msg.listHeaders.size(); j++)
                 {
                     ByteList const &headerBytes = msg.listHeaders[j];
                     ByteList const &dataBytes = msg.listData[j];
 
+                    OBDREF_PROFILE_START(profileTimer);
+
                     obdref::Data parsedData;
 
                     // fill out parameter data
@@ -1162,11 +2246,13 @@ namespace obdref
                     duk_put_prop_index(m_js_ctx,list_arr_idx,0);
                     duk_call(m_js_ctx,1);
                     duk_pop(m_js_ctx);
+                    OBDREF_PROFILE_LAP(profileTimer,msgFrame.name,PROFILE_JS_MARSHAL);
 
                     // parse the data
                     duk_dup(m_js_ctx,m_js_listFunctionIdx[js_f_idx]);
                     duk_call(m_js_ctx,0);
                     duk_pop(m_js_ctx);
+                    OBDREF_PROFILE_LAP(profileTimer,msgFrame.name,PROFILE_JS_CALL);
 
                     // save results
                     this->saveNumAndLitData(parsedData);
@@ -1183,6 +2269,7 @@ namespace obdref
                     parsedData.listLiteralData.push_back(srcAddress);
 
                     listData.push_back(parsedData);
+                    OBDREF_PROFILE_LAP(profileTimer,msgFrame.name,PROFILE_SAVE_RESULTS);
                 }
             }
             return true;
@@ -1206,6 +2293,8 @@ namespace obdref
             //   - BYTE(N) is a single byte in that list of
             //     data bytes
 
+            OBDREF_PROFILE_START(profileTimer);
+
             // clear existing data in js context
             duk_dup(m_js_ctx,m_js_idx_f_clear_data);
             duk_call(m_js_ctx,0);
@@ -1249,14 +2338,18 @@ namespace obdref
                 duk_call(m_js_ctx,2);
                 duk_pop(m_js_ctx);
             }
+            OBDREF_PROFILE_LAP(profileTimer,msgFrame.name,PROFILE_JS_MARSHAL);
+
             // parse the data
             duk_dup(m_js_ctx,m_js_listFunctionIdx[js_f_idx]);
             duk_call(m_js_ctx,0);
             duk_pop(m_js_ctx);
+            OBDREF_PROFILE_LAP(profileTimer,msgFrame.name,PROFILE_JS_CALL);
 
             // save results
             this->saveNumAndLitData(parsedData);
             listData.push_back(parsedData);
+            OBDREF_PROFILE_LAP(profileTimer,msgFrame.name,PROFILE_SAVE_RESULTS);
             return true;
         }
         return false;
@@ -1337,71 +2430,77 @@ namespace obdref
     // ========================================================================== //
     // ========================================================================== //
 
-    bool Parser::cleanFrames_Legacy(MessageData &msg)
+    void Parser::cleanFrames_Legacy(MessageData &msg,
+                                    int const idxStart)
     {
         int const headerLength=3;
-        for(int j=0; j < msg.listRawFrames.size(); j++)
+        int const prefixLength=msg.expDataPrefix.size();
+
+        // filter out frames with a mismatched header
+        // or data prefix before splitting anything
+        m_listIdxAccepted.clear();
+        m_frameFilter.FilterFrames_Legacy(msg,idxStart,m_listIdxAccepted);
+
+        int const numRejected =
+            msg.listRawFrames.size()-idxStart-m_listIdxAccepted.size();
+
+        if(numRejected > 0)   {
+            RejectStats stats;
+            m_frameFilter.CountRejected(m_listIdxAccepted,idxStart,stats);
+            addRejectStats(msg,stats);
+        }
+
+        for(int j=0; j < m_listIdxAccepted.size(); j++)
         {
-            ByteList const &rawFrame = msg.listRawFrames[j];
+            ByteList const &rawFrame =
+                msg.listRawFrames[m_listIdxAccepted[j]];
 
             // Split each raw frame into a header and its
-            // corresponding data bytes
-            // [h0 h1 h2] [d0 d1 d2 d3 d4 d5 d6 ...]
+            // corresponding data bytes, skipping the prefix
+            // [h0 h1 h2] [prefix] [d0 d1 d2 d3 d4 d5 d6 ...]
             ByteList headerBytes;
             for(int k=0; k < headerLength; k++)   {
                 headerBytes << rawFrame[k];
             }
             ByteList dataBytes;
-            for(int k=headerLength; k < rawFrame.size(); k++)   {
+            for(int k=headerLength+prefixLength; k < rawFrame.size(); k++)   {
                 dataBytes << rawFrame[k];
             }
 
-            // check header
-            if(!checkBytesAgainstMask(msg.expHeaderBytes,
-                                      msg.expHeaderMask,
-                                      headerBytes))   {
-                OBDREFDEBUG << "Warn: SAE J1850/ISO 9141-2/ISO 14230-4, "
-                               "header bytes mismatch";
-                continue;
-            }
-
-            // check data prefix
-            bool dataPrefixOk = true;
-            for(int k=0; k < msg.expDataPrefix.size(); k++)   {
-                ubyte dataByte = dataBytes.takeAt(0);
-                if(dataByte != msg.expDataPrefix[k])   {
-                    dataPrefixOk = false;
-                    break;
-                }
-            }
-            if(!dataPrefixOk)   {
-                OBDREFDEBUG << "Warn: SAE J1850/ISO 9141-2/ISO 14230-4, "
-                               "data prefix mismatch";
-                continue;
-            }
-
             // save
             msg.listHeaders << headerBytes;
             msg.listData << dataBytes;
         }
-
-        if(msg.listHeaders.empty())   {
-            OBDREFDEBUG << "Error: SAE J1850/ISO 9141-2/ISO 14230-4, "
-                           "empty message data";
-            return false;
-        }
-
-        return true;
     }
 
     // ========================================================================== //
     // ========================================================================== //
 
-    bool Parser::cleanFrames_ISO_14230(MessageData &msg)
+    void Parser::cleanFrames_ISO_14230(MessageData &msg,
+                                       int const idxStart)
     {
-        for(int j=0; j < msg.listRawFrames.size(); j++)
+        int const prefixLength=msg.expDataPrefix.size();
+
+        // filter out frames with a mismatched header
+        // or data prefix before splitting anything; the
+        // filter resolves the header type for each frame
+        // (see below) and compares [format] [target] [source]
+        m_listIdxAccepted.clear();
+        m_frameFilter.FilterFrames_ISO_14230(msg,idxStart,m_listIdxAccepted);
+
+        int const numRejected =
+            msg.listRawFrames.size()-idxStart-m_listIdxAccepted.size();
+
+        if(numRejected > 0)   {
+            RejectStats stats;
+            m_frameFilter.CountRejected(m_listIdxAccepted,idxStart,stats);
+            addRejectStats(msg,stats);
+        }
+
+        for(int j=0; j < m_listIdxAccepted.size(); j++)
         {
-            ByteList const &rawFrame = msg.listRawFrames[j];
+            ByteList const &rawFrame =
+                msg.listRawFrames[m_listIdxAccepted[j]];
 
             // determine header type:
             // A [format]
@@ -1429,83 +2528,55 @@ namespace obdref
                 rawFrame[headerLength-1] : (rawFrame[0] & 0x3F);
 
             // split each raw frame into a header and its
-            // corresponding data bytes
+            // corresponding data bytes, skipping the prefix
             ByteList headerBytes;
             for(int k=0; k < headerLength; k++)   {
                 headerBytes << rawFrame[k];
             }
 
             ByteList dataBytes;
-            for(int k=headerLength; k < (headerLength+dataLength); k++)   {
+            for(int k=headerLength+prefixLength;
+                k < (headerLength+dataLength); k++)   {
                 dataBytes << rawFrame[k];
             }
 
-            // filter with expHeaderBytes
-            // for ISO 14230, by default expHeaderBytes
-            // looks like: [format] [target] [source]
-
-            // we add and remove bytes to match up with
-            // the actual header before comparing
-            ByteList expHeaderBytes,expHeaderMask;
-
-            // all headers have a format byte
-            expHeaderBytes << msg.expHeaderBytes[0];
-            expHeaderMask << msg.expHeaderMask[0];
-
-            switch(headerLength)   {
-                case 2:   { // [format] [length]
-                    expHeaderBytes << 0x00;
-                    expHeaderMask << 0x00;
-                    break;
-                }
-                case 3:   { // [format] [target] [source]
-                    expHeaderBytes << msg.expHeaderBytes[1] << msg.expHeaderBytes[2];
-                    expHeaderMask << msg.expHeaderMask[1] << msg.expHeaderMask[2];
-                    break;
-                }
-                case 4:   { // [format] [target] [source] [length]
-                    expHeaderBytes << msg.expHeaderBytes[1] << msg.expHeaderBytes[2] << 0x00;
-                    expHeaderMask << msg.expHeaderMask[1] << msg.expHeaderMask[2] << 0x00;
-                    break;
-                }
-                default:   {
-                    break;
-                }
-            }
-
-            // check for expected header bytes
-            if(!checkBytesAgainstMask(expHeaderBytes,expHeaderMask,headerBytes))   {
-                OBDREFDEBUG << "Warn: ISO 14230, header bytes mismatch";
-                continue;
-            }
-
-            // check/remove data prefix
-            if(!checkAndRemoveDataPrefix(msg.expDataPrefix,dataBytes))   {
-                OBDREFDEBUG << "Warn: ISO 14230, data prefix mismatch";
-                continue;
-            }
-
             // save
             msg.listHeaders << headerBytes;
             msg.listData << dataBytes;
         }
-
-        if(msg.listHeaders.empty())   {
-            OBDREFDEBUG << "Error: ISO 14230, empty message data";
-            return false;
-        }
-
-        return true;
     }
 
     // ========================================================================== //
     // ========================================================================== //
 
-    bool Parser::cleanFrames_ISO_15765(MessageData &msg, int const headerLength)
+    void Parser::cleanFrames_ISO_15765(MessageData &msg,
+                                       int const headerLength,
+                                       int const idxStart)
     {
-        for(int j=0; j < msg.listRawFrames.size(); j++)
+        // filter out frames with a mismatched header before
+        // splitting anything; SFs and FFs with a mismatched
+        // data prefix are also rejected here, but the prefix
+        // is checked again after merging since it may extend
+        // past the first frame
+        m_listIdxAccepted.clear();
+        m_frameFilter.FilterFrames_ISO_15765(msg,headerLength,
+                                             idxStart,m_listIdxAccepted);
+
+        RejectStats stats;
+        int const numRejected =
+            msg.listRawFrames.size()-idxStart-m_listIdxAccepted.size();
+
+        if(numRejected > 0)   {
+            m_frameFilter.CountRejected(m_listIdxAccepted,idxStart,stats);
+        }
+
+        // only frames cleaned in this call are merged
+        int const idxFirstNew = msg.listHeaders.size();
+
+        for(int j=0; j < m_listIdxAccepted.size(); j++)
         {
-            ByteList const &rawFrame = msg.listRawFrames[j];
+            ByteList const &rawFrame =
+                msg.listRawFrames[m_listIdxAccepted[j]];
 
             // split raw frame into a header and its
             // corresponding data bytes
@@ -1518,15 +2589,6 @@ namespace obdref
                 dataBytes << rawFrame[k];
             }
 
-            // check header
-            if(!checkBytesAgainstMask(msg.expHeaderBytes,
-                                      msg.expHeaderMask,
-                                      headerBytes))   {
-                OBDREFDEBUG << "Warn: ISO 15765-4, "
-                               "header bytes mismatch";
-                continue;
-            }
-
             // save
             msg.listHeaders << headerBytes;
             msg.listData << dataBytes;
@@ -1540,7 +2602,7 @@ namespace obdref
             listMergedFrames << false;
         }
 
-        for(int j=0; j < msg.listHeaders.size(); j++)   {
+        for(int j=idxFirstNew; j < msg.listHeaders.size(); j++)   {
             // ignore already merged frames
             if(listMergedFrames[j])   {
                 continue;
@@ -1560,7 +2622,7 @@ namespace obdref
 
                 int dataBytesSeen = msg.listData[j].size()-2;
 
-                for(int k=0; k < msg.listHeaders.size(); k++)   {
+                for(int k=idxFirstNew; k < msg.listHeaders.size(); k++)   {
                     // ignore already merged frames
                     if(listMergedFrames[k])   {
                         continue;
@@ -1593,16 +2655,19 @@ namespace obdref
                         }
 
                         // reset k
-                        k=0;
+                        k=idxFirstNew;
                     }
                 }
                 // once we get here, all the CF for the FF
                 // at msg.listData[j] should be merged
+                if(dataBytesSeen < dataLength)   {
+                    stats.truncated++;
+                }
             }
         }
 
         // clean up CFs and pci bytes
-        for(int j=msg.listHeaders.size()-1; j >= 0; j--)   {
+        for(int j=msg.listHeaders.size()-1; j >= idxFirstNew; j--)   {
             if(listMergedFrames[j])   {
                 msg.listHeaders.removeAt(j);
                 msg.listData.removeAt(j);
@@ -1617,6 +2682,15 @@ namespace obdref
                 msg.listData[j].removeAt(0);
                 msg.listData[j].removeAt(0);
             }
+            else if((pciByte >> 4) == 2)   {    // CF
+                // out of sequence or without a first frame
+                // (merged CFs were already removed above)
+                stats.sequenceGap++;
+                msg.listHeaders.removeAt(j);
+                msg.listData.removeAt(j);
+                listMergedFrames.removeAt(j);
+                continue;
+            }
 
             // check data prefix
             bool dataPrefixOk = true;
@@ -1628,7 +2702,7 @@ namespace obdref
                 }
             }
             if(!dataPrefixOk)   {
-                OBDREFDEBUG << "Warn: ISO 15765-4, data prefix mismatch";
+                stats.prefixMismatch++;
                 msg.listHeaders.removeAt(j);
                 msg.listData.removeAt(j);
                 listMergedFrames.removeAt(j);
@@ -1636,17 +2710,243 @@ namespace obdref
             }
         }
 
-        if(msg.listHeaders.empty())   {
-            OBDREFDEBUG << "Error: ISO 15765-4, empty message data";
-            return false;
+        if(stats.Total() > 0)   {
+            addRejectStats(msg,stats);
         }
+    }
 
-        return true;
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void Parser::cleanFramesInOrder_ISO_15765(MessageData &msg,
+                                              int const headerLength,
+                                              int const idxStart)
+    {
+        m_listIdxAccepted.clear();
+        m_frameFilter.FilterFrames_ISO_15765(msg,headerLength,
+                                             idxStart,m_listIdxAccepted);
+
+        RejectStats stats;
+        int const numRejected =
+            msg.listRawFrames.size()-idxStart-m_listIdxAccepted.size();
+
+        if(numRejected > 0)   {
+            m_frameFilter.CountRejected(m_listIdxAccepted,idxStart,stats);
+        }
+
+        for(int j=0; j < m_listIdxAccepted.size(); j++)
+        {
+            ByteList const &rawFrame =
+                msg.listRawFrames[m_listIdxAccepted[j]];
+
+            ByteList headerBytes;
+            for(int k=0; k < headerLength; k++)   {
+                headerBytes << rawFrame[k];
+            }
+
+            // find any message from the same
+            // sender that's waiting on CFs
+            int idxPartial=-1;
+            for(int k=0; k < msg.listPartialMessages.size(); k++)   {
+                if(msg.listPartialMessages[k].header == headerBytes)   {
+                    idxPartial = k;
+                    break;
+                }
+            }
+
+            ubyte pciByte = rawFrame[headerLength];
+            ByteList dataBytes;
+
+            if((pciByte >> 4) == 0)   {
+                // [single frame] a sender can't start a new
+                // message before finishing the last one
+                if(idxPartial != -1)   {
+                    msg.listPartialMessages.removeAt(idxPartial);
+                    stats.truncated++;
+                }
+                for(int k=headerLength+1; k < rawFrame.size(); k++)   {
+                    dataBytes << rawFrame[k];
+                }
+            }
+            else if((pciByte >> 4) == 1)   {
+                // [first frame]
+                if(idxPartial != -1)   {
+                    msg.listPartialMessages.removeAt(idxPartial);
+                    stats.truncated++;
+                }
+                if(rawFrame.size() < headerLength+2)   {
+                    stats.badLength++;
+                    continue;
+                }
+                MultiFrameMessage partial;
+                partial.header = headerBytes;
+                partial.dataLength = ((pciByte & 0x0F) << 8) +
+                                     rawFrame[headerLength+1];
+
+                for(int k=headerLength+2; k < rawFrame.size(); k++)   {
+                    partial.data << rawFrame[k];
+                }
+                if(partial.data.size() < partial.dataLength)   {
+                    msg.listPartialMessages.push_back(partial);
+                    continue;
+                }
+                dataBytes = partial.data;
+            }
+            else if((pciByte >> 4) == 2)   {
+                // [consecutive frame]
+                if(idxPartial == -1)   {
+                    stats.sequenceGap++;
+                    continue;
+                }
+                MultiFrameMessage &partial = msg.listPartialMessages[idxPartial];
+                if(pciByte != partial.nextPciByte)   {
+                    stats.sequenceGap++;
+                    msg.listPartialMessages.removeAt(idxPartial);
+                    continue;
+                }
+
+                for(int k=headerLength+1; k < rawFrame.size(); k++)   {
+                    partial.data << rawFrame[k];
+                }
+                if(partial.data.size() < partial.dataLength)   {
+                    // set next target pci byte
+                    partial.nextPciByte+=0x01;
+                    if(partial.nextPciByte == 0x30)   {
+                        partial.nextPciByte = 0x20;
+                    }
+                    continue;
+                }
+                dataBytes = partial.data;
+                msg.listPartialMessages.removeAt(idxPartial);
+            }
+            else   {
+                // [flow control]
+                continue;
+            }
+
+            // check/remove data prefix
+            if(dataBytes.size() < msg.expDataPrefix.size() ||
+               !checkAndRemoveDataPrefix(msg.expDataPrefix,dataBytes))   {
+                stats.prefixMismatch++;
+                continue;
+            }
+
+            // save
+            msg.listHeaders << headerBytes;
+            msg.listData << dataBytes;
+        }
+
+        if(stats.Total() > 0)   {
+            addRejectStats(msg,stats);
+        }
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void Parser::cleanFrames_UUDT(MessageData &msg,
+                                  int const headerLength,
+                                  int const idxStart)
+    {
+        RejectStats stats;
+        int const prefixLength = msg.expDataPrefix.size();
+
+        for(int i=idxStart; i < msg.listRawFrames.size(); i++)
+        {
+            ByteList const &rawFrame = msg.listRawFrames[i];
+            if(rawFrame.size() < headerLength+prefixLength)   {
+                stats.badLength++;
+                continue;
+            }
+
+            bool headerOk = true;
+            for(int k=0; k < headerLength; k++)   {
+                if(k < msg.expHeaderBytes.size() &&
+                   k < msg.expHeaderMask.size())   {
+                    ubyte const mask = msg.expHeaderMask[k];
+                    if((rawFrame[k] & mask) !=
+                       (msg.expHeaderBytes[k] & mask))   {
+                        headerOk = false;
+                        break;
+                    }
+                }
+            }
+            if(!headerOk)   {
+                stats.headerMismatch++;
+                continue;
+            }
+
+            bool prefixOk = true;
+            for(int k=0; k < prefixLength; k++)   {
+                if(rawFrame[headerLength+k] != msg.expDataPrefix[k])   {
+                    prefixOk = false;
+                    break;
+                }
+            }
+            if(!prefixOk)   {
+                stats.prefixMismatch++;
+                continue;
+            }
+
+            // save
+            msg.listHeaders << rawFrame.mid(0,headerLength);
+            msg.listData << rawFrame.mid(headerLength+prefixLength);
+        }
+
+        if(stats.Total() > 0)   {
+            addRejectStats(msg,stats);
+        }
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void Parser::addRejectStats(MessageData &msg,
+                                RejectStats const &stats)
+    {
+        msg.rejectStats.Add(stats);
+        m_rejectStats.Add(stats);
+
+        if(m_rejectLogInterval == 0)   {
+            return;
+        }
+        m_rejectsSinceLog += stats.Total();
+        if(m_rejectsSinceLog >= m_rejectLogInterval)   {
+            m_rejectsSinceLog = 0;
+            OBDREFWARN << "Warn: Parser: rejected frames: header"
+                       << m_rejectStats.headerMismatch << "prefix"
+                       << m_rejectStats.prefixMismatch << "length"
+                       << m_rejectStats.badLength << "sequence"
+                       << m_rejectStats.sequenceGap << "truncated"
+                       << m_rejectStats.truncated;
+        }
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void Parser::resetIncrementalState(MessageData &msg)
+    {
+        msg.listHeaders.clear();
+        msg.listData.clear();
+        msg.idxNextRawFrame = 0;
+        msg.idxNextData = 0;
+        msg.lastRawFrame.clear();
+        msg.listPartialMessages.clear();
     }
 
     // ========================================================================== //
     // ========================================================================== //
 
+    void Parser::appendBytesToKey(QByteArray &key,
+                                  ByteList const &bytes)
+    {
+        key.append(char(bytes.size()));
+        for(int i=0; i < bytes.size(); i++)   {
+            key.append(char(bytes[i]));
+        }
+    }
+
     bool Parser::checkBytesAgainstMask(ByteList const &expBytes,
                                        ByteList const &expMask,
                                        ByteList const &bytes)
@@ -1728,7 +3028,7 @@ namespace obdref
             return true;
         }
 
-        OBDREFDEBUG << "Could not open file: "
+        OBDREFERROR << "Could not open file: "
                     << filePath << "\n";
         return false;
     }
@@ -34,16 +34,29 @@
 
 // obdref
 #include "datatypes.h"
+#include "framefilter.h"
 #include "obdrefdebug.h"
+#include "parseprofiler.h"
 
 namespace obdref
 {
 
+class SupportedPids;
+
 class Parser
 {
 
 public:
     Parser(QString const &filePath, bool &parsedOk);
+
+    // Parser
+    // * reads the definitions from fileContents instead of
+    //   filePath (which is only used in messages), so a file
+    //   can be read once and shared by several Parsers
+    Parser(QString const &filePath,
+           QString const &fileContents,
+           bool &parsedOk);
+
     ~Parser();
 
     // BuildParameterFrame
@@ -61,6 +74,152 @@ public:
     bool ParseParameterFrame(ParameterFrame &msgFrame,
                            QList<Data> &listDataResults);
 
+    // CleanParameterFrame
+    // * only the first step of ParseParameterFrame: splits
+    //   the raw frames of each MessageData in msgFrame into
+    //   listHeaders and listData without parsing them
+    // * returns false if any MessageData has no data
+    //   once cleaned
+    bool CleanParameterFrame(ParameterFrame &msgFrame);
+
+    // ParseParameterFrameIncremental
+    // * like ParseParameterFrame, but only the frames
+    //   appended to listRawFrames since the last call
+    //   are cleaned, and only their results are saved
+    //   to listDataResults
+    // * ISO 15765 multi-frame messages are merged across
+    //   calls; frames are expected in the order they
+    //   were received
+    // * having no new frames is not an error
+    // * the parse restarts if listRawFrames has fewer
+    //   frames than the last call or its last cleaned
+    //   frame changed; call ResetIncremental when the
+    //   frames are replaced with the same frames
+    // * PARSE_COMBINED parameters are parsed (with all
+    //   of their data) once every MessageData has data,
+    //   and again each time new data is cleaned
+    bool ParseParameterFrameIncremental(ParameterFrame &msgFrame,
+                                        QList<Data> &listDataResults);
+
+    // ResetIncremental
+    // * makes the next ParseParameterFrameIncremental
+    //   call clean every raw frame in msgFrame again
+    void ResetIncremental(ParameterFrame &msgFrame);
+
+    // GroupSharedRequests
+    // * groups parameters in listParams (which must have
+    //   been built with BuildParameterFrame) that share the
+    //   same requests and expected responses, so that the
+    //   requests only need to be sent once for the group
+    // * each entry in listGroups is a list of indices
+    //   into listParams; every parameter is in exactly
+    //   one group and groups are in the order they were
+    //   first seen in listParams
+    void GroupSharedRequests(QList<ParameterFrame> const &listParams,
+                             QList<QList<int> > &listGroups);
+
+    // ParseSharedResponse
+    // * copies the raw frames received for the first
+    //   parameter in listGroup to every other parameter
+    //   in the group and parses all of them
+    // * returns false if any parameter failed to parse
+    bool ParseSharedResponse(QList<ParameterFrame> &listParams,
+                             QList<int> const &listGroup,
+                             QList<Data> &listDataResults);
+
+    // BuildCoalescedFrames
+    // * packs the requests of SAE J1979 mode 01 parameters
+    //   in listParams (which must have been built with
+    //   BuildParameterFrame) into as few requests as
+    //   possible, with up to six PIDs per request
+    // * only ISO 15765 parameters with a single [0x01 PID]
+    //   request, a [0x41 PID] response prefix and a known
+    //   response byte count can be coalesced; the indices
+    //   of every other parameter are saved to
+    //   listParamIdxOther so they can be requested normally
+    // * 'PIDs Supported' PIDs (0x00, 0x20, ...) are only
+    //   coalesced with each other, as per SAE J1979
+    void BuildCoalescedFrames(QList<ParameterFrame> const &listParams,
+                              QList<CoalescedFrame> &listFrames,
+                              QList<int> &listParamIdxOther);
+
+    // ParseCoalescedFrame
+    // * splits each response in coalescedFrame.msg into
+    //   the data for each PID and passes it to the parse
+    //   script of the corresponding parameter
+    // * a response may contain any subset of the PIDs
+    //   that were requested (ie. when an ECU doesn't
+    //   support all of them)
+    bool ParseCoalescedFrame(QList<ParameterFrame> &listParams,
+                             CoalescedFrame &coalescedFrame,
+                             QList<Data> &listDataResults);
+
+    // BuildPeriodicFrames
+    // * bundles the data of UDS parameters in listParams
+    //   (which must have been built with BuildParameterFrame)
+    //   into dynamically defined identifiers that are sent
+    //   periodically by the ECU at the given rate
+    // * only ISO 15765 parameters with a single [0x22 DID]
+    //   request, a [0x62 DID] response prefix and a known
+    //   response byte count can be bundled; the indices
+    //   of every other parameter are saved to
+    //   listParamIdxOther so they can be requested normally
+    // * each periodic frame holds as many parameters as can
+    //   fit in a single periodic message; periodic ids are
+    //   assigned starting at 0xF200+firstPeriodicId
+    // * by default periodic messages are expected as ISO
+    //   14229-2 type 1 UUDT frames without a pci byte
+    //   ([periodicId] [d0 ... d6]); some ECUs send them
+    //   as ISO-TP single frames instead, which can be
+    //   selected with PERIODIC_LAYOUT_SINGLE_FRAME
+    //   ([pci] [periodicId] [d0 ... d5])
+    // * to start streaming, send msgDefine then msgStart
+    //   for each frame
+    void BuildPeriodicFrames(QList<ParameterFrame> const &listParams,
+                             PeriodicRate const rate,
+                             ubyte const firstPeriodicId,
+                             QList<PeriodicFrame> &listFrames,
+                             QList<int> &listParamIdxOther,
+                             PeriodicLayout const layout=PERIODIC_LAYOUT_UUDT);
+
+    // ParsePeriodicFrame
+    // * splits each periodic message in msgData back into
+    //   the data for each parameter and passes it to the
+    //   parse script of the corresponding parameter
+    // * frames are split according to periodicFrame.layout
+    bool ParsePeriodicFrame(QList<ParameterFrame> &listParams,
+                            PeriodicFrame &periodicFrame,
+                            QList<Data> &listDataResults);
+
+    // CountCompleteResponses
+    // * returns the number of complete responses in the
+    //   raw frames of a MessageData in paramFrame; raw
+    //   frames are expected in the order they were received
+    // * SAE J1850, ISO 9141-2, ISO 14230: frames with the
+    //   expected header, prefix (and data byte count if
+    //   known) are grouped by the ecu that sent them; an
+    //   ecu's response is complete once it has sent
+    //   expFramesPerResponse different frames (or one if
+    //   that isn't known), so repeated frames aren't
+    //   counted twice
+    // * ISO 15765: single frames and multi-frame messages
+    //   that have been fully received are counted
+    int CountCompleteResponses(ParameterFrame const &paramFrame,
+                               int const msgIdx);
+
+    // IsMessageComplete
+    // * returns true if every expected response for a
+    //   MessageData in paramFrame has been received, so
+    //   the caller can stop waiting for more frames
+    // * always false if expResponseCount is unknown
+    bool IsMessageComplete(ParameterFrame const &paramFrame,
+                           int const msgIdx);
+
+    // IsParameterFrameComplete
+    // * returns true if IsMessageComplete is true
+    //   for every MessageData in paramFrame
+    bool IsParameterFrameComplete(ParameterFrame const &paramFrame);
+
     // ConvValToHexByte
     // * converts a ubyte value to its equivalent
     //   hex byte characters ie 255 -> "FF"
@@ -87,17 +246,74 @@ public:
                                   QString const &protocolName,
                                   QString const &addressName);
 
+    // GetParameterNames
+    // * as above, but leaves out SAE J1979 mode 01
+    //   parameters that aren't in supportedPids
+    QStringList GetParameterNames(QString const &specName,
+                                  QString const &protocolName,
+                                  QString const &addressName,
+                                  SupportedPids const &supportedPids);
+
     // GetLastKnownErrors
     // * returns a list of errors
     QStringList GetLastKnownErrors();
 
+    // GetRejectStats
+    // * returns the number of raw frames rejected while
+    //   cleaning for each reason, over every parameter
+    //   parsed since the last ResetRejectStats (see
+    //   MessageData.rejectStats for a single message)
+    RejectStats const & GetRejectStats() const
+    {   return m_rejectStats;   }
+
+    // ResetRejectStats
+    void ResetRejectStats();
+
+    // GetProfiler
+    // * per stage, per parameter latency histograms;
+    //   only recorded to if libobdref was built with
+    //   OBDREF_PROFILE defined
+    ParseProfiler const & GetProfiler() const
+    {   return m_profiler;   }
+
+    // ResetProfiler
+    void ResetProfiler();
+
+    // GetJsHeapStats
+    // * allocations made by the javascript heap since
+    //   the Parser was created
+    JsHeapStats const & GetJsHeapStats() const
+    {   return m_jsHeapStats;   }
+
+    // SetRejectLogInterval
+    // * logs a warning with the reject stats each time
+    //   another logInterval frames have been rejected;
+    //   0 (the default) turns logging off
+    void SetRejectLogInterval(quint32 const logInterval);
+
 private:
+    // init
+    // * loads the definitions in xmlFileContents
+    //   and sets up the js context
+    void init(QString const &xmlFileContents, bool &initOk);
+
     // jsInit
     // * creates js heap and context
     // * registers all required vars and functions
     //   to the js context's global object
     bool jsInit();
 
+    // jsCompileFunction
+    // * compiles the parse function at functionKeyIdx
+    //   if it hasn't been already; parse functions are
+    //   compiled the first time a parameter that uses
+    //   them is built instead of all at once in jsInit,
+    //   since compiling takes longer the more functions
+    //   there are (each garbage collection marks them all)
+    // * returns false (and logs the error) if the script
+    //   doesn't compile
+    bool jsCompileFunction(int const functionKeyIdx);
+
     //
     bool buildHeader_Legacy(ParameterFrame & paramFrame,
                             pugi::xml_node xnAddress);
@@ -111,6 +327,22 @@ private:
     bool buildData(ParameterFrame & paramFrame,
                    pugi::xml_node xnParameter);
 
+    // formatReqData_ISO_15765
+    // * splits request data into frames and adds pci
+    //   bytes as specified by paramFrame's options
+    void formatReqData_ISO_15765(ParameterFrame const &paramFrame,
+                                 QList<ByteList> &listReqDataBytes);
+
+    // getReadDataId
+    // * returns the data identifier of a parameter that has
+    //   a single UDS 0x22 request or -1 if there isn't one
+    int getReadDataId(ParameterFrame const &paramFrame);
+
+    // getMode01Pid
+    // * returns the pid of a parameter that has a single
+    //   SAE J1979 mode 01 request or -1 if there isn't one
+    int getMode01Pid(ParameterFrame const &paramFrame);
+
     // parseResponse
     // * passes data processed by cleanRawData[] to
     //   the javascript engine and uses the script
@@ -138,20 +370,61 @@ private:
     //   expected message bytes and groups/merges
     //   the frames as appropriate to save the
     //   data in listHeaders and listCleanData
+    // * frames before idxStart are ignored, and
+    //   cleaned data is appended to any existing
+    //   data in listHeaders and listData
 
     // cleanFrames_Legacy
     // * includes: SAEJ1850 VPW/PWM,ISO 9141-2,ISO 14230-4
     //   (not suitable for any other ISO 14230)
-    bool cleanFrames_Legacy(MessageData &msg);
+    void cleanFrames_Legacy(MessageData &msg,
+                            int const idxStart);
 
     // cleanFrames_ISO14230
-    bool cleanFrames_ISO_14230(MessageData &msg);
+    void cleanFrames_ISO_14230(MessageData &msg,
+                               int const idxStart);
 
     // cleanFrames_ISO_15765
     // * includes: ISO 15765, 11-bit and 29-bit headers,
     //   and ISO 15765-2/ISO-TP (multiframe messages)
-    bool cleanFrames_ISO_15765(MessageData &msg,
-                               int const headerLength);
+    void cleanFrames_ISO_15765(MessageData &msg,
+                               int const headerLength,
+                               int const idxStart);
+
+    // cleanFramesInOrder_ISO_15765
+    // * like cleanFrames_ISO_15765, but assumes frames
+    //   are in the order they were received so that
+    //   multi-frame messages can be merged across calls
+    // * messages still waiting on consecutive frames
+    //   are kept in msg.listPartialMessages
+    void cleanFramesInOrder_ISO_15765(MessageData &msg,
+                                      int const headerLength,
+                                      int const idxStart);
+
+    // cleanFrames_UUDT
+    // * [header] [prefix] [d0 d1 ...], a single CAN frame
+    //   without a pci byte (ie. ISO 14229-2 periodic data)
+    // * frames are never merged; each accepted frame is
+    //   saved as a message with its prefix removed
+    void cleanFrames_UUDT(MessageData &msg,
+                          int const headerLength,
+                          int const idxStart);
+
+    // addRejectStats
+    // * adds the frames rejected by a single call to
+    //   cleanFrames_[...] to msg and the parser's stats
+    void addRejectStats(MessageData &msg,
+                        RejectStats const &stats);
+
+    // resetIncrementalState
+    // * clears cleaned data and incremental parse state
+    void resetIncrementalState(MessageData &msg);
+
+    // appendBytesToKey
+    // * appends the size of bytes followed by
+    //   bytes to a lookup key
+    void appendBytesToKey(QByteArray &key,
+                          ByteList const &bytes);
 
     // checkHeaderBytes
     // * checks bytes against expected bytes with a mask
@@ -193,7 +466,13 @@ private:
     QString m_xmlFilePath;
     pugi::xml_document m_xmlDoc;
 
+    // <parameter> nodes by "spec:address:name" so
+    // BuildParameterFrame doesn't have to search
+    // every parameter in the file
+    QHash<QString,pugi::xml_node> m_tableParamNodes;
+
     // duktape
+    JsHeapStats m_jsHeapStats;
     duk_context * m_js_ctx;
     quint32 m_js_idx_global_object;
     quint32 m_js_idx_f_add_databytes;
@@ -205,6 +484,20 @@ private:
     // duktape javascript parse function registry
     QList<QString> m_js_listFunctionKey;
     QList<quint32> m_js_listFunctionIdx;
+    QHash<QString,int> m_js_tableFunctionKeyIdx;
+    QList<pugi::xml_node> m_js_listFunctionScript;
+
+    // batch header/prefix filter used by cleanFrames_[...]
+    FrameFilter m_frameFilter;
+    QList<int> m_listIdxAccepted;
+
+    // frame rejection counters
+    RejectStats m_rejectStats;
+    quint32 m_rejectLogInterval;
+    quint32 m_rejectsSinceLog;
+
+    // stage latencies (see OBDREF_PROFILE)
+    ParseProfiler m_profiler;
 
     // errors
     QTextStream m_lkErrors;
@@ -0,0 +1,360 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "pollscheduler.h"
+
+namespace obdref
+{
+    // response time assumed until one has been
+    // measured (when the budget isn't set)
+    static double const DEFAULT_RESPONSE_MS = 100.0;
+
+    // the cycle is replanned when the measured
+    // budget drifts by more than this fraction
+    static double const REPLAN_THRESHOLD = 0.1;
+
+    // upper bound on the number of entries GetCycle
+    // will generate for a single cycle
+    static int const MAX_CYCLE_ENTRIES = 4096;
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    PollScheduler::PollScheduler() :
+        m_budget(0),
+        m_budgetPlanned(0),
+        m_avgResponseMs(DEFAULT_RESPONSE_MS),
+        m_activeParam(-1),
+        m_activeMsg(0),
+        m_awaitingResponse(false),
+        m_requestTimeMs(0),
+        m_readyTimeMs(0)
+    {}
+
+    int PollScheduler::AddParameterFrame(ParameterFrame const &paramFrame)
+    {
+        PollParam param;
+        param.rate = paramFrame.pollRate;
+        param.priority = paramFrame.pollPriority;
+        param.allocRate = 0;
+        param.periodMs = -1;
+        param.nextReleaseMs = 0;
+
+        for(int i=0; i < paramFrame.listMessageData.size(); i++)   {
+            MessageData const &msg = paramFrame.listMessageData[i];
+            if(msg.listReqDataBytes.isEmpty())   {
+                continue;
+            }
+            param.listMsgIdx << i;
+            param.listDelayMs << int(msg.reqDataDelayMs);
+        }
+
+        if(param.listMsgIdx.isEmpty())   {
+            OBDREFWARN << "Warn: PollScheduler: parameter"
+                       << paramFrame.name << "has no requests";
+        }
+
+        m_listParams << param;
+        PlanCycle();
+
+        return m_listParams.size()-1;
+    }
+
+    void PollScheduler::SetRate(int const paramIdx,double const rate)
+    {
+        if(paramIdx < 0 || paramIdx >= m_listParams.size())   {
+            OBDREFERROR << "Error: PollScheduler: invalid parameter index";
+            return;
+        }
+        m_listParams[paramIdx].rate = (rate < 0) ? 0 : rate;
+        PlanCycle();
+    }
+
+    void PollScheduler::SetPriority(int const paramIdx,int const priority)
+    {
+        if(paramIdx < 0 || paramIdx >= m_listParams.size())   {
+            OBDREFERROR << "Error: PollScheduler: invalid parameter index";
+            return;
+        }
+        m_listParams[paramIdx].priority = priority;
+        PlanCycle();
+    }
+
+    void PollScheduler::SetBusBudget(double const requestsPerSec)
+    {
+        m_budget = (requestsPerSec < 0) ? 0 : requestsPerSec;
+        PlanCycle();
+    }
+
+    double PollScheduler::GetBusBudget() const
+    {
+        if(m_budget > 0)   {
+            return m_budget;
+        }
+        return 1000.0/m_avgResponseMs;
+    }
+
+    double PollScheduler::GetAllocatedRate(int const paramIdx) const
+    {
+        if(paramIdx < 0 || paramIdx >= m_listParams.size())   {
+            return 0;
+        }
+        return m_listParams[paramIdx].allocRate;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    void PollScheduler::PlanCycle()
+    {
+        double budget = GetBusBudget();
+        m_budgetPlanned = budget;
+
+        QList<bool> listDone;
+        for(int i=0; i < m_listParams.size(); i++)   {
+            m_listParams[i].allocRate = 0;
+            listDone << m_listParams[i].listMsgIdx.isEmpty();
+        }
+
+        // share the budget out one priority level at a time,
+        // starting with the highest; demand is in requests
+        // per second, and a rate of 0 has unlimited demand
+        while(true)
+        {
+            bool foundLevel=false;
+            int priority=0;
+            for(int i=0; i < m_listParams.size(); i++)   {
+                if(!listDone[i] && (!foundLevel ||
+                   m_listParams[i].priority > priority))   {
+                    priority = m_listParams[i].priority;
+                    foundLevel = true;
+                }
+            }
+            if(!foundLevel)   {
+                break;
+            }
+
+            QList<int> listLevel;
+            for(int i=0; i < m_listParams.size(); i++)   {
+                if(!listDone[i] && m_listParams[i].priority == priority)   {
+                    listLevel << i;
+                    listDone[i] = true;
+                }
+            }
+
+            // water-fill: parameters that want less than an even
+            // share get what they want, and the rest is split
+            // evenly between the others
+            bool satisfiedParam=true;
+            while(satisfiedParam && !listLevel.isEmpty() && budget > 0)
+            {
+                satisfiedParam = false;
+                double const share = budget/listLevel.size();
+                for(int i=0; i < listLevel.size(); i++)   {
+                    PollParam &param = m_listParams[listLevel[i]];
+                    double const demand = param.rate*param.listMsgIdx.size();
+                    if(param.rate > 0 && demand <= share)   {
+                        param.allocRate = param.rate;
+                        budget -= demand;
+                        listLevel.removeAt(i);
+                        satisfiedParam = true;
+                        i--;
+                    }
+                }
+            }
+            if(budget > 0)   {
+                for(int i=0; i < listLevel.size(); i++)   {
+                    PollParam &param = m_listParams[listLevel[i]];
+                    param.allocRate = budget/listLevel.size()/
+                            param.listMsgIdx.size();
+                }
+                if(!listLevel.isEmpty())   {
+                    budget = 0;
+                }
+            }
+        }
+
+        for(int i=0; i < m_listParams.size(); i++)   {
+            PollParam &param = m_listParams[i];
+            param.periodMs = (param.allocRate > 0) ?
+                        1000.0/param.allocRate : -1;
+        }
+    }
+
+    void PollScheduler::GetCycle(QList<int> &listParamIdx) const
+    {
+        listParamIdx.clear();
+
+        QList<PollParam> listParams = m_listParams;
+        double cycleMs=0;
+        for(int i=0; i < listParams.size(); i++)   {
+            listParams[i].nextReleaseMs = 0;
+            if(listParams[i].periodMs > cycleMs)   {
+                cycleMs = listParams[i].periodMs;
+            }
+        }
+        double const requestMs = 1000.0/m_budgetPlanned;
+
+        double timeMs=0;
+        while(timeMs < cycleMs && listParamIdx.size() < MAX_CYCLE_ENTRIES)
+        {
+            int const paramIdx = pickNext(listParams,timeMs);
+            if(paramIdx < 0)   {
+                timeMs = getNextReleaseMs(listParams);
+                continue;
+            }
+            PollParam &param = listParams[paramIdx];
+            releaseParam(param,timeMs);
+            listParamIdx << paramIdx;
+            timeMs += requestMs*param.listMsgIdx.size();
+        }
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    bool PollScheduler::NextRequest(qint64 const timeMs,
+                                    int &paramIdx,
+                                    int &msgIdx,
+                                    qint64 &waitMs)
+    {
+        if(m_awaitingResponse)   {
+            waitMs = -1;
+            return false;
+        }
+
+        if(m_activeParam < 0)
+        {
+            m_activeParam = pickNext(m_listParams,timeMs);
+            if(m_activeParam < 0)   {
+                double const nextReleaseMs = getNextReleaseMs(m_listParams);
+                waitMs = (nextReleaseMs < 0) ? -1 :
+                    qint64(nextReleaseMs-timeMs+0.999);
+                return false;
+            }
+            releaseParam(m_listParams[m_activeParam],timeMs);
+            m_activeMsg = 0;
+            m_readyTimeMs = timeMs +
+                m_listParams[m_activeParam].listDelayMs[0];
+        }
+
+        if(timeMs < m_readyTimeMs)   {
+            waitMs = m_readyTimeMs-timeMs;
+            return false;
+        }
+
+        paramIdx = m_activeParam;
+        msgIdx = m_listParams[m_activeParam].listMsgIdx[m_activeMsg];
+        waitMs = 0;
+
+        m_awaitingResponse = true;
+        m_requestTimeMs = timeMs;
+        return true;
+    }
+
+    void PollScheduler::ResponseReceived(qint64 const timeMs,
+                                         bool const responseOk)
+    {
+        if(!m_awaitingResponse)   {
+            OBDREFWARN << "Warn: PollScheduler: response "
+                          "received without a request";
+            return;
+        }
+        m_awaitingResponse = false;
+
+        // timeouts use up the bus too, so they're
+        // counted when estimating the budget
+        double const responseMs =
+            qMax(double(timeMs-m_requestTimeMs),1.0);
+        m_avgResponseMs += (responseMs-m_avgResponseMs)/8.0;
+
+        PollParam const &param = m_listParams[m_activeParam];
+        m_activeMsg++;
+        if(!responseOk || m_activeMsg >= param.listMsgIdx.size())   {
+            m_activeParam = -1;
+        }
+        else   {
+            m_readyTimeMs = timeMs + param.listDelayMs[m_activeMsg];
+        }
+
+        if(m_budget <= 0)   {
+            double const budget = GetBusBudget();
+            if(qAbs(budget-m_budgetPlanned) > m_budgetPlanned*REPLAN_THRESHOLD)   {
+                PlanCycle();
+            }
+        }
+    }
+
+    void PollScheduler::Clear()
+    {
+        m_listParams.clear();
+        m_activeParam = -1;
+        m_activeMsg = 0;
+        m_awaitingResponse = false;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    int PollScheduler::pickNext(QList<PollParam> const &listParams,
+                                double const timeMs) const
+    {
+        int idxNext=-1;
+        double deadlineNext=0;
+        for(int i=0; i < listParams.size(); i++)   {
+            PollParam const &param = listParams[i];
+            if(param.periodMs < 0 || param.nextReleaseMs > timeMs)   {
+                continue;
+            }
+            double const deadline = param.nextReleaseMs + param.periodMs;
+            if(idxNext < 0 || deadline < deadlineNext ||
+               (deadline == deadlineNext &&
+                param.priority > listParams[idxNext].priority))   {
+                idxNext = i;
+                deadlineNext = deadline;
+            }
+        }
+        return idxNext;
+    }
+
+    double PollScheduler::getNextReleaseMs(QList<PollParam> const &listParams) const
+    {
+        double nextReleaseMs=-1;
+        for(int i=0; i < listParams.size(); i++)   {
+            PollParam const &param = listParams[i];
+            if(param.periodMs < 0)   {
+                continue;
+            }
+            if(nextReleaseMs < 0 || param.nextReleaseMs < nextReleaseMs)   {
+                nextReleaseMs = param.nextReleaseMs;
+            }
+        }
+        return nextReleaseMs;
+    }
+
+    void PollScheduler::releaseParam(PollParam &param,
+                                     double const timeMs) const
+    {
+        // if a parameter has fallen more than a period
+        // behind, don't try to catch up with a burst
+        param.nextReleaseMs += param.periodMs;
+        if(param.nextReleaseMs < timeMs)   {
+            param.nextReleaseMs = timeMs;
+        }
+    }
+}
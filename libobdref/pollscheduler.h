@@ -0,0 +1,169 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef POLLSCHEDULER_H
+#define POLLSCHEDULER_H
+
+#include "datatypes.h"
+#include "obdrefdebug.h"
+
+namespace obdref
+{
+
+// PollScheduler
+// * decides which request to send next when polling
+//   a set of parameters, based on each parameter's
+//   target rate and priority (ParameterFrame.pollRate
+//   and pollPriority, which can be set with the 'rate'
+//   and 'priority' attributes in the definitions file)
+// * the bus budget (requests per second the adapter
+//   and bus can sustain) is shared out by priority:
+//   higher priority parameters get their full target
+//   rate first, and parameters with the same priority
+//   share what's left evenly (max-min fair); a sample
+//   faster than the target rate isn't useful, so no
+//   parameter is allocated more than it asked for
+// * parameters that don't get any of the budget are
+//   not polled until the budget or rates change
+// * requests are picked earliest deadline first using
+//   the allocated rates; only one request is expected
+//   to be outstanding at a time, and every request of
+//   a parameter is sent before moving on to another
+// * times are passed in by the caller (in ms, from
+//   any monotonic clock) so the adapter layer decides
+//   how to wait
+class PollScheduler
+{
+public:
+    PollScheduler();
+
+    // AddParameterFrame
+    // * adds a parameter that has already been built
+    //   with Parser::BuildParameterFrame and returns the
+    //   index used to refer to it in the other functions
+    //   (indices are assigned in the order added)
+    // * MessageData without request data are skipped,
+    //   and parameters without any requests are never
+    //   returned by NextRequest
+    int AddParameterFrame(ParameterFrame const &paramFrame);
+
+    // SetRate / SetPriority
+    // * override the rate or priority of a parameter
+    void SetRate(int const paramIdx,double const rate);
+    void SetPriority(int const paramIdx,int const priority);
+
+    // SetBusBudget
+    // * sets the number of requests per second that
+    //   can be sent; a budget of 0 (the default) means
+    //   the budget is estimated from the time taken
+    //   between each request and its response
+    void SetBusBudget(double const requestsPerSec);
+
+    // GetBusBudget
+    // * returns the budget currently being used
+    double GetBusBudget() const;
+
+    // GetAllocatedRate
+    // * returns the rate (in Hz) a parameter was
+    //   allocated the last time the cycle was planned
+    double GetAllocatedRate(int const paramIdx) const;
+
+    // PlanCycle
+    // * allocates the bus budget to each parameter
+    // * called automatically when parameters, rates,
+    //   priorities or the budget change
+    void PlanCycle();
+
+    // GetCycle
+    // * saves the order parameters would be requested
+    //   in over one cycle (the period of the slowest
+    //   polled parameter) to listParamIdx, assuming
+    //   every request takes exactly 1/budget seconds
+    void GetCycle(QList<int> &listParamIdx) const;
+
+    // NextRequest
+    // * returns true and sets paramIdx and msgIdx (an
+    //   index into ParameterFrame.listMessageData) if a
+    //   request should be sent at timeMs
+    // * otherwise returns false and sets waitMs to how
+    //   long to wait before calling NextRequest again;
+    //   waitMs is -1 if a response is still expected
+    //   or if there is nothing to poll
+    // * reqDataDelayMs is waited before each request
+    bool NextRequest(qint64 const timeMs,
+                     int &paramIdx,
+                     int &msgIdx,
+                     qint64 &waitMs);
+
+    // ResponseReceived
+    // * must be called once for each request returned
+    //   by NextRequest, when its response has been
+    //   received or the adapter has given up on it
+    // * if responseOk is false, the parameter's
+    //   remaining requests for this sample are skipped
+    void ResponseReceived(qint64 const timeMs,
+                          bool const responseOk=true);
+
+    // Clear
+    // * removes all parameters
+    void Clear();
+
+private:
+    struct PollParam
+    {
+        QList<int>  listMsgIdx;         // MessageData with requests
+        QList<int>  listDelayMs;        // reqDataDelayMs for each
+        double      rate;
+        int         priority;
+        double      allocRate;          // rate after PlanCycle
+        double      periodMs;           // < 0 if not polled
+        double      nextReleaseMs;      // time the next sample is due
+    };
+
+    // pickNext
+    // * returns the due parameter with the earliest
+    //   deadline (ties go to the higher priority) or
+    //   -1 if none are due at timeMs
+    int pickNext(QList<PollParam> const &listParams,
+                 double const timeMs) const;
+
+    // getNextReleaseMs
+    // * returns the earliest time any parameter is
+    //   due or -1 if no parameters are polled
+    double getNextReleaseMs(QList<PollParam> const &listParams) const;
+
+    void releaseParam(PollParam &param,
+                      double const timeMs) const;
+
+    QList<PollParam> m_listParams;
+
+    double m_budget;            // set by SetBusBudget
+    double m_budgetPlanned;     // budget used in the last PlanCycle
+    double m_avgResponseMs;     // moving average of response times
+
+    // current request
+    int m_activeParam;
+    int m_activeMsg;
+    bool m_awaitingResponse;
+    qint64 m_requestTimeMs;
+    qint64 m_readyTimeMs;
+};
+
+}
+
+#endif // POLLSCHEDULER_H
@@ -0,0 +1,242 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "respondermap.h"
+
+namespace obdref
+{
+    // ========================================================================== //
+    // ========================================================================== //
+
+    ResponderMap::ResponderMap()
+    {}
+
+    void ResponderMap::RecordResponders(ParameterFrame const &paramFrame)
+    {
+        for(int i=0; i < paramFrame.listMessageData.size(); i++)   {
+            MessageData const &msg = paramFrame.listMessageData[i];
+            if(msg.listHeaders.isEmpty())   {
+                continue;
+            }
+
+            QList<ByteList> &listResponders =
+                m_tableResponders[getKey(paramFrame,msg)];
+
+            QList<ByteList> listFrameResponders;
+            QList<int> listFrameCounts;
+            for(int j=0; j < msg.listHeaders.size(); j++)   {
+                ByteList const responderId =
+                    getResponderId(paramFrame,msg.listHeaders[j]);
+
+                if(!listResponders.contains(responderId))   {
+                    listResponders << responderId;
+                }
+
+                int const idx = listFrameResponders.indexOf(responderId);
+                if(idx == -1)   {
+                    listFrameResponders << responderId;
+                    listFrameCounts << 1;
+                }
+                else   {
+                    listFrameCounts[idx]++;
+                }
+            }
+            // legacy protocols don't have a multi-frame header,
+            // so a response split across frames is only seen as
+            // the same responder being cleaned more than once
+            if(paramFrame.parseProtocol == PROTOCOL_ISO_15765)   {
+                continue;
+            }
+
+            int &framesPerResponse = m_tableFramesPerResponse[getKey(paramFrame,msg)];
+            for(int j=0; j < listFrameCounts.size(); j++)   {
+                framesPerResponse = qMax(framesPerResponse,listFrameCounts[j]);
+            }
+        }
+    }
+
+    QList<ByteList> ResponderMap::GetResponders(ParameterFrame const &paramFrame,
+                                                int const msgIdx) const
+    {
+        if(msgIdx < 0 || msgIdx >= paramFrame.listMessageData.size())   {
+            OBDREFERROR << "Error: ResponderMap: invalid message index";
+            return QList<ByteList>();
+        }
+        MessageData const &msg = paramFrame.listMessageData[msgIdx];
+        return m_tableResponders.value(getKey(paramFrame,msg));
+    }
+
+    void ResponderMap::ApplyResponseCounts(ParameterFrame &paramFrame) const
+    {
+        for(int i=0; i < paramFrame.listMessageData.size(); i++)   {
+            MessageData &msg = paramFrame.listMessageData[i];
+            int const numResponders =
+                m_tableResponders.value(getKey(paramFrame,msg)).size();
+
+            if(numResponders > 0)   {
+                msg.expResponseCount = numResponders;
+            }
+
+            int const framesPerResponse =
+                m_tableFramesPerResponse.value(getKey(paramFrame,msg),0);
+
+            if(framesPerResponse > 0)   {
+                msg.expFramesPerResponse = framesPerResponse;
+            }
+        }
+    }
+
+    bool ResponderMap::BuildPhysicalFrame(ParameterFrame const &paramFrame,
+                                          ParameterFrame &physicalFrame) const
+    {
+        // every request must be answered by the same ecu
+        ByteList respHeader;
+        for(int i=0; i < paramFrame.listMessageData.size(); i++)   {
+            QList<ByteList> listResponders = GetResponders(paramFrame,i);
+            if(listResponders.size() != 1)   {
+                return false;
+            }
+            if(i == 0)   {
+                respHeader = listResponders[0];
+            }
+            else if(listResponders[0] != respHeader)   {
+                return false;
+            }
+        }
+        if(respHeader.isEmpty())   {
+            return false;
+        }
+
+        ByteList reqHeader;
+        ByteList respMask;
+        if(paramFrame.parseProtocol == PROTOCOL_ISO_15765)
+        {
+            if(paramFrame.iso15765_extendedId)   {
+                // [prio] [format] [target] [source]
+                if(respHeader.size() != 4)   {
+                    return false;
+                }
+                reqHeader << respHeader[0] << respHeader[1]
+                          << respHeader[3] << respHeader[2];
+                respMask << 0xFF << 0xFF << 0xFF << 0xFF;
+            }
+            else   {
+                // [11-bit identifier]
+                if(respHeader.size() != 2)   {
+                    return false;
+                }
+                quint32 const respId = (quint32(respHeader[0]) << 8) | respHeader[1];
+                if(respId < 0x7E8 || respId > 0x7EF)   {
+                    return false;
+                }
+                quint32 const reqId = respId-8;
+                reqHeader << ubyte(reqId >> 8) << ubyte(reqId & 0xFF);
+                respMask << 0xFF << 0xFF;
+            }
+        }
+        else if(paramFrame.parseProtocol == PROTOCOL_ISO_14230)
+        {
+            // [format & 0xC0] [target] [source] (see getResponderId)
+            if(respHeader.size() != 3 ||
+               paramFrame.listMessageData[0].reqHeaderBytes.size() < 3)   {
+                return false;
+            }
+            // the format byte also holds the data length
+            respMask << 0xC0 << 0xFF << 0xFF;
+        }
+        else
+        {
+            // [prio] [target] [source]
+            if(respHeader.size() != 3)   {
+                return false;
+            }
+            respMask << paramFrame.listMessageData[0].expHeaderMask.value(0,0x00)
+                     << 0xFF << 0xFF;
+        }
+
+        physicalFrame = paramFrame;
+        for(int i=0; i < physicalFrame.listMessageData.size(); i++)
+        {
+            MessageData &msg = physicalFrame.listMessageData[i];
+            if(paramFrame.parseProtocol == PROTOCOL_ISO_15765)   {
+                msg.reqHeaderBytes = reqHeader;
+            }
+            else if(paramFrame.parseProtocol == PROTOCOL_ISO_14230)   {
+                // 0b10LLLLLL: physical addressing, keep the length
+                msg.reqHeaderBytes[0] = (msg.reqHeaderBytes[0] & 0x3F) | 0x80;
+                msg.reqHeaderBytes[1] = respHeader[2];
+            }
+            msg.expHeaderBytes = respHeader;
+            msg.expHeaderMask = respMask;
+            msg.expResponseCount = 1;
+        }
+        return true;
+    }
+
+    void ResponderMap::Clear()
+    {
+        m_tableResponders.clear();
+        m_tableFramesPerResponse.clear();
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    QByteArray ResponderMap::getKey(ParameterFrame const &paramFrame,
+                                    MessageData const &msg) const
+    {
+        QByteArray key = paramFrame.protocol.toUtf8();
+        key.append(char(0));
+        key.append(paramFrame.address.toUtf8());
+        key.append(char(0));
+
+        appendBytesToKey(key,msg.reqHeaderBytes);
+        key.append(char(msg.listReqDataBytes.size()));
+        for(int i=0; i < msg.listReqDataBytes.size(); i++)   {
+            appendBytesToKey(key,msg.listReqDataBytes[i]);
+        }
+        appendBytesToKey(key,msg.expDataPrefix);
+        return key;
+    }
+
+    ByteList ResponderMap::getResponderId(ParameterFrame const &paramFrame,
+                                          ByteList const &header) const
+    {
+        if(paramFrame.parseProtocol != PROTOCOL_ISO_14230 || header.isEmpty())   {
+            return header;
+        }
+
+        // [format] [target] [source] [length]; the format
+        // and length bytes hold the data length
+        ByteList responderId;
+        responderId << (header[0] & 0xC0);
+        if((header[0] >> 6) != 0 && header.size() >= 3)   {
+            responderId << header[1] << header[2];
+        }
+        return responderId;
+    }
+
+    void ResponderMap::appendBytesToKey(QByteArray &key,
+                                        ByteList const &bytes) const
+    {
+        key.append(char(bytes.size()));
+        for(int i=0; i < bytes.size(); i++)   {
+            key.append(char(bytes[i]));
+        }
+    }
+}
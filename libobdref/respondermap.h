@@ -0,0 +1,113 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef RESPONDERMAP_H
+#define RESPONDERMAP_H
+
+#include <QHash>
+
+#include "datatypes.h"
+#include "obdrefdebug.h"
+
+namespace obdref
+{
+
+// ResponderMap
+// * records which ecus (response headers) answered
+//   each request, so that later requests can expect
+//   an exact number of responses or be sent to the
+//   one ecu that answers instead of every ecu
+// * requests are identified by their protocol, address,
+//   request header and data and the expected response
+//   prefix, so parameters that share a request share
+//   their responders
+class ResponderMap
+{
+public:
+    ResponderMap();
+
+    // RecordResponders
+    // * saves the headers in listHeaders of every
+    //   MessageData in paramFrame, which must have been
+    //   cleaned (ie. with Parser::ParseParameterFrame)
+    // * responders are added to the ones already
+    //   recorded for the same request
+    // * SAE J1850, ISO 9141-2, ISO 14230: also records the
+    //   most frames a single ecu sent for the request
+    void RecordResponders(ParameterFrame const &paramFrame);
+
+    // GetResponders
+    // * returns the headers recorded for a MessageData
+    //   in paramFrame; ISO 14230 headers are saved as
+    //   [format & 0xC0] [target] [source] so frames of
+    //   different lengths from one ecu are one responder
+    QList<ByteList> GetResponders(ParameterFrame const &paramFrame,
+                                  int const msgIdx) const;
+
+    // ApplyResponseCounts
+    // * sets expResponseCount of every MessageData in
+    //   paramFrame that has recorded responders
+    // * SAE J1850, ISO 9141-2, ISO 14230: also sets
+    //   expFramesPerResponse; if ecus split the same
+    //   response into a different number of frames, the
+    //   largest count is used
+    void ApplyResponseCounts(ParameterFrame &paramFrame) const;
+
+    // BuildPhysicalFrame
+    // * copies paramFrame to physicalFrame with its
+    //   requests sent to the single ecu that answers all
+    //   of them, and expecting exactly one response
+    // * ISO 15765: 11-bit ids 0x7E8-0x7EF are requested with
+    //   0x7E0-0x7E7; 29-bit ids swap the target and source
+    // * ISO 14230: uses a physical format byte and the
+    //   ecu's address as the target
+    // * SAE J1850 and ISO 9141-2 don't have physical OBD
+    //   requests, so the requests stay functional and only
+    //   the expected response header is narrowed
+    // * returns false if paramFrame doesn't have exactly one
+    //   recorded responder or it can't be addressed
+    bool BuildPhysicalFrame(ParameterFrame const &paramFrame,
+                            ParameterFrame &physicalFrame) const;
+
+    // Clear
+    void Clear();
+
+private:
+    QByteArray getKey(ParameterFrame const &paramFrame,
+                      MessageData const &msg) const;
+
+    // getResponderId
+    // * returns header without the bits that hold the
+    //   data length, ie. [format & 0xC0] [target] [source]
+    //   for ISO 14230; other headers are returned as is
+    ByteList getResponderId(ParameterFrame const &paramFrame,
+                            ByteList const &header) const;
+
+    void appendBytesToKey(QByteArray &key,
+                          ByteList const &bytes) const;
+
+    // [request key] -> list of response headers
+    QHash<QByteArray,QList<ByteList> > m_tableResponders;
+
+    // [request key] -> most frames one responder sent
+    QHash<QByteArray,int> m_tableFramesPerResponse;
+};
+
+}
+
+#endif // RESPONDERMAP_H
@@ -0,0 +1,365 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cerrno>
+#include <cstring>
+
+#include <net/if.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+#include <QVector>
+
+#include "socketcanreader.h"
+
+namespace obdref
+{
+    // number of frames read with each recvmmsg call
+    static int const READ_BATCH_SIZE = 64;
+
+    struct SocketCanReader::ReadBuffers
+    {
+        struct can_frame frames[READ_BATCH_SIZE];
+        struct iovec iovecs[READ_BATCH_SIZE];
+        struct mmsghdr msgs[READ_BATCH_SIZE];
+
+        ReadBuffers()
+        {
+            memset(msgs,0,sizeof(msgs));
+            for(int i=0; i < READ_BATCH_SIZE; i++)   {
+                iovecs[i].iov_base = &(frames[i]);
+                iovecs[i].iov_len = sizeof(struct can_frame);
+                msgs[i].msg_hdr.msg_iov = &(iovecs[i]);
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+        }
+    };
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    SocketCanReader::SocketCanReader() :
+        m_socketFd(-1),
+        m_buffers(new ReadBuffers)
+    {}
+
+    SocketCanReader::~SocketCanReader()
+    {
+        Close();
+        delete m_buffers;
+    }
+
+    bool SocketCanReader::AddParameterFrame(ParameterFrame const &paramFrame)
+    {
+        if(paramFrame.parseProtocol != PROTOCOL_ISO_15765)   {
+            OBDREFERROR << "Error: SocketCanReader: parameter"
+                        << paramFrame.name << "doesn't use ISO 15765";
+            return false;
+        }
+
+        for(int i=0; i < paramFrame.listMessageData.size(); i++)
+        {
+            MessageData const &msg = paramFrame.listMessageData[i];
+            int const headerLength = (paramFrame.iso15765_extendedId) ? 4 : 2;
+            if(msg.expHeaderBytes.size() != headerLength ||
+               msg.expHeaderMask.size() != headerLength)   {
+                OBDREFERROR << "Error: SocketCanReader: invalid "
+                               "expected header for" << paramFrame.name;
+                return false;
+            }
+
+            quint32 id=0;
+            quint32 mask=0;
+            for(int j=0; j < headerLength; j++)   {
+                id = (id << 8) | msg.expHeaderBytes[j];
+                mask = (mask << 8) | msg.expHeaderMask[j];
+            }
+
+            CanFilter filter;
+            filter.extendedId = paramFrame.iso15765_extendedId;
+            quint32 const idMask = (filter.extendedId) ? CAN_EFF_MASK : CAN_SFF_MASK;
+            filter.mask = mask & idMask;
+            filter.id = id & filter.mask;
+            AddFilter(filter);
+        }
+        return true;
+    }
+
+    void SocketCanReader::AddFilter(CanFilter const &filter)
+    {
+        // skip filters that an existing filter already
+        // covers (its mask bits are a subset of the new
+        // mask bits and the ids agree on them)
+        for(int i=0; i < m_listFilters.size(); i++)   {
+            CanFilter const &other = m_listFilters[i];
+            if(other.extendedId == filter.extendedId &&
+               (other.mask & filter.mask) == other.mask &&
+               (other.id & other.mask) == (filter.id & other.mask))   {
+                return;
+            }
+        }
+
+        // and remove existing filters the new one covers
+        for(int i=0; i < m_listFilters.size(); i++)   {
+            CanFilter const &other = m_listFilters[i];
+            if(other.extendedId == filter.extendedId &&
+               (filter.mask & other.mask) == filter.mask &&
+               (filter.id & filter.mask) == (other.id & filter.mask))   {
+                m_listFilters.removeAt(i);
+                i--;
+            }
+        }
+        m_listFilters.push_back(filter);
+    }
+
+    void SocketCanReader::ClearFilters()
+    {
+        m_listFilters.clear();
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    bool SocketCanReader::Open(QString const &interfaceName)
+    {
+        Close();
+
+        QByteArray const name = interfaceName.toLocal8Bit();
+        if(name.isEmpty() || name.size() >= IFNAMSIZ)   {
+            OBDREFERROR << "Error: SocketCanReader: invalid interface"
+                        << interfaceName;
+            return false;
+        }
+
+        m_socketFd = socket(PF_CAN,SOCK_RAW,CAN_RAW);
+        if(m_socketFd < 0)   {
+            OBDREFERROR << "Error: SocketCanReader: could not open socket";
+            return false;
+        }
+
+        struct ifreq ifr;
+        memset(&ifr,0,sizeof(ifr));
+        strncpy(ifr.ifr_name,name.constData(),IFNAMSIZ-1);
+        if(ioctl(m_socketFd,SIOCGIFINDEX,&ifr) < 0)   {
+            OBDREFERROR << "Error: SocketCanReader: no interface"
+                        << interfaceName;
+            Close();
+            return false;
+        }
+
+        // apply filters before binding so no unfiltered
+        // frames are queued
+        if(!ApplyFilters())   {
+            Close();
+            return false;
+        }
+
+        struct sockaddr_can addr;
+        memset(&addr,0,sizeof(addr));
+        addr.can_family = AF_CAN;
+        addr.can_ifindex = ifr.ifr_ifindex;
+        if(bind(m_socketFd,(struct sockaddr*)&addr,sizeof(addr)) < 0)   {
+            OBDREFERROR << "Error: SocketCanReader: could not bind to"
+                        << interfaceName;
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void SocketCanReader::Close()
+    {
+        if(m_socketFd >= 0)   {
+            close(m_socketFd);
+            m_socketFd = -1;
+        }
+    }
+
+    bool SocketCanReader::ApplyFilters()
+    {
+        if(m_socketFd < 0)   {
+            return true;
+        }
+
+        // remote frames are never accepted and the
+        // id type must match
+        QVector<struct can_filter> listKernelFilters(m_listFilters.size());
+        for(int i=0; i < m_listFilters.size(); i++)   {
+            CanFilter const &filter = m_listFilters[i];
+            struct can_filter &kfilter = listKernelFilters[i];
+            kfilter.can_id = filter.id;
+            kfilter.can_mask = filter.mask | CAN_EFF_FLAG | CAN_RTR_FLAG;
+            if(filter.extendedId)   {
+                kfilter.can_id |= CAN_EFF_FLAG;
+            }
+        }
+
+        void const * filterData = (listKernelFilters.isEmpty()) ?
+            NULL : listKernelFilters.constData();
+
+        if(setsockopt(m_socketFd,SOL_CAN_RAW,CAN_RAW_FILTER,filterData,
+                      listKernelFilters.size()*sizeof(struct can_filter)) < 0)   {
+            OBDREFERROR << "Error: SocketCanReader: could not set filters";
+            return false;
+        }
+        return true;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    int SocketCanReader::ReadFrames(QList<ByteList> &listRawFrames,
+                                    int const timeoutMs)
+    {
+        if(!waitForFrames(timeoutMs))   {
+            return (m_socketFd < 0) ? -1 : 0;
+        }
+
+        int numFrames=0;
+        for(;;)   {
+            int const numRead = readBatch();
+            if(numRead < 0)   {
+                return (numFrames > 0) ? numFrames : -1;
+            }
+            for(int i=0; i < numRead; i++)   {
+                convFrame(i,m_rawFrame);
+                listRawFrames.push_back(m_rawFrame);
+            }
+            numFrames += numRead;
+            if(numRead < READ_BATCH_SIZE)   {
+                break;
+            }
+        }
+        return numFrames;
+    }
+
+    int SocketCanReader::ReadFrames(FrameDispatcher &dispatcher,
+                                    int const timeoutMs)
+    {
+        if(!waitForFrames(timeoutMs))   {
+            return (m_socketFd < 0) ? -1 : 0;
+        }
+
+        int numFrames=0;
+        for(;;)   {
+            int const numRead = readBatch();
+            if(numRead < 0)   {
+                return (numFrames > 0) ? numFrames : -1;
+            }
+            for(int i=0; i < numRead; i++)   {
+                convFrame(i,m_rawFrame);
+                dispatcher.DispatchFrame(m_rawFrame);
+            }
+            numFrames += numRead;
+            if(numRead < READ_BATCH_SIZE)   {
+                break;
+            }
+        }
+        return numFrames;
+    }
+
+    bool SocketCanReader::WriteFrame(ByteList const &rawFrame,
+                                     bool const extendedId)
+    {
+        if(m_socketFd < 0)   {
+            return false;
+        }
+
+        int const headerLength = (extendedId) ? 4 : 2;
+        int const dataLength = rawFrame.size()-headerLength;
+        if(dataLength < 0 || dataLength > 8)   {
+            OBDREFERROR << "Error: SocketCanReader: invalid frame length";
+            return false;
+        }
+
+        struct can_frame frame;
+        memset(&frame,0,sizeof(frame));
+        for(int i=0; i < headerLength; i++)   {
+            frame.can_id = (frame.can_id << 8) | rawFrame[i];
+        }
+        if(extendedId)   {
+            frame.can_id = (frame.can_id & CAN_EFF_MASK) | CAN_EFF_FLAG;
+        }
+        else   {
+            frame.can_id &= CAN_SFF_MASK;
+        }
+
+        frame.can_dlc = dataLength;
+        for(int i=0; i < dataLength; i++)   {
+            frame.data[i] = rawFrame[headerLength+i];
+        }
+
+        return (write(m_socketFd,&frame,sizeof(frame)) == sizeof(frame));
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    int SocketCanReader::readBatch()
+    {
+        int const numRead = recvmmsg(m_socketFd,m_buffers->msgs,
+                                     READ_BATCH_SIZE,MSG_DONTWAIT,NULL);
+        if(numRead < 0)   {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)   {
+                return 0;
+            }
+            OBDREFERROR << "Error: SocketCanReader: read failed";
+            return -1;
+        }
+        return numRead;
+    }
+
+    void SocketCanReader::convFrame(int const frameIdx,
+                                    ByteList &rawFrame) const
+    {
+        struct can_frame const &frame = m_buffers->frames[frameIdx];
+
+        rawFrame.clear();
+        if(frame.can_id & CAN_EFF_FLAG)   {
+            quint32 const id = frame.can_id & CAN_EFF_MASK;
+            rawFrame << ubyte(id >> 24) << ubyte(id >> 16)
+                     << ubyte(id >> 8) << ubyte(id);
+        }
+        else   {
+            quint32 const id = frame.can_id & CAN_SFF_MASK;
+            rawFrame << ubyte(id >> 8) << ubyte(id);
+        }
+
+        int const dataLength = qMin(int(frame.can_dlc),8);
+        for(int i=0; i < dataLength; i++)   {
+            rawFrame << frame.data[i];
+        }
+    }
+
+    bool SocketCanReader::waitForFrames(int const timeoutMs) const
+    {
+        if(m_socketFd < 0)   {
+            return false;
+        }
+        struct pollfd pfd;
+        pfd.fd = m_socketFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        return (poll(&pfd,1,timeoutMs) > 0);
+    }
+}
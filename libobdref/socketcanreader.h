@@ -0,0 +1,145 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SOCKETCANREADER_H
+#define SOCKETCANREADER_H
+
+#include "datatypes.h"
+#include "obdrefdebug.h"
+#include "framedispatcher.h"
+
+namespace obdref
+{
+
+// CanFilter
+// * a kernel acceptance filter; a frame is accepted
+//   if (frame id & mask) == (id & mask)
+struct CanFilter
+{
+    CanFilter() :
+        id(0),
+        mask(0),
+        extendedId(false)
+    {}
+
+    quint32 id;
+    quint32 mask;
+    bool extendedId;
+};
+
+// SocketCanReader
+// * reads ISO 15765 frames from a Linux SocketCAN
+//   interface (ie. 'can0' or 'vcan0') with a CAN_RAW
+//   socket (only built on Linux)
+// * kernel acceptance filters (CAN_RAW_FILTER) are built
+//   from the expHeaderBytes/expHeaderMask of the added
+//   parameters, so frames none of them could match are
+//   dropped before they're copied to userspace
+// * frames are read in batches with recvmmsg and saved
+//   as raw frames ([header] [data]) with 11-bit ids as
+//   two header bytes and 29-bit ids as four
+class SocketCanReader
+{
+public:
+    SocketCanReader();
+    ~SocketCanReader();
+
+    // AddParameterFrame
+    // * adds acceptance filters for every MessageData in
+    //   paramFrame (which must use ISO 15765); identical
+    //   filters are only added once
+    // * a MessageData with an empty header mask accepts
+    //   every frame, which makes every other filter for
+    //   the same id type redundant
+    bool AddParameterFrame(ParameterFrame const &paramFrame);
+
+    // AddFilter
+    // * adds a filter that isn't based on a parameter
+    void AddFilter(CanFilter const &filter);
+
+    // GetFilters
+    QList<CanFilter> const & GetFilters() const
+    {   return m_listFilters;   }
+
+    // ClearFilters
+    // * removes all filters; with no filters
+    //   no frames are received
+    void ClearFilters();
+
+    // Open
+    // * opens a CAN_RAW socket bound to interfaceName
+    //   and applies the current filters
+    bool Open(QString const &interfaceName);
+
+    // Close
+    void Close();
+
+    bool IsOpen() const
+    {   return (m_socketFd >= 0);   }
+
+    // ApplyFilters
+    // * updates the socket's filters after filters
+    //   have been added or cleared
+    bool ApplyFilters();
+
+    // ReadFrames
+    // * waits up to timeoutMs for frames and then reads
+    //   every frame that's queued (in batches), appending
+    //   them to listRawFrames
+    // * returns the number of frames read, or -1 if
+    //   there was an error
+    int ReadFrames(QList<ByteList> &listRawFrames,
+                   int const timeoutMs);
+
+    // ReadFrames
+    // * as above, but frames are dispatched directly
+    //   with dispatcher
+    int ReadFrames(FrameDispatcher &dispatcher,
+                   int const timeoutMs);
+
+    // WriteFrame
+    // * sends rawFrame ([header] [data], at most 8
+    //   data bytes) with an 11-bit (two header bytes)
+    //   or 29-bit (four header bytes) id
+    bool WriteFrame(ByteList const &rawFrame,
+                    bool const extendedId);
+
+private:
+    // readBatch
+    // * reads up to a batch of frames without blocking
+    //   and returns the number read (0 if none were
+    //   queued) or -1 if there was an error
+    int readBatch();
+
+    void convFrame(int const frameIdx,
+                   ByteList &rawFrame) const;
+
+    bool waitForFrames(int const timeoutMs) const;
+
+    int m_socketFd;
+    QList<CanFilter> m_listFilters;
+
+    // recvmmsg buffers (see socketcanreader.cpp)
+    struct ReadBuffers;
+    ReadBuffers * m_buffers;
+    ByteList m_rawFrame;
+};
+
+}
+
+#endif // SOCKETCANREADER_H
@@ -0,0 +1,365 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "supportedpids.h"
+
+namespace obdref
+{
+    // ========================================================================== //
+    // ========================================================================== //
+
+    SupportedPids::SupportedPids(Parser * parser) :
+        m_parser(parser),
+        m_idxNextBitmap(0)
+    {}
+
+    bool SupportedPids::StartDiscovery(QString const &spec,
+                                       QString const &protocol,
+                                       QString const &address)
+    {
+        Clear();
+
+        QStringList listParams =
+            m_parser->GetParameterNames(spec,protocol,address);
+
+        for(int i=0; i < listParams.size(); i++)   {
+            ParameterFrame param;
+            param.spec = spec;
+            param.protocol = protocol;
+            param.address = address;
+            param.name = listParams[i];
+
+            if(!m_parser->BuildParameterFrame(param))   {
+                continue;
+            }
+
+            int const pid = getBitmapPid(param);
+            if(pid < 0)   {
+                continue;
+            }
+
+            // keep the list sorted by pid
+            int k=0;
+            for(; k < m_listBitmapFrames.size(); k++)   {
+                if(getBitmapPid(m_listBitmapFrames[k]) > pid)   {
+                    break;
+                }
+            }
+            m_listBitmapFrames.insert(k,param);
+        }
+
+        if(m_listBitmapFrames.isEmpty())   {
+            OBDREFERROR << "Error: SupportedPids: no bitmap pids "
+                           "defined for" << spec << protocol << address;
+            return false;
+        }
+        return true;
+    }
+
+    bool SupportedPids::NextDiscoveryFrame(ParameterFrame &paramFrame)
+    {
+        if(m_idxNextBitmap >= m_listBitmapFrames.size())   {
+            return false;
+        }
+
+        // the last pid in each bitmap says whether
+        // the next bitmap pid is supported
+        ParameterFrame const &bitmapFrame = m_listBitmapFrames[m_idxNextBitmap];
+        if(m_idxNextBitmap > 0 &&
+           !anyEcuHasPid(ubyte(getBitmapPid(bitmapFrame))))   {
+            m_idxNextBitmap = m_listBitmapFrames.size();
+            return false;
+        }
+
+        paramFrame = bitmapFrame;
+        m_idxNextBitmap++;
+        return true;
+    }
+
+    bool SupportedPids::SaveDiscoveryFrame(ParameterFrame &paramFrame)
+    {
+        int const pid = getBitmapPid(paramFrame);
+        if(pid < 0)   {
+            OBDREFERROR << "Error: SupportedPids: parameter"
+                        << paramFrame.name << "is not a bitmap pid";
+            return false;
+        }
+
+        if(paramFrame.listMessageData[0].listRawFrames.isEmpty())   {
+            return true;
+        }
+
+        QList<Data> listData;
+        if(!m_parser->ParseParameterFrame(paramFrame,listData))   {
+            OBDREFERROR << "Error: SupportedPids: could not parse"
+                        << paramFrame.name;
+            return false;
+        }
+
+        MessageData const &msg = paramFrame.listMessageData[0];
+        int const idxBitmap = (pid/0x20)*4;
+        for(int i=0; i < msg.listHeaders.size(); i++)   {
+            ByteList const &header = msg.listHeaders[i];
+            ByteList const &data = msg.listData[i];
+            if(data.size() < 4)   {
+                continue;
+            }
+
+            QByteArray ecuKey;
+            for(int j=0; j < header.size(); j++)   {
+                ecuKey.append(char(header[j]));
+            }
+
+            QByteArray &bitmap = m_tableEcuBitmaps[ecuKey];
+            while(bitmap.size() < idxBitmap+4)   {
+                bitmap.append(char(0));
+            }
+            for(int j=0; j < 4; j++)   {
+                bitmap[idxBitmap+j] = char(data[j]);
+            }
+        }
+        return true;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    bool SupportedPids::IsPidSupported(ubyte const pid,
+                                       ByteList const &ecuHeader) const
+    {
+        if(!HasData())   {
+            return true;
+        }
+        if(ecuHeader.isEmpty())   {
+            return anyEcuHasPid(pid);
+        }
+
+        QByteArray ecuKey;
+        for(int i=0; i < ecuHeader.size(); i++)   {
+            ecuKey.append(char(ecuHeader[i]));
+        }
+        return isPidSetInBitmap(m_tableEcuBitmaps.value(ecuKey),pid);
+    }
+
+    bool SupportedPids::IsParameterSupported(ParameterFrame const &paramFrame) const
+    {
+        if(paramFrame.listMessageData.size() != 1)   {
+            return true;
+        }
+        ByteList const &prefix = paramFrame.listMessageData[0].expDataPrefix;
+        if(prefix.size() < 2 || prefix[0] != 0x41)   {
+            return true;
+        }
+        return IsPidSupported(prefix[1]);
+    }
+
+    QList<ByteList> SupportedPids::GetEcuHeaders() const
+    {
+        QList<ByteList> listHeaders;
+        QHash<QByteArray,QByteArray>::const_iterator it;
+        for(it = m_tableEcuBitmaps.begin(); it != m_tableEcuBitmaps.end(); ++it)   {
+            ByteList header;
+            QByteArray const &ecuKey = it.key();
+            for(int i=0; i < ecuKey.size(); i++)   {
+                header << ubyte(ecuKey[i]);
+            }
+            listHeaders << header;
+        }
+        return listHeaders;
+    }
+
+    void SupportedPids::Clear()
+    {
+        m_listBitmapFrames.clear();
+        m_idxNextBitmap = 0;
+        m_tableEcuBitmaps.clear();
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    bool SupportedPids::SaveToFile(QString const &filePath,
+                                   QString const &vehicleKey)
+    {
+        if(vehicleKey.isEmpty() || vehicleKey.contains(" "))   {
+            OBDREFERROR << "Error: SupportedPids: invalid vehicle key"
+                        << vehicleKey;
+            return false;
+        }
+        QByteArray const key = vehicleKey.toUtf8();
+
+        // each line is [vehicle key] [ecu header] [bitmap]
+        // with the header and bitmap as hex strings; keep
+        // the lines saved for other vehicles
+        QByteArray fileData;
+        QFile fileIn(filePath);
+        if(fileIn.open(QIODevice::ReadOnly))   {
+            QList<QByteArray> listLines = fileIn.readAll().split('\n');
+            for(int i=0; i < listLines.size(); i++)   {
+                QList<QByteArray> listFields = listLines[i].split(' ');
+                if(listFields.size() != 3 || listFields[0] == key)   {
+                    continue;
+                }
+                fileData.append(listLines[i]);
+                fileData.append('\n');
+            }
+            fileIn.close();
+        }
+
+        QHash<QByteArray,QByteArray>::const_iterator it;
+        for(it = m_tableEcuBitmaps.begin(); it != m_tableEcuBitmaps.end(); ++it)   {
+            ByteList header,bitmap;
+            for(int i=0; i < it.key().size(); i++)   {
+                header << ubyte(it.key()[i]);
+            }
+            for(int i=0; i < it.value().size(); i++)   {
+                bitmap << ubyte(it.value()[i]);
+            }
+            fileData.append(key);
+            fileData.append(' ');
+            fileData.append(convByteListToHexStr(header));
+            fileData.append(' ');
+            fileData.append(convByteListToHexStr(bitmap));
+            fileData.append('\n');
+        }
+
+        QFile fileOut(filePath);
+        if(!fileOut.open(QIODevice::WriteOnly))   {
+            OBDREFERROR << "Error: SupportedPids: could not open"
+                        << filePath;
+            return false;
+        }
+        bool const writeOk = (fileOut.write(fileData) == fileData.size());
+        fileOut.close();
+
+        return writeOk;
+    }
+
+    bool SupportedPids::LoadFromFile(QString const &filePath,
+                                     QString const &vehicleKey)
+    {
+        QFile file(filePath);
+        if(!file.open(QIODevice::ReadOnly))   {
+            return false;
+        }
+        QByteArray const key = vehicleKey.toUtf8();
+        QList<QByteArray> listLines = file.readAll().split('\n');
+        file.close();
+
+        m_tableEcuBitmaps.clear();
+        for(int i=0; i < listLines.size(); i++)   {
+            QList<QByteArray> listFields = listLines[i].split(' ');
+            if(listFields.size() != 3 || listFields[0] != key)   {
+                continue;
+            }
+            ByteList header,bitmap;
+            if(!convHexStrToByteList(listFields[1],header) ||
+               !convHexStrToByteList(listFields[2],bitmap))   {
+                OBDREFWARN << "Warn: SupportedPids: invalid line in"
+                           << filePath;
+                continue;
+            }
+
+            QByteArray ecuKey,ecuBitmap;
+            for(int j=0; j < header.size(); j++)   {
+                ecuKey.append(char(header[j]));
+            }
+            for(int j=0; j < bitmap.size(); j++)   {
+                ecuBitmap.append(char(bitmap[j]));
+            }
+            m_tableEcuBitmaps.insert(ecuKey,ecuBitmap);
+        }
+
+        return HasData();
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    int SupportedPids::getBitmapPid(ParameterFrame const &paramFrame) const
+    {
+        if(paramFrame.listMessageData.size() != 1)   {
+            return -1;
+        }
+        MessageData const &msg = paramFrame.listMessageData[0];
+        if(msg.expDataPrefix.size() != 2 ||
+           msg.expDataPrefix[0] != 0x41 ||
+           msg.expDataPrefix[1] % 0x20 != 0 ||
+           msg.expDataByteCount != 4)   {
+            return -1;
+        }
+        return msg.expDataPrefix[1];
+    }
+
+    bool SupportedPids::isPidSetInBitmap(QByteArray const &bitmap,
+                                         ubyte const pid) const
+    {
+        if(pid == 0x00)   {
+            return !bitmap.isEmpty();
+        }
+
+        // the msb of the first byte is pid 0x01
+        int const idxByte = (pid-1)/8;
+        int const idxBit = 7-((pid-1)%8);
+        if(idxByte >= bitmap.size())   {
+            // pids past the last bitmap that was read are
+            // unknown (there's no parameter defined for their
+            // bitmap) if the ecu says that bitmap is supported
+            return (!bitmap.isEmpty() &&
+                    (ubyte(bitmap[bitmap.size()-1]) & 0x01));
+        }
+        return ((ubyte(bitmap[idxByte]) >> idxBit) & 0x01);
+    }
+
+    bool SupportedPids::anyEcuHasPid(ubyte const pid) const
+    {
+        QHash<QByteArray,QByteArray>::const_iterator it;
+        for(it = m_tableEcuBitmaps.begin(); it != m_tableEcuBitmaps.end(); ++it)   {
+            if(isPidSetInBitmap(it.value(),pid))   {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    QByteArray SupportedPids::convByteListToHexStr(ByteList const &byteList)
+    {
+        QByteArray hexStr;
+        for(int i=0; i < byteList.size(); i++)   {
+            hexStr.append(m_parser->ConvUByteToHexStr(byteList[i]));
+        }
+        return hexStr;
+    }
+
+    bool SupportedPids::convHexStrToByteList(QByteArray const &hexStr,
+                                             ByteList &byteList)
+    {
+        if(hexStr.isEmpty() || (hexStr.size() % 2) != 0)   {
+            return false;
+        }
+        for(int i=0; i < hexStr.size(); i+=2)   {
+            bool convOk = false;
+            int const byte = hexStr.mid(i,2).toInt(&convOk,16);
+            if(!convOk)   {
+                return false;
+            }
+            byteList << ubyte(byte);
+        }
+        return true;
+    }
+}
@@ -0,0 +1,140 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef SUPPORTEDPIDS_H
+#define SUPPORTEDPIDS_H
+
+#include <QHash>
+
+#include "parser.h"
+
+namespace obdref
+{
+
+// SupportedPids
+// * discovers which SAE J1979 mode 01 PIDs each ecu
+//   supports using the 'PIDs Supported' bitmap PIDs
+//   (0x00, 0x20, 0x40, ...), so requests for PIDs that
+//   never answer can be skipped
+// * the bitmaps received from each ecu are kept as is,
+//   keyed by the ecu's response header
+// * until discovery has saved data for at least one
+//   ecu, every PID is considered supported
+class SupportedPids
+{
+public:
+    SupportedPids(Parser * parser);
+
+    // StartDiscovery
+    // * builds the bitmap PID parameters defined for
+    //   spec/protocol/address and clears any saved data
+    // * returns false if no bitmap PIDs are defined
+    bool StartDiscovery(QString const &spec,
+                        QString const &protocol,
+                        QString const &address);
+
+    // NextDiscoveryFrame
+    // * copies the next bitmap PID parameter that needs
+    //   to be requested to paramFrame; returns false once
+    //   no ecu has reported support for further bitmaps
+    // * the responses should be saved to the frame's
+    //   listRawFrames and passed to SaveDiscoveryFrame
+    //   before calling NextDiscoveryFrame again
+    bool NextDiscoveryFrame(ParameterFrame &paramFrame);
+
+    // SaveDiscoveryFrame
+    // * saves the bitmap in each response received
+    //   for paramFrame; no responses is not an error
+    bool SaveDiscoveryFrame(ParameterFrame &paramFrame);
+
+    // IsPidSupported
+    // * returns true if the ecu with the given response
+    //   header supports pid; if ecuHeader is empty, any
+    //   ecu supporting pid is enough
+    // * pids past the last bitmap that was read (because
+    //   its bitmap PID isn't defined) are supported if
+    //   the ecu reported support for that bitmap
+    bool IsPidSupported(ubyte const pid,
+                        ByteList const &ecuHeader=ByteList()) const;
+
+    // IsParameterSupported
+    // * returns false for SAE J1979 mode 01 parameters
+    //   (with a [0x41 PID] response prefix) whose PID
+    //   isn't supported; always true for other parameters
+    bool IsParameterSupported(ParameterFrame const &paramFrame) const;
+
+    // GetEcuHeaders
+    // * returns the response header of every ecu that
+    //   has sent a bitmap
+    QList<ByteList> GetEcuHeaders() const;
+
+    // HasData
+    bool HasData() const
+    {   return !m_tableEcuBitmaps.isEmpty();   }
+
+    // Clear
+    void Clear();
+
+    // SaveToFile
+    // * saves the bitmaps of every ecu to filePath under
+    //   vehicleKey (ie. the VIN, or an ecu address if the
+    //   VIN isn't known), replacing anything previously
+    //   saved for vehicleKey; other vehicles are kept
+    bool SaveToFile(QString const &filePath,
+                    QString const &vehicleKey);
+
+    // LoadFromFile
+    // * replaces any saved data with the bitmaps saved
+    //   to filePath under vehicleKey
+    // * returns false if there was nothing to load
+    bool LoadFromFile(QString const &filePath,
+                      QString const &vehicleKey);
+
+private:
+    // getBitmapPid
+    // * returns the bitmap PID of paramFrame
+    //   or -1 if it isn't a bitmap PID
+    int getBitmapPid(ParameterFrame const &paramFrame) const;
+
+    bool isPidSetInBitmap(QByteArray const &bitmap,
+                          ubyte const pid) const;
+
+    // anyEcuHasPid
+    // * like IsPidSupported without an ecu header, but
+    //   false if there's no data
+    bool anyEcuHasPid(ubyte const pid) const;
+
+    QByteArray convByteListToHexStr(ByteList const &byteList);
+
+    bool convHexStrToByteList(QByteArray const &hexStr,
+                              ByteList &byteList);
+
+    Parser * m_parser;
+
+    // bitmap PID parameters sorted by PID
+    QList<ParameterFrame> m_listBitmapFrames;
+    int m_idxNextBitmap;
+
+    // [ecu response header] -> bitmap bytes, four per
+    // bitmap PID in the order they're sent by the ecu
+    QHash<QByteArray,QByteArray> m_tableEcuBitmaps;
+};
+
+}
+
+#endif // SUPPORTEDPIDS_H
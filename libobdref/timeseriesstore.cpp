@@ -0,0 +1,351 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include "timeseriesstore.h"
+
+namespace obdref
+{
+    // TimeSeriesSegment
+    // * a fixed size block of a column; only the
+    //   first size entries are in use
+    struct TimeSeriesSegment
+    {
+        TimeSeriesSegment() :
+            size(0)
+        {}
+
+        QVector<qint64> listTimestampUs;
+        QVector<double> listValues;     // numerical columns
+        QVector<quint32> listCodes;     // literal columns
+        int size;
+    };
+
+    struct TimeSeriesColumn
+    {
+        TimeSeriesColumn() :
+            lastTimestampUs(0)
+        {}
+
+        ColumnInfo info;
+        QList<TimeSeriesSegment*> listSegments;     // oldest first
+        qint64 lastTimestampUs;
+    };
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    // lowerBound
+    // * index of the first timestamp >= value
+    static int lowerBound(qint64 const * listTimestampUs,
+                          int const size,
+                          qint64 const value)
+    {
+        int lo=0;
+        int hi=size;
+        while(lo < hi)   {
+            int const mid = lo+(hi-lo)/2;
+            if(listTimestampUs[mid] < value)   {
+                lo = mid+1;
+            }
+            else   {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    // upperBound
+    // * index of the first timestamp > value
+    static int upperBound(qint64 const * listTimestampUs,
+                          int const size,
+                          qint64 const value)
+    {
+        int lo=0;
+        int hi=size;
+        while(lo < hi)   {
+            int const mid = lo+(hi-lo)/2;
+            if(listTimestampUs[mid] <= value)   {
+                lo = mid+1;
+            }
+            else   {
+                hi = mid;
+            }
+        }
+        return lo;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    TimeSeriesStore::TimeSeriesStore(int const segmentSize,
+                                     int const maxSegments) :
+        m_segmentSize(qMax(segmentSize,1)),
+        m_maxSegments(qMax(maxSegments,0))
+    {}
+
+    TimeSeriesStore::~TimeSeriesStore()
+    {
+        Clear();
+    }
+
+    void TimeSeriesStore::Add(qint64 const timestampUs,
+                              Data const &data)
+    {
+        for(int i=0; i < data.listNumericalData.size(); i++)   {
+            NumericalData const &numData = data.listNumericalData[i];
+            TimeSeriesColumn * column =
+                getColumn(data,numData.property,numData.units,false);
+            append(column,timestampUs,numData.value,0);
+        }
+        for(int i=0; i < data.listLiteralData.size(); i++)   {
+            LiteralData const &litData = data.listLiteralData[i];
+            TimeSeriesColumn * column =
+                getColumn(data,litData.property,QString(),true);
+            quint32 const code = getLiteralCode((litData.value) ?
+                litData.valueIfTrue : litData.valueIfFalse);
+            append(column,timestampUs,0,code);
+        }
+    }
+
+    void TimeSeriesStore::Add(QList<qint64> const &listTimestampUs,
+                              QList<Data> const &listData)
+    {
+        if(listTimestampUs.size() != listData.size())   {
+            OBDREFERROR << "Error: TimeSeriesStore: expected a"
+                        << "timestamp for each data";
+            return;
+        }
+        for(int i=0; i < listData.size(); i++)   {
+            Add(listTimestampUs[i],listData[i]);
+        }
+    }
+
+    void TimeSeriesStore::Clear()
+    {
+        for(int i=0; i < m_listColumns.size(); i++)   {
+            TimeSeriesColumn * column = m_listColumns[i];
+            for(int j=0; j < column->listSegments.size(); j++)   {
+                delete column->listSegments[j];
+            }
+            delete column;
+        }
+        m_listColumns.clear();
+        m_tableColumnsByParam.clear();
+        m_listLiterals.clear();
+        m_tableLiteralCodes.clear();
+    }
+
+    int TimeSeriesStore::FindColumn(QString const &paramName,
+                                    QString const &srcName,
+                                    QString const &property) const
+    {
+        QList<int> const listColumnIdx = m_tableColumnsByParam.value(paramName);
+        for(int i=0; i < listColumnIdx.size(); i++)   {
+            ColumnInfo const &info = m_listColumns[listColumnIdx[i]]->info;
+            if(info.property == property && info.srcName == srcName)   {
+                return listColumnIdx[i];
+            }
+        }
+        return -1;
+    }
+
+    ColumnInfo TimeSeriesStore::GetColumnInfo(int const columnIdx) const
+    {
+        if(columnIdx < 0 || columnIdx >= m_listColumns.size())   {
+            return ColumnInfo();
+        }
+        return m_listColumns[columnIdx]->info;
+    }
+
+    void TimeSeriesStore::GetRange(int const columnIdx,
+                                   qint64 const startUs,
+                                   qint64 const endUs,
+                                   QList<ColumnView> &listViews) const
+    {
+        if(columnIdx < 0 || columnIdx >= m_listColumns.size())   {
+            return;
+        }
+
+        TimeSeriesColumn const * column = m_listColumns[columnIdx];
+        for(int i=0; i < column->listSegments.size(); i++)   {
+            TimeSeriesSegment const * segment = column->listSegments[i];
+            qint64 const * listTimestampUs = segment->listTimestampUs.constData();
+
+            if(endUs >= 0 && listTimestampUs[0] > endUs)   {
+                break;
+            }
+            int const idxStart = (startUs < 0) ? 0 :
+                lowerBound(listTimestampUs,segment->size,startUs);
+            int const idxEnd = (endUs < 0) ? segment->size :
+                upperBound(listTimestampUs,segment->size,endUs);
+            if(idxStart >= idxEnd)   {
+                continue;
+            }
+
+            ColumnView view;
+            view.timestampUs = listTimestampUs+idxStart;
+            if(column->info.isLiteral)   {
+                view.codes = segment->listCodes.constData()+idxStart;
+            }
+            else   {
+                view.values = segment->listValues.constData()+idxStart;
+            }
+            view.size = idxEnd-idxStart;
+            listViews.append(view);
+        }
+    }
+
+    int TimeSeriesStore::CopyRange(int const columnIdx,
+                                   qint64 const startUs,
+                                   qint64 const endUs,
+                                   QVector<qint64> &listTimestampUs,
+                                   QVector<double> &listValues) const
+    {
+        QList<ColumnView> listViews;
+        GetRange(columnIdx,startUs,endUs,listViews);
+
+        int numValues=0;
+        for(int i=0; i < listViews.size(); i++)   {
+            numValues += listViews[i].size;
+        }
+        listTimestampUs.reserve(listTimestampUs.size()+numValues);
+        listValues.reserve(listValues.size()+numValues);
+
+        for(int i=0; i < listViews.size(); i++)   {
+            ColumnView const &view = listViews[i];
+            for(int j=0; j < view.size; j++)   {
+                listTimestampUs.append(view.timestampUs[j]);
+                listValues.append((view.values) ?
+                    view.values[j] : double(view.codes[j]));
+            }
+        }
+        return numValues;
+    }
+
+    qint64 TimeSeriesStore::GetMemoryBytes() const
+    {
+        qint64 numBytes=0;
+        for(int i=0; i < m_listColumns.size(); i++)   {
+            TimeSeriesColumn const * column = m_listColumns[i];
+            qint64 const bytesPerValue = sizeof(qint64) + ((column->info.isLiteral) ?
+                sizeof(quint32) : sizeof(double));
+            numBytes += column->listSegments.size()*m_segmentSize*bytesPerValue;
+        }
+        return numBytes;
+    }
+
+    // ========================================================================== //
+    // ========================================================================== //
+
+    TimeSeriesColumn * TimeSeriesStore::getColumn(Data const &data,
+                                                  QString const &property,
+                                                  QString const &units,
+                                                  bool const isLiteral)
+    {
+        // a parameter only has a few columns, so they're
+        // found by name and then compared directly (which
+        // doesn't build a key for every value)
+        QList<int> const listColumnIdx =
+            m_tableColumnsByParam.value(data.paramName);
+
+        for(int i=0; i < listColumnIdx.size(); i++)   {
+            TimeSeriesColumn * column = m_listColumns[listColumnIdx[i]];
+            if(column->info.isLiteral == isLiteral &&
+               column->info.property == property &&
+               column->info.srcName == data.srcName)   {
+                return column;
+            }
+        }
+
+        TimeSeriesColumn * column = new TimeSeriesColumn;
+        column->info.paramName = data.paramName;
+        column->info.srcName = data.srcName;
+        column->info.property = property;
+        column->info.units = units;
+        column->info.isLiteral = isLiteral;
+
+        m_tableColumnsByParam[data.paramName].append(m_listColumns.size());
+        m_listColumns.append(column);
+        return column;
+    }
+
+    void TimeSeriesStore::append(TimeSeriesColumn * column,
+                                 qint64 const timestampUs,
+                                 double const value,
+                                 quint32 const code)
+    {
+        if(column->listSegments.isEmpty() ||
+           column->listSegments.last()->size == m_segmentSize)
+        {
+            TimeSeriesSegment * segment = NULL;
+            if(m_maxSegments > 0 &&
+               column->listSegments.size() >= m_maxSegments)   {
+                // reuse the oldest segment
+                segment = column->listSegments.takeFirst();
+                column->info.numValues -= segment->size;
+                column->info.numDropped += segment->size;
+                segment->size = 0;
+            }
+            else   {
+                segment = new TimeSeriesSegment;
+                segment->listTimestampUs.resize(m_segmentSize);
+                if(column->info.isLiteral)   {
+                    segment->listCodes.resize(m_segmentSize);
+                }
+                else   {
+                    segment->listValues.resize(m_segmentSize);
+                }
+            }
+            column->listSegments.append(segment);
+        }
+
+        // keep each column sorted by time
+        if(column->info.numValues+column->info.numDropped > 0)   {
+            column->lastTimestampUs = qMax(column->lastTimestampUs,timestampUs);
+        }
+        else   {
+            column->lastTimestampUs = timestampUs;
+        }
+
+        TimeSeriesSegment * segment = column->listSegments.last();
+        segment->listTimestampUs.data()[segment->size] = column->lastTimestampUs;
+        if(column->info.isLiteral)   {
+            segment->listCodes.data()[segment->size] = code;
+        }
+        else   {
+            segment->listValues.data()[segment->size] = value;
+        }
+        segment->size++;
+        column->info.numValues++;
+    }
+
+    quint32 TimeSeriesStore::getLiteralCode(QString const &literal)
+    {
+        QHash<QString,quint32>::const_iterator it =
+            m_tableLiteralCodes.find(literal);
+        if(it != m_tableLiteralCodes.end())   {
+            return it.value();
+        }
+
+        quint32 const code = quint32(m_listLiterals.size());
+        m_listLiterals.append(literal);
+        m_tableLiteralCodes.insert(literal,code);
+        return code;
+    }
+}
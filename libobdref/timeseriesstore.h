@@ -0,0 +1,177 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#ifndef TIMESERIESSTORE_H
+#define TIMESERIESSTORE_H
+
+#include <QHash>
+#include <QVector>
+
+#include "datatypes.h"
+#include "obdrefdebug.h"
+
+namespace obdref
+{
+
+struct TimeSeriesColumn;
+
+// ColumnInfo
+// * what a column in a TimeSeriesStore holds
+struct ColumnInfo
+{
+    ColumnInfo() :
+        isLiteral(false),
+        numValues(0),
+        numDropped(0)
+    {}
+
+    QString paramName;
+    QString srcName;
+    QString property;
+    QString units;          // numerical columns only
+    bool isLiteral;         // values are codes for GetLiteral
+    qint64 numValues;       // values in the store
+    qint64 numDropped;      // values overwritten by the ring
+};
+
+// ColumnView
+// * a run of values from one segment of a column; the
+//   arrays point into the store (they aren't copies)
+// * values is set for numerical columns and codes
+//   (indices for GetLiteral) for literal columns
+struct ColumnView
+{
+    ColumnView() :
+        timestampUs(NULL),
+        values(NULL),
+        codes(NULL),
+        size(0)
+    {}
+
+    qint64 const * timestampUs;
+    double const * values;
+    quint32 const * codes;
+    int size;
+};
+
+// TimeSeriesStore
+// * keeps parsed values in columns, one for each parameter,
+//   source and property, instead of a list of Data (which
+//   copies names, units and properties for every value)
+// * each column saves timestamps and values in arrays of
+//   segmentSize entries; with maxSegments, a column is a
+//   ring that reuses its oldest segment once it has that
+//   many (so memory use is fixed)
+// * literal values are saved as codes for a dictionary
+//   of strings shared by every column
+// * values are expected in time order for each column; a
+//   value that's older than the last one in its column
+//   is saved with the last value's timestamp
+class TimeSeriesStore
+{
+public:
+    TimeSeriesStore(int const segmentSize=4096,
+                    int const maxSegments=0);
+    ~TimeSeriesStore();
+
+    // Add
+    // * saves every value in data with timestampUs
+    void Add(qint64 const timestampUs,
+             Data const &data);
+
+    // Add
+    // * saves listData[i] with listTimestampUs[i] (as
+    //   returned by FrameSource::Replay)
+    void Add(QList<qint64> const &listTimestampUs,
+             QList<Data> const &listData);
+
+    // Clear
+    // * removes every column and literal
+    void Clear();
+
+    int GetColumnCount() const
+    {   return m_listColumns.size();   }
+
+    // FindColumn
+    // * returns the index of the column for paramName,
+    //   srcName and property or -1 if there isn't one
+    int FindColumn(QString const &paramName,
+                   QString const &srcName,
+                   QString const &property) const;
+
+    ColumnInfo GetColumnInfo(int const columnIdx) const;
+
+    // GetRange
+    // * appends views of the values in a column with
+    //   timestamps in [startUs,endUs] to listViews, in
+    //   time order (-1 for the start/end of the column)
+    // * views stay valid until the store is cleared or
+    //   (with maxSegments) the ring reuses their segment
+    void GetRange(int const columnIdx,
+                  qint64 const startUs,
+                  qint64 const endUs,
+                  QList<ColumnView> &listViews) const;
+
+    // CopyRange
+    // * as GetRange, but the timestamps and values (or
+    //   codes as doubles for literal columns) are copied;
+    //   returns the number of values copied
+    int CopyRange(int const columnIdx,
+                  qint64 const startUs,
+                  qint64 const endUs,
+                  QVector<qint64> &listTimestampUs,
+                  QVector<double> &listValues) const;
+
+    int GetLiteralCount() const
+    {   return m_listLiterals.size();   }
+
+    QString const & GetLiteral(quint32 const code) const
+    {   return m_listLiterals[int(code)];   }
+
+    // GetMemoryBytes
+    // * bytes allocated for segments (names and
+    //   literals aren't included)
+    qint64 GetMemoryBytes() const;
+
+private:
+    TimeSeriesColumn * getColumn(Data const &data,
+                                 QString const &property,
+                                 QString const &units,
+                                 bool const isLiteral);
+
+    void append(TimeSeriesColumn * column,
+                qint64 const timestampUs,
+                double const value,
+                quint32 const code);
+
+    quint32 getLiteralCode(QString const &literal);
+
+    int m_segmentSize;
+    int m_maxSegments;
+
+    QList<TimeSeriesColumn*> m_listColumns;
+    QHash<QString,QList<int> > m_tableColumnsByParam;    // param name -> column indices
+
+    QStringList m_listLiterals;
+    QHash<QString,quint32> m_tableLiteralCodes;
+};
+
+}
+
+#endif // TIMESERIESSTORE_H
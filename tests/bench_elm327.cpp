@@ -0,0 +1,355 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include "elm327emulator.h"
+#include "pollscheduler.h"
+#include "respondermap.h"
+
+// bench_elm327
+// * polls a set of SAEJ1979 parameters from an emulated
+//   ELM327 over a pty, going through Elm327Codec, the
+//   PollScheduler and the Parser like a real client, and
+//   reports the sample rate and request latency
+// * runs once without and once with response count
+//   hints (learned with a ResponderMap)
+// * usage: ./bench_elm327 /path/to/obd2.xml [options]
+//   protocol=<name>    (default "ISO 15765 Standard Id")
+//   ecus=<n>           number of ecus (default 2)
+//   latency=<ms>       ecu response time (default 10)
+//   timeout=<ms>       adapter timeout (default 100)
+//   bytes=<n>          data bytes for variable length
+//                      responses like DTCs (default 12)
+//   seconds=<n>        time to poll for (default 3)
+//   serve              only run the emulator, printing
+//                      the pty path to connect to
+
+static int const PROMPT_TIMEOUT_MS = 2000;
+
+int bad_args()
+{
+    qDebug() << "Pass the definitions file in as an argument:";
+    qDebug() << "./bench_elm327 /path/to/obd2.xml "
+                "[protocol=\"ISO 15765 Standard Id\"] [ecus=2] "
+                "[latency=10] [timeout=100] [bytes=12] [seconds=3] [serve]";
+    return -1;
+}
+
+int open_port(QString const &path)
+{
+    int const fd = open(path.toLocal8Bit().constData(),O_RDWR | O_NOCTTY);
+    if(fd < 0)   {
+        return -1;
+    }
+    struct termios tio;
+    tcgetattr(fd,&tio);
+    cfmakeraw(&tio);
+    tcsetattr(fd,TCSANOW,&tio);
+    return fd;
+}
+
+bool write_command(int const fd,QByteArray const &cmd)
+{
+    return (write(fd,cmd.constData(),cmd.size()) == cmd.size());
+}
+
+// read_until_prompt
+// * reads adapter output and passes it through codec
+//   until the prompt is seen
+bool read_until_prompt(int const fd,
+                       obdref::Elm327Codec &codec,
+                       obdref::ParameterFrame const &param,
+                       QList<obdref::ByteList> &listRawFrames)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while(timer.elapsed() < PROMPT_TIMEOUT_MS)   {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if(poll(&pfd,1,50) <= 0)   {
+            continue;
+        }
+        char buff[256];
+        ssize_t const bytesRead = read(fd,buff,sizeof(buff));
+        if(bytesRead <= 0)   {
+            return false;
+        }
+        if(codec.DecodeResponse(param,buff,int(bytesRead),listRawFrames))   {
+            return true;
+        }
+    }
+    return false;
+}
+
+struct BenchResult
+{
+    BenchResult() :
+        numRequests(0),
+        numSamples(0),
+        numFailed(0),
+        latencyMinMs(-1),
+        latencyMaxMs(0),
+        latencySumMs(0)
+    {}
+
+    int numRequests;
+    int numSamples;
+    int numFailed;
+    qint64 latencyMinMs;
+    qint64 latencyMaxMs;
+    qint64 latencySumMs;
+};
+
+bool bench_poll(int const fd,
+                obdref::Parser &parser,
+                QList<obdref::ParameterFrame> &listParams,
+                bool const useHints,
+                int const seconds,
+                BenchResult &result)
+{
+    obdref::Elm327Codec codec;
+    codec.SetResponseCountHints(useHints);
+
+    QList<QByteArray> listCommands;
+    obdref::ParameterFrame noParam;
+    QList<obdref::ByteList> listUnused;
+    codec.GetInitCommands(listCommands);
+    for(int i=0; i < listCommands.size(); i++)   {
+        write_command(fd,listCommands[i]);
+        if(!read_until_prompt(fd,codec,noParam,listUnused))   {
+            qDebug() << "Error: no prompt after" << listCommands[i];
+            return false;
+        }
+    }
+
+    // ask for more than the adapter can do so
+    // the scheduler uses the whole budget
+    obdref::PollScheduler scheduler;
+    for(int i=0; i < listParams.size(); i++)   {
+        int const paramIdx = scheduler.AddParameterFrame(listParams[i]);
+        scheduler.SetRate(paramIdx,50.0);
+    }
+
+    obdref::ResponderMap responders;
+    QList<obdref::ParameterFrame> listActive = listParams;
+
+    QElapsedTimer timer;
+    timer.start();
+    while(timer.elapsed() < seconds*1000)
+    {
+        int paramIdx,msgIdx;
+        qint64 waitMs;
+        if(!scheduler.NextRequest(timer.elapsed(),paramIdx,msgIdx,waitMs))   {
+            if(waitMs < 0)   {
+                qDebug() << "Error: nothing to poll";
+                return false;
+            }
+            QThread::msleep(waitMs);
+            continue;
+        }
+
+        obdref::ParameterFrame &param = listActive[paramIdx];
+        if(msgIdx == 0)   {
+            param = listParams[paramIdx];
+            if(useHints)   {
+                responders.ApplyResponseCounts(param);
+            }
+        }
+
+        codec.EncodeRequest(param,msgIdx,listCommands);
+        qint64 const requestTimeMs = timer.elapsed();
+
+        // header commands only return OK
+        bool responseOk = true;
+        for(int i=0; i < listCommands.size() && responseOk; i++)   {
+            write_command(fd,listCommands[i]);
+            QList<obdref::ByteList> &listRawFrames = (i == listCommands.size()-1) ?
+                param.listMessageData[msgIdx].listRawFrames : listUnused;
+            responseOk = read_until_prompt(fd,codec,param,listRawFrames);
+        }
+        listUnused.clear();
+
+        qint64 const latencyMs = timer.elapsed()-requestTimeMs;
+        result.numRequests++;
+        result.latencySumMs += latencyMs;
+        result.latencyMaxMs = qMax(result.latencyMaxMs,latencyMs);
+        if(result.latencyMinMs < 0 || latencyMs < result.latencyMinMs)   {
+            result.latencyMinMs = latencyMs;
+        }
+
+        responseOk = responseOk &&
+            !param.listMessageData[msgIdx].listRawFrames.isEmpty();
+
+        if(responseOk && msgIdx == param.listMessageData.size()-1)   {
+            QList<obdref::Data> listData;
+            if(parser.ParseParameterFrame(param,listData))   {
+                responders.RecordResponders(param);
+                result.numSamples += listData.size();
+            }
+            else   {
+                responseOk = false;
+            }
+        }
+        if(!responseOk)   {
+            result.numFailed++;
+        }
+        scheduler.ResponseReceived(timer.elapsed(),responseOk);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)   {
+        return bad_args();
+    }
+
+    QString pathDefinitions(argv[1]);
+    QString protocol("ISO 15765 Standard Id");
+    Elm327Emulator::Options options;
+    options.numEcus = 2;
+    int seconds = 3;
+    bool serve = false;
+
+    for(int i=2; i < argc; i++)   {
+        QString arg(argv[i]);
+        QString value = arg.mid(arg.indexOf("=")+1);
+        if(arg.startsWith("protocol="))   {
+            protocol = value;
+        }
+        else if(arg.startsWith("ecus="))   {
+            options.numEcus = value.toInt();
+        }
+        else if(arg.startsWith("latency="))   {
+            options.latencyMs = value.toInt();
+        }
+        else if(arg.startsWith("timeout="))   {
+            options.timeoutMs = value.toInt();
+        }
+        else if(arg.startsWith("bytes="))   {
+            options.varDataBytes = value.toInt();
+        }
+        else if(arg.startsWith("seconds="))   {
+            seconds = value.toInt();
+        }
+        else if(arg == "serve")   {
+            serve = true;
+        }
+        else   {
+            return bad_args();
+        }
+    }
+
+    bool ok = false;
+    obdref::Parser parser(pathDefinitions,ok);
+    if(!ok) { return -1; }
+
+    QString const spec("SAEJ1979");
+    QString const address("Default");
+
+    Elm327Emulator emulator(parser,options);
+    if(!emulator.Init(spec,protocol,address))   {
+        return -1;
+    }
+    emulator.start();
+
+    if(serve)   {
+        qDebug() << "ELM327 emulator for" << protocol
+                 << "listening on" << emulator.GetSlavePath();
+        for(;;)   {
+            QThread::msleep(1000);
+        }
+    }
+
+    QStringList listNames;
+    listNames << "Engine RPM"
+              << "Vehicle Speed"
+              << "Engine Coolant Temperature"
+              << "Calculated Engine Load"
+              << "Intake Air Temperature"
+              << "Throttle Position"
+              << "Request Stored Diagnostic Trouble Codes";
+
+    QList<obdref::ParameterFrame> listParams;
+    for(int i=0; i < listNames.size(); i++)   {
+        obdref::ParameterFrame param;
+        param.spec = spec;
+        param.protocol = protocol;
+        param.address = address;
+        param.name = listNames[i];
+        if(!parser.BuildParameterFrame(param))   {
+            qDebug() << "Error: could not build" << listNames[i];
+            return -1;
+        }
+        listParams << param;
+    }
+
+    int const fd = open_port(emulator.GetSlavePath());
+    if(fd < 0)   {
+        qDebug() << "Error: could not open" << emulator.GetSlavePath();
+        return -1;
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << protocol << "," << options.numEcus << "ecus,"
+             << options.latencyMs << "ms latency,"
+             << options.timeoutMs << "ms timeout";
+
+    bool benchOk = true;
+    for(int i=0; i < 2; i++)   {
+        bool const useHints = (i == 1);
+        BenchResult result;
+        if(!bench_poll(fd,parser,listParams,useHints,seconds,result))   {
+            benchOk = false;
+            break;
+        }
+        if(result.numRequests == 0 || result.numFailed > 0)   {
+            benchOk = false;
+        }
+
+        double const elapsedSec = seconds;
+        qDebug() << ((useHints) ? "with count hints:" : "without count hints:");
+        qDebug() << "  requests:" << result.numRequests
+                 << "(" << result.numRequests/elapsedSec << "/s ),"
+                 << "samples:" << result.numSamples
+                 << "(" << result.numSamples/elapsedSec << "/s ),"
+                 << "failed:" << result.numFailed;
+        if(result.numRequests > 0)   {
+            qDebug() << "  latency (ms): min" << result.latencyMinMs
+                     << "avg" << double(result.latencySumMs)/result.numRequests
+                     << "max" << result.latencyMaxMs;
+        }
+    }
+    close(fd);
+
+    emulator.Stop();
+    emulator.wait();
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << "bench elm327" << ((benchOk) ? "passed!" : "failed!");
+    return (benchOk) ? 0 : -1;
+}
@@ -0,0 +1,58 @@
+TEMPLATE    = app
+TARGET      = bench_elm327
+QT          += core
+
+HEADERS += elm327emulator.h
+SOURCES += elm327emulator.cpp bench_elm327.cpp
+
+# obdref lib
+PATH_OBDREF = ../libobdref
+
+INCLUDEPATH += $${PATH_OBDREF}
+
+HEADERS += \
+    $${PATH_OBDREF}/pugixml/pugiconfig.hpp \
+    $${PATH_OBDREF}/duktape/duktape.h \
+    $${PATH_OBDREF}/pugixml/pugixml.hpp \
+    $${PATH_OBDREF}/obdrefdebug.h \
+    $${PATH_OBDREF}/datatypes.h \
+    $${PATH_OBDREF}/framefilter.h \
+    $${PATH_OBDREF}/parser.h \
+    $${PATH_OBDREF}/framedispatcher.h \
+    $${PATH_OBDREF}/pollscheduler.h \
+    $${PATH_OBDREF}/bustimingmodel.h \
+    $${PATH_OBDREF}/supportedpids.h \
+    $${PATH_OBDREF}/respondermap.h \
+    $${PATH_OBDREF}/elm327codec.h \
+    $${PATH_OBDREF}/isotpflowcontrol.h \
+    $${PATH_OBDREF}/parseprofiler.h \
+    $${PATH_OBDREF}/framecapture.h \
+    $${PATH_OBDREF}/batchdecoder.h \
+    $${PATH_OBDREF}/logimporter.h \
+    $${PATH_OBDREF}/timeseriesstore.h
+
+SOURCES += \
+    $${PATH_OBDREF}/pugixml/pugixml.cpp \
+    $${PATH_OBDREF}/duktape/duktape.c \
+    $${PATH_OBDREF}/obdrefdebug.cpp \
+    $${PATH_OBDREF}/framefilter.cpp \
+    $${PATH_OBDREF}/parser.cpp \
+    $${PATH_OBDREF}/framedispatcher.cpp \
+    $${PATH_OBDREF}/pollscheduler.cpp \
+    $${PATH_OBDREF}/bustimingmodel.cpp \
+    $${PATH_OBDREF}/supportedpids.cpp \
+    $${PATH_OBDREF}/respondermap.cpp \
+    $${PATH_OBDREF}/elm327codec.cpp \
+    $${PATH_OBDREF}/isotpflowcontrol.cpp \
+    $${PATH_OBDREF}/parseprofiler.cpp \
+    $${PATH_OBDREF}/framecapture.cpp \
+    $${PATH_OBDREF}/batchdecoder.cpp \
+    $${PATH_OBDREF}/logimporter.cpp \
+    $${PATH_OBDREF}/timeseriesstore.cpp
+
+linux {
+    HEADERS += $${PATH_OBDREF}/socketcanreader.h
+    SOURCES += $${PATH_OBDREF}/socketcanreader.cpp
+}
+
+DEFINES += OBDREF_DEBUG_QDEBUG
@@ -0,0 +1,196 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cstdlib>
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include "framefilter.h"
+
+// bench_framefilter
+// * compares the per-frame header/prefix checks the
+//   cleanFrames_[...] functions used to do against
+//   the batch FrameFilter (scalar and SIMD)
+// * a large set of frames where only a small fraction
+//   match is used (ie. a busy bus with lots of traffic
+//   that isn't a response to the current request)
+// * usage: ./bench_framefilter [num_frames] [match_pct]
+
+obdref::ubyte randomByte()
+{   return obdref::ubyte(rand() % 255);  }
+
+void make_frames(obdref::MessageData &msg,
+                 int const headerLength,
+                 int const numFrames,
+                 int const matchPct)
+{
+    msg.listRawFrames.clear();
+    for(int i=0; i < numFrames; i++)   {
+        obdref::ByteList rawFrame;
+        bool const match = ((rand() % 100) < matchPct);
+        for(int k=0; k < headerLength; k++)   {
+            rawFrame << ((match) ? msg.expHeaderBytes[k] : randomByte());
+        }
+        // [single frame] pci byte
+        if(headerLength != 3)   {
+            rawFrame << 0x07;
+        }
+        for(int k=0; k < msg.expDataPrefix.size(); k++)   {
+            rawFrame << ((match) ? msg.expDataPrefix[k] : randomByte());
+        }
+        while(rawFrame.size() < headerLength+8)   {
+            rawFrame << randomByte();
+        }
+        msg.listRawFrames << rawFrame;
+    }
+}
+
+// filter_reference
+// * the per-frame split and compare that was
+//   previously done in Parser::cleanFrames_[...]
+void filter_reference(obdref::MessageData const &msg,
+                      int const headerLength,
+                      QList<int> &listIdxAccepted)
+{
+    int const idxPrefix = (headerLength == 3) ? 3 : headerLength+1;
+    for(int j=0; j < msg.listRawFrames.size(); j++)   {
+        obdref::ByteList const &rawFrame = msg.listRawFrames[j];
+
+        obdref::ByteList headerBytes;
+        for(int k=0; k < headerLength; k++)   {
+            headerBytes << rawFrame[k];
+        }
+        obdref::ByteList dataBytes;
+        for(int k=idxPrefix; k < rawFrame.size(); k++)   {
+            dataBytes << rawFrame[k];
+        }
+
+        bool bytesOk = true;
+        for(int k=0; k < headerBytes.size(); k++)   {
+            obdref::ubyte maskByte = msg.expHeaderMask[k];
+            if((maskByte & headerBytes[k]) !=
+               (maskByte & msg.expHeaderBytes[k]))   {
+                bytesOk = false;
+                break;
+            }
+        }
+        if(!bytesOk)   {
+            continue;
+        }
+
+        for(int k=0; k < msg.expDataPrefix.size(); k++)   {
+            if(msg.expDataPrefix[k] != dataBytes.takeAt(0))   {
+                bytesOk = false;
+                break;
+            }
+        }
+        if(!bytesOk)   {
+            continue;
+        }
+
+        listIdxAccepted << j;
+    }
+}
+
+bool bench_protocol(QString const &desc,
+                    int const headerLength,
+                    int const numFrames,
+                    int const matchPct)
+{
+    obdref::MessageData msg;
+    if(headerLength == 2)   {
+        msg.expHeaderBytes << 0x07 << 0xE8;
+        msg.expHeaderMask << 0x07 << 0xF8;
+    }
+    else if(headerLength == 3)   {
+        msg.expHeaderBytes << 0x48 << 0x6B << 0x10;
+        msg.expHeaderMask << 0xFF << 0xFF << 0x00;
+    }
+    else   {
+        msg.expHeaderBytes << 0x18 << 0xDA << 0xF1 << 0x10;
+        msg.expHeaderMask << 0xFF << 0xFF << 0xFF << 0x00;
+    }
+    msg.expDataPrefix << 0x41 << 0x0C;
+
+    make_frames(msg,headerLength,numFrames,matchPct);
+
+    obdref::FrameFilter filter;
+    QList<int> listRef,listScalar,listSimd;
+    QElapsedTimer timer;
+
+    timer.start();
+    filter_reference(msg,headerLength,listRef);
+    qint64 const msRef = timer.elapsed();
+
+    filter.SetUseSimd(false);
+    timer.start();
+    if(headerLength == 3)   {
+        filter.FilterFrames_Legacy(msg,0,listScalar);
+    }
+    else   {
+        filter.FilterFrames_ISO_15765(msg,headerLength,0,listScalar);
+    }
+    qint64 const msScalar = timer.elapsed();
+
+    filter.SetUseSimd(true);
+    timer.start();
+    if(headerLength == 3)   {
+        filter.FilterFrames_Legacy(msg,0,listSimd);
+    }
+    else   {
+        filter.FilterFrames_ISO_15765(msg,headerLength,0,listSimd);
+    }
+    qint64 const msSimd = timer.elapsed();
+
+    qDebug() << desc << ":" << numFrames << "frames,"
+             << listRef.size() << "accepted";
+    qDebug() << "  reference:" << msRef << "ms";
+    qDebug() << "  filter (scalar):" << msScalar << "ms";
+    qDebug() << "  filter (" << obdref::FrameFilter::SimdInstructionSet()
+             << "):" << msSimd << "ms";
+
+    if(listRef != listScalar || listRef != listSimd)   {
+        qDebug() << desc << "failed! (accepted frames differ)";
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int numFrames = 1000000;
+    int matchPct = 2;
+    if(argc > 1)   {
+        numFrames = atoi(argv[1]);
+    }
+    if(argc > 2)   {
+        matchPct = atoi(argv[2]);
+    }
+
+    if(!bench_protocol("legacy",3,numFrames,matchPct))   {
+        return -1;
+    }
+    if(!bench_protocol("iso 15765 (standard ids)",2,numFrames,matchPct))   {
+        return -1;
+    }
+    if(!bench_protocol("iso 15765 (extended ids)",4,numFrames,matchPct))   {
+        return -1;
+    }
+    return 0;
+}
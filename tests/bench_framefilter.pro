@@ -0,0 +1,20 @@
+TEMPLATE    = app
+TARGET      = bench_framefilter
+QT          += core
+
+SOURCES += bench_framefilter.cpp
+
+# obdref lib
+PATH_OBDREF = ../libobdref
+
+INCLUDEPATH += $${PATH_OBDREF}
+
+HEADERS += \
+    $${PATH_OBDREF}/datatypes.h \
+    $${PATH_OBDREF}/framefilter.h
+
+SOURCES += \
+    $${PATH_OBDREF}/framefilter.cpp
+
+# uncomment to benchmark the AVX2 path
+# QMAKE_CXXFLAGS += -mavx2
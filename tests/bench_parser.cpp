@@ -0,0 +1,377 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <QDebug>
+#include <QElapsedTimer>
+
+#include "obdreftest.h"
+#include "parseprofiler.h"
+
+// bench_parser
+// * times BuildParameterFrame, CleanParameterFrame and
+//   ParseParameterFrame (PARSE_SEPARATELY and PARSE_COMBINED)
+//   for every protocol in the test definitions, using the
+//   same sim_vehicle_message_[...] responses as test_basic
+// * cleaning and parsing are run for 1 to N frames per
+//   response and 1 to N responding ecus (doubling)
+// * a line per case is logged, and the results are written
+//   as json to stdout (or to a file with out=<path>) so
+//   they can be compared between builds
+// * usage: ./bench_parser /path/to/test.xml [options]
+//   iterations=<n>     runs of each case (default 100)
+//   frames=<n>         max frames per response (default 8)
+//   ecus=<n>           max ecus (default 4)
+//   out=<path>         json output file
+
+struct BenchResult
+{
+    BenchResult() :
+        frames(0),
+        ecus(0),
+        numOps(0),
+        numFrames(0),
+        totalNs(0)
+    {}
+
+    QString bench;
+    QString protocol;
+    int frames;             // frames per response per ecu
+    int ecus;
+    quint64 numOps;         // calls timed
+    quint64 numFrames;      // raw frames processed
+    qint64 totalNs;
+    obdref::LatencyHistogram latency;
+};
+
+static char const * const PARAM_SEPARATELY = "T_REQ_NONE_RESP_SF_PARSE_SEP";
+static char const * const PARAM_COMBINED = "T_REQ_NON_RESP_MF_PARSE_COMBINED";
+
+int bad_args()
+{
+    qDebug() << "Pass the test definitions file in as an argument:";
+    qDebug() << "./bench_parser /path/to/test.xml "
+                "[iterations=100] [frames=8] [ecus=4] [out=results.json]";
+    return -1;
+}
+
+double per_second(quint64 const count,qint64 const ns)
+{
+    return (ns > 0) ? (double(count)*1E9)/double(ns) : 0.0;
+}
+
+// add_ecu_response
+// * appends a response of numFrames frames from an ecu,
+//   which is identified by the last header byte (the
+//   source address or the low byte of the can id)
+void add_ecu_response(obdref::ParameterFrame &param,
+                      int const numFrames,
+                      int const ecuIdx)
+{
+    QList<int> listNumRawFrames;
+    for(int i=0; i < param.listMessageData.size(); i++)   {
+        listNumRawFrames << param.listMessageData[i].listRawFrames.size();
+    }
+
+    if(param.parseProtocol == obdref::PROTOCOL_ISO_15765)   {
+        sim_vehicle_message_iso15765(param,numFrames,false);
+    }
+    else if(param.parseProtocol == obdref::PROTOCOL_ISO_14230)   {
+        for(int j=0; j < numFrames; j++)   {
+            sim_vehicle_message_iso14230(param,1,false,3);
+        }
+    }
+    else   {
+        sim_vehicle_message_legacy(param,numFrames,false);
+    }
+
+    for(int i=0; i < param.listMessageData.size(); i++)   {
+        obdref::MessageData &msg = param.listMessageData[i];
+        int const idxSrc = msg.expHeaderBytes.size()-1;
+        msg.expHeaderMask[idxSrc] = 0x00;
+        for(int j=listNumRawFrames[i]; j < msg.listRawFrames.size(); j++)   {
+            msg.listRawFrames[j][idxSrc] += obdref::ubyte(ecuIdx);
+        }
+    }
+}
+
+quint64 count_raw_frames(obdref::ParameterFrame const &param)
+{
+    quint64 numFrames=0;
+    for(int i=0; i < param.listMessageData.size(); i++)   {
+        numFrames += param.listMessageData[i].listRawFrames.size();
+    }
+    return numFrames;
+}
+
+bool build_param(obdref::Parser &parser,
+                 QString const &protocol,
+                 QString const &name,
+                 obdref::ParameterFrame &param)
+{
+    param.spec = "TEST";
+    param.protocol = protocol;
+    param.address = "Default";
+    param.name = name;
+    if(!parser.BuildParameterFrame(param))   {
+        qDebug() << "Error: could not build frame for param:" << name;
+        return false;
+    }
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool bench_build(obdref::Parser &parser,
+                 QString const &protocol,
+                 int const iterations,
+                 BenchResult &result)
+{
+    QStringList const listParams =
+        parser.GetParameterNames("TEST",protocol,"Default");
+
+    result.bench = "build";
+    result.protocol = protocol;
+
+    obdref::ProfileTimer timer;
+    for(int n=0; n < iterations; n++)   {
+        for(int i=0; i < listParams.size(); i++)   {
+            obdref::ParameterFrame param;
+            timer.Start();
+            bool const ok = build_param(parser,protocol,listParams[i],param);
+            quint64 const ns = timer.Lap();
+            if(!ok)   {
+                return false;
+            }
+            result.latency.Record(ns);
+            result.totalNs += ns;
+            result.numOps++;
+        }
+    }
+    return true;
+}
+
+// bench_clean_parse
+// * with paramName empty, only cleaning is timed
+bool bench_clean_parse(obdref::Parser &parser,
+                       QString const &protocol,
+                       QString const &paramName,
+                       int const numFrames,
+                       int const numEcus,
+                       int const iterations,
+                       BenchResult &result)
+{
+    bool const cleanOnly = paramName.isEmpty();
+
+    obdref::ParameterFrame param;
+    QString const buildName = (cleanOnly) ? PARAM_SEPARATELY : paramName;
+    if(!build_param(parser,protocol,buildName,param))   {
+        return false;
+    }
+    for(int e=0; e < numEcus; e++)   {
+        add_ecu_response(param,numFrames,e);
+    }
+
+    result.bench = (cleanOnly) ? "clean" :
+        (param.parseMode == obdref::PARSE_COMBINED) ?
+            "parse_combined" : "parse_separately";
+    result.protocol = protocol;
+    result.frames = numFrames;
+    result.ecus = numEcus;
+
+    quint64 const numRawFrames = count_raw_frames(param);
+
+    QList<obdref::Data> listData;
+    obdref::ProfileTimer timer;
+    for(int n=0; n < iterations; n++)   {
+        listData.clear();
+        timer.Start();
+        bool const ok = (cleanOnly) ?
+            parser.CleanParameterFrame(param) :
+            parser.ParseParameterFrame(param,listData);
+        quint64 const ns = timer.Lap();
+
+        if(!ok || (!cleanOnly && listData.isEmpty()))   {
+            qDebug() << "Error: could not" << result.bench << buildName
+                     << "with" << numFrames << "frames from"
+                     << numEcus << "ecus";
+            return false;
+        }
+        result.latency.Record(ns);
+        result.totalNs += ns;
+        result.numOps++;
+        result.numFrames += numRawFrames;
+    }
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+void log_result(BenchResult const &result)
+{
+    QString desc = result.bench + ": " + result.protocol;
+    if(result.frames > 0)   {
+        desc += QString(" (%1 frames, %2 ecus)")
+            .arg(result.frames).arg(result.ecus);
+    }
+    qDebug() << desc.toLocal8Bit().constData()
+             << qint64(per_second(result.numOps,result.totalNs)) << "ops/s"
+             << qint64(per_second(result.numFrames,result.totalNs)) << "frames/s"
+             << "p50:" << result.latency.GetPercentile(50.0) << "ns"
+             << "p99:" << result.latency.GetPercentile(99.0) << "ns";
+}
+
+void append_result_json(BenchResult const &result,QByteArray &json)
+{
+    json.append("{\"bench\":\"");
+    json.append(result.bench.toUtf8());
+    json.append("\",\"protocol\":\"");
+    json.append(result.protocol.toUtf8());
+    json.append('"');
+    if(result.frames > 0)   {
+        json.append(",\"frames\":");
+        json.append(QByteArray::number(result.frames));
+        json.append(",\"ecus\":");
+        json.append(QByteArray::number(result.ecus));
+        json.append(",\"frames_per_s\":");
+        json.append(QByteArray::number(
+            quint64(per_second(result.numFrames,result.totalNs))));
+    }
+    json.append(",\"ops\":");
+    json.append(QByteArray::number(result.numOps));
+    json.append(",\"ops_per_s\":");
+    json.append(QByteArray::number(
+        quint64(per_second(result.numOps,result.totalNs))));
+    json.append(",\"latency_ns\":");
+    result.latency.ToJson(json);
+    json.append('}');
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)   {
+        return bad_args();
+    }
+
+    QString pathDefinitions(argv[1]);
+    QString pathOut;
+    int iterations = 100;
+    int maxFrames = 8;
+    int maxEcus = 4;
+
+    for(int i=2; i < argc; i++)   {
+        QString arg(argv[i]);
+        QString value = arg.mid(arg.indexOf("=")+1);
+        if(arg.startsWith("iterations="))   {
+            iterations = value.toInt();
+        }
+        else if(arg.startsWith("frames="))   {
+            maxFrames = value.toInt();
+        }
+        else if(arg.startsWith("ecus="))   {
+            maxEcus = value.toInt();
+        }
+        else if(arg.startsWith("out="))   {
+            pathOut = value;
+        }
+        else   {
+            return bad_args();
+        }
+    }
+    if(iterations < 1 || maxFrames < 1 || maxEcus < 1)   {
+        return bad_args();
+    }
+
+    bool ok = false;
+    obdref::Parser parser(pathDefinitions,ok);
+    if(!ok) { return -1; }
+
+    // fixed seed so each run cleans and
+    // parses the same data
+    srand(1);
+
+    QStringList listProtocols;
+    listProtocols << "SAE J1850 PWM"
+                  << "SAE J1850 VPW"
+                  << "ISO 9141-2"
+                  << "ISO 14230"
+                  << "ISO 15765 Standard Id"
+                  << "ISO 15765 Extended Id";
+
+    QStringList listParseParams;
+    listParseParams << PARAM_SEPARATELY << PARAM_COMBINED;
+
+    QList<BenchResult> listResults;
+    for(int p=0; p < listProtocols.size(); p++)   {
+        QString const &protocol = listProtocols[p];
+
+        BenchResult buildResult;
+        if(!bench_build(parser,protocol,iterations,buildResult))   {
+            qDebug() << "bench parser failed!";
+            return -1;
+        }
+        listResults << buildResult;
+
+        // an empty param name only cleans
+        QStringList listBenchParams;
+        listBenchParams << QString() << listParseParams;
+
+        for(int b=0; b < listBenchParams.size(); b++)   {
+            for(int f=1; f <= maxFrames; f *= 2)   {
+                for(int e=1; e <= maxEcus; e *= 2)   {
+                    BenchResult result;
+                    if(!bench_clean_parse(parser,protocol,listBenchParams[b],
+                                          f,e,iterations,result))   {
+                        qDebug() << "bench parser failed!";
+                        return -1;
+                    }
+                    listResults << result;
+                }
+            }
+        }
+    }
+
+    QByteArray json;
+    json.append("{\"iterations\":");
+    json.append(QByteArray::number(iterations));
+    json.append(",\"results\":[\n");
+    for(int i=0; i < listResults.size(); i++)   {
+        log_result(listResults[i]);
+        append_result_json(listResults[i],json);
+        json.append((i+1 < listResults.size()) ? ",\n" : "\n");
+    }
+    json.append("]}\n");
+
+    FILE * file = (pathOut.isEmpty()) ? stdout :
+        fopen(pathOut.toLocal8Bit().constData(),"w");
+    if(file == NULL)   {
+        qDebug() << "Error: could not open" << pathOut;
+        return -1;
+    }
+    fwrite(json.constData(),1,json.size(),file);
+    if(file != stdout)   {
+        fclose(file);
+    }
+
+    qDebug() << "bench parser passed!";
+    return 0;
+}
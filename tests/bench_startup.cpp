@@ -0,0 +1,320 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+#include <QDebug>
+#include <QFile>
+#include <QElapsedTimer>
+
+#include "parser.h"
+#include "parseprofiler.h"
+#include "defgenerator.h"
+
+// bench_startup
+// * generates definitions files with DefGenerator, starting
+//   at 100 parameters per spec/address and doubling up to
+//   params=<n>, and for each one measures:
+//   - how long it takes to construct a Parser, and how much
+//     of that is loading the xml (the rest is mostly
+//     indexing parameters and parse scripts in jsInit)
+//   - the resident memory the Parser adds
+//   - BuildParameterFrame latency for parameters spread
+//     evenly through the file, the first time each one is
+//     built (which compiles its parse script) and after
+// * the time per parameter is compared to the previous
+//   size; with maxscaling=<x> the bench fails if it grows
+//   by more than x (ie. 2 means twice the parameters took
+//   more than four times as long)
+// * usage: ./bench_startup [options]
+//   params=<n>         max params per spec/address (default 3200)
+//   specs=<n>          (default 1)
+//   protocols=<n>      (default 6)
+//   addresses=<n>      (default 1)
+//   lines=<n>          values saved by each script (default 4)
+//   lookups=<n>        parameters to build (default 1000)
+//   dir=<path>         where to write the files (default .)
+//   maxscaling=<x>     (default 0, off)
+//   out=<path>         json output file
+//   write=<path>       only write a file with params=<n>
+
+struct StartupResult
+{
+    int numParams;          // total parameters in the file
+    qint64 fileBytes;
+    qint64 xmlLoadNs;
+    qint64 constructNs;
+    qint64 rssBytes;
+    obdref::LatencyHistogram firstLookup;
+    obdref::LatencyHistogram lookup;
+};
+
+int bad_args()
+{
+    qDebug() << "./bench_startup [params=3200] [specs=1] [protocols=6] "
+                "[addresses=1] [lines=4] [lookups=1000] [dir=.] "
+                "[maxscaling=0] [out=results.json] [write=defs.xml]";
+    return -1;
+}
+
+// get_rss_bytes
+// * returns the resident set size of this
+//   process, or 0 if it isn't known
+qint64 get_rss_bytes()
+{
+#ifdef Q_OS_LINUX
+    FILE * file = fopen("/proc/self/statm","r");
+    if(file == NULL)   {
+        return 0;
+    }
+    long numPagesTotal=0;
+    long numPagesResident=0;
+    int const numRead = fscanf(file,"%ld %ld",&numPagesTotal,&numPagesResident);
+    fclose(file);
+    return (numRead == 2) ? qint64(numPagesResident)*sysconf(_SC_PAGESIZE) : 0;
+#else
+    return 0;
+#endif
+}
+
+bool bench_size(DefGenerator::Options const &options,
+                QString const &filePath,
+                int const numLookups,
+                StartupResult &result)
+{
+    if(!DefGenerator::Write(options,filePath))   {
+        qDebug() << "Error: could not write" << filePath;
+        return false;
+    }
+
+    QStringList const listProtocols =
+        DefGenerator::GetProtocols(options.numProtocols);
+    int const numAddresses = qBound(1,options.numAddresses,8);
+
+    result.numParams = options.numSpecs*numAddresses*options.numParams;
+    result.fileBytes = QFile(filePath).size();
+
+    // the xml load on its own (the Parser
+    // reads the file the same way)
+    QElapsedTimer timer;
+    {
+        QFile file(filePath);
+        if(!file.open(QIODevice::ReadOnly | QIODevice::Text))   {
+            return false;
+        }
+        QString const contents = QString(file.readAll());
+        timer.start();
+        pugi::xml_document xmlDoc;
+        if(!xmlDoc.load(contents.toLocal8Bit().data()))   {
+            qDebug() << "Error: generated file is invalid";
+            return false;
+        }
+        result.xmlLoadNs = timer.nsecsElapsed();
+    }
+
+    qint64 const rssBefore = get_rss_bytes();
+    timer.start();
+    bool ok = false;
+    obdref::Parser parser(filePath,ok);
+    result.constructNs = timer.nsecsElapsed();
+    result.rssBytes = get_rss_bytes()-rssBefore;
+    if(!ok)   {
+        return false;
+    }
+
+    // lookups spread across the whole file; the first
+    // pass includes compiling each parse script
+    obdref::ProfileTimer lookupTimer;
+    for(int i=0; i < 2*numLookups; i++)   {
+        obdref::ParameterFrame param;
+        int const k = i % numLookups;
+        param.spec = DefGenerator::GetSpecName(k % options.numSpecs);
+        param.protocol = listProtocols[k % listProtocols.size()];
+        param.address = DefGenerator::GetAddressName(k % numAddresses);
+        param.name = DefGenerator::GetParamName(
+            int((qint64(k)*options.numParams)/numLookups));
+
+        lookupTimer.Start();
+        bool const buildOk = parser.BuildParameterFrame(param);
+        quint64 const ns = lookupTimer.Lap();
+        if(!buildOk)   {
+            qDebug() << "Error: could not build" << param.spec
+                     << param.protocol << param.address << param.name;
+            return false;
+        }
+        if(i < numLookups)   {
+            result.firstLookup.Record(ns);
+        }
+        else   {
+            result.lookup.Record(ns);
+        }
+    }
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+void append_result_json(StartupResult const &result,QByteArray &json)
+{
+    json.append("{\"params\":");
+    json.append(QByteArray::number(result.numParams));
+    json.append(",\"file_bytes\":");
+    json.append(QByteArray::number(result.fileBytes));
+    json.append(",\"xml_load_ns\":");
+    json.append(QByteArray::number(result.xmlLoadNs));
+    json.append(",\"construct_ns\":");
+    json.append(QByteArray::number(result.constructNs));
+    json.append(",\"rss_bytes\":");
+    json.append(QByteArray::number(result.rssBytes));
+    json.append(",\"first_lookup_ns\":");
+    result.firstLookup.ToJson(json);
+    json.append(",\"lookup_ns\":");
+    result.lookup.ToJson(json);
+    json.append('}');
+}
+
+int main(int argc, char* argv[])
+{
+    DefGenerator::Options options;
+    int maxParams = 3200;
+    int numLookups = 1000;
+    double maxScaling = 0;
+    QString dir(".");
+    QString pathOut;
+    QString pathWrite;
+
+    for(int i=1; i < argc; i++)   {
+        QString arg(argv[i]);
+        QString value = arg.mid(arg.indexOf("=")+1);
+        if(arg.startsWith("params="))   {
+            maxParams = value.toInt();
+        }
+        else if(arg.startsWith("specs="))   {
+            options.numSpecs = value.toInt();
+        }
+        else if(arg.startsWith("protocols="))   {
+            options.numProtocols = value.toInt();
+        }
+        else if(arg.startsWith("addresses="))   {
+            options.numAddresses = value.toInt();
+        }
+        else if(arg.startsWith("lines="))   {
+            options.scriptLines = value.toInt();
+        }
+        else if(arg.startsWith("lookups="))   {
+            numLookups = value.toInt();
+        }
+        else if(arg.startsWith("dir="))   {
+            dir = value;
+        }
+        else if(arg.startsWith("maxscaling="))   {
+            maxScaling = value.toDouble();
+        }
+        else if(arg.startsWith("out="))   {
+            pathOut = value;
+        }
+        else if(arg.startsWith("write="))   {
+            pathWrite = value;
+        }
+        else   {
+            return bad_args();
+        }
+    }
+    if(maxParams < 1 || numLookups < 1 || options.numSpecs < 1)   {
+        return bad_args();
+    }
+
+    if(!pathWrite.isEmpty())   {
+        options.numParams = maxParams;
+        if(!DefGenerator::Write(options,pathWrite))   {
+            qDebug() << "Error: could not write" << pathWrite;
+            return -1;
+        }
+        return 0;
+    }
+
+    QList<StartupResult> listResults;
+    for(int n=qMin(100,maxParams); n <= maxParams; n *= 2)   {
+        options.numParams = n;
+        QString const filePath = dir+"/bench_startup_"+QString::number(n)+".xml";
+
+        StartupResult result;
+        bool const ok = bench_size(options,filePath,numLookups,result);
+        QFile::remove(filePath);
+        if(!ok)   {
+            qDebug() << "bench startup failed!";
+            return -1;
+        }
+
+        qDebug() << result.numParams << "params,"
+                 << result.fileBytes/1024 << "KiB:"
+                 << "construct" << result.constructNs/1000 << "us"
+                 << "(xml" << result.xmlLoadNs/1000 << "us),"
+                 << "rss" << result.rssBytes/1024 << "KiB,"
+                 << "first lookup p50:" << result.firstLookup.GetPercentile(50.0) << "ns,"
+                 << "lookup p50:" << result.lookup.GetPercentile(50.0) << "ns"
+                 << "p99:" << result.lookup.GetPercentile(99.0) << "ns";
+
+        if(!listResults.isEmpty() && maxScaling > 0)   {
+            StartupResult const &prev = listResults.last();
+            double const sizeRatio = double(result.numParams)/prev.numParams;
+            double const constructScaling =
+                (double(result.constructNs)/prev.constructNs)/sizeRatio;
+            double const lookupScaling =
+                (double(result.lookup.GetPercentile(50.0))/
+                 prev.lookup.GetPercentile(50.0))/sizeRatio;
+
+            if(constructScaling > maxScaling || lookupScaling > maxScaling)   {
+                qDebug() << "Error: time per parameter grew by"
+                         << constructScaling << "(construct)"
+                         << lookupScaling << "(lookup)";
+                qDebug() << "bench startup failed!";
+                return -1;
+            }
+        }
+        listResults << result;
+    }
+
+    QByteArray json;
+    json.append("{\"results\":[\n");
+    for(int i=0; i < listResults.size(); i++)   {
+        append_result_json(listResults[i],json);
+        json.append((i+1 < listResults.size()) ? ",\n" : "\n");
+    }
+    json.append("]}\n");
+
+    FILE * file = (pathOut.isEmpty()) ? stdout :
+        fopen(pathOut.toLocal8Bit().constData(),"w");
+    if(file == NULL)   {
+        qDebug() << "Error: could not open" << pathOut;
+        return -1;
+    }
+    fwrite(json.constData(),1,json.size(),file);
+    if(file != stdout)   {
+        fclose(file);
+    }
+
+    qDebug() << "bench startup passed!";
+    return 0;
+}
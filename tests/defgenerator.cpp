@@ -0,0 +1,181 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <QFile>
+
+#include "defgenerator.h"
+
+// dids used by generated parameters start here
+static int const FIRST_DID = 0x1000;
+
+// ========================================================================== //
+// ========================================================================== //
+
+static QByteArray hexByte(int const value)
+{
+    QByteArray str = QByteArray::number(value & 0xFF,16).toUpper();
+    if(str.size() < 2)   {
+        str.prepend('0');
+    }
+    return "0x"+str;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+QStringList DefGenerator::GetProtocols(int const numProtocols)
+{
+    QStringList listProtocols;
+    listProtocols << "ISO 15765 Standard Id"
+                  << "ISO 15765 Extended Id"
+                  << "ISO 14230"
+                  << "ISO 9141-2"
+                  << "SAE J1850 VPW"
+                  << "SAE J1850 PWM";
+
+    return listProtocols.mid(0,qBound(1,numProtocols,listProtocols.size()));
+}
+
+QString DefGenerator::GetSpecName(int const specIdx)
+{
+    return "GEN_"+QString::number(specIdx);
+}
+
+QString DefGenerator::GetAddressName(int const addressIdx)
+{
+    return (addressIdx == 0) ? QString("Default") :
+        "ECU"+QString::number(addressIdx);
+}
+
+QString DefGenerator::GetParamName(int const paramIdx)
+{
+    return "P_"+QString::number(paramIdx);
+}
+
+QByteArray DefGenerator::Generate(Options const &options)
+{
+    QStringList const listProtocols = GetProtocols(options.numProtocols);
+    int const numAddresses = qBound(1,options.numAddresses,8);
+
+    QByteArray xml;
+    xml.append("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n\n");
+
+    for(int s=0; s < options.numSpecs; s++)   {
+        xml.append("<spec name=\""+GetSpecName(s).toUtf8()+
+                   "\" desc=\"libobdref generated definitions\">\n\n");
+
+        for(int p=0; p < listProtocols.size(); p++)   {
+            appendProtocol(xml,listProtocols[p],numAddresses);
+        }
+
+        for(int a=0; a < numAddresses; a++)   {
+            xml.append("   <parameters address=\""+
+                       GetAddressName(a).toUtf8()+"\">\n\n");
+            for(int i=0; i < options.numParams; i++)   {
+                appendParameter(xml,i,options.scriptLines);
+            }
+            xml.append("   </parameters>\n\n");
+        }
+        xml.append("</spec>\n\n");
+    }
+    return xml;
+}
+
+bool DefGenerator::Write(Options const &options,
+                         QString const &filePath)
+{
+    QFile file(filePath);
+    if(!file.open(QIODevice::WriteOnly | QIODevice::Truncate))   {
+        return false;
+    }
+    QByteArray const xml = Generate(options);
+    return (file.write(xml) == xml.size());
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+void DefGenerator::appendProtocol(QByteArray &xml,
+                                  QString const &protocol,
+                                  int const numAddresses)
+{
+    xml.append("   <protocol name=\""+protocol.toUtf8()+"\">\n");
+    if(protocol == "ISO 14230")   {
+        xml.append("      <option name=\"Length Byte\" value=\"true\" />\n");
+    }
+
+    for(int a=0; a < numAddresses; a++)   {
+        xml.append("      <address name=\""+GetAddressName(a).toUtf8()+"\">\n");
+        if(protocol == "ISO 15765 Standard Id")   {
+            xml.append("         <request identifier=\"0x7"+
+                       QByteArray::number(0xE0+a,16).toUpper()+"\" />\n");
+            xml.append("         <response identifier=\"0x7"+
+                       QByteArray::number(0xE8+a,16).toUpper()+"\" />\n");
+        }
+        else if(protocol == "ISO 15765 Extended Id")   {
+            xml.append("         <request prio=\"0x18\" format=\"0xDA\" "
+                       "target=\""+hexByte(0x10+a)+"\" source=\"0xF1\" />\n");
+            xml.append("         <response prio=\"0x18\" format=\"0xDA\" "
+                       "target=\"0xF1\" source=\""+hexByte(0x10+a)+"\" />\n");
+        }
+        else if(protocol == "ISO 14230")   {
+            xml.append("         <request format=\"0b10000000\" "
+                       "target=\""+hexByte(0x10+a)+"\" source=\"0xF1\" />\n");
+            xml.append("         <response format=\"0b10000000\" "
+                       "target=\"0xF1\" source=\""+hexByte(0x10+a)+"\" />\n");
+        }
+        else   {
+            QByteArray const reqPrio =
+                (protocol == "SAE J1850 PWM") ? "0x61" : "0x68";
+            QByteArray const respPrio =
+                (protocol == "SAE J1850 PWM") ? "0x41" : "0x48";
+            xml.append("         <request prio=\""+reqPrio+"\" "
+                       "target=\"0x6A\" source=\"0xF1\" />\n");
+            xml.append("         <response prio=\""+respPrio+"\" "
+                       "target=\"0x6B\" source=\""+hexByte(0x10+a)+"\" />\n");
+        }
+        xml.append("      </address>\n");
+    }
+    xml.append("   </protocol>\n\n");
+}
+
+void DefGenerator::appendParameter(QByteArray &xml,
+                                   int const paramIdx,
+                                   int const scriptLines)
+{
+    int const did = FIRST_DID+paramIdx;
+    QByteArray const didBytes = hexByte(did >> 8)+" "+hexByte(did);
+
+    xml.append("      <parameter name=\""+GetParamName(paramIdx).toUtf8()+"\"\n");
+    xml.append("         request=\"0x22 "+didBytes+"\" "
+               "response.prefix=\"0x62 "+didBytes+"\" response.bytes=\"2\">\n");
+    xml.append("         <script>\n");
+    xml.append("            <![CDATA[\n");
+    for(int i=0; i < scriptLines; i++)   {
+        QByteArray const var = "v"+QByteArray::number(i);
+        xml.append("            var "+var+" = new NumericalDataObj();\n");
+        xml.append("            "+var+".property = \"Value "+
+                   QByteArray::number(i)+"\";\n");
+        xml.append("            "+var+".value = (BYTE(0)*256+BYTE(1))*"+
+                   QByteArray::number(i+1)+"/10;\n");
+        xml.append("            saveNumericalData("+var+");\n");
+    }
+    xml.append("            ]]>\n");
+    xml.append("         </script>\n");
+    xml.append("      </parameter>\n\n");
+}
@@ -0,0 +1,85 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef DEF_GENERATOR_H
+#define DEF_GENERATOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+
+// DefGenerator
+// * generates synthetic (but valid) definitions files
+//   to test how the Parser scales with large files
+// * specs are named GEN_0, GEN_1, ...; every spec has the
+//   same protocols and addresses ("Default", "ECU1", ...)
+//   and a parameters group for each address with params
+//   named P_0, P_1, ... that are requested with UDS
+//   ReadDataByIdentifier (0x22 DID)
+// * each parse script saves scriptLines numerical values
+//   so script size and complexity can be scaled too
+class DefGenerator
+{
+public:
+    struct Options
+    {
+        Options() :
+            numSpecs(1),
+            numProtocols(6),
+            numAddresses(1),
+            numParams(100),
+            scriptLines(4)
+        {}
+
+        int numSpecs;
+        int numProtocols;   // 1-6, see GetProtocols
+        int numAddresses;   // per protocol (1-8)
+        int numParams;      // per spec and address
+        int scriptLines;    // values saved by each script
+    };
+
+    // GetProtocols
+    // * the names of the first numProtocols protocols
+    //   in the generated files
+    static QStringList GetProtocols(int const numProtocols);
+
+    static QString GetSpecName(int const specIdx);
+    static QString GetAddressName(int const addressIdx);
+    static QString GetParamName(int const paramIdx);
+
+    // Generate
+    // * returns the definitions file for options
+    static QByteArray Generate(Options const &options);
+
+    // Write
+    // * writes the definitions file for options to
+    //   filePath, returning false on failure
+    static bool Write(Options const &options,
+                      QString const &filePath);
+
+private:
+    static void appendProtocol(QByteArray &xml,
+                               QString const &protocol,
+                               int const numAddresses);
+
+    static void appendParameter(QByteArray &xml,
+                                int const paramIdx,
+                                int const scriptLines);
+};
+
+#endif // DEF_GENERATOR_H
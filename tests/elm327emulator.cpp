@@ -0,0 +1,611 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "elm327emulator.h"
+
+// ecu addresses (and 11-bit ids from 0x7E8)
+// are assigned starting from here
+static obdref::ubyte const FIRST_ECU_ADDR = 0x10;
+
+// functional target address for 29-bit ids
+// and ISO 14230
+static obdref::ubyte const FUNCTIONAL_ADDR = 0x33;
+
+static char const * ELM_VERSION = "ELM327 v1.5";
+
+// ========================================================================== //
+// ========================================================================== //
+
+obdref::ubyte calc_j1850_crc(obdref::ByteList const &bytes)
+{
+    // SAE J1850 crc-8 (poly 0x1D)
+    obdref::ubyte crc = 0xFF;
+    for(int i=0; i < bytes.size(); i++)   {
+        crc ^= bytes[i];
+        for(int k=0; k < 8; k++)   {
+            crc = (crc & 0x80) ? ((crc << 1) ^ 0x1D) : (crc << 1);
+        }
+    }
+    return ~crc;
+}
+
+obdref::ubyte calc_checksum(obdref::ByteList const &bytes)
+{
+    obdref::ubyte sum = 0;
+    for(int i=0; i < bytes.size(); i++)   {
+        sum += bytes[i];
+    }
+    return sum;
+}
+
+QByteArray bytelist_to_key(obdref::ByteList const &bytes)
+{
+    QByteArray key;
+    for(int i=0; i < bytes.size(); i++)   {
+        key.append(char(bytes[i]));
+    }
+    return key;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+Elm327Emulator::Elm327Emulator(obdref::Parser &parser,
+                               Options const &options) :
+    m_parser(parser),
+    m_options(options),
+    m_protocol(obdref::PROTOCOL_ISO_15765),
+    m_extendedId(false),
+    m_masterFd(-1),
+    m_slaveFd(-1),
+    m_stop(false)
+{
+    m_options.numEcus = qBound(1,m_options.numEcus,8);
+    resetState();
+}
+
+Elm327Emulator::~Elm327Emulator()
+{
+    Stop();
+    wait();
+
+    if(m_slaveFd >= 0)   {
+        close(m_slaveFd);
+    }
+    if(m_masterFd >= 0)   {
+        close(m_masterFd);
+    }
+}
+
+bool Elm327Emulator::Init(QString const &spec,
+                          QString const &protocol,
+                          QString const &address)
+{
+    m_tableResponses.clear();
+    m_protocolName = protocol;
+
+    QStringList listParams = m_parser.GetParameterNames(spec,protocol,address);
+    for(int i=0; i < listParams.size(); i++)   {
+        obdref::ParameterFrame param;
+        param.spec = spec;
+        param.protocol = protocol;
+        param.address = address;
+        param.name = listParams[i];
+
+        if(!m_parser.BuildParameterFrame(param))   {
+            continue;
+        }
+        m_protocol = param.parseProtocol;
+        m_extendedId = param.iso15765_extendedId;
+
+        for(int j=0; j < param.listMessageData.size(); j++)   {
+            obdref::MessageData const &msg = param.listMessageData[j];
+            if(msg.listReqDataBytes.size() != 1)   {
+                continue;
+            }
+            if(m_defReqHeader.isEmpty())   {
+                m_defReqHeader = msg.reqHeaderBytes;
+                m_respHeader = msg.expHeaderBytes;
+            }
+
+            obdref::ByteList reqData = msg.listReqDataBytes[0];
+            if(m_protocol == obdref::PROTOCOL_ISO_15765 &&
+               param.iso15765_addPciByte)   {
+                reqData.removeFirst();
+            }
+
+            QByteArray const key = bytelist_to_key(reqData);
+            if(!m_tableResponses.contains(key))   {
+                Response resp;
+                resp.prefix = msg.expDataPrefix;
+                resp.dataByteCount = msg.expDataByteCount;
+                m_tableResponses.insert(key,resp);
+            }
+        }
+    }
+
+    if(m_tableResponses.isEmpty())   {
+        qDebug() << "Error: Elm327Emulator: no requests for"
+                 << spec << protocol << address;
+        return false;
+    }
+    resetState();
+
+    // open the pty; the slave side is kept open so
+    // reads on the master don't fail when clients
+    // disconnect
+    m_masterFd = posix_openpt(O_RDWR | O_NOCTTY);
+    if(m_masterFd < 0 || grantpt(m_masterFd) != 0 ||
+       unlockpt(m_masterFd) != 0)   {
+        qDebug() << "Error: Elm327Emulator: could not open pty";
+        return false;
+    }
+    m_slavePath = QString(ptsname(m_masterFd));
+
+    m_slaveFd = open(ptsname(m_masterFd),O_RDWR | O_NOCTTY);
+    if(m_slaveFd < 0)   {
+        qDebug() << "Error: Elm327Emulator: could not open" << m_slavePath;
+        return false;
+    }
+    struct termios tio;
+    tcgetattr(m_slaveFd,&tio);
+    cfmakeraw(&tio);
+    tcsetattr(m_slaveFd,TCSANOW,&tio);
+
+    return true;
+}
+
+QString Elm327Emulator::GetSlavePath() const
+{
+    return m_slavePath;
+}
+
+void Elm327Emulator::Stop()
+{
+    m_stop = true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool Elm327Emulator::ProcessCommand(QByteArray const &cmd,
+                                    QList<QByteArray> &listLines,
+                                    int &responseCount)
+{
+    listLines.clear();
+    responseCount = -1;
+
+    // the adapter ignores spaces and case
+    QByteArray command;
+    for(int i=0; i < cmd.size(); i++)   {
+        if(cmd[i] != ' ')   {
+            command.append(char(toupper(cmd[i])));
+        }
+    }
+
+    if(command.startsWith("AT"))   {
+        processAtCommand(command.mid(2),listLines);
+        return false;
+    }
+
+    // [request data] [response count]
+    if(command.size() % 2 != 0)   {
+        QByteArray const countStr = "0" + command.right(1);
+        obdref::ByteList count;
+        if(!obdref::Elm327Codec::DecodeHex(countStr.constData(),2,count))   {
+            listLines << "?";
+            return false;
+        }
+        responseCount = count[0];
+        command.chop(1);
+    }
+
+    obdref::ByteList reqData;
+    if(command.isEmpty() ||
+       !obdref::Elm327Codec::DecodeHex(command.constData(),command.size(),reqData))   {
+        listLines << "?";
+        return false;
+    }
+
+    obdref::ByteList respData;
+    int prefixLength = 0;
+    if(!buildResponseData(reqData,respData,prefixLength))   {
+        return true;
+    }
+
+    for(int i=0; i < m_options.numEcus; i++)   {
+        if(!ecuResponds(i))   {
+            continue;
+        }
+        QList<obdref::ByteList> listFrames;
+        buildFrames(i,respData,prefixLength,listFrames);
+        for(int j=0; j < listFrames.size(); j++)   {
+            listLines << formatFrame(listFrames[j]);
+        }
+    }
+    return true;
+}
+
+void Elm327Emulator::run()
+{
+    QByteArray command;
+    QByteArray lastCommand;
+    while(!m_stop)
+    {
+        struct pollfd pfd;
+        pfd.fd = m_masterFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if(poll(&pfd,1,50) <= 0)   {
+            continue;
+        }
+
+        char buff[256];
+        ssize_t const bytesRead = read(m_masterFd,buff,sizeof(buff));
+        if(bytesRead <= 0)   {
+            QThread::msleep(10);
+            continue;
+        }
+
+        for(ssize_t i=0; i < bytesRead; i++)
+        {
+            char const c = buff[i];
+            if(c != '\r')   {
+                if(c != '\n' && c != '\0')   {
+                    command.append(c);
+                }
+                continue;
+            }
+
+            QByteArray const lineEnd = (m_linefeeds) ? "\r\n" : "\r";
+            if(m_echo)   {
+                writeOutput(command + lineEnd);
+            }
+
+            // an empty command repeats the last one
+            if(command.trimmed().isEmpty())   {
+                command = lastCommand;
+            }
+            lastCommand = command;
+
+            QList<QByteArray> listLines;
+            int responseCount=-1;
+            bool const isRequest = ProcessCommand(command,listLines,responseCount);
+            command.clear();
+
+            if(!isRequest)   {
+                QByteArray output;
+                for(int j=0; j < listLines.size(); j++)   {
+                    output.append(listLines[j] + lineEnd);
+                }
+                writeOutput(output + lineEnd + ">");
+                continue;
+            }
+
+            // the adapter stops as soon as it has seen
+            // the expected number of responses, and
+            // otherwise waits for the timeout
+            QThread::msleep(m_options.latencyMs);
+            int numLines = listLines.size();
+            if(responseCount > 0)   {
+                numLines = qMin(numLines,responseCount);
+            }
+            for(int j=0; j < numLines; j++)   {
+                if(j > 0)   {
+                    QThread::msleep(m_options.frameGapMs);
+                }
+                writeOutput(listLines[j] + lineEnd);
+            }
+            if(responseCount < 0 || numLines < responseCount)   {
+                QThread::msleep(m_timeoutMs);
+            }
+            if(numLines == 0)   {
+                writeOutput("NO DATA" + lineEnd);
+            }
+            writeOutput(lineEnd + ">");
+        }
+    }
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+void Elm327Emulator::processAtCommand(QByteArray const &cmd,
+                                      QList<QByteArray> &listLines)
+{
+    if(cmd == "Z" || cmd == "WS" || cmd == "D")   {
+        resetState();
+        if(cmd != "D")   {
+            listLines << "" << ELM_VERSION;
+            return;
+        }
+    }
+    else if(cmd == "I")   {
+        listLines << ELM_VERSION;
+        return;
+    }
+    else if(cmd == "DP")   {
+        listLines << m_protocolName.toLocal8Bit();
+        return;
+    }
+    else if(cmd == "RV")   {
+        listLines << "12.6V";
+        return;
+    }
+    else if(cmd.size() == 2 && (cmd[1] == '0' || cmd[1] == '1') &&
+            QByteArray("ELSH").contains(cmd[0]))   {
+        bool const on = (cmd[1] == '1');
+        switch(cmd[0])   {
+            case 'E': { m_echo = on; break; }
+            case 'L': { m_linefeeds = on; break; }
+            case 'S': { m_spaces = on; break; }
+            case 'H': { m_headers = on; break; }
+            default: break;
+        }
+    }
+    else if(cmd.startsWith("SH"))   {
+        QByteArray header = cmd.mid(2);
+        if(header.size() == 3)   {
+            header.prepend('0');
+        }
+        obdref::ByteList headerBytes;
+        if(!obdref::Elm327Codec::DecodeHex(header.constData(),
+                                           header.size(),headerBytes))   {
+            listLines << "?";
+            return;
+        }
+        m_reqHeader = headerBytes;
+    }
+    else if(cmd.startsWith("CP") || cmd.startsWith("ST"))   {
+        obdref::ByteList value;
+        if(!obdref::Elm327Codec::DecodeHex(cmd.constData()+2,
+                                           cmd.size()-2,value) ||
+           value.size() != 1)   {
+            listLines << "?";
+            return;
+        }
+        if(cmd.startsWith("CP"))   {
+            m_canPriority = value[0];
+        }
+        else   {
+            // ATST sets the timeout in units of 4ms
+            m_timeoutMs = (value[0] == 0) ? m_options.timeoutMs : value[0]*4;
+        }
+    }
+    listLines << "OK";
+}
+
+void Elm327Emulator::resetState()
+{
+    m_echo = true;
+    m_linefeeds = true;
+    m_spaces = true;
+    m_headers = false;
+    m_timeoutMs = m_options.timeoutMs;
+    m_canPriority = 0x18;
+
+    // ATSH sets the last three bytes of 29-bit ids
+    m_reqHeader = m_defReqHeader;
+    if(m_extendedId && m_reqHeader.size() == 4)   {
+        m_canPriority = m_reqHeader.takeFirst();
+    }
+}
+
+bool Elm327Emulator::buildResponseData(obdref::ByteList const &reqData,
+                                       obdref::ByteList &respData,
+                                       int &prefixLength) const
+{
+    respData.clear();
+
+    QHash<QByteArray,Response>::const_iterator it =
+        m_tableResponses.find(bytelist_to_key(reqData));
+
+    if(it != m_tableResponses.end())   {
+        Response const &resp = it.value();
+        respData = resp.prefix;
+        prefixLength = resp.prefix.size();
+
+        int const dataByteCount = (resp.dataByteCount < 0) ?
+            m_options.varDataBytes : resp.dataByteCount;
+
+        // report every pid as supported so that
+        // clients don't skip anything
+        bool const isBitmap = (resp.prefix.size() == 2 &&
+                               resp.prefix[0] == 0x41 &&
+                               resp.prefix[1] % 0x20 == 0);
+
+        for(int i=0; i < dataByteCount; i++)   {
+            respData << ((isBitmap) ? 0xFF : obdref::ubyte(rand() % 256));
+        }
+        return true;
+    }
+
+    // coalesced mode 01 requests: [01] [pid] [pid] ...
+    if(m_protocol != obdref::PROTOCOL_ISO_15765 ||
+       reqData.size() < 3 || reqData[0] != 0x01)   {
+        return false;
+    }
+    respData << 0x41;
+    prefixLength = 1;
+    for(int i=1; i < reqData.size(); i++)   {
+        obdref::ByteList pidReq,pidResp;
+        int pidPrefixLength=0;
+        pidReq << 0x01 << reqData[i];
+        if(!buildResponseData(pidReq,pidResp,pidPrefixLength))   {
+            return false;
+        }
+        respData << pidResp.mid(1);
+    }
+    return true;
+}
+
+bool Elm327Emulator::ecuResponds(int const ecuIdx) const
+{
+    if(m_protocol == obdref::PROTOCOL_ISO_15765 && !m_extendedId)   {
+        if(m_reqHeader.size() != 2)   {
+            return false;
+        }
+        int const reqId = (int(m_reqHeader[0]) << 8) | m_reqHeader[1];
+        return (reqId == 0x7DF || reqId == 0x7E0+ecuIdx);
+    }
+    else if(m_protocol == obdref::PROTOCOL_ISO_15765 ||
+            m_protocol == obdref::PROTOCOL_ISO_14230)   {
+        // [format] [target] [source]
+        if(m_reqHeader.size() != 3)   {
+            return false;
+        }
+        return (m_reqHeader[1] == FUNCTIONAL_ADDR ||
+                m_reqHeader[1] == FIRST_ECU_ADDR+ecuIdx);
+    }
+    // legacy requests are always functional
+    return true;
+}
+
+void Elm327Emulator::buildFrames(int const ecuIdx,
+                                 obdref::ByteList const &respData,
+                                 int const prefixLength,
+                                 QList<obdref::ByteList> &listFrames) const
+{
+    listFrames.clear();
+    obdref::ubyte const ecuAddr = FIRST_ECU_ADDR+ecuIdx;
+
+    if(m_protocol == obdref::PROTOCOL_ISO_15765)
+    {
+        obdref::ByteList header;
+        if(m_extendedId)   {
+            header << m_canPriority << m_respHeader.value(1,0xDA)
+                   << m_respHeader.value(2,0xF1) << ecuAddr;
+        }
+        else   {
+            int const respId = 0x7E8+ecuIdx;
+            header << obdref::ubyte(respId >> 8) << obdref::ubyte(respId & 0xFF);
+        }
+
+        // [single frame]
+        if(respData.size() <= 7)   {
+            obdref::ByteList frame = header;
+            frame << obdref::ubyte(respData.size()) << respData;
+            listFrames << frame;
+            return;
+        }
+
+        // [first frame] [consecutive frames]
+        obdref::ByteList frame = header;
+        frame << obdref::ubyte(0x10 | ((respData.size() >> 8) & 0x0F))
+              << obdref::ubyte(respData.size() & 0xFF)
+              << respData.mid(0,6);
+        listFrames << frame;
+
+        obdref::ubyte seqNum = 1;
+        for(int i=6; i < respData.size(); i+=7)   {
+            frame = header;
+            frame << obdref::ubyte(0x20 | seqNum) << respData.mid(i,7);
+            listFrames << frame;
+            seqNum = (seqNum+1) & 0x0F;
+        }
+        return;
+    }
+
+    // legacy frames hold 7 data bytes and ISO 14230
+    // frames up to 63; longer responses repeat the
+    // prefix in each frame
+    int const maxDataLength =
+        (m_protocol == obdref::PROTOCOL_ISO_14230) ? 63 : 7;
+
+    obdref::ByteList prefix = respData.mid(0,prefixLength);
+    obdref::ByteList data = respData.mid(prefixLength);
+    int const chunkLength = qMax(1,maxDataLength-prefixLength);
+
+    int idx=0;
+    do   {
+        obdref::ByteList frameData = prefix;
+        frameData << data.mid(idx,chunkLength);
+        idx += chunkLength;
+
+        obdref::ByteList frame;
+        if(m_protocol == obdref::PROTOCOL_ISO_14230)   {
+            frame << obdref::ubyte((m_respHeader.value(0,0x80) & 0xC0) |
+                                   frameData.size());
+            frame << m_respHeader.value(1,0xF1) << ecuAddr;
+        }
+        else   {
+            frame << m_respHeader.value(0,0x48)
+                  << m_respHeader.value(1,0x6B) << ecuAddr;
+        }
+        frame << frameData;
+
+        // [checksum]
+        if(m_protocol == obdref::PROTOCOL_SAE_J1850)   {
+            frame << calc_j1850_crc(frame);
+        }
+        else   {
+            frame << calc_checksum(frame);
+        }
+        listFrames << frame;
+    }
+    while(idx < data.size());
+}
+
+QByteArray Elm327Emulator::formatFrame(obdref::ByteList const &frame) const
+{
+    bool const isCan = (m_protocol == obdref::PROTOCOL_ISO_15765);
+    int headerLength = 3;
+    if(isCan)   {
+        headerLength = (m_extendedId) ? 4 : 2;
+    }
+
+    QByteArray line;
+    if(!m_headers)   {
+        // headers off hides the header and pci byte
+        // or checksum
+        obdref::ByteList data = (isCan) ?
+            frame.mid(headerLength+1) : frame.mid(headerLength,
+                                                  frame.size()-headerLength-1);
+        obdref::Elm327Codec::EncodeHex(data,line,m_spaces);
+        return line;
+    }
+
+    obdref::Elm327Codec::EncodeHex(frame,line,m_spaces);
+    if(isCan && !m_extendedId)   {
+        // 11-bit ids are printed as three hex digits
+        line.remove(0,1);
+        if(m_spaces)   {
+            line.remove(2,1);
+        }
+    }
+    return line;
+}
+
+void Elm327Emulator::writeOutput(QByteArray const &output)
+{
+    int bytesWritten=0;
+    while(bytesWritten < output.size())   {
+        ssize_t const n = write(m_masterFd,output.constData()+bytesWritten,
+                                output.size()-bytesWritten);
+        if(n <= 0)   {
+            return;
+        }
+        bytesWritten += n;
+    }
+}
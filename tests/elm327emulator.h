@@ -0,0 +1,155 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#ifndef ELM327_EMULATOR_H
+#define ELM327_EMULATOR_H
+
+#include <QThread>
+#include <QHash>
+
+#include "parser.h"
+#include "elm327codec.h"
+
+// Elm327Emulator
+// * pretends to be an ELM327 adapter connected to a
+//   vehicle, on the master side of a pseudo terminal;
+//   clients open the slave side (GetSlavePath) like
+//   they would a serial port
+// * answers every request defined for a spec, protocol
+//   and address in a definitions file with random data
+//   from each emulated ecu
+// * supports the AT commands libobdref's Elm327Codec
+//   uses (echo, linefeeds, spaces, headers, ATSH, ATCP,
+//   ATST) and the response count suffix on requests;
+//   other AT commands just return OK
+// * ISO 15765 responses that don't fit in a single
+//   frame are sent as first and consecutive frames;
+//   other protocols repeat the response prefix in each
+//   frame, like mode 03 responses do
+class Elm327Emulator : public QThread
+{
+public:
+    struct Options
+    {
+        Options() :
+            numEcus(1),
+            latencyMs(10),
+            frameGapMs(1),
+            timeoutMs(100),
+            varDataBytes(12)
+        {}
+
+        int numEcus;        // number of ecus that respond (1-8)
+        int latencyMs;      // time before the first response
+        int frameGapMs;     // time between each response frame
+        int timeoutMs;      // time the adapter waits for more
+                            // responses (without a count hint)
+        int varDataBytes;   // data bytes sent for responses
+                            // without a fixed byte count
+    };
+
+    Elm327Emulator(obdref::Parser &parser,
+                   Options const &options);
+
+    ~Elm327Emulator();
+
+    // Init
+    // * builds the responses for every parameter in
+    //   spec/protocol/address and opens the pty
+    bool Init(QString const &spec,
+              QString const &protocol,
+              QString const &address);
+
+    // GetSlavePath
+    // * path of the pty to open as the 'serial port'
+    QString GetSlavePath() const;
+
+    // Stop
+    // * stops run() the next time it checks for input
+    void Stop();
+
+    // ProcessCommand
+    // * saves the lines the adapter prints in response
+    //   to cmd (without the echo or the prompt) to
+    //   listLines and returns true if cmd was a vehicle
+    //   request, in which case listLines has the frames
+    //   (empty for 'NO DATA') and responseCount is the
+    //   response count suffix (-1 if there wasn't one)
+    bool ProcessCommand(QByteArray const &cmd,
+                        QList<QByteArray> &listLines,
+                        int &responseCount);
+
+protected:
+    void run();
+
+private:
+    struct Response
+    {
+        obdref::ByteList prefix;
+        int dataByteCount;
+    };
+
+    void processAtCommand(QByteArray const &cmd,
+                          QList<QByteArray> &listLines);
+
+    void resetState();
+
+    bool buildResponseData(obdref::ByteList const &reqData,
+                           obdref::ByteList &respData,
+                           int &prefixLength) const;
+
+    bool ecuResponds(int const ecuIdx) const;
+
+    void buildFrames(int const ecuIdx,
+                     obdref::ByteList const &respData,
+                     int const prefixLength,
+                     QList<obdref::ByteList> &listFrames) const;
+
+    QByteArray formatFrame(obdref::ByteList const &frame) const;
+
+    void writeOutput(QByteArray const &output);
+
+    obdref::Parser &m_parser;
+    Options m_options;
+
+    // protocol
+    QString m_protocolName;
+    obdref::Protocol m_protocol;
+    bool m_extendedId;
+    obdref::ByteList m_defReqHeader;
+    obdref::ByteList m_respHeader;
+
+    // [request data] -> response
+    QHash<QByteArray,Response> m_tableResponses;
+
+    // adapter state
+    bool m_echo;
+    bool m_linefeeds;
+    bool m_spaces;
+    bool m_headers;
+    int m_timeoutMs;
+    obdref::ByteList m_reqHeader;
+    obdref::ubyte m_canPriority;
+
+    int m_masterFd;
+    int m_slaveFd;
+    QString m_slavePath;
+    volatile bool m_stop;
+};
+
+#endif // ELM327_EMULATOR_H
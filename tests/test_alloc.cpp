@@ -0,0 +1,311 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include <cstdlib>
+#include <new>
+
+#include "obdreftest.h"
+
+// test_alloc
+// * counts the heap allocations (and bytes) made by each
+//   call to CleanParameterFrame and ParseParameterFrame for
+//   every protocol and parse mode, and fails if a count is
+//   over its budget in g_list_budgets, so code that adds
+//   allocations to the clean and parse paths gets caught
+// * malloc, calloc and realloc are interposed with glibc
+//   (which covers operator new, Qt containers and the
+//   javascript heap); otherwise only operator new is
+//   counted and the budgets aren't checked
+// * allocations made by the javascript heap are reported
+//   separately with Parser::GetJsHeapStats
+// * usage: ./test_alloc /path/to/test.xml [verbose]
+
+#if defined(__GLIBC__)
+#define ALLOC_COUNT_MALLOC
+#endif
+
+static bool g_alloc_counting = false;
+static quint64 g_alloc_count = 0;
+static quint64 g_alloc_bytes = 0;
+
+static inline void count_alloc(size_t const size)
+{
+    if(g_alloc_counting)   {
+        g_alloc_count++;
+        g_alloc_bytes += size;
+    }
+}
+
+#ifdef ALLOC_COUNT_MALLOC
+extern "C" void * __libc_malloc(size_t size);
+extern "C" void * __libc_calloc(size_t num,size_t size);
+extern "C" void * __libc_realloc(void * ptr,size_t size);
+extern "C" void __libc_free(void * ptr);
+
+extern "C" void * malloc(size_t size)
+{
+    count_alloc(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void * calloc(size_t num,size_t size)
+{
+    count_alloc(num*size);
+    return __libc_calloc(num,size);
+}
+
+extern "C" void * realloc(void * ptr,size_t size)
+{
+    if(size > 0)   {
+        count_alloc(size);
+    }
+    return __libc_realloc(ptr,size);
+}
+
+extern "C" void free(void * ptr)
+{
+    __libc_free(ptr);
+}
+#endif
+
+void * operator new(size_t size)
+{
+#ifndef ALLOC_COUNT_MALLOC
+    count_alloc(size);
+#endif
+    void * ptr = malloc((size > 0) ? size : 1);
+    if(ptr == NULL)   {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void * operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void * ptr) throw()
+{
+    free(ptr);
+}
+
+void operator delete[](void * ptr) throw()
+{
+    free(ptr);
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+// AllocBudget
+// * the most allocations a single call for stage may
+//   make: maxPerCall + (maxPerFrame * raw frames)
+// * set from measured counts with a little headroom; most
+//   of the allocations when parsing are made by the
+//   javascript heap (150-200 per parse function call)
+struct AllocBudget
+{
+    char const * stage;
+    quint64 maxPerCall;
+    quint64 maxPerFrame;
+};
+
+static AllocBudget const g_list_budgets[] = {
+    { "clean",              4,      9   },
+    { "parse_separately",   48,     200 },
+    { "parse_combined",     128,    200 }
+};
+
+static int const NUM_BUDGETS = sizeof(g_list_budgets)/sizeof(AllocBudget);
+
+// calls that are counted for each case (after
+// one that isn't, to warm up caches)
+static int const NUM_COUNTED_CALLS = 10;
+
+struct AllocCount
+{
+    AllocCount() :
+        numAllocs(0),
+        numBytes(0),
+        numJsAllocs(0)
+    {}
+
+    quint64 numAllocs;
+    quint64 numBytes;
+    quint64 numJsAllocs;
+};
+
+AllocBudget const * get_budget(QString const &stage)
+{
+    for(int i=0; i < NUM_BUDGETS; i++)   {
+        if(stage == g_list_budgets[i].stage)   {
+            return &(g_list_budgets[i]);
+        }
+    }
+    return NULL;
+}
+
+void sim_response(obdref::ParameterFrame &param,int const numFrames)
+{
+    if(param.parseProtocol == obdref::PROTOCOL_ISO_15765)   {
+        sim_vehicle_message_iso15765(param,numFrames,true);
+    }
+    else if(param.parseProtocol == obdref::PROTOCOL_ISO_14230)   {
+        for(int j=0; j < numFrames; j++)   {
+            sim_vehicle_message_iso14230(param,1,true,3);
+        }
+    }
+    else   {
+        sim_vehicle_message_legacy(param,numFrames,true);
+    }
+}
+
+bool count_case(obdref::Parser &parser,
+                QString const &protocol,
+                QString const &paramName,
+                QString const &stage,
+                int const numFrames,
+                int const numResponses,
+                bool const verbose)
+{
+    obdref::ParameterFrame param;
+    param.spec = "TEST";
+    param.protocol = protocol;
+    param.address = "Default";
+    param.name = paramName;
+    if(!parser.BuildParameterFrame(param))   {
+        qDebug() << "Error: could not build frame for param:" << paramName;
+        return false;
+    }
+    for(int i=0; i < numResponses; i++)   {
+        sim_response(param,numFrames);
+    }
+
+    int numRawFrames=0;
+    for(int i=0; i < param.listMessageData.size(); i++)   {
+        numRawFrames += param.listMessageData[i].listRawFrames.size();
+    }
+
+    bool const cleanOnly = (stage == "clean");
+    QList<obdref::Data> listData;
+    AllocCount count;
+
+    for(int n=0; n <= NUM_COUNTED_CALLS; n++)   {
+        listData.clear();
+        quint64 const numJsAllocs = parser.GetJsHeapStats().numAllocs;
+
+        // the first call isn't counted
+        g_alloc_count = 0;
+        g_alloc_bytes = 0;
+        g_alloc_counting = (n > 0);
+        bool const ok = (cleanOnly) ?
+            parser.CleanParameterFrame(param) :
+            parser.ParseParameterFrame(param,listData);
+        g_alloc_counting = false;
+
+        if(!ok)   {
+            qDebug() << "Error: could not" << stage << paramName;
+            return false;
+        }
+        if(n > 0)   {
+            count.numAllocs += g_alloc_count;
+            count.numBytes += g_alloc_bytes;
+            count.numJsAllocs += parser.GetJsHeapStats().numAllocs-numJsAllocs;
+        }
+    }
+
+    quint64 const allocsPerCall = count.numAllocs/NUM_COUNTED_CALLS;
+    quint64 const bytesPerCall = count.numBytes/NUM_COUNTED_CALLS;
+    quint64 const jsAllocsPerCall = count.numJsAllocs/NUM_COUNTED_CALLS;
+
+    AllocBudget const * budget = get_budget(stage);
+    quint64 const maxAllocs = budget->maxPerCall+(budget->maxPerFrame*numRawFrames);
+
+    if(verbose)   {
+        qDebug() << stage << protocol << numRawFrames << "frames:"
+                 << allocsPerCall << "allocs" << bytesPerCall << "bytes"
+                 << jsAllocsPerCall << "js allocs"
+                 << "(budget" << maxAllocs << ")";
+    }
+
+#ifdef ALLOC_COUNT_MALLOC
+    if(allocsPerCall > maxAllocs)   {
+        qDebug() << "Error:" << stage << protocol << "with"
+                 << numRawFrames << "frames made" << allocsPerCall
+                 << "allocations (budget" << maxAllocs << ")";
+        return false;
+    }
+#endif
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+int main(int argc, char* argv[])
+{
+    // we expect a single argument that specifies
+    // the path to the test definitions file
+    bool opOk = false;
+    QString filePath(argv[1]);
+    if(filePath.isEmpty())   {
+       qDebug() << "Pass the test definitions file in as an argument:";
+       qDebug() << "./test_alloc /path/to/test.xml [verbose]";
+       return -1;
+    }
+    bool const verbose = (argc > 2 && QString(argv[2]) == "verbose");
+
+    obdref::Parser parser(filePath,opOk);
+    if(!opOk) { return -1; }
+
+    QStringList listProtocols;
+    listProtocols << "SAE J1850 PWM"
+                  << "SAE J1850 VPW"
+                  << "ISO 9141-2"
+                  << "ISO 14230"
+                  << "ISO 15765 Standard Id"
+                  << "ISO 15765 Extended Id";
+
+    for(int p=0; p < listProtocols.size(); p++)   {
+        g_test_desc = "test allocations ("+listProtocols[p]+")";
+
+        for(int f=1; f <= 4; f *= 2)   {
+            for(int r=1; r <= 2; r++)   {
+                if(!count_case(parser,listProtocols[p],
+                               "T_REQ_NONE_RESP_SF_PARSE_SEP",
+                               "clean",f,r,verbose) ||
+                   !count_case(parser,listProtocols[p],
+                               "T_REQ_NONE_RESP_SF_PARSE_SEP",
+                               "parse_separately",f,r,verbose) ||
+                   !count_case(parser,listProtocols[p],
+                               "T_REQ_NON_RESP_MF_PARSE_COMBINED",
+                               "parse_combined",f,r,verbose))
+                {
+                    qDebug() << "////////////////////////////////////////////////";
+                    qDebug() << g_test_desc << "failed!";
+                    return -1;
+                }
+            }
+        }
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "passed!";
+    }
+
+    return 0;
+}
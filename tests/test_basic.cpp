@@ -17,6 +17,19 @@
 */
 
 #include "obdreftest.h"
+#include "pollscheduler.h"
+#include "elm327codec.h"
+#include "isotpflowcontrol.h"
+#include "parseprofiler.h"
+#include "framecapture.h"
+#include "batchdecoder.h"
+#include "logimporter.h"
+#include "timeseriesstore.h"
+#include "respondermap.h"
+
+#ifdef Q_OS_LINUX
+#include "socketcanreader.h"
+#endif
 
 bool test_legacy(obdref::Parser & parser,
                  bool const randomizeHeader=false);
@@ -29,6 +42,48 @@ bool test_iso14230(obdref::Parser & parser,
 bool test_iso15765(obdref::Parser & parser,
                    bool const randomizeHeader=false,
                    bool const extendedId=false);
+
+bool test_iso15765_ext_header(obdref::Parser & parser);
+
+bool test_incremental(obdref::Parser & parser,
+                      QString const &protocol);
+
+bool test_shared_requests(obdref::Parser & parser,
+                          QString const &protocol);
+
+bool test_periodic(obdref::Parser & parser);
+
+bool test_scheduler(obdref::Parser & parser);
+
+bool test_completeness(obdref::Parser & parser);
+bool test_completeness_legacy(obdref::Parser & parser);
+
+bool test_completeness_iso14230(obdref::Parser & parser);
+
+bool test_elm327(obdref::Parser & parser);
+
+bool test_flow_control(obdref::Parser & parser);
+
+bool test_reject_stats(obdref::Parser & parser);
+
+bool test_profiler(obdref::Parser & parser);
+
+bool test_capture(obdref::Parser & parser);
+
+bool test_batch(obdref::Parser & parser,
+                QString const &filePath);
+
+bool test_log_import(obdref::Parser & parser);
+
+bool test_timeseries(obdref::Parser & parser);
+
+bool test_dispatcher_split(obdref::Parser & parser);
+
+bool test_script_errors();
+
+#ifdef Q_OS_LINUX
+bool test_socketcan(obdref::Parser & parser);
+#endif
                    
 int main(int argc, char* argv[])
 {
@@ -84,6 +139,108 @@ int main(int argc, char* argv[])
     if(!test_iso15765(parser,randHeaders,true))   {
         return -1;
     }
+
+    g_test_desc = "test iso 15765 extended id response header";
+    if(!test_iso15765_ext_header(parser))   {
+        return -1;
+    }
+
+    g_test_desc = "test incremental parse (iso 9141)";
+    if(!test_incremental(parser,"ISO 9141-2"))   {
+        return -1;
+    }
+
+    g_test_desc = "test incremental parse (iso 15765)";
+    if(!test_incremental(parser,"ISO 15765 Standard Id"))   {
+        return -1;
+    }
+
+    g_test_desc = "test shared requests (iso 15765)";
+    if(!test_shared_requests(parser,"ISO 15765 Standard Id"))   {
+        return -1;
+    }
+
+    g_test_desc = "test periodic identifiers (iso 15765)";
+    if(!test_periodic(parser))   {
+        return -1;
+    }
+
+    g_test_desc = "test poll scheduler";
+    if(!test_scheduler(parser))   {
+        return -1;
+    }
+
+    g_test_desc = "test response completeness (iso 15765)";
+    if(!test_completeness(parser))   {
+        return -1;
+    }
+
+    g_test_desc = "test response completeness (iso 9141-2)";
+    if(!test_completeness_legacy(parser))   {
+        return -1;
+    }
+
+    g_test_desc = "test response completeness (iso 14230)";
+    if(!test_completeness_iso14230(parser))   {
+        return -1;
+    }
+
+    g_test_desc = "test elm327 codec";
+    if(!test_elm327(parser))   {
+        return -1;
+    }
+
+    g_test_desc = "test iso 15765 flow control";
+    if(!test_flow_control(parser))   {
+        return -1;
+    }
+
+    g_test_desc = "test frame reject stats";
+    if(!test_reject_stats(parser))   {
+        return -1;
+    }
+
+    g_test_desc = "test parse profiler";
+    if(!test_profiler(parser))   {
+        return -1;
+    }
+
+    g_test_desc = "test frame capture and replay";
+    if(!test_capture(parser))   {
+        return -1;
+    }
+
+    g_test_desc = "test batch decoder";
+    if(!test_batch(parser,filePath))   {
+        return -1;
+    }
+
+    g_test_desc = "test candump and ASC log import";
+    if(!test_log_import(parser))   {
+        return -1;
+    }
+
+    g_test_desc = "test time series store";
+    if(!test_timeseries(parser))   {
+        return -1;
+    }
+
+    g_test_desc = "test dispatcher multi-frame messages";
+    if(!test_dispatcher_split(parser))   {
+        return -1;
+    }
+
+    g_test_desc = "test parse script errors";
+    if(!test_script_errors())   {
+        return -1;
+    }
+
+#ifdef Q_OS_LINUX
+    g_test_desc = "test socketcan filters";
+    if(!test_socketcan(parser))   {
+        return -1;
+    }
+#endif
     
     return 0;
 }
@@ -306,3 +463,2155 @@ bool test_iso15765(obdref::Parser & parser,
     qDebug() << g_test_desc << "passed!";
     return true;
 }
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_iso15765_ext_header(obdref::Parser & parser)
+{
+    obdref::ParameterFrame param;
+    param.spec = "TEST";
+    param.protocol = "ISO 15765 Extended Id";
+    param.address = "Default";
+    param.name = "T_UDS_DID_4_BYTES";
+
+    if(!parser.BuildParameterFrame(param))   {
+        qDebug() << "Error: could not build frame "
+                    "for param:" << param.name;
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // the expected header comes from the response node:
+    // [0x18] [0xDA] [target 0xF1] [any source]
+    obdref::MessageData &msg = param.listMessageData[0];
+    obdref::ByteList expHeader,expMask;
+    expHeader << 0x18 << 0xDA << 0xF1 << 0x00;
+    expMask << 0xFF << 0xFF << 0xFF << 0x00;
+    if(msg.expHeaderBytes != expHeader || msg.expHeaderMask != expMask)   {
+        qDebug() << "Error: unexpected response header"
+                 << msg.expHeaderBytes << msg.expHeaderMask;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // a response from any ecu is accepted, but not
+    // a frame with the request's format and target
+    obdref::ByteList respFrame,reqFrame;
+    respFrame << 0x18 << 0xDA << 0xF1 << 0x10
+              << 0x07 << 0x62 << 0xF4 << 0x10 << 0x01 << 0x02 << 0x03 << 0x04;
+    reqFrame << 0x18 << 0xDB << 0x33 << 0xF1
+             << 0x07 << 0x62 << 0xF4 << 0x10 << 0x01 << 0x02 << 0x03 << 0x04;
+    msg.listRawFrames << respFrame << reqFrame;
+
+    QList<obdref::Data> listData;
+    if(!parser.ParseParameterFrame(param,listData) || listData.size() != 1)   {
+        qDebug() << "Error: unexpected responses accepted:" << listData.size();
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_incremental(obdref::Parser & parser,
+                      QString const &protocol)
+{
+    QStringList listParams =
+        parser.GetParameterNames("TEST",protocol,"Default");
+
+    for(int i=0; i < listParams.size(); i++)   {
+        obdref::ParameterFrame param;
+        param.spec = "TEST";
+        param.protocol = protocol;
+        param.address = "Default";
+        param.name = listParams[i];
+
+        if(param.name != "T_REQ_SINGLE_RESP_SF_PARSE_SEP" &&
+           param.name != "T_REQ_SINGLE_RESP_MF_PARSE_SEP")   {
+            continue;
+        }
+
+        if(!parser.BuildParameterFrame(param))   {
+            qDebug() << "Error: could not build frame "
+                        "for param:" << listParams[i];
+            qDebug() << g_test_desc << "failed!";
+            return false;
+        }
+
+        // simulate a few responses
+        for(int j=0; j < 3; j++)   {
+            if(param.parseProtocol == obdref::PROTOCOL_ISO_15765)   {
+                sim_vehicle_message_iso15765(param,1,false);
+                sim_vehicle_message_iso15765(param,3+j,false);
+            }
+            else   {
+                sim_vehicle_message_legacy(param,2,false);
+            }
+        }
+
+        // parse everything at once
+        QList<obdref::Data> listDataAll;
+        bool parseOk = parser.ParseParameterFrame(param,listDataAll);
+
+        // parse the same frames as they arrive
+        QList<obdref::ByteList> listRawFrames =
+            param.listMessageData[0].listRawFrames;
+
+        param.listMessageData[0].listRawFrames.clear();
+
+        QList<obdref::Data> listDataNew;
+        for(int j=0; j < listRawFrames.size(); j++)   {
+            param.listMessageData[0].listRawFrames << listRawFrames[j];
+            parseOk = parseOk &&
+                parser.ParseParameterFrameIncremental(param,listDataNew);
+        }
+
+        // no new frames
+        int const numParsed = listDataNew.size();
+        parseOk = parseOk &&
+            parser.ParseParameterFrameIncremental(param,listDataNew);
+
+        bool dataOk = parseOk &&
+            (listDataNew.size() == numParsed) &&
+            (listDataNew.size() == listDataAll.size());
+
+        for(int j=0; dataOk && j < listDataAll.size(); j++)   {
+            QList<obdref::LiteralData> const &litAll =
+                listDataAll[j].listLiteralData;
+
+            QList<obdref::LiteralData> const &litNew =
+                listDataNew[j].listLiteralData;
+
+            dataOk = (litAll.size() == litNew.size());
+            for(int k=0; dataOk && k < litAll.size(); k++)   {
+                dataOk = (litAll[k].valueIfTrue == litNew[k].valueIfTrue);
+            }
+        }
+
+        if(!dataOk)   {
+            qDebug() << "Error: incremental parse mismatch "
+                        "for param:" << listParams[i];
+            qDebug() << "////////////////////////////////////////////////";
+            qDebug() << g_test_desc << "failed!";
+            return false;
+        }
+
+        // clearing and refilling the frames (with a different
+        // last frame) should restart the parse, as should
+        // ResetIncremental with the same frames
+        param.listMessageData[0].listRawFrames = listRawFrames;
+        param.listMessageData[0].listRawFrames.last().last() ^= 0xFF;
+        QList<obdref::Data> listDataRefill;
+        parseOk = parser.ParseParameterFrameIncremental(param,listDataRefill);
+
+        param.listMessageData[0].listRawFrames = listRawFrames;
+        parser.ResetIncremental(param);
+        QList<obdref::Data> listDataReset;
+        parseOk = parseOk &&
+            parser.ParseParameterFrameIncremental(param,listDataReset);
+
+        if(!parseOk || listDataRefill.size() != listDataAll.size() ||
+           listDataReset.size() != listDataAll.size())   {
+            qDebug() << "Error: incremental parse didn't restart "
+                        "for param:" << listParams[i]
+                     << listDataRefill.size() << listDataReset.size();
+            qDebug() << "////////////////////////////////////////////////";
+            qDebug() << g_test_desc << "failed!";
+            return false;
+        }
+    }
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_shared_requests(obdref::Parser & parser,
+                          QString const &protocol)
+{
+    QStringList listParams =
+        parser.GetParameterNames("TEST",protocol,"Default");
+
+    QList<obdref::ParameterFrame> listParamFrames;
+    for(int i=0; i < listParams.size(); i++)   {
+        obdref::ParameterFrame param;
+        param.spec = "TEST";
+        param.protocol = protocol;
+        param.address = "Default";
+        param.name = listParams[i];
+
+        if(!parser.BuildParameterFrame(param))   {
+            qDebug() << "Error: could not build frame "
+                        "for param:" << listParams[i];
+            qDebug() << g_test_desc << "failed!";
+            return false;
+        }
+        listParamFrames << param;
+    }
+
+    QList<QList<int> > listGroups;
+    parser.GroupSharedRequests(listParamFrames,listGroups);
+
+    // test.xml has two groups of parameters with requests:
+    // T_REQ_SINGLE_RESP_[...] share one request and
+    // T_REQ_MULTI_RESP_[...] share three requests
+    QStringList listSingleResp,listMultiResp;
+    for(int i=0; i < listGroups.size(); i++)   {
+        QStringList listNames;
+        for(int j=0; j < listGroups[i].size(); j++)   {
+            listNames << listParamFrames[listGroups[i][j]].name;
+        }
+        if(listNames.contains("T_REQ_SINGLE_RESP_SF_PARSE_SEP"))   {
+            listSingleResp = listNames;
+        }
+        else if(listNames.contains("T_REQ_MULTI_RESP_SF_PARSE_SEP"))   {
+            listMultiResp = listNames;
+
+            // 'send' the requests once and parse the
+            // response for every parameter in the group
+            obdref::ParameterFrame &srcParam =
+                listParamFrames[listGroups[i][0]];
+
+            sim_vehicle_message_iso15765(srcParam,1,false);
+
+            QList<obdref::Data> listData;
+            if(!parser.ParseSharedResponse(listParamFrames,
+                                           listGroups[i],
+                                           listData))   {
+                qDebug() << "Error: could not parse shared response";
+                qDebug() << g_test_desc << "failed!";
+                return false;
+            }
+
+            QStringList listParsedNames;
+            for(int j=0; j < listData.size(); j++)   {
+                listParsedNames << listData[j].paramName;
+            }
+            for(int j=0; j < listNames.size(); j++)   {
+                if(!listParsedNames.contains(listNames[j]))   {
+                    qDebug() << "Error: no data for param:" << listNames[j];
+                    qDebug() << g_test_desc << "failed!";
+                    return false;
+                }
+            }
+        }
+    }
+
+    if(listSingleResp.size() != 2 ||
+       !listSingleResp.contains("T_REQ_SINGLE_RESP_MF_PARSE_SEP") ||
+       listMultiResp.size() != 3)   {
+        qDebug() << "Error: unexpected shared request groups";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_periodic(obdref::Parser & parser)
+{
+    QString protocol = "ISO 15765 Standard Id";
+    QStringList listParams =
+        parser.GetParameterNames("TEST",protocol,"Default");
+
+    QList<obdref::ParameterFrame> listParamFrames;
+    for(int i=0; i < listParams.size(); i++)   {
+        obdref::ParameterFrame param;
+        param.spec = "TEST";
+        param.protocol = protocol;
+        param.address = "Default";
+        param.name = listParams[i];
+
+        if(!parser.BuildParameterFrame(param))   {
+            qDebug() << "Error: could not build frame "
+                        "for param:" << listParams[i];
+            qDebug() << g_test_desc << "failed!";
+            return false;
+        }
+        listParamFrames << param;
+    }
+
+    QList<obdref::PeriodicFrame> listFrames;
+    QList<int> listParamIdxOther;
+    parser.BuildPeriodicFrames(listParamFrames,
+                               obdref::PERIODIC_RATE_FAST,0x00,
+                               listFrames,listParamIdxOther,
+                               obdref::PERIODIC_LAYOUT_SINGLE_FRAME);
+
+    // T_UDS_DID_1_BYTE and T_UDS_DID_2_BYTES fit in a
+    // single periodic frame, T_UDS_DID_4_BYTES doesn't
+    bool framesOk = (listFrames.size() == 2) &&
+        (listFrames[0].listParamIdx.size() == 2) &&
+        (listFrames[1].listParamIdx.size() == 1) &&
+        (listParamIdxOther.size()+3 == listParamFrames.size());
+
+    if(framesOk)   {
+        obdref::ByteList expDefineFF,expDefineCF,expStart;
+        expDefineFF << 0x10 << 0x0C << 0x2C << 0x01 << 0xF2 << 0x00 << 0xF4 << 0x0D;
+        expDefineCF << 0x21 << 0x01 << 0x01 << 0xF4 << 0x0C << 0x01 << 0x02;
+        expStart << 0x03 << 0x2A << 0x03 << 0x00;
+
+        obdref::PeriodicFrame const &frame = listFrames[0];
+        framesOk = (frame.msgDefine.listReqDataBytes.size() == 2) &&
+            (frame.msgDefine.listReqDataBytes[0] == expDefineFF) &&
+            (frame.msgDefine.listReqDataBytes[1] == expDefineCF) &&
+            (frame.msgStart.listReqDataBytes[0] == expStart) &&
+            (listFrames[1].periodicId == 0x01);
+    }
+
+    if(!framesOk)   {
+        qDebug() << "Error: unexpected periodic frames";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // simulate two periodic messages for the first frame:
+    // [pci] [periodicId] [DID_1 d0] [DID_2 d0 d1] [padding]
+    obdref::PeriodicFrame &frame = listFrames[0];
+    for(int i=0; i < 2; i++)   {
+        obdref::ByteList rawFrame;
+        rawFrame << frame.msgData.expHeaderBytes
+                 << 0x04 << frame.periodicId
+                 << 0x11*(i+1) << 0x22*(i+1) << 0x33*(i+1)
+                 << 0x00 << 0x00 << 0x00;
+        frame.msgData.listRawFrames << rawFrame;
+    }
+
+    QList<obdref::Data> listData;
+    if(!parser.ParsePeriodicFrame(listParamFrames,frame,listData))   {
+        qDebug() << "Error: could not parse periodic frame";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    QStringList listReceived;
+    for(int i=0; i < listData.size(); i++)   {
+        listReceived << listData[i].paramName+":"+
+                        listData[i].listLiteralData[0].valueIfTrue;
+    }
+    if(listReceived.size() != 4 ||
+       !listReceived.contains("T_UDS_DID_1_BYTE:11 ") ||
+       !listReceived.contains("T_UDS_DID_1_BYTE:22 ") ||
+       !listReceived.contains("T_UDS_DID_2_BYTES:22 33 ") ||
+       !listReceived.contains("T_UDS_DID_2_BYTES:44 66 "))   {
+        qDebug() << "Error: unexpected periodic data" << listReceived;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // uudt periodic messages don't have a pci byte,
+    // so all three parameters fit in a single frame
+    parser.BuildPeriodicFrames(listParamFrames,
+                               obdref::PERIODIC_RATE_FAST,0x00,
+                               listFrames,listParamIdxOther);
+
+    if(listFrames.size() != 1 ||
+       listFrames[0].listParamIdx.size() != 3 ||
+       listFrames[0].layout != obdref::PERIODIC_LAYOUT_UUDT)   {
+        qDebug() << "Error: unexpected uudt periodic frames";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // [periodicId] [DID_1 d0] [DID_2 d0 d1] [DID_4 d0 ... d3]
+    obdref::PeriodicFrame &uudtFrame = listFrames[0];
+    obdref::ByteList rawFrame;
+    rawFrame << uudtFrame.msgData.expHeaderBytes
+             << uudtFrame.periodicId
+             << 0x11 << 0x22 << 0x33
+             << 0x44 << 0x55 << 0x66 << 0x77;
+    uudtFrame.msgData.listRawFrames << rawFrame;
+
+    listData.clear();
+    if(!parser.ParsePeriodicFrame(listParamFrames,uudtFrame,listData))   {
+        qDebug() << "Error: could not parse uudt periodic frame";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    listReceived.clear();
+    for(int i=0; i < listData.size(); i++)   {
+        listReceived << listData[i].paramName+":"+
+                        listData[i].listLiteralData[0].valueIfTrue;
+    }
+    if(listReceived.size() != 3 ||
+       !listReceived.contains("T_UDS_DID_1_BYTE:11 ") ||
+       !listReceived.contains("T_UDS_DID_2_BYTES:22 33 ") ||
+       !listReceived.contains("T_UDS_DID_4_BYTES:44 55 66 77 "))   {
+        qDebug() << "Error: unexpected uudt periodic data" << listReceived;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_scheduler(obdref::Parser & parser)
+{
+    // T_UDS_DID_1_BYTE:  rate 10, priority 1
+    // T_UDS_DID_2_BYTES: rate 5
+    // T_UDS_DID_4_BYTES: no rate (as often as possible)
+    QStringList listParams;
+    listParams << "T_UDS_DID_1_BYTE"
+               << "T_UDS_DID_2_BYTES"
+               << "T_UDS_DID_4_BYTES";
+
+    obdref::PollScheduler scheduler;
+    for(int i=0; i < listParams.size(); i++)   {
+        obdref::ParameterFrame param;
+        param.spec = "TEST";
+        param.protocol = "ISO 15765 Standard Id";
+        param.address = "Default";
+        param.name = listParams[i];
+
+        if(!parser.BuildParameterFrame(param))   {
+            qDebug() << "Error: could not build frame "
+                        "for param:" << listParams[i];
+            qDebug() << g_test_desc << "failed!";
+            return false;
+        }
+        scheduler.AddParameterFrame(param);
+    }
+
+    // with a budget of 20 requests/s, DID_1 gets its 10 Hz
+    // first and the other two share the rest evenly
+    scheduler.SetBusBudget(20);
+    if(scheduler.GetAllocatedRate(0) != 10 ||
+       scheduler.GetAllocatedRate(1) != 5 ||
+       scheduler.GetAllocatedRate(2) != 5)   {
+        qDebug() << "Error: unexpected allocated rates";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // simulate ten seconds of polling where
+    // every response takes 50ms
+    QList<int> listSampleCount;
+    listSampleCount << 0 << 0 << 0;
+
+    qint64 timeMs=0;
+    while(timeMs < 10000)
+    {
+        int paramIdx,msgIdx;
+        qint64 waitMs;
+        if(scheduler.NextRequest(timeMs,paramIdx,msgIdx,waitMs))   {
+            timeMs += 50;
+            scheduler.ResponseReceived(timeMs);
+            listSampleCount[paramIdx]++;
+        }
+        else if(waitMs > 0)   {
+            timeMs += waitMs;
+        }
+        else   {
+            qDebug() << "Error: scheduler stalled";
+            qDebug() << "////////////////////////////////////////////////";
+            qDebug() << g_test_desc << "failed!";
+            return false;
+        }
+    }
+
+    if(qAbs(listSampleCount[0]-100) > 5 ||
+       qAbs(listSampleCount[1]-50) > 5 ||
+       qAbs(listSampleCount[2]-50) > 5)   {
+        qDebug() << "Error: unexpected sample counts" << listSampleCount;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // the planned cycle should match the allocated rates
+    QList<int> listCycle;
+    scheduler.GetCycle(listCycle);
+    if(listCycle.count(0) != 2 ||
+       listCycle.count(1) != 1 ||
+       listCycle.count(2) != 1)   {
+        qDebug() << "Error: unexpected cycle" << listCycle;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // if the budget can't cover DID_1, nothing else is polled
+    scheduler.SetBusBudget(8);
+    if(scheduler.GetAllocatedRate(0) != 8 ||
+       scheduler.GetAllocatedRate(1) != 0 ||
+       scheduler.GetAllocatedRate(2) != 0)   {
+        qDebug() << "Error: unexpected allocated rates (low budget)";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_completeness(obdref::Parser & parser)
+{
+    obdref::ParameterFrame param;
+    param.spec = "TEST";
+    param.protocol = "ISO 15765 Standard Id";
+    param.address = "Default";
+    param.name = "T_UDS_DID_4_BYTES";
+
+    if(!parser.BuildParameterFrame(param))   {
+        qDebug() << "Error: could not build frame "
+                    "for param:" << param.name;
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // 0x7E8 sends a single frame, 0x7E9 sends a multi-frame
+    // message and 0x7EA answers something else
+    QList<obdref::ByteList> listRawFrames;
+    obdref::ByteList rawFrame;
+    rawFrame << 0x07 << 0xE8 << 0x07 << 0x62 << 0xF4 << 0x10
+             << 0x01 << 0x02 << 0x03 << 0x04;
+    listRawFrames << rawFrame;
+    rawFrame.clear();
+    rawFrame << 0x07 << 0xEA << 0x07 << 0x62 << 0xF4 << 0x11
+             << 0x01 << 0x02 << 0x03 << 0x04;
+    listRawFrames << rawFrame;
+    rawFrame.clear();
+    rawFrame << 0x07 << 0xE9 << 0x10 << 0x09 << 0x62 << 0xF4
+             << 0x10 << 0x01 << 0x02 << 0x03;
+    listRawFrames << rawFrame;
+    rawFrame.clear();
+    rawFrame << 0x07 << 0xE9 << 0x21 << 0x04 << 0x05 << 0x00
+             << 0x00 << 0x00 << 0x00 << 0x00;
+    listRawFrames << rawFrame;
+
+    QList<int> listExpCount;
+    listExpCount << 1 << 1 << 1 << 2;
+
+    // nothing is complete while the response count is unknown
+    obdref::MessageData &msg = param.listMessageData[0];
+    msg.listRawFrames = listRawFrames;
+    if(parser.IsMessageComplete(param,0))   {
+        qDebug() << "Error: complete without a response count";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    msg.listRawFrames.clear();
+    msg.expResponseCount = 2;
+    for(int i=0; i < listRawFrames.size(); i++)   {
+        msg.listRawFrames << listRawFrames[i];
+        int const count = parser.CountCompleteResponses(param,0);
+        bool const complete = parser.IsParameterFrameComplete(param);
+        if(count != listExpCount[i] || complete != (i == listRawFrames.size()-1))   {
+            qDebug() << "Error: unexpected response count" << count
+                     << "after frame" << i;
+            qDebug() << "////////////////////////////////////////////////";
+            qDebug() << g_test_desc << "failed!";
+            return false;
+        }
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_completeness_legacy(obdref::Parser & parser)
+{
+    obdref::ParameterFrame param;
+    param.spec = "TEST";
+    param.protocol = "ISO 9141-2";
+    param.address = "Default";
+    param.name = "T_REQ_SINGLE_RESP_SF_PARSE_SEP";
+
+    if(!parser.BuildParameterFrame(param))   {
+        qDebug() << "Error: could not build frame "
+                    "for param:" << param.name;
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+    obdref::ParameterFrame const emptyParam = param;
+
+    // 0x10 splits its response into three frames
+    QList<obdref::ByteList> listRawFrames;
+    for(int i=0; i < 3; i++)   {
+        obdref::ByteList rawFrame;
+        rawFrame << 0x48 << 0x6B << 0x10 << 0x62 << 0x04 << (i+1);
+        listRawFrames << rawFrame;
+    }
+
+    // learn the frame count from a full response
+    param.listMessageData[0].listRawFrames = listRawFrames;
+    QList<obdref::Data> listData;
+    if(!parser.ParseParameterFrame(param,listData))   {
+        qDebug() << "Error: could not parse frame";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+    obdref::ResponderMap responderMap;
+    responderMap.RecordResponders(param);
+
+    param = emptyParam;
+    responderMap.ApplyResponseCounts(param);
+    obdref::MessageData &msg = param.listMessageData[0];
+    if(msg.expResponseCount != 1 || msg.expFramesPerResponse != 3)   {
+        qDebug() << "Error: unexpected counts" << msg.expResponseCount
+                 << msg.expFramesPerResponse;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // a repeated frame doesn't count towards the response
+    QList<obdref::ByteList> listRecvFrames;
+    listRecvFrames << listRawFrames[0] << listRawFrames[0]
+                   << listRawFrames[1] << listRawFrames[2];
+
+    for(int i=0; i < listRecvFrames.size(); i++)   {
+        msg.listRawFrames << listRecvFrames[i];
+        bool const complete = parser.IsMessageComplete(param,0);
+        if(complete != (i == listRecvFrames.size()-1))   {
+            qDebug() << "Error: unexpected completeness after frame" << i;
+            qDebug() << "////////////////////////////////////////////////";
+            qDebug() << g_test_desc << "failed!";
+            return false;
+        }
+    }
+
+    // without a frame count each ecu is counted once
+    param = emptyParam;
+    obdref::MessageData &msgSingle = param.listMessageData[0];
+    msgSingle.expResponseCount = 2;
+    msgSingle.listRawFrames << listRawFrames[0] << listRawFrames[0];
+    if(parser.CountCompleteResponses(param,0) != 1 ||
+       parser.IsMessageComplete(param,0))   {
+        qDebug() << "Error: repeated frame counted twice";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+    obdref::ByteList rawFrame;
+    rawFrame << 0x48 << 0x6B << 0x11 << 0x62 << 0x04 << 0x01;
+    msgSingle.listRawFrames << rawFrame;
+    if(parser.CountCompleteResponses(param,0) != 2 ||
+       !parser.IsMessageComplete(param,0))   {
+        qDebug() << "Error: second ecu not counted";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_completeness_iso14230(obdref::Parser & parser)
+{
+    obdref::ParameterFrame param;
+    param.spec = "TEST";
+    param.protocol = "ISO 14230";
+    param.address = "Default";
+    param.name = "T_REQ_SINGLE_RESP_SF_PARSE_SEP";
+
+    if(!parser.BuildParameterFrame(param))   {
+        qDebug() << "Error: could not build frame "
+                    "for param:" << param.name;
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+    obdref::ParameterFrame const emptyParam = param;
+
+    // 0x10 answers with two frames of different lengths,
+    // so their format bytes differ
+    QList<obdref::ByteList> listRawFrames;
+    obdref::ByteList rawFrame;
+    rawFrame << 0x83 << 0xF1 << 0x10 << 0x62 << 0x04 << 0x01;
+    listRawFrames << rawFrame;
+    rawFrame.clear();
+    rawFrame << 0x84 << 0xF1 << 0x10 << 0x62 << 0x04 << 0x02 << 0x03;
+    listRawFrames << rawFrame;
+
+    param.listMessageData[0].listRawFrames = listRawFrames;
+    QList<obdref::Data> listData;
+    if(!parser.ParseParameterFrame(param,listData) || listData.size() != 2)   {
+        qDebug() << "Error: could not parse frame";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+    obdref::ResponderMap responderMap;
+    responderMap.RecordResponders(param);
+
+    // one responder, matched on [format & 0xC0] [target] [source]
+    param = emptyParam;
+    responderMap.ApplyResponseCounts(param);
+    obdref::ParameterFrame physicalParam;
+    obdref::ByteList expHeader,expMask;
+    expHeader << 0x80 << 0xF1 << 0x10;
+    expMask << 0xC0 << 0xFF << 0xFF;
+
+    obdref::MessageData &msg = param.listMessageData[0];
+    if(msg.expResponseCount != 1 || msg.expFramesPerResponse != 2 ||
+       !responderMap.BuildPhysicalFrame(param,physicalParam) ||
+       physicalParam.listMessageData[0].expHeaderBytes != expHeader ||
+       physicalParam.listMessageData[0].expHeaderMask != expMask)   {
+        qDebug() << "Error: unexpected responders" << msg.expResponseCount
+                 << msg.expFramesPerResponse;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    for(int i=0; i < listRawFrames.size(); i++)   {
+        msg.listRawFrames << listRawFrames[i];
+        bool const complete = parser.IsMessageComplete(param,0);
+        if(complete != (i == listRawFrames.size()-1))   {
+            qDebug() << "Error: unexpected completeness after frame" << i;
+            qDebug() << "////////////////////////////////////////////////";
+            qDebug() << g_test_desc << "failed!";
+            return false;
+        }
+    }
+
+    // frames that only hold the prefix aren't responses; the
+    // length is either in the format byte or the length byte
+    obdref::ParameterFrame shortParam = emptyParam;
+    rawFrame.clear();
+    rawFrame << 0x82 << 0xF1 << 0x10 << 0x62 << 0x04;
+    shortParam.listMessageData[0].listRawFrames << rawFrame;
+    rawFrame.clear();
+    rawFrame << 0x80 << 0xF1 << 0x11 << 0x02 << 0x62 << 0x04;
+    shortParam.listMessageData[0].listRawFrames << rawFrame;
+
+    if(parser.CountCompleteResponses(shortParam,0) != 0)   {
+        qDebug() << "Error: frames without data counted as responses";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_elm327(obdref::Parser & parser)
+{
+    // hex conversion
+    obdref::ByteList bytes;
+    bytes << 0x00 << 0x7E << 0xA5 << 0xFF;
+    QByteArray hexStr;
+    obdref::Elm327Codec::EncodeHex(bytes,hexStr,true);
+
+    obdref::ByteList decBytes;
+    if(hexStr != "00 7E A5 FF" ||
+       !obdref::Elm327Codec::DecodeHex(hexStr.constData(),hexStr.size(),decBytes) ||
+       decBytes != bytes ||
+       obdref::Elm327Codec::DecodeHex("7E8",3,decBytes) ||
+       obdref::Elm327Codec::DecodeHex("NO DATA",7,decBytes))   {
+        qDebug() << "Error: hex conversion failed:" << hexStr;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    obdref::ParameterFrame param;
+    param.spec = "TEST";
+    param.protocol = "ISO 15765 Standard Id";
+    param.address = "Default";
+    param.name = "T_UDS_DID_4_BYTES";
+
+    if(!parser.BuildParameterFrame(param))   {
+        qDebug() << "Error: could not build frame "
+                    "for param:" << param.name;
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+    param.listMessageData[0].expResponseCount = 1;
+
+    // the header is only sent with the first request
+    obdref::Elm327Codec codec;
+    QList<QByteArray> listCommands;
+    codec.EncodeRequest(param,0,listCommands);
+    if(listCommands.size() != 2 ||
+       listCommands[0] != "ATSH7DF\r" ||
+       listCommands[1] != "22F4101\r")   {
+        qDebug() << "Error: unexpected commands" << listCommands;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+    codec.EncodeRequest(param,0,listCommands);
+    if(listCommands.size() != 1)   {
+        qDebug() << "Error: header sent twice" << listCommands;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // the response arrives in arbitrary pieces
+    QByteArray response("SEARCHING...\r7E8 07 62 F4 10 01 02 03 04 \r\r>");
+    QList<obdref::ByteList> listRawFrames;
+    bool done = false;
+    for(int i=0; i < response.size(); i+=5)   {
+        int const length = qMin(5,response.size()-i);
+        done = codec.DecodeResponse(param,response.constData()+i,
+                                    length,listRawFrames);
+    }
+
+    QList<obdref::Data> listData;
+    param.listMessageData[0].listRawFrames = listRawFrames;
+    if(!done || listRawFrames.size() != 1 ||
+       codec.GetLastStatus() != "SEARCHING..." ||
+       !parser.ParseParameterFrame(param,listData) ||
+       listData.size() != 1)   {
+        qDebug() << "Error: could not decode response";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // legacy frames have their checksum removed
+    obdref::ParameterFrame legacyParam;
+    legacyParam.spec = "TEST";
+    legacyParam.protocol = "ISO 9141-2";
+    legacyParam.address = "Default";
+    legacyParam.name = "T_REQ_SINGLE_RESP_SF_PARSE_SEP";
+    parser.BuildParameterFrame(legacyParam);
+
+    codec.EncodeRequest(legacyParam,0,listCommands);
+    if(listCommands.size() != 2 || listCommands[0] != "ATSH686AF1\r")   {
+        qDebug() << "Error: unexpected commands" << listCommands;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // legacy responses only get a hint if they
+    // fit in a single frame
+    obdref::MessageData &legacyMsg = legacyParam.listMessageData[0];
+    legacyMsg.expResponseCount = 1;
+    codec.EncodeRequest(legacyParam,0,listCommands);
+    QByteArray const cmdSingle = listCommands.value(0);
+
+    legacyMsg.expDataByteCount = 6;
+    codec.EncodeRequest(legacyParam,0,listCommands);
+    QByteArray const cmdLong = listCommands.value(0);
+
+    legacyMsg.expDataByteCount = 1;
+    legacyMsg.expFramesPerResponse = 3;
+    codec.EncodeRequest(legacyParam,0,listCommands);
+    QByteArray const cmdMulti = listCommands.value(0);
+
+    if(cmdSingle != "22041\r" || cmdLong != "2204\r" || cmdMulti != "2204\r")   {
+        qDebug() << "Error: unexpected legacy hints"
+                 << cmdSingle << cmdLong << cmdMulti;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    response = "486B10620412C3\r\r>";
+    listRawFrames.clear();
+    codec.DecodeResponse(legacyParam,response.constData(),
+                         response.size(),listRawFrames);
+    if(listRawFrames.size() != 1 || listRawFrames[0].size() != 6)   {
+        qDebug() << "Error: could not decode legacy response";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_flow_control(obdref::Parser & parser)
+{
+    // STmin conversion
+    if(obdref::IsoTpFlowControl::EncodeStMin(0) != 0x00 ||
+       obdref::IsoTpFlowControl::EncodeStMin(300) != 0xF3 ||
+       obdref::IsoTpFlowControl::EncodeStMin(2500) != 0x02 ||
+       obdref::IsoTpFlowControl::EncodeStMin(500000) != 0x7F ||
+       obdref::IsoTpFlowControl::DecodeStMin(0xF3) != 300 ||
+       obdref::IsoTpFlowControl::DecodeStMin(0x14) != 20000)   {
+        qDebug() << "Error: STmin conversion failed";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    obdref::ParameterFrame param;
+    param.spec = "TEST";
+    param.protocol = "ISO 15765 Standard Id";
+    param.address = "Default";
+    param.name = "T_UDS_DID_4_BYTES";
+
+    if(!parser.BuildParameterFrame(param))   {
+        qDebug() << "Error: could not build frame "
+                    "for param:" << param.name;
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // 20 data bytes: a first frame and 2 consecutive frames
+    obdref::ByteList respHeader;
+    respHeader << 0x07 << 0xE8;
+
+    obdref::ByteList ff,cf1,cf2;
+    ff << respHeader << 0x10 << 0x14 << 0x62 << 0xF4 << 0x10 << 0x01 << 0x02 << 0x03;
+    cf1 << respHeader << 0x21 << 0x04 << 0x05 << 0x06 << 0x07 << 0x08 << 0x09 << 0x0A;
+    cf2 << respHeader << 0x22 << 0x0B << 0x0C << 0x0D << 0x0E << 0x0F << 0x10 << 0x11;
+
+    // the flow control frame goes to the physical
+    // request id of the ecu
+    obdref::IsoTpFlowControl flowControl;
+    flowControl.SetParameters(respHeader,1,0);
+
+    obdref::ByteList fcFrame,expFcFrame;
+    expFcFrame << 0x07 << 0xE0 << 0x30 << 0x01 << 0x00
+               << 0x00 << 0x00 << 0x00 << 0x00 << 0x00;
+
+    bool const sendAfterFf = flowControl.ProcessFrame(param,ff,0,fcFrame);
+    int const framesLeft = flowControl.GetFramesUntilFlowControl(respHeader);
+    if(!sendAfterFf || fcFrame != expFcFrame || framesLeft != 1)   {
+        qDebug() << "Error: unexpected flow control frame" << fcFrame;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // with a block size of 1, each consecutive frame but
+    // the last is followed by a flow control frame
+    bool const sendAfterCf1 = flowControl.ProcessFrame(param,cf1,1,fcFrame);
+    bool const sendAfterCf2 = flowControl.ProcessFrame(param,cf2,2,fcFrame);
+    if(!sendAfterCf1 || sendAfterCf2 ||
+       flowControl.GetFramesUntilFlowControl(respHeader) != -1)   {
+        qDebug() << "Error: flow control not sent after block";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // when adaptive, lost frames and timeouts increase STmin
+    // and error free transfers decrease it again
+    flowControl.SetAdaptive(true);
+    flowControl.ProcessFrame(param,ff,10,fcFrame);
+    flowControl.ProcessFrame(param,cf2,11,fcFrame);
+    quint32 const stMinLost = flowControl.GetStMinUs(respHeader);
+
+    flowControl.ProcessFrame(param,ff,20,fcFrame);
+    int const numTimedOut = flowControl.CheckTimeouts(2000);
+    quint32 const stMinTimedOut = flowControl.GetStMinUs(respHeader);
+
+    if(stMinLost != 1000 || numTimedOut != 1 || stMinTimedOut != 2000)   {
+        qDebug() << "Error: STmin not increased:" << stMinLost << stMinTimedOut;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    for(int i=0; i < 4; i++)   {
+        flowControl.ProcessFrame(param,ff,3000+i,fcFrame);
+        flowControl.ProcessFrame(param,cf1,3000+i,fcFrame);
+        flowControl.ProcessFrame(param,cf2,3000+i,fcFrame);
+    }
+    if(flowControl.GetStMinUs(respHeader) != 1000)   {
+        qDebug() << "Error: STmin not decreased";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // adapter commands
+    obdref::Elm327Codec codec;
+    QList<QByteArray> listCommands;
+    flowControl.BuildFlowControlFrame(param,respHeader,fcFrame);
+    if(!codec.GetFlowControlCommands(param,fcFrame,listCommands) ||
+       listCommands.size() != 3 ||
+       listCommands[0] != "ATFCSH7E0\r" ||
+       listCommands[1] != "ATFCSD300101\r" ||
+       listCommands[2] != "ATFCSM1\r")   {
+        qDebug() << "Error: unexpected commands" << listCommands;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_reject_stats(obdref::Parser & parser)
+{
+    obdref::ParameterFrame param;
+    param.spec = "TEST";
+    param.protocol = "ISO 15765 Extended Id";
+    param.address = "Default";
+    param.name = "T_UDS_DID_4_BYTES";
+
+    if(!parser.BuildParameterFrame(param))   {
+        qDebug() << "Error: could not build frame "
+                    "for param:" << param.name;
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+    obdref::ParameterFrame incParam = param;
+
+    obdref::ByteList frameOk,frameHeader,framePrefix,frameShort;
+    frameOk << 0x18 << 0xDA << 0xF1 << 0x10
+            << 0x07 << 0x62 << 0xF4 << 0x10 << 0x01 << 0x02 << 0x03 << 0x04;
+    frameHeader << 0x18 << 0xDB << 0xF1 << 0x10
+                << 0x07 << 0x62 << 0xF4 << 0x10 << 0x01 << 0x02 << 0x03 << 0x04;
+    framePrefix << 0x18 << 0xDA << 0xF1 << 0x10
+                << 0x07 << 0x62 << 0xF4 << 0x11 << 0x01 << 0x02 << 0x03 << 0x04;
+    frameShort << 0x18 << 0xDA << 0xF1 << 0x10;
+
+    obdref::MessageData &msg = param.listMessageData[0];
+    msg.listRawFrames << frameHeader << frameOk << framePrefix << frameShort;
+
+    parser.ResetRejectStats();
+    parser.SetRejectLogInterval(1);
+
+    QList<obdref::Data> listData;
+    parser.ParseParameterFrame(param,listData);
+    parser.SetRejectLogInterval(0);
+
+    if(listData.size() != 1 ||
+       msg.rejectStats.headerMismatch != 1 ||
+       msg.rejectStats.prefixMismatch != 1 ||
+       msg.rejectStats.badLength != 1 ||
+       msg.rejectStats.Total() != 3)   {
+        qDebug() << "Error: unexpected reject stats";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // consecutive frames that are out of sequence
+    // or don't follow a first frame
+    obdref::ByteList ff,cfGap,cfOrphan;
+    ff << 0x18 << 0xDA << 0xF1 << 0x10
+       << 0x10 << 0x0A << 0x62 << 0xF4 << 0x10 << 0x01 << 0x02 << 0x03;
+    cfGap << 0x18 << 0xDA << 0xF1 << 0x10
+          << 0x22 << 0x04 << 0x05 << 0x06 << 0x07;
+    cfOrphan << 0x18 << 0xDA << 0xF1 << 0x10
+             << 0x21 << 0x04 << 0x05 << 0x06 << 0x07;
+
+    obdref::ParameterFrame gapParam = incParam;
+    obdref::ParameterFrame orphanParam = incParam;
+
+    obdref::MessageData &incMsg = incParam.listMessageData[0];
+    incMsg.listRawFrames << ff << cfGap << cfOrphan;
+    listData.clear();
+    parser.ParseParameterFrameIncremental(incParam,listData);
+
+    obdref::RejectStats const &stats = parser.GetRejectStats();
+    if(incMsg.rejectStats.sequenceGap != 2 ||
+       stats.sequenceGap != 2 || stats.Total() != 5)   {
+        qDebug() << "Error: unexpected sequence reject stats";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // a full parse merges the CF with the expected
+    // sequence number wherever it is, so only the
+    // other one is out of sequence
+    obdref::MessageData &gapMsg = gapParam.listMessageData[0];
+    gapMsg.listRawFrames << ff << cfGap << cfOrphan;
+    listData.clear();
+    parser.ParseParameterFrame(gapParam,listData);
+    if(listData.size() != 1 ||
+       gapMsg.rejectStats.sequenceGap != 1 ||
+       gapMsg.rejectStats.Total() != 1)   {
+        qDebug() << "Error: unexpected full parse sequence reject stats";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // without a prefix an orphaned CF would
+    // otherwise be parsed as data
+    obdref::MessageData &orphanMsg = orphanParam.listMessageData[0];
+    orphanMsg.expDataPrefix.clear();
+    orphanMsg.listRawFrames << cfOrphan;
+    listData.clear();
+    parser.ParseParameterFrame(orphanParam,listData);
+    if(!listData.isEmpty() ||
+       orphanMsg.rejectStats.sequenceGap != 1 ||
+       orphanMsg.rejectStats.Total() != 1)   {
+        qDebug() << "Error: orphaned CF wasn't rejected";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_profiler(obdref::Parser & parser)
+{
+    // values below 32 are exact, larger values are
+    // kept to within a sub-bucket (~6%)
+    obdref::LatencyHistogram histogram;
+    for(quint64 i=1; i <= 100; i++)   {
+        histogram.Record(i);
+    }
+    histogram.Record(1000000);
+
+    quint64 const p50 = histogram.GetPercentile(50.0);
+    quint64 const p99 = histogram.GetPercentile(99.0);
+    if(histogram.GetCount() != 101 ||
+       histogram.GetMin() != 1 ||
+       histogram.GetMax() != 1000000 ||
+       histogram.GetPercentile(10.0) != 10 ||
+       p50 < 48 || p50 > 54 ||
+       p99 < 94 || p99 > 106 ||
+       histogram.GetPercentile(100.0) != 1000000)   {
+        qDebug() << "Error: unexpected histogram values:"
+                 << histogram.GetCount() << p50 << p99;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    obdref::ParseProfiler profiler;
+    for(int i=0; i < 10; i++)   {
+        profiler.Record("T_FAST",obdref::PROFILE_BUILD,100);
+        profiler.Record("T_FAST",obdref::PROFILE_JS_CALL,200);
+        profiler.Record("T_\"SLOW\"",obdref::PROFILE_JS_CALL,5000);
+    }
+
+    obdref::LatencyHistogram const * jsCall =
+        profiler.GetHistogram("T_FAST",obdref::PROFILE_JS_CALL);
+
+    QByteArray const json = profiler.ToJson();
+    if(jsCall == NULL || jsCall->GetCount() != 10 ||
+       profiler.GetHistogram("T_NONE",obdref::PROFILE_BUILD) != NULL ||
+       profiler.GetStageHistogram(obdref::PROFILE_JS_CALL).GetCount() != 20 ||
+       !json.contains("\"js_call\":{\"count\":20") ||
+       !json.contains("\"build\":{\"count\":10") ||
+       json.indexOf("T_\\\"SLOW\\\"") < 0 ||
+       json.indexOf("T_\\\"SLOW\\\"") > json.indexOf("T_FAST"))   {
+        qDebug() << "Error: unexpected profiler json:" << json;
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    profiler.Reset();
+    if(!profiler.GetParameterNames().isEmpty())   {
+        qDebug() << "Error: profiler not reset";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // the Parser records each stage of a real parse
+    // when it's built with OBDREF_PROFILE (test_basic.pro)
+    obdref::ParameterFrame param;
+    param.spec = "TEST";
+    param.protocol = "ISO 15765 Standard Id";
+    param.address = "Default";
+    param.name = "T_UDS_DID_4_BYTES";
+
+    parser.ResetProfiler();
+    if(!parser.BuildParameterFrame(param))   {
+        qDebug() << "Error: could not build frame "
+                    "for param:" << param.name;
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+    obdref::ByteList rawFrame;
+    rawFrame << 0x07 << 0xE8 << 0x07 << 0x62 << 0xF4 << 0x10
+             << 0x01 << 0x02 << 0x03 << 0x04;
+    param.listMessageData[0].listRawFrames << rawFrame;
+
+    QList<obdref::Data> listData;
+    if(!parser.ParseParameterFrame(param,listData) || listData.size() != 1)   {
+        qDebug() << "Error: could not parse frame";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    obdref::ParseProfiler const &parseProfiler = parser.GetProfiler();
+    obdref::ProfileStage const listStages[] = {
+        obdref::PROFILE_BUILD,
+        obdref::PROFILE_CLEAN,
+        obdref::PROFILE_JS_CALL,
+        obdref::PROFILE_SAVE_RESULTS
+    };
+    for(int i=0; i < 4; i++)   {
+        obdref::LatencyHistogram const * stageHistogram =
+            parseProfiler.GetHistogram(param.name,listStages[i]);
+#ifdef OBDREF_PROFILE
+        bool const stageOk = (stageHistogram != NULL &&
+                              stageHistogram->GetCount() == 1);
+#else
+        bool const stageOk = (stageHistogram == NULL);
+#endif
+        if(!stageOk)   {
+            qDebug() << "Error: unexpected parser histogram for stage" << i;
+            qDebug() << "////////////////////////////////////////////////";
+            qDebug() << g_test_desc << "failed!";
+            return false;
+        }
+    }
+    parser.ResetProfiler();
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_capture(obdref::Parser & parser)
+{
+    QString const filePath("test_capture.obdcap");
+    QString const truncPath("test_capture_trunc.obdcap");
+
+    // enough frames for a few index blocks
+    int const numFrames = 10000;
+    obdref::CaptureWriter writer;
+    if(!writer.Open(filePath))   {
+        qDebug() << "Error: could not open capture for writing";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+    for(int i=0; i < numFrames; i++)   {
+        obdref::ByteList rawFrame;
+        rawFrame << 0x07 << 0xE8 << obdref::ubyte(i >> 8) << obdref::ubyte(i);
+        for(int j=0; j < i%9; j++)   {
+            rawFrame << obdref::ubyte(j);
+        }
+        writer.WriteFrame(qint64(i)*100,obdref::ubyte(i%2),2,rawFrame);
+    }
+    writer.Close();
+
+    obdref::CaptureReader reader;
+    obdref::CapturedFrame frame;
+    bool readOk = reader.Open(filePath) && reader.HasIndex() &&
+                  reader.GetFrameCount() == quint64(numFrames) &&
+                  reader.GetFirstTimestampUs() == 0 &&
+                  reader.GetLastTimestampUs() == qint64(numFrames-1)*100;
+
+    for(int i=0; readOk && i < numFrames; i++)   {
+        readOk = reader.ReadNext(frame) &&
+                 frame.timestampUs == qint64(i)*100 &&
+                 frame.channel == i%2 &&
+                 frame.headerLength == 2 &&
+                 frame.rawFrame.size() == 4+i%9 &&
+                 frame.rawFrame[3] == obdref::ubyte(i);
+    }
+    if(!readOk || reader.ReadNext(frame))   {
+        qDebug() << "Error: capture frames don't match written frames";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // seek into the third block, between two frames
+    if(!reader.SeekToTime(900050) || !reader.ReadNext(frame) ||
+       frame.timestampUs != 900100 || frame.rawFrame[3] != obdref::ubyte(9001) ||
+       !reader.SeekToTime(0) || !reader.ReadNext(frame) ||
+       frame.timestampUs != 0 ||
+       reader.SeekToTime(qint64(numFrames)*100))   {
+        qDebug() << "Error: unexpected frame after seek";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // a capture that was cut off (no index or trailer)
+    // can still be read up to its last full record
+    QByteArray contents;
+    {
+        QFile file(filePath);
+        file.open(QIODevice::ReadOnly);
+        contents = file.readAll();
+    }
+    {
+        QFile file(truncPath);
+        file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+        file.write(contents.constData(),contents.size()/2);
+    }
+    obdref::CaptureReader truncReader;
+    int numTruncFrames=0;
+    readOk = truncReader.Open(truncPath) && !truncReader.HasIndex() &&
+             truncReader.SeekToTime(100000) &&
+             truncReader.ReadNext(frame) && frame.timestampUs == 100000;
+    truncReader.Rewind();
+    while(readOk && truncReader.ReadNext(frame))   {
+        readOk = (frame.timestampUs == qint64(numTruncFrames)*100);
+        numTruncFrames++;
+    }
+    truncReader.Close();
+    QFile::remove(truncPath);
+
+    if(!readOk || numTruncFrames < 1000 || numTruncFrames >= numFrames)   {
+        qDebug() << "Error: could not read truncated capture";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // capture frames seen by a dispatcher
+    obdref::ParameterFrame param;
+    param.spec = "TEST";
+    param.protocol = "ISO 15765 Extended Id";
+    param.address = "Default";
+    param.name = "T_UDS_DID_4_BYTES";
+
+    obdref::FrameDispatcher dispatcher(&parser);
+    if(!parser.BuildParameterFrame(param) ||
+       !dispatcher.AddParameterFrame(param))   {
+        qDebug() << "Error: could not build frame "
+                    "for param:" << param.name;
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    obdref::ByteList frameOk;
+    frameOk << 0x18 << 0xDA << 0xF1 << 0x10
+            << 0x07 << 0x62 << 0xF4 << 0x10 << 0x01 << 0x02 << 0x03 << 0x04;
+
+    writer.Open(filePath);
+    dispatcher.SetCaptureWriter(&writer,1);
+    dispatcher.DispatchFrame(frameOk);
+    dispatcher.SetCaptureWriter(NULL);
+    dispatcher.ClearDispatchedFrames();
+    writer.Close();
+
+    readOk = reader.Open(filePath) && reader.GetFrameCount() == 1 &&
+             reader.ReadNext(frame) && frame.channel == 1 &&
+             frame.headerLength == 4 && frame.rawFrame == frameOk;
+    if(!readOk)   {
+        qDebug() << "Error: dispatched frame wasn't captured";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // replay responses 200ms apart; each one should be
+    // parsed separately, and in real time the replay
+    // should take as long as the capture
+    writer.Open(filePath);
+    for(int i=0; i < 3; i++)   {
+        writer.WriteFrame(qint64(i)*200000,0,4,frameOk);
+    }
+    writer.Close();
+
+    QList<obdref::Data> listData;
+    obdref::ReplayOptions options;
+    reader.Open(filePath);
+    qint64 const numReplayed = reader.Replay(dispatcher,options,listData);
+    if(numReplayed != 3 || listData.size() != 3)   {
+        qDebug() << "Error: unexpected replay:" << numReplayed
+                 << "frames" << listData.size() << "data";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    listData.clear();
+    options.speed = 10;
+    options.startUs = 200000;
+    reader.Rewind();
+
+    QElapsedTimer timer;
+    timer.start();
+    if(reader.Replay(dispatcher,options,listData) != 2 ||
+       listData.size() != 2 || timer.elapsed() < 19)   {
+        qDebug() << "Error: unexpected real time replay";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+    reader.Close();
+    QFile::remove(filePath);
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool compare_batch_time(obdref::BatchResult const &a,
+                        obdref::BatchResult const &b)
+{
+    return (a.timestampUs < b.timestampUs);
+}
+
+bool test_batch(obdref::Parser & parser,
+                QString const &filePath)
+{
+    QStringList listCapturePaths;
+    listCapturePaths << "test_batch_0.obdcap" << "test_batch_1.obdcap";
+
+    // two drives with a response every 10ms for 30s;
+    // the second starts 5ms after the first
+    int const numFrames = 3000;
+    for(int c=0; c < listCapturePaths.size(); c++)   {
+        obdref::CaptureWriter writer;
+        writer.Open(listCapturePaths[c]);
+        for(int i=0; i < numFrames; i++)   {
+            obdref::ByteList rawFrame;
+            rawFrame << 0x18 << 0xDA << 0xF1 << 0x10
+                     << 0x07 << 0x62 << 0xF4 << 0x10
+                     << obdref::ubyte(c) << obdref::ubyte(i >> 16)
+                     << obdref::ubyte(i >> 8) << obdref::ubyte(i);
+            writer.WriteFrame(qint64(i)*10000+c*5000,0,4,rawFrame);
+        }
+        writer.Close();
+    }
+
+    obdref::ReplayOptions replay;
+    replay.parseIntervalUs = 50000;
+
+    // replay each capture serially as a reference
+    QList<obdref::BatchResult> listExpected;
+    for(int c=0; c < listCapturePaths.size(); c++)   {
+        obdref::FrameDispatcher dispatcher(&parser);
+        dispatcher.AddParameters("TEST","ISO 15765 Extended Id","Default");
+
+        QList<obdref::Data> listData;
+        QList<qint64> listTimestampUs;
+        obdref::CaptureReader reader;
+        reader.Open(listCapturePaths[c]);
+        reader.Replay(dispatcher,replay,listData,&listTimestampUs);
+
+        for(int i=0; i < listData.size(); i++)   {
+            obdref::BatchResult result;
+            result.timestampUs = listTimestampUs[i];
+            result.captureIdx = c;
+            result.data = listData[i];
+            listExpected.append(result);
+        }
+    }
+    qStableSort(listExpected.begin(),listExpected.end(),compare_batch_time);
+
+    bool initOk=false;
+    obdref::BatchDecoder decoder(filePath,initOk);
+    decoder.AddParameters("TEST","ISO 15765 Extended Id","Default");
+
+    obdref::BatchOptions options;
+    options.numThreads = 4;
+    options.shardUs = 990000;    // rounded up to 1s
+    options.replay = replay;
+
+    QList<obdref::BatchResult> listResults;
+    if(!initOk || !decoder.Decode(listCapturePaths,options,listResults) ||
+       decoder.GetStats().numShards != 60 ||
+       decoder.GetStats().numFrames != 2*numFrames ||
+       listResults.size() != listExpected.size() ||
+       listResults.size() < 2*numFrames)   {
+        qDebug() << "Error: unexpected batch decode:"
+                 << listResults.size() << "results,"
+                 << listExpected.size() << "expected,"
+                 << decoder.GetStats().numShards << "shards";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // results should match the serial replay
+    // once it's merged by time
+    bool mergeOk=true;
+    for(int i=0; mergeOk && i < listResults.size(); i++)   {
+        obdref::BatchResult const &result = listResults[i];
+        obdref::BatchResult const &expected = listExpected[i];
+        mergeOk = result.timestampUs == expected.timestampUs &&
+                  result.captureIdx == expected.captureIdx &&
+                  result.data.paramName == expected.data.paramName &&
+                  result.data.listNumericalData.size() ==
+                    expected.data.listNumericalData.size();
+
+        for(int k=0; mergeOk && k < result.data.listNumericalData.size(); k++)   {
+            mergeOk = (result.data.listNumericalData[k].value ==
+                       expected.data.listNumericalData[k].value);
+        }
+    }
+
+    // a single thread gives the same results
+    QList<obdref::BatchResult> listResultsOneThread;
+    options.numThreads = 1;
+    mergeOk = mergeOk &&
+        decoder.Decode(listCapturePaths,options,listResultsOneThread) &&
+        listResultsOneThread.size() == listResults.size() &&
+        listResultsOneThread.last().timestampUs == listResults.last().timestampUs &&
+        decoder.GetStats().numStolen == 0;
+
+    for(int c=0; c < listCapturePaths.size(); c++)   {
+        QFile::remove(listCapturePaths[c]);
+    }
+
+    if(!mergeOk)   {
+        qDebug() << "Error: batch results don't match serial replay";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_log_import(obdref::Parser & parser)
+{
+    QString const candumpPath("test_log_import.log");
+    QString const ascPath("test_log_import.asc");
+    QString const capturePath("test_log_import.obdcap");
+
+    // candump -l; the error, remote and FD frames
+    // and the bad line should be skipped
+    {
+        QFile file(candumpPath);
+        file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+        file.write("(1436509052.249713) can0 18DAF110#0762F41001020304\n"
+                   "(1436509052.250713) can1 7E8#03410D2A\r\n"
+                   "(1436509052.251713) can0 20000080#0000000000000000\n"
+                   "(1436509052.252713) can0 7DF#R\n"
+                   "(1436509052.253713) can0 7E8##1112233\n"
+                   "(1436509052.254713) can0 7E8#0341Z\n"
+                   "\n"
+                   "(1436509052.349713) can0 18DAF110#0762F41001020305");
+    }
+
+    obdref::LogImporter importer;
+    obdref::CapturedFrame frame;
+    obdref::ByteList frameOk;
+    frameOk << 0x18 << 0xDA << 0xF1 << 0x10
+            << 0x07 << 0x62 << 0xF4 << 0x10 << 0x01 << 0x02 << 0x03 << 0x04;
+
+    bool readOk = importer.Open(candumpPath) &&
+                  importer.GetFormat() == obdref::LOG_FORMAT_CANDUMP &&
+                  importer.GetStartTimeMs() == 1436509052249LL &&
+                  importer.ReadNext(frame) &&
+                  frame.timestampUs == 0 && frame.channel == 0 &&
+                  frame.headerLength == 4 && frame.rawFrame == frameOk &&
+                  importer.ReadNext(frame) &&
+                  frame.timestampUs == 1000 && frame.channel == 1 &&
+                  frame.headerLength == 2 && frame.rawFrame.size() == 6 &&
+                  frame.rawFrame[0] == 0x07 && frame.rawFrame[1] == 0xE8 &&
+                  frame.rawFrame[5] == 0x2A &&
+                  importer.ReadNext(frame) &&
+                  frame.timestampUs == 100000 && frame.rawFrame[11] == 0x05 &&
+                  !importer.ReadNext(frame) &&
+                  importer.GetLineCount() == 8 &&
+                  importer.GetSkippedLineCount() == 4 &&
+                  importer.GetChannelNames().size() == 2 &&
+                  importer.GetChannelNames()[1] == "can1";
+    if(!readOk)   {
+        qDebug() << "Error: unexpected frames from candump log";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // ASC with relative timestamps; the header, error,
+    // remote and CAN FD lines should be skipped
+    {
+        QFile file(ascPath);
+        file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+        file.write("date Sat Jul 11 10:17:32.249 am 2015\n"
+                   "base hex  timestamps relative\n"
+                   "internal events logged\n"
+                   "// version 8.0.0\n"
+                   "Begin Triggerblock Sat Jul 11 10:17:32.249 am 2015\n"
+                   "   0.000000 Start of measurement\n"
+                   "   0.010000 1  18DAF110x       Rx   d 8 07 62 F4 10 01 02 03 04  Length = 272000 BitCount = 140 ID = 417001744x\n"
+                   "   0.001000 2  7E8             Rx   d 4 03 41 0D 2A\n"
+                   "   0.001000 1  ErrorFrame\n"
+                   "   0.001000 1  7DF             Tx   r\n"
+                   "   0.001000 CANFD   1 Rx 7E8 1 0 8 8 03 41 0D 2A 00 00 00 00\n"
+                   "   0.096000 1  18DAF110x       Rx   d 8 07 62 F4 10 01 02 03 05\n"
+                   "End TriggerBlock\n");
+    }
+
+    readOk = importer.Open(ascPath) &&
+             importer.GetFormat() == obdref::LOG_FORMAT_ASC &&
+             importer.ReadNext(frame) &&
+             frame.timestampUs == 0 && frame.channel == 1 &&
+             frame.headerLength == 4 && frame.rawFrame == frameOk &&
+             importer.ReadNext(frame) &&
+             frame.timestampUs == 1000 && frame.channel == 2 &&
+             frame.headerLength == 2 && frame.rawFrame.size() == 6 &&
+             frame.rawFrame[5] == 0x2A &&
+             importer.ReadNext(frame) &&
+             frame.timestampUs == 100000 && frame.rawFrame[11] == 0x05 &&
+             !importer.ReadNext(frame) &&
+             importer.GetLineCount() == 13 &&
+             importer.GetSkippedLineCount() == 4;
+    if(!readOk)   {
+        qDebug() << "Error: unexpected frames from ASC log";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // both responses should be decoded with the definitions,
+    // from the log and after converting it to a capture
+    obdref::ParameterFrame param;
+    param.spec = "TEST";
+    param.protocol = "ISO 15765 Extended Id";
+    param.address = "Default";
+    param.name = "T_UDS_DID_4_BYTES";
+
+    obdref::FrameDispatcher dispatcher(&parser);
+    if(!parser.BuildParameterFrame(param) ||
+       !dispatcher.AddParameterFrame(param))   {
+        qDebug() << "Error: could not build frame "
+                    "for param:" << param.name;
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    QList<obdref::Data> listData;
+    obdref::ReplayOptions options;
+    options.channel = 1;
+    importer.Rewind();
+    qint64 const numReplayed = importer.Replay(dispatcher,options,listData);
+
+    QList<obdref::Data> listCaptureData;
+    obdref::CaptureReader reader;
+    bool const convertOk = (importer.ConvertToCapture(capturePath) == 3) &&
+        reader.Open(capturePath) && reader.GetFrameCount() == 3 &&
+        reader.Replay(dispatcher,options,listCaptureData) == 2;
+    reader.Close();
+    importer.Close();
+
+    QFile::remove(candumpPath);
+    QFile::remove(ascPath);
+    QFile::remove(capturePath);
+
+    if(numReplayed != 2 || listData.size() != 2 ||
+       !convertOk || listCaptureData.size() != 2)   {
+        qDebug() << "Error: unexpected replay:" << numReplayed
+                 << "frames" << listData.size() << "data";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_timeseries(obdref::Parser & parser)
+{
+    // four values to a segment; speed is numerical
+    // and alternates every second, gear is a literal
+    obdref::TimeSeriesStore store(4);
+    for(int i=0; i < 10; i++)   {
+        obdref::NumericalData numData;
+        numData.property = "Speed";
+        numData.units = "km/h";
+        numData.value = i*10;
+
+        obdref::LiteralData litData;
+        litData.property = "Gear";
+        litData.value = (i%2 == 0);
+        litData.valueIfTrue = "Drive";
+        litData.valueIfFalse = "Neutral";
+
+        obdref::Data data;
+        data.paramName = "T_SPEED";
+        data.srcName = "ECU";
+        data.listNumericalData << numData;
+        data.listLiteralData << litData;
+
+        // the last value is out of order
+        store.Add((i < 9) ? qint64(i)*1000000 : 0,data);
+    }
+
+    int const speedIdx = store.FindColumn("T_SPEED","ECU","Speed");
+    int const gearIdx = store.FindColumn("T_SPEED","ECU","Gear");
+    obdref::ColumnInfo const speedInfo = store.GetColumnInfo(speedIdx);
+    obdref::ColumnInfo const gearInfo = store.GetColumnInfo(gearIdx);
+
+    QList<obdref::ColumnView> listViews;
+    store.GetRange(speedIdx,2500000,6000000,listViews);
+
+    QVector<qint64> listTimestampUs;
+    QVector<double> listValues;
+    int const numCopied = store.CopyRange(speedIdx,-1,-1,listTimestampUs,listValues);
+
+    bool storeOk = store.GetColumnCount() == 2 &&
+        speedIdx >= 0 && gearIdx >= 0 &&
+        store.FindColumn("T_SPEED","ECU2","Speed") < 0 &&
+        speedInfo.units == "km/h" && !speedInfo.isLiteral &&
+        speedInfo.numValues == 10 && gearInfo.isLiteral &&
+        store.GetLiteralCount() == 2 &&
+        store.GetMemoryBytes() == 3*4*(8+8) + 3*4*(8+4) &&
+        listViews.size() == 2 &&
+        listViews[0].size == 1 && listViews[0].timestampUs[0] == 3000000 &&
+        listViews[0].values[0] == 30 && listViews[0].codes == NULL &&
+        listViews[1].size == 3 && listViews[1].timestampUs[2] == 6000000 &&
+        numCopied == 10 && listTimestampUs[9] == 8000000 &&
+        listValues[9] == 90;
+
+    listViews.clear();
+    store.GetRange(gearIdx,1000000,1000000,listViews);
+    storeOk = storeOk && listViews.size() == 1 && listViews[0].size == 1 &&
+        store.GetLiteral(listViews[0].codes[0]) == "Neutral";
+
+    if(!storeOk)   {
+        qDebug() << "Error: unexpected values in time series store";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // with two segments, the oldest values are
+    // overwritten once both are full
+    obdref::TimeSeriesStore ringStore(4,2);
+    obdref::Data data;
+    data.paramName = "T_SPEED";
+    data.listNumericalData << obdref::NumericalData();
+    for(int i=0; i < 10; i++)   {
+        data.listNumericalData[0].value = i;
+        ringStore.Add(qint64(i),data);
+    }
+    listTimestampUs.clear();
+    listValues.clear();
+    ringStore.CopyRange(0,-1,-1,listTimestampUs,listValues);
+    if(ringStore.GetColumnInfo(0).numValues != 6 ||
+       ringStore.GetColumnInfo(0).numDropped != 4 ||
+       listValues.size() != 6 || listValues[0] != 4 || listValues[5] != 9)   {
+        qDebug() << "Error: unexpected values in time series ring";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // a replay into a store should keep the same
+    // values as a replay into a list
+    QString const filePath("test_timeseries.obdcap");
+    obdref::ByteList rawFrame;
+    rawFrame << 0x18 << 0xDA << 0xF1 << 0x10
+             << 0x07 << 0x62 << 0xF4 << 0x10 << 0x01 << 0x02 << 0x03 << 0x04;
+
+    obdref::CaptureWriter writer;
+    writer.Open(filePath);
+    for(int i=0; i < 50; i++)   {
+        writer.WriteFrame(qint64(i)*200000,0,4,rawFrame);
+    }
+    writer.Close();
+
+    obdref::ParameterFrame param;
+    param.spec = "TEST";
+    param.protocol = "ISO 15765 Extended Id";
+    param.address = "Default";
+    param.name = "T_UDS_DID_4_BYTES";
+
+    obdref::FrameDispatcher dispatcher(&parser);
+    if(!parser.BuildParameterFrame(param) ||
+       !dispatcher.AddParameterFrame(param))   {
+        qDebug() << "Error: could not build frame "
+                    "for param:" << param.name;
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    obdref::ReplayOptions options;
+    obdref::CaptureReader reader;
+    QList<obdref::Data> listData;
+    QList<qint64> listDataTimestampUs;
+    reader.Open(filePath);
+    reader.Replay(dispatcher,options,listData,&listDataTimestampUs);
+
+    obdref::TimeSeriesStore replayStore;
+    reader.Rewind();
+    qint64 const numReplayed = reader.Replay(dispatcher,options,replayStore);
+    reader.Close();
+    QFile::remove(filePath);
+
+    obdref::TimeSeriesStore listStore;
+    listStore.Add(listDataTimestampUs,listData);
+
+    storeOk = numReplayed == 50 && listData.size() == 50 &&
+        replayStore.GetColumnCount() > 0 &&
+        replayStore.GetColumnCount() == listStore.GetColumnCount();
+
+    for(int i=0; storeOk && i < replayStore.GetColumnCount(); i++)   {
+        listViews.clear();
+        replayStore.GetRange(i,-1,-1,listViews);
+        obdref::ColumnInfo const info = replayStore.GetColumnInfo(i);
+        storeOk = info.paramName == param.name &&
+            info.numValues == 50 && listViews.size() == 1 &&
+            listViews[0].timestampUs[49] == 49*200000 &&
+            listStore.GetColumnInfo(i).numValues == 50;
+    }
+    if(!storeOk)   {
+        qDebug() << "Error: unexpected replay into time series store";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_dispatcher_split(obdref::Parser & parser)
+{
+    // a parse that runs between a first frame and its
+    // consecutive frames shouldn't split the message
+    obdref::ParameterFrame param;
+    param.spec = "TEST";
+    param.protocol = "ISO 15765 Extended Id";
+    param.address = "Default";
+    param.name = "T_UDS_DID_4_BYTES";
+
+    obdref::FrameDispatcher dispatcher(&parser);
+    if(!parser.BuildParameterFrame(param) ||
+       !dispatcher.AddParameterFrame(param))   {
+        qDebug() << "Error: could not build frame "
+                    "for param:" << param.name;
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    obdref::ByteList frameFF;
+    frameFF << 0x18 << 0xDA << 0xF1 << 0x10
+            << 0x10 << 0x0A << 0x62 << 0xF4 << 0x10 << 0x01 << 0x02 << 0x03;
+
+    obdref::ByteList frameCF;
+    frameCF << 0x18 << 0xDA << 0xF1 << 0x10
+            << 0x21 << 0x04 << 0x05 << 0x06 << 0x07 << 0x00 << 0x00 << 0x00;
+
+    QList<obdref::Data> listData;
+    dispatcher.DispatchFrame(frameFF);
+    dispatcher.ParseDispatchedFrames(listData);
+    bool const waitedOk = listData.isEmpty();
+
+    dispatcher.DispatchFrame(frameCF);
+    dispatcher.ParseDispatchedFrames(listData);
+
+    // a single frame parsed on its own afterwards
+    obdref::ByteList frameSF;
+    frameSF << 0x18 << 0xDA << 0xF1 << 0x10
+            << 0x07 << 0x62 << 0xF4 << 0x10 << 0x01 << 0x02 << 0x03 << 0x04;
+    dispatcher.DispatchFrame(frameSF);
+    dispatcher.ParseDispatchedFrames(listData);
+
+    obdref::RejectStats const &rejectStats =
+        dispatcher.GetParameterFrames()[0].listMessageData[0].rejectStats;
+
+    if(!waitedOk || listData.size() != 2 ||
+       rejectStats.sequenceGap != 0 || rejectStats.truncated != 0)   {
+        qDebug() << "Error: multi-frame message was split:"
+                 << listData.size() << "data"
+                 << rejectStats.sequenceGap << "sequence gaps"
+                 << rejectStats.truncated << "truncated";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_script_errors()
+{
+    QString const definitions(
+        "<spec name=\"TEST\">"
+        "<protocol name=\"ISO 9141-2\">"
+        "<address name=\"Default\">"
+        "<request prio=\"0x68\" target=\"0x6A\" source=\"0xF1\" />"
+        "<response prio=\"0x48\" target=\"0x6B\" />"
+        "</address>"
+        "</protocol>"
+        "<parameters address=\"Default\">"
+        "<parameter name=\"T_BROKEN\" request=\"0x22 0x04\""
+        " response.prefix=\"0x62 0x04\" response.bytes=\"1\">"
+        "<script>var x = ;</script>"
+        "</parameter>"
+        "<parameter name=\"T_VALID\" request=\"0x22 0x05\""
+        " response.prefix=\"0x62 0x05\" response.bytes=\"1\">"
+        "<script>"
+        "var jsData = new NumericalDataObj();"
+        "jsData.units = \"\";"
+        "jsData.value = BYTE(0);"
+        "saveNumericalData(jsData);"
+        "</script>"
+        "</parameter>"
+        "</parameters>"
+        "</spec>");
+
+    bool initOk=false;
+    obdref::Parser parser("",definitions,initOk);
+    obdref::Parser otherParser("",definitions,initOk);
+
+    // a syntax error fails the build instead of aborting
+    obdref::ParameterFrame brokenParam;
+    brokenParam.spec = "TEST";
+    brokenParam.protocol = "ISO 9141-2";
+    brokenParam.address = "Default";
+    brokenParam.name = "T_BROKEN";
+    if(!initOk || parser.BuildParameterFrame(brokenParam))   {
+        qDebug() << "Error: built a parameter with a broken script";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // otherParser hasn't compiled the function the
+    // frame uses, so it's compiled when parsing
+    obdref::ParameterFrame param;
+    param.spec = "TEST";
+    param.protocol = "ISO 9141-2";
+    param.address = "Default";
+    param.name = "T_VALID";
+    obdref::ByteList rawFrame;
+    rawFrame << 0x48 << 0x6B << 0x10 << 0x62 << 0x05 << 0x2A;
+
+    QList<obdref::Data> listData;
+    QList<obdref::Data> listOtherData;
+    bool parsedOk = parser.BuildParameterFrame(param);
+    param.listMessageData[0].listRawFrames << rawFrame;
+    parsedOk = parsedOk && parser.ParseParameterFrame(param,listData) &&
+               otherParser.ParseParameterFrame(param,listOtherData);
+
+    if(!parsedOk || listData.size() != 1 || listOtherData.size() != 1 ||
+       listData[0].listNumericalData.size() != 1 ||
+       listOtherData[0].listNumericalData.size() != 1 ||
+       listOtherData[0].listNumericalData[0].value != 42)   {
+        qDebug() << "Error: could not parse after a script error";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+
+#ifdef Q_OS_LINUX
+bool test_socketcan(obdref::Parser & parser)
+{
+    obdref::ParameterFrame extParam;
+    extParam.spec = "TEST";
+    extParam.protocol = "ISO 15765 Extended Id";
+    extParam.address = "Default";
+    extParam.name = "T_UDS_DID_4_BYTES";
+
+    obdref::ParameterFrame stdParam = extParam;
+    stdParam.protocol = "ISO 15765 Standard Id";
+
+    if(!parser.BuildParameterFrame(extParam) ||
+       !parser.BuildParameterFrame(stdParam))   {
+        qDebug() << "Error: could not build frames";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // filters covered by existing ones aren't added
+    obdref::SocketCanReader reader;
+    reader.AddParameterFrame(extParam);
+    reader.AddParameterFrame(extParam);
+
+    obdref::CanFilter filter;
+    filter.id = 0x18DAF110;
+    filter.mask = 0x1FFFFFFF;
+    filter.extendedId = true;
+    reader.AddFilter(filter);
+
+    QList<obdref::CanFilter> listFilters = reader.GetFilters();
+    if(listFilters.size() != 1 ||
+       listFilters[0].id != 0x18DAF100 ||
+       listFilters[0].mask != 0x1FFFFF00 ||
+       !listFilters[0].extendedId)   {
+        qDebug() << "Error: unexpected extended id filters";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // 11-bit response ids are derived from the request
+    // id when they aren't given: a functional request
+    // accepts 0x7E8-0x7EF and a physical one its id + 8
+    QString const definitions(
+        "<spec name=\"TEST\">"
+        "<protocol name=\"ISO 15765 Standard Id\">"
+        "<address name=\"Functional\"><request identifier=\"0x7DF\" /></address>"
+        "<address name=\"Physical\"><request identifier=\"0x7E2\" /></address>"
+        "</protocol>"
+        "<parameters address=\"Functional\">"
+        "<parameter name=\"T_PID\" request=\"0x01 0x0D\""
+        " response.prefix=\"0x41 0x0D\" response.bytes=\"1\">"
+        "<script></script></parameter>"
+        "</parameters>"
+        "<parameters address=\"Physical\">"
+        "<parameter name=\"T_PID\" request=\"0x01 0x0D\""
+        " response.prefix=\"0x41 0x0D\" response.bytes=\"1\">"
+        "<script></script></parameter>"
+        "</parameters>"
+        "</spec>");
+
+    bool initOk=false;
+    obdref::Parser idParser("",definitions,initOk);
+
+    obdref::ParameterFrame funcParam;
+    funcParam.spec = "TEST";
+    funcParam.protocol = "ISO 15765 Standard Id";
+    funcParam.address = "Functional";
+    funcParam.name = "T_PID";
+
+    obdref::ParameterFrame ecuParam = funcParam;
+    ecuParam.address = "Physical";
+
+    if(!initOk || !idParser.BuildParameterFrame(funcParam) ||
+       !idParser.BuildParameterFrame(ecuParam))   {
+        qDebug() << "Error: could not build 11-bit frames";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+    obdref::MessageData const &funcMsg = funcParam.listMessageData[0];
+    obdref::MessageData const &ecuMsg = ecuParam.listMessageData[0];
+    if(funcMsg.expHeaderBytes[0] != 0x07 || funcMsg.expHeaderBytes[1] != 0xE8 ||
+       funcMsg.expHeaderMask[0] != 0x07 || funcMsg.expHeaderMask[1] != 0xF8 ||
+       ecuMsg.expHeaderBytes[0] != 0x07 || ecuMsg.expHeaderBytes[1] != 0xEA ||
+       ecuMsg.expHeaderMask[0] != 0x07 || ecuMsg.expHeaderMask[1] != 0xFF)   {
+        qDebug() << "Error: unexpected 11-bit response headers";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // the physical filter is covered by the functional one
+    reader.AddParameterFrame(stdParam);
+    reader.AddParameterFrame(ecuParam);
+    reader.AddParameterFrame(funcParam);
+    filter.id = 0x7E8;
+    filter.mask = 0x7FF;
+    filter.extendedId = false;
+    reader.AddFilter(filter);
+
+    listFilters = reader.GetFilters();
+    if(listFilters.size() != 2 ||
+       listFilters[1].id != 0x7E8 ||
+       listFilters[1].mask != 0x7F8 ||
+       listFilters[1].extendedId)   {
+        qDebug() << "Error: unexpected standard id filters";
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return false;
+    }
+
+    // loop frames back through vcan0 if it's available
+    reader.ClearFilters();
+    reader.AddParameterFrame(extParam);
+
+    obdref::SocketCanReader writer;
+    if(reader.Open("vcan0") && writer.Open("vcan0"))
+    {
+        obdref::ByteList frameOk,frameOther,frameStd;
+        frameOk << 0x18 << 0xDA << 0xF1 << 0x10
+                << 0x07 << 0x62 << 0xF4 << 0x10 << 0x01 << 0x02 << 0x03 << 0x04;
+        frameOther << 0x18 << 0xDB << 0x33 << 0xF1
+                   << 0x03 << 0x22 << 0xF4 << 0x10;
+        frameStd << 0x07 << 0xE8
+                 << 0x07 << 0x62 << 0xF4 << 0x10 << 0x01 << 0x02 << 0x03 << 0x04;
+
+        writer.WriteFrame(frameOther,true);
+        writer.WriteFrame(frameStd,false);
+        writer.WriteFrame(frameOk,true);
+
+        QList<obdref::ByteList> listRawFrames;
+        reader.ReadFrames(listRawFrames,100);
+
+        QList<obdref::Data> listData;
+        extParam.listMessageData[0].listRawFrames = listRawFrames;
+        if(listRawFrames.size() != 1 || listRawFrames[0] != frameOk ||
+           !parser.ParseParameterFrame(extParam,listData))   {
+            qDebug() << "Error: unexpected frames read from vcan0";
+            qDebug() << "////////////////////////////////////////////////";
+            qDebug() << g_test_desc << "failed!";
+            return false;
+        }
+    }
+
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+    return true;
+}
+#endif
@@ -0,0 +1,271 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include <QAtomicInt>
+#include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+
+#include "obdrefdebug.h"
+
+// test_debug
+// * logs from several threads with OBDREF_DEBUG_BROADCAST
+//   (see test_debug.pro) and checks that each thread's
+//   messages are broadcast in order, that long messages
+//   are cut and that messages that don't fit in a full
+//   ring are counted as dropped
+// * a receiver that calls FlushDebug must not deadlock
+// * usage: ./test_debug
+
+// messages logged by each thread (less than
+// the ring size so none are dropped)
+static int const NUM_THREADS = 4;
+static int const NUM_MESSAGES = 100;
+
+// must match RING_SIZE in obdrefdebug.cpp
+static int const RING_SIZE = 256;
+
+static QString g_test_desc;
+
+// DebugReceiver
+// * saves every message it receives; "block" holds up
+//   the thread emitting it until Release is called and
+//   "flush" calls FlushDebug from within the receiver
+class DebugReceiver : public QObject
+{
+    Q_OBJECT
+
+public:
+    DebugReceiver() :
+        m_blocked(0),
+        m_release(0)
+    {}
+
+    QStringList TakeMessages()
+    {
+        QMutexLocker locker(&m_mutex);
+        QStringList listMessages = m_listMessages;
+        m_listMessages.clear();
+        return listMessages;
+    }
+
+    bool IsBlocked()
+    {   return (m_blocked.loadAcquire() != 0);   }
+
+    void Release()
+    {   m_release.storeRelease(1);   }
+
+public slots:
+    void onDebug(QString timestamp,QString msg)
+    {
+        Q_UNUSED(timestamp);
+        if(msg == "block")   {
+            m_blocked.storeRelease(1);
+            while(m_release.loadAcquire() == 0)   {
+                QThread::msleep(1);
+            }
+            m_blocked.storeRelease(0);
+            return;
+        }
+        if(msg == "flush")   {
+            obdref::FlushDebug();
+        }
+        QMutexLocker locker(&m_mutex);
+        m_listMessages.push_back(msg);
+    }
+
+private:
+    QMutex m_mutex;
+    QStringList m_listMessages;
+    QAtomicInt m_blocked;
+    QAtomicInt m_release;
+};
+
+class LogThread : public QThread
+{
+public:
+    LogThread(int threadIdx) :
+        m_threadIdx(threadIdx)
+    {}
+
+protected:
+    void run()
+    {
+        for(int i=0; i < NUM_MESSAGES; i++)   {
+            OBDREFDEBUG << "thread " << m_threadIdx << " msg " << i;
+        }
+    }
+
+private:
+    int m_threadIdx;
+};
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_order(DebugReceiver &receiver)
+{
+    OBDREFDEBUG << "flush";
+
+    QList<LogThread*> listThreads;
+    for(int i=0; i < NUM_THREADS; i++)   {
+        listThreads.push_back(new LogThread(i));
+        listThreads.back()->start();
+    }
+    for(int i=0; i < listThreads.size(); i++)   {
+        listThreads[i]->wait();
+        delete listThreads[i];
+    }
+    obdref::FlushDebug();
+
+    QStringList listMessages = receiver.TakeMessages();
+    if(!listMessages.contains("flush"))   {
+        qDebug() << "Error: flush message missing";
+        return false;
+    }
+
+    QList<int> listNextMsg;
+    for(int i=0; i < NUM_THREADS; i++)   {
+        listNextMsg.push_back(0);
+    }
+    for(int i=0; i < listMessages.size(); i++)   {
+        QStringList listParts = listMessages[i].split(" ");
+        if(listParts.size() != 4 || listParts[0] != "thread")   {
+            continue;
+        }
+        int const threadIdx = listParts[1].toInt();
+        int const msgIdx = listParts[3].toInt();
+        if(threadIdx < 0 || threadIdx >= NUM_THREADS ||
+           msgIdx != listNextMsg[threadIdx])   {
+            qDebug() << "Error: out of order message:" << listMessages[i];
+            return false;
+        }
+        listNextMsg[threadIdx]++;
+    }
+    for(int i=0; i < NUM_THREADS; i++)   {
+        if(listNextMsg[i] != NUM_MESSAGES)   {
+            qDebug() << "Error: thread" << i << "sent"
+                     << listNextMsg[i] << "messages";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool test_truncation(DebugReceiver &receiver)
+{
+    QString const longMsg(300,QChar('a'));
+    QByteArray const longBytes(300,'b');
+    OBDREFDEBUG << longMsg << 12345;
+    OBDREFDEBUG << "c" << longBytes.constData();
+    obdref::FlushDebug();
+
+    QStringList listMessages = receiver.TakeMessages();
+    if(listMessages.size() != 2 ||
+       listMessages[0] != QString(obdref::Debug::MAX_MSG_LENGTH,QChar('a')) ||
+       listMessages[1].size() != obdref::Debug::MAX_MSG_LENGTH ||
+       !listMessages[1].startsWith("cb"))   {
+        qDebug() << "Error: long messages weren't cut:" << listMessages;
+        return false;
+    }
+    return true;
+}
+
+bool test_dropped(DebugReceiver &receiver)
+{
+    // hold up the drain thread so the ring fills up
+    OBDREFDEBUG << "block";
+    while(!receiver.IsBlocked())   {
+        QThread::msleep(1);
+    }
+    for(int i=0; i < 2*RING_SIZE; i++)   {
+        OBDREFDEBUG << "drop " << i;
+    }
+    receiver.Release();
+    while(receiver.IsBlocked())   {
+        QThread::msleep(1);
+    }
+    obdref::FlushDebug();
+
+    QStringList listMessages = receiver.TakeMessages();
+    QString const expDropped("Warn: Debug: dropped " +
+                             QString::number(RING_SIZE) + " message(s)");
+
+    if(listMessages.size() != RING_SIZE+1 ||
+       listMessages.back() != expDropped)   {
+        qDebug() << "Error: unexpected messages after dropping"
+                 << listMessages.size() << listMessages.value(RING_SIZE);
+        return false;
+    }
+    for(int i=0; i < RING_SIZE; i++)   {
+        if(listMessages[i] != "drop " + QString::number(i))   {
+            qDebug() << "Error: unexpected message:" << listMessages[i];
+            return false;
+        }
+    }
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+int main()
+{
+    // direct connections run the receiver in
+    // whichever thread drains the messages
+    DebugReceiver receiver;
+    QObject::connect(obdref::g_debug_broadcast,SIGNAL(debug(QString,QString)),
+                     &receiver,SLOT(onDebug(QString,QString)),
+                     Qt::DirectConnection);
+
+    g_test_desc = "test debug message order";
+    if(!test_order(receiver))   {
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return -1;
+    }
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+
+    g_test_desc = "test debug message truncation";
+    if(!test_truncation(receiver))   {
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return -1;
+    }
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+
+    g_test_desc = "test debug dropped messages";
+    if(!test_dropped(receiver))   {
+        qDebug() << "////////////////////////////////////////////////";
+        qDebug() << g_test_desc << "failed!";
+        return -1;
+    }
+    qDebug() << "////////////////////////////////////////////////";
+    qDebug() << g_test_desc << "passed!";
+
+    return 0;
+}
+
+#include "test_debug.moc"
@@ -17,6 +17,10 @@
 */
 
 #include "obdreftest.h"
+#include "framedispatcher.h"
+#include "bustimingmodel.h"
+#include "supportedpids.h"
+#include "respondermap.h"
 
 int bad_args()
 {
@@ -34,6 +38,35 @@ int test_failed()
     qDebug() << g_test_desc << "failed!";
 }
 
+bool test_dispatcher(obdref::Parser &parser,
+                     QString const &spec,
+                     QString const &protocol,
+                     QString const &address,
+                     QStringList const &listParams);
+
+bool test_coalesced(obdref::Parser &parser,
+                    QString const &spec,
+                    QString const &protocol,
+                    QString const &address,
+                    QStringList const &listParams);
+
+bool test_timing(obdref::Parser &parser,
+                 QString const &spec,
+                 QString const &protocol,
+                 QString const &address,
+                 QStringList const &listParams);
+
+bool test_supported_pids(obdref::Parser &parser,
+                         QString const &spec,
+                         QString const &protocol,
+                         QString const &address,
+                         QStringList const &listParams);
+
+bool test_responders(obdref::Parser &parser,
+                     QString const &spec,
+                     QString const &protocol,
+                     QString const &address);
+
 int main(int argc, char* argv[])
 {
     // we expect a single argument that specifies
@@ -118,7 +151,490 @@ int main(int argc, char* argv[])
         }
     }
 
+    if(!test_dispatcher(parser,spec,protocol,address,listParams))   {
+        return test_failed();
+    }
+
+    if(!test_coalesced(parser,spec,protocol,address,listParams))   {
+        return test_failed();
+    }
+
+    if(!test_timing(parser,spec,protocol,address,listParams))   {
+        return test_failed();
+    }
+
+    if(!test_supported_pids(parser,spec,protocol,address,listParams))   {
+        return test_failed();
+    }
+
+    if(!test_responders(parser,spec,protocol,address))   {
+        return test_failed();
+    }
+
     qDebug() << "////////////////////////////////////////////////";
     qDebug() << g_test_desc << "passed!";
     return 0;
 }
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_dispatcher(obdref::Parser &parser,
+                     QString const &spec,
+                     QString const &protocol,
+                     QString const &address,
+                     QStringList const &listParams)
+{
+    // simulate the frames seen on the bus if every
+    // parameter was requested once, and check that
+    // the dispatcher can route them back
+    QList<obdref::ByteList> listBusFrames;
+    for(int i=0; i < listParams.size(); i++)
+    {
+        obdref::ParameterFrame param;
+        param.spec = spec;
+        param.protocol = protocol;
+        param.address = address;
+        param.name = listParams[i];
+
+        if(!parser.BuildParameterFrame(param))   {
+            return false;
+        }
+
+        if(param.parseProtocol < 0xA00)   {
+            sim_vehicle_message_legacy(param,1,false);
+        }
+        else if(param.parseProtocol == obdref::PROTOCOL_ISO_14230)   {
+            sim_vehicle_message_iso14230(param,1,false);
+        }
+        else if(param.parseProtocol == obdref::PROTOCOL_ISO_15765)   {
+            sim_vehicle_message_iso15765(param,3,false);
+        }
+
+        for(int j=0; j < param.listMessageData.size(); j++)   {
+            listBusFrames << param.listMessageData[j].listRawFrames;
+        }
+    }
+
+    obdref::FrameDispatcher dispatcher(&parser);
+    if(!dispatcher.AddParameters(spec,protocol,address))   {
+        return false;
+    }
+
+    for(int i=0; i < listBusFrames.size(); i++)   {
+        dispatcher.DispatchFrame(listBusFrames[i]);
+    }
+
+    QList<obdref::Data> listData;
+    if(!dispatcher.ParseDispatchedFrames(listData))   {
+        qDebug() << "Error: could not parse dispatched frames";
+        return false;
+    }
+
+    QStringList listParsedNames;
+    for(int i=0; i < listData.size(); i++)   {
+        listParsedNames << listData[i].paramName;
+    }
+    for(int i=0; i < listParams.size(); i++)   {
+        if(!listParsedNames.contains(listParams[i]))   {
+            qDebug() << "Error: no dispatched frames parsed "
+                        "for param:" << listParams[i];
+            return false;
+        }
+    }
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_coalesced(obdref::Parser &parser,
+                    QString const &spec,
+                    QString const &protocol,
+                    QString const &address,
+                    QStringList const &listParams)
+{
+    QList<obdref::ParameterFrame> listParamFrames;
+    for(int i=0; i < listParams.size(); i++)
+    {
+        obdref::ParameterFrame param;
+        param.spec = spec;
+        param.protocol = protocol;
+        param.address = address;
+        param.name = listParams[i];
+
+        if(!parser.BuildParameterFrame(param))   {
+            return false;
+        }
+        listParamFrames << param;
+    }
+
+    QList<obdref::CoalescedFrame> listFrames;
+    QList<int> listParamIdxOther;
+    parser.BuildCoalescedFrames(listParamFrames,listFrames,listParamIdxOther);
+
+    if(listParamFrames[0].parseProtocol != obdref::PROTOCOL_ISO_15765)   {
+        // only ISO 15765 requests can be coalesced
+        return listFrames.isEmpty();
+    }
+
+    if(listFrames.isEmpty())   {
+        qDebug() << "Error: no coalesced frames";
+        return false;
+    }
+
+    for(int i=0; i < listFrames.size(); i++)
+    {
+        obdref::CoalescedFrame &frame = listFrames[i];
+
+        // simulate the combined response:
+        // [0x41] [pid0] [data0] [pid1] [data1] ...
+        obdref::ByteList catData;
+        catData << 0x41;
+        for(int j=0; j < frame.listParamIdx.size(); j++)   {
+            if(frame.listPids.indexOf(frame.listPids[j]) != j)   {
+                continue;   // shared pid
+            }
+            obdref::MessageData const &msg =
+                listParamFrames[frame.listParamIdx[j]].listMessageData[0];
+
+            catData << frame.listPids[j];
+            for(int k=0; k < msg.expDataByteCount; k++)   {
+                catData << obdref::ubyte(rand() % 255);
+            }
+        }
+
+        obdref::ByteList const &header = frame.msg.expHeaderBytes;
+        if(catData.size() <= 7)   {
+            obdref::ByteList rawFrame;
+            rawFrame << header << obdref::ubyte(catData.size()) << catData;
+            while(rawFrame.size() < header.size()+8)   {
+                rawFrame << 0x00;   // padding
+            }
+            frame.msg.listRawFrames << rawFrame;
+        }
+        else   {
+            obdref::ByteList rawFrame;
+            rawFrame << header
+                     << obdref::ubyte(0x10 | (catData.size() >> 8))
+                     << obdref::ubyte(catData.size() & 0xFF);
+            for(int k=0; k < 6; k++)   {
+                rawFrame << catData.takeAt(0);
+            }
+            frame.msg.listRawFrames << rawFrame;
+
+            obdref::ubyte pciByte = 0x21;
+            while(!catData.isEmpty())   {
+                rawFrame.clear();
+                rawFrame << header << pciByte;
+                for(int k=0; k < 7; k++)   {
+                    rawFrame << ((catData.isEmpty()) ? 0x00 : catData.takeAt(0));
+                }
+                frame.msg.listRawFrames << rawFrame;
+                pciByte = (pciByte == 0x2F) ? 0x20 : pciByte+1;
+            }
+        }
+
+        QList<obdref::Data> listData;
+        if(!parser.ParseCoalescedFrame(listParamFrames,frame,listData))   {
+            qDebug() << "Error: could not parse coalesced frame";
+            return false;
+        }
+
+        QStringList listParsedNames;
+        for(int j=0; j < listData.size(); j++)   {
+            listParsedNames << listData[j].paramName;
+        }
+        for(int j=0; j < frame.listParamIdx.size(); j++)   {
+            QString const &name = listParamFrames[frame.listParamIdx[j]].name;
+            if(!listParsedNames.contains(name))   {
+                qDebug() << "Error: no coalesced data for param:" << name;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_timing(obdref::Parser &parser,
+                 QString const &spec,
+                 QString const &protocol,
+                 QString const &address,
+                 QStringList const &listParams)
+{
+    QList<obdref::ParameterFrame> listParamFrames;
+    for(int i=0; i < listParams.size(); i++)   {
+        obdref::ParameterFrame param;
+        param.spec = spec;
+        param.protocol = protocol;
+        param.address = address;
+        param.name = listParams[i];
+        if(!parser.BuildParameterFrame(param))   {
+            qDebug() << "Error: could not build frame "
+                        "for param:" << listParams[i];
+            return false;
+        }
+        listParamFrames << param;
+    }
+
+    obdref::BusTimingModel model;
+    for(int i=0; i < listParamFrames.size(); i++)   {
+        if(listParamFrames[i].baudRate == 0 ||
+           model.GetParameterTimeUs(listParamFrames[i]) <= 0)   {
+            qDebug() << "Error: no timing for param:" << listParams[i];
+            return false;
+        }
+    }
+
+    // single frame request and response at 250 kbit/s
+    // (the lowest baud rate listed) with worst case
+    // bit stuffing: 135 or 160 bits per frame
+    if(protocol.contains("ISO 15765"))   {
+        int const idx = listParams.indexOf("Engine RPM");
+        if(idx < 0)   {
+            qDebug() << "Error: no Engine RPM param";
+            return false;
+        }
+        double const expTimeUs = (protocol.contains("Extended Id")) ?
+                    2*160*4.0 : 2*135*4.0;
+        double const timeUs = model.GetParameterTimeUs(listParamFrames[idx]);
+        if(qAbs(timeUs-expTimeUs) > 0.01)   {
+            qDebug() << "Error: unexpected timing for Engine RPM:" << timeUs;
+            return false;
+        }
+    }
+
+    // polling every parameter at the max sample
+    // rate should use the whole bus
+    double const maxRate = model.GetMaxSampleRate(listParamFrames);
+    for(int i=0; i < listParamFrames.size(); i++)   {
+        listParamFrames[i].pollRate = maxRate;
+    }
+    double const utilization = model.GetUtilization(listParamFrames);
+    if(qAbs(utilization-1.0) > 0.0001)   {
+        qDebug() << "Error: unexpected bus utilization:" << utilization;
+        return false;
+    }
+
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_supported_pids(obdref::Parser &parser,
+                         QString const &spec,
+                         QString const &protocol,
+                         QString const &address,
+                         QStringList const &listParams)
+{
+    if(protocol != "ISO 15765 Standard Id")   {
+        // the bitmaps are simulated as single frames from
+        // two ecus that differ by the last header byte
+        return true;
+    }
+
+    obdref::SupportedPids supportedPids(&parser);
+    if(!supportedPids.StartDiscovery(spec,protocol,address))   {
+        qDebug() << "Error: could not start pid discovery";
+        return false;
+    }
+
+    // two ecus respond: the first supports 0x0C (Engine RPM),
+    // the 0x20 bitmap (which only has the 0x40 bitmap) and
+    // 0x46 (Ambient Air Temperature); the second only
+    // supports 0x0D (Vehicle Speed)
+    obdref::ByteList listBitmapsEcu0,listBitmapsEcu1;
+    listBitmapsEcu0 << 0x00 << 0x10 << 0x00 << 0x01
+                    << 0x00 << 0x00 << 0x00 << 0x01
+                    << 0x04 << 0x00 << 0x00 << 0x00;
+    listBitmapsEcu1 << 0x00 << 0x08 << 0x00 << 0x00;
+
+    QList<int> listRequestedPids;
+    obdref::ParameterFrame bitmapFrame;
+    while(supportedPids.NextDiscoveryFrame(bitmapFrame))
+    {
+        obdref::MessageData &msg = bitmapFrame.listMessageData[0];
+        obdref::ubyte const pid = msg.expDataPrefix[1];
+        listRequestedPids << pid;
+
+        for(int i=0; i < 2; i++)   {
+            obdref::ByteList const &listBitmaps =
+                (i == 0) ? listBitmapsEcu0 : listBitmapsEcu1;
+            int const idxBitmap = (pid/0x20)*4;
+            if(idxBitmap >= listBitmaps.size())   {
+                continue;
+            }
+
+            obdref::ByteList rawFrame;
+            rawFrame << msg.expHeaderBytes;
+            rawFrame.last() = rawFrame.last()+i;
+            rawFrame << 0x06 << 0x41 << pid;
+            for(int j=0; j < 4; j++)   {
+                rawFrame << listBitmaps[idxBitmap+j];
+            }
+            rawFrame << 0x00;
+            msg.listRawFrames << rawFrame;
+        }
+
+        if(!supportedPids.SaveDiscoveryFrame(bitmapFrame))   {
+            qDebug() << "Error: could not save bitmap";
+            return false;
+        }
+    }
+
+    QList<int> listExpRequestedPids;
+    listExpRequestedPids << 0x00 << 0x20 << 0x40;
+    if(listRequestedPids != listExpRequestedPids ||
+       supportedPids.GetEcuHeaders().size() != 2)   {
+        qDebug() << "Error: unexpected discovery" << listRequestedPids;
+        return false;
+    }
+
+    obdref::ByteList ecuHeader1 = supportedPids.GetEcuHeaders()[0];
+    if(!supportedPids.IsPidSupported(0x0D,ecuHeader1))   {
+        ecuHeader1 = supportedPids.GetEcuHeaders()[1];
+    }
+
+    if(!supportedPids.IsPidSupported(0x0C) ||
+       !supportedPids.IsPidSupported(0x0D) ||
+       !supportedPids.IsPidSupported(0x46) ||
+       supportedPids.IsPidSupported(0x05) ||
+       supportedPids.IsPidSupported(0x42) ||
+       supportedPids.IsPidSupported(0x61) ||
+       supportedPids.IsPidSupported(0x0C,ecuHeader1))   {
+        qDebug() << "Error: unexpected supported pids";
+        return false;
+    }
+
+    QStringList listSupportedParams =
+        parser.GetParameterNames(spec,protocol,address,supportedPids);
+
+    if(!listSupportedParams.contains("Engine RPM") ||
+       !listSupportedParams.contains("Vehicle Speed") ||
+       !listSupportedParams.contains("Ambient Air Temperature") ||
+       listSupportedParams.contains("Engine Coolant Temperature") ||
+       listSupportedParams.contains("Control Module Voltage") ||
+       listSupportedParams.size() >= listParams.size())   {
+        qDebug() << "Error: unexpected supported parameters";
+        return false;
+    }
+
+    // save and reload the bitmaps
+    QString const filePath("test_supported_pids.txt");
+    if(!supportedPids.SaveToFile(filePath,"1G1JC5444R7252367"))   {
+        qDebug() << "Error: could not save supported pids";
+        return false;
+    }
+
+    obdref::SupportedPids loadedPids(&parser);
+    obdref::SupportedPids otherPids(&parser);
+    bool const loadOk =
+        loadedPids.LoadFromFile(filePath,"1G1JC5444R7252367") &&
+        !otherPids.LoadFromFile(filePath,"1FTRX18W1XKA00001");
+    QFile::remove(filePath);
+
+    if(!loadOk ||
+       loadedPids.GetEcuHeaders().size() != 2 ||
+       !loadedPids.IsPidSupported(0x0C) ||
+       loadedPids.IsPidSupported(0x05) ||
+       loadedPids.IsPidSupported(0x0C,ecuHeader1))   {
+        qDebug() << "Error: could not load supported pids";
+        return false;
+    }
+
+    return true;
+}
+
+// ========================================================================== //
+// ========================================================================== //
+
+bool test_responders(obdref::Parser &parser,
+                     QString const &spec,
+                     QString const &protocol,
+                     QString const &address)
+{
+    if(protocol != "ISO 15765 Standard Id")   {
+        // responses are simulated as single frames
+        // from ecus 0x7E8 and 0x7E9
+        return true;
+    }
+
+    // Engine RPM is answered by 0x7E8,
+    // Vehicle Speed by 0x7E8 and 0x7E9
+    QStringList listNames;
+    listNames << "Engine RPM" << "Vehicle Speed";
+
+    obdref::ResponderMap responderMap;
+    QList<obdref::ParameterFrame> listParamFrames;
+    for(int i=0; i < listNames.size(); i++)
+    {
+        obdref::ParameterFrame param;
+        param.spec = spec;
+        param.protocol = protocol;
+        param.address = address;
+        param.name = listNames[i];
+        if(!parser.BuildParameterFrame(param))   {
+            return false;
+        }
+
+        obdref::MessageData &msg = param.listMessageData[0];
+        for(int j=0; j <= i; j++)   {
+            obdref::ByteList rawFrame;
+            rawFrame << 0x07 << obdref::ubyte(0xE8+j)
+                     << obdref::ubyte(msg.expDataPrefix.size()+msg.expDataByteCount)
+                     << msg.expDataPrefix;
+            while(rawFrame.size() < 10)   {
+                rawFrame << 0x00;
+            }
+            msg.listRawFrames << rawFrame;
+        }
+
+        QList<obdref::Data> listData;
+        if(!parser.ParseParameterFrame(param,listData))   {
+            qDebug() << "Error: could not parse" << listNames[i];
+            return false;
+        }
+        responderMap.RecordResponders(param);
+        listParamFrames << param;
+    }
+
+    // a rebuilt frame should share the recorded responders
+    obdref::ParameterFrame rpmFrame;
+    rpmFrame.spec = spec;
+    rpmFrame.protocol = protocol;
+    rpmFrame.address = address;
+    rpmFrame.name = "Engine RPM";
+    parser.BuildParameterFrame(rpmFrame);
+
+    obdref::ParameterFrame physicalFrame;
+    if(!responderMap.BuildPhysicalFrame(rpmFrame,physicalFrame))   {
+        qDebug() << "Error: could not build physical frame";
+        return false;
+    }
+
+    obdref::ByteList expReqHeader,expRespHeader;
+    expReqHeader << 0x07 << 0xE0;
+    expRespHeader << 0x07 << 0xE8;
+    obdref::MessageData const &physicalMsg = physicalFrame.listMessageData[0];
+    if(physicalMsg.reqHeaderBytes != expReqHeader ||
+       physicalMsg.expHeaderBytes != expRespHeader ||
+       physicalMsg.expResponseCount != 1)   {
+        qDebug() << "Error: unexpected physical frame";
+        return false;
+    }
+
+    // two ecus answer Vehicle Speed
+    obdref::ParameterFrame &speedFrame = listParamFrames[1];
+    responderMap.ApplyResponseCounts(speedFrame);
+    if(responderMap.BuildPhysicalFrame(speedFrame,physicalFrame) ||
+       speedFrame.listMessageData[0].expResponseCount != 2)   {
+        qDebug() << "Error: unexpected responders for Vehicle Speed";
+        return false;
+    }
+
+    return true;
+}
@@ -5,3 +5,21 @@ test_basic.file = test_basic.pro
 
 SUBDIRS += test_spec
 test_spec.file = test_spec.pro
+
+SUBDIRS += test_alloc
+test_alloc.file = test_alloc.pro
+
+SUBDIRS += bench_framefilter
+bench_framefilter.file = bench_framefilter.pro
+
+SUBDIRS += bench_elm327
+bench_elm327.file = bench_elm327.pro
+
+SUBDIRS += bench_parser
+bench_parser.file = bench_parser.pro
+
+SUBDIRS += bench_startup
+bench_startup.file = bench_startup.pro
+
+SUBDIRS += test_debug
+test_debug.file = test_debug.pro
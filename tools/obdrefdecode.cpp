@@ -0,0 +1,265 @@
+/*
+   This source is part of libobdref
+
+   Copyright (C) 2012,2013 Preet Desai (preet.desai@gmail.com)
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+
+#include <cstdio>
+
+#include <QDebug>
+#include <QFile>
+#include <QThread>
+
+#include "batchdecoder.h"
+#include "logimporter.h"
+
+// obdrefdecode
+// * decodes recorded captures (see CaptureWriter) on every
+//   core with BatchDecoder and writes the results, merged in
+//   timestamp order, as csv:
+//   timestamp_us,capture,param,source,property,value,units
+// * candump (-l) .log and Vector .asc logs are imported
+//   with LogImporter and saved as <log>.obdcap first (a
+//   capture that's already there is reused)
+// * with scaling, the captures are decoded with 1, 2, 4 ...
+//   threads up to threads=<n> (or one per core) and the
+//   throughput of each is reported; results are written
+//   for the last run
+// * usage: ./obdrefdecode /path/to/defs.xml [options] capture|log ...
+//   spec=<name>        (default SAEJ1979)
+//   protocol=<name>    (default "ISO 15765 Standard Id")
+//   address=<name>     (default Default)
+//   threads=<n>        (default 0, one per core)
+//   shard=<s>          shard length in seconds (default 60,
+//                      0 decodes each capture as one shard)
+//   interval=<ms>      parse interval (default 100)
+//   start=<us>         first timestamp to decode
+//   end=<us>           last timestamp to decode
+//   channel=<n>        only decode frames from channel n
+//   out=<path>         csv output file (default stdout)
+//   scaling
+
+// import_log
+// * returns the capture to decode for path, which is
+//   converted from a log if it isn't a capture
+QString import_log(QString const &path)
+{
+    if(!path.endsWith(".log",Qt::CaseInsensitive) &&
+       !path.endsWith(".asc",Qt::CaseInsensitive))   {
+        return path;
+    }
+
+    QString const capturePath = path+".obdcap";
+    if(QFile::exists(capturePath))   {
+        return capturePath;
+    }
+
+    obdref::LogImporter importer;
+    qint64 const numFrames = (importer.Open(path)) ?
+        importer.ConvertToCapture(capturePath) : -1;
+    if(numFrames < 0)   {
+        qDebug() << "Error: could not import" << path;
+        QFile::remove(capturePath);
+        return QString();
+    }
+    qDebug() << "imported" << path << ":" << numFrames << "frames,"
+             << importer.GetSkippedLineCount() << "lines skipped";
+    return capturePath;
+}
+
+int bad_args()
+{
+    qDebug() << "./obdrefdecode /path/to/defs.xml [spec=SAEJ1979] "
+                "[protocol=\"ISO 15765 Standard Id\"] [address=Default] "
+                "[threads=0] [shard=60] [interval=100] [start=us] [end=us] "
+                "[channel=n] [out=results.csv] [scaling] capture|log ...";
+    return -1;
+}
+
+QByteArray csv_field(QString const &field)
+{
+    QByteArray str = field.toUtf8();
+    if(str.contains(',') || str.contains('"'))   {
+        str.replace("\"","\"\"");
+        str.prepend('"');
+        str.append('"');
+    }
+    return str;
+}
+
+void append_result_csv(obdref::BatchResult const &result,QByteArray &csv)
+{
+    QByteArray prefix = QByteArray::number(result.timestampUs);
+    prefix.append(',');
+    prefix.append(QByteArray::number(result.captureIdx));
+    prefix.append(',');
+    prefix.append(csv_field(result.data.paramName));
+    prefix.append(',');
+    prefix.append(csv_field(result.data.srcName));
+    prefix.append(',');
+
+    for(int i=0; i < result.data.listNumericalData.size(); i++)   {
+        obdref::NumericalData const &numData = result.data.listNumericalData[i];
+        csv.append(prefix);
+        csv.append(csv_field(numData.property));
+        csv.append(',');
+        csv.append(QByteArray::number(numData.value,'g',10));
+        csv.append(',');
+        csv.append(csv_field(numData.units));
+        csv.append('\n');
+    }
+    for(int i=0; i < result.data.listLiteralData.size(); i++)   {
+        obdref::LiteralData const &litData = result.data.listLiteralData[i];
+        csv.append(prefix);
+        csv.append(csv_field(litData.property));
+        csv.append(',');
+        csv.append(csv_field((litData.value) ?
+            litData.valueIfTrue : litData.valueIfFalse));
+        csv.append(",\n");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 3)   {
+        return bad_args();
+    }
+
+    QString const filePath(argv[1]);
+    QString spec("SAEJ1979");
+    QString protocol("ISO 15765 Standard Id");
+    QString address("Default");
+    QString pathOut;
+    bool scaling=false;
+    QStringList listCapturePaths;
+
+    obdref::BatchOptions options;
+    for(int i=2; i < argc; i++)   {
+        QString arg(argv[i]);
+        QString value = arg.mid(arg.indexOf("=")+1);
+        if(arg.startsWith("spec="))   {
+            spec = value;
+        }
+        else if(arg.startsWith("protocol="))   {
+            protocol = value;
+        }
+        else if(arg.startsWith("address="))   {
+            address = value;
+        }
+        else if(arg.startsWith("threads="))   {
+            options.numThreads = value.toInt();
+        }
+        else if(arg.startsWith("shard="))   {
+            options.shardUs = qint64(value.toDouble()*1000000);
+        }
+        else if(arg.startsWith("interval="))   {
+            options.replay.parseIntervalUs = qint64(value.toDouble()*1000);
+        }
+        else if(arg.startsWith("start="))   {
+            options.replay.startUs = value.toLongLong();
+        }
+        else if(arg.startsWith("end="))   {
+            options.replay.endUs = value.toLongLong();
+        }
+        else if(arg.startsWith("channel="))   {
+            options.replay.channel = value.toInt();
+        }
+        else if(arg.startsWith("out="))   {
+            pathOut = value;
+        }
+        else if(arg == "scaling")   {
+            scaling = true;
+        }
+        else if(arg.contains("="))   {
+            return bad_args();
+        }
+        else   {
+            QString const capturePath = import_log(arg);
+            if(capturePath.isEmpty())   {
+                return -1;
+            }
+            listCapturePaths << capturePath;
+        }
+    }
+    if(listCapturePaths.isEmpty() || options.numThreads < 0)   {
+        return bad_args();
+    }
+
+    bool initOk=false;
+    obdref::BatchDecoder decoder(filePath,initOk);
+    if(!initOk)   {
+        return -1;
+    }
+    decoder.AddParameters(spec,protocol,address);
+
+    int const maxThreads = (options.numThreads > 0) ?
+        options.numThreads : QThread::idealThreadCount();
+
+    QList<int> listNumThreads;
+    if(scaling)   {
+        for(int n=1; n < maxThreads; n *= 2)   {
+            listNumThreads << n;
+        }
+    }
+    listNumThreads << maxThreads;
+
+    QList<obdref::BatchResult> listResults;
+    double baseFramesPerSec=0;
+    for(int i=0; i < listNumThreads.size(); i++)   {
+        options.numThreads = listNumThreads[i];
+        listResults.clear();
+        if(!decoder.Decode(listCapturePaths,options,listResults))   {
+            qDebug() << "Error: could not decode captures";
+            return -1;
+        }
+
+        obdref::BatchStats const &stats = decoder.GetStats();
+        double const framesPerSec =
+            double(stats.numFrames)*1E9/qMax(stats.elapsedNs,qint64(1));
+        if(i == 0)   {
+            baseFramesPerSec = framesPerSec;
+        }
+        qDebug() << stats.numThreads << "threads:"
+                 << stats.numFrames << "frames,"
+                 << stats.numShards << "shards"
+                 << "(" << stats.numStolen << "stolen ),"
+                 << listResults.size() << "results in"
+                 << stats.elapsedNs/1000000 << "ms,"
+                 << qint64(framesPerSec) << "frames/s"
+                 << "(x" << framesPerSec/qMax(baseFramesPerSec,1.0) << ")";
+    }
+
+    FILE * file = (pathOut.isEmpty()) ? stdout :
+        fopen(pathOut.toLocal8Bit().constData(),"w");
+    if(file == NULL)   {
+        qDebug() << "Error: could not open" << pathOut;
+        return -1;
+    }
+
+    QByteArray csv("timestamp_us,capture,param,source,property,value,units\n");
+    for(int i=0; i < listResults.size(); i++)   {
+        append_result_csv(listResults[i],csv);
+        if(csv.size() > (1 << 20))   {
+            fwrite(csv.constData(),1,csv.size(),file);
+            csv.clear();
+        }
+    }
+    fwrite(csv.constData(),1,csv.size(),file);
+    if(file != stdout)   {
+        fclose(file);
+    }
+    return 0;
+}